@@ -0,0 +1,297 @@
+#include "ImpairmentProxy.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <random>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+namespace pbterm {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kPollTimeoutMs = 100;
+constexpr size_t kReadBufferSize = 65536;
+
+// 相手が切断済みでもSIGPIPEで落ちないようにする
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+// 遅延は全てプロキシ側で加えるので、Nagleで余計な待ちが入らないようにする
+void configureSocket(int fd) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+#ifdef SO_NOSIGPIPE
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+bool writeAll(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t n = ::send(fd, data, len, kSendFlags);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+} // namespace
+
+// 片方向の中継路
+struct ImpairmentProxy::Link {
+    struct Segment {
+        Clock::time_point deliverAt;
+        std::string data;       // 空ならEOF
+    };
+
+    int from = -1;
+    int to = -1;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<Segment> queue;
+    size_t queuedBytes = 0;
+    bool closed = false;
+
+    // 帯域で直列化したときに回線が空く時刻と、最後に送り出す時刻（順序を保つため）
+    Clock::time_point linkFree;
+    Clock::time_point lastDelivery;
+    std::mt19937 rng;
+};
+
+struct ImpairmentProxy::Connection {
+    int clientFd = -1;
+    int serverFd = -1;
+    Link up;        // クライアント → サーバー
+    Link down;      // サーバー → クライアント
+    std::vector<std::thread> threads;
+};
+
+ImpairmentProxy::ImpairmentProxy(const Settings& settings)
+    : m_settings(settings)
+{
+    m_settings.segmentBytes = std::max<size_t>(m_settings.segmentBytes, 1);
+    m_settings.queueBytes = std::max(m_settings.queueBytes, m_settings.segmentBytes);
+}
+
+ImpairmentProxy::~ImpairmentProxy() {
+    stop();
+}
+
+bool ImpairmentProxy::start(int targetPort, std::string& error) {
+    if (m_listenFd >= 0) {
+        return true;
+    }
+    m_targetPort = targetPort;
+
+    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listenFd < 0) {
+        error = std::string("socket failed: ") + std::strerror(errno);
+        return false;
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    socklen_t addrLen = sizeof(addr);
+    if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(m_listenFd, 16) != 0 ||
+        getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0) {
+        error = std::string("listen failed: ") + std::strerror(errno);
+        ::close(m_listenFd);
+        m_listenFd = -1;
+        return false;
+    }
+    m_port = ntohs(addr.sin_port);
+
+    m_stopping = false;
+    m_acceptThread = std::thread(&ImpairmentProxy::acceptLoop, this);
+    return true;
+}
+
+void ImpairmentProxy::stop() {
+    m_stopping = true;
+    if (m_acceptThread.joinable()) {
+        m_acceptThread.join();
+    }
+    if (m_listenFd >= 0) {
+        ::close(m_listenFd);
+        m_listenFd = -1;
+    }
+
+    std::vector<std::unique_ptr<Connection>> connections;
+    {
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        connections.swap(m_connections);
+    }
+    for (auto& connection : connections) {
+        abort(connection.get());
+        for (auto& thread : connection->threads) {
+            thread.join();
+        }
+        ::close(connection->clientFd);
+        ::close(connection->serverFd);
+    }
+}
+
+void ImpairmentProxy::acceptLoop() {
+    while (!m_stopping) {
+        pollfd pfd = {m_listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, kPollTimeoutMs) <= 0) {
+            continue;
+        }
+        int clientFd = accept(m_listenFd, nullptr, nullptr);
+        if (clientFd < 0) {
+            continue;
+        }
+
+        int serverFd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(static_cast<uint16_t>(m_targetPort));
+        if (serverFd < 0 || connect(serverFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+            if (serverFd >= 0) ::close(serverFd);
+            ::close(clientFd);
+            continue;
+        }
+        configureSocket(clientFd);
+        configureSocket(serverFd);
+
+        auto connection = std::make_unique<Connection>();
+        connection->clientFd = clientFd;
+        connection->serverFd = serverFd;
+        connection->up.from = clientFd;
+        connection->up.to = serverFd;
+        connection->down.from = serverFd;
+        connection->down.to = clientFd;
+        // 揺らぎは固定シード（同じ設定なら同じ系列になる）
+        connection->up.rng.seed(1);
+        connection->down.rng.seed(2);
+
+        Connection* raw = connection.get();
+        raw->threads.emplace_back(&ImpairmentProxy::readerThread, this, raw, &raw->up);
+        raw->threads.emplace_back(&ImpairmentProxy::writerThread, this, raw, &raw->up);
+        raw->threads.emplace_back(&ImpairmentProxy::readerThread, this, raw, &raw->down);
+        raw->threads.emplace_back(&ImpairmentProxy::writerThread, this, raw, &raw->down);
+
+        std::lock_guard<std::mutex> lock(m_connectionsMutex);
+        m_connections.push_back(std::move(connection));
+    }
+}
+
+void ImpairmentProxy::readerThread(Connection* connection, Link* link) {
+    const double bytesPerSecond = m_settings.bandwidthMbps * 1e6 / 8.0;
+    std::uniform_int_distribution<int> jitter(-m_settings.jitterMs, m_settings.jitterMs);
+    std::vector<char> buffer(kReadBufferSize);
+
+    for (;;) {
+        ssize_t n = ::recv(link->from, buffer.data(), buffer.size(), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(link->mutex);
+        if (n <= 0) {
+            // EOF（またはエラー）は最後のデータの後に送り出す
+            Clock::time_point deliverAt = std::max(link->lastDelivery,
+                Clock::now() + std::chrono::milliseconds(m_settings.delayMs));
+            link->queue.push_back({deliverAt, std::string()});
+            link->cv.notify_all();
+            return;
+        }
+
+        for (size_t offset = 0; offset < static_cast<size_t>(n); offset += m_settings.segmentBytes) {
+            size_t size = std::min(m_settings.segmentBytes, static_cast<size_t>(n) - offset);
+            link->cv.wait(lock, [&]() {
+                return link->closed || link->queuedBytes + size <= m_settings.queueBytes;
+            });
+            if (link->closed) {
+                return;
+            }
+
+            // 帯域: 前のセグメントを送り終えてから次を送る
+            Clock::time_point now = Clock::now();
+            Clock::time_point departure = now;
+            if (bytesPerSecond > 0.0) {
+                auto transmit = std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(size / bytesPerSecond));
+                departure = std::max(now, link->linkFree) + transmit;
+                link->linkFree = departure;
+            }
+            // 遅延と揺らぎ（先に送ったセグメントより前には届けない）
+            int delayMs = std::max(0, m_settings.delayMs + (m_settings.jitterMs > 0 ? jitter(link->rng) : 0));
+            Clock::time_point deliverAt = std::max(link->lastDelivery,
+                departure + std::chrono::milliseconds(delayMs));
+            link->lastDelivery = deliverAt;
+
+            link->queue.push_back({deliverAt, std::string(buffer.data() + offset, size)});
+            link->queuedBytes += size;
+            link->cv.notify_all();
+        }
+    }
+}
+
+void ImpairmentProxy::writerThread(Connection* connection, Link* link) {
+    std::unique_lock<std::mutex> lock(link->mutex);
+    for (;;) {
+        link->cv.wait(lock, [&]() { return link->closed || !link->queue.empty(); });
+        if (link->closed) {
+            return;
+        }
+        Clock::time_point deliverAt = link->queue.front().deliverAt;
+        if (Clock::now() < deliverAt) {
+            link->cv.wait_until(lock, deliverAt);
+            continue;
+        }
+
+        Link::Segment segment = std::move(link->queue.front());
+        link->queue.pop_front();
+        link->queuedBytes -= segment.data.size();
+        link->cv.notify_all();
+        lock.unlock();
+
+        if (segment.data.empty()) {
+            shutdown(link->to, SHUT_WR);
+            return;
+        }
+        if (!writeAll(link->to, segment.data.data(), segment.data.size())) {
+            abort(connection);
+            return;
+        }
+        lock.lock();
+    }
+}
+
+// 両方向を止め、ブロック中のrecv/sendを解除する
+void ImpairmentProxy::abort(Connection* connection) {
+    for (Link* link : {&connection->up, &connection->down}) {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        link->closed = true;
+        link->cv.notify_all();
+    }
+    shutdown(connection->clientFd, SHUT_RDWR);
+    shutdown(connection->serverFd, SHUT_RDWR);
+}
+
+} // namespace pbterm
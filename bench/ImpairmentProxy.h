@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstddef>
+
+namespace pbterm {
+
+// 回線品質を模擬するローカルTCPプロキシ（ベンチマーク用）
+// 127.0.0.1の空きポートで受け付け、接続ごとに転送先（127.0.0.1:targetPort）へ中継する
+// 方向ごとに、データをsegmentBytes単位に分けて帯域で直列化（ペーシング）し、
+// 片道遅延と揺らぎを加えた時刻に送り出す（TCPなので揺らぎがあっても順序は保つ）
+class ImpairmentProxy {
+public:
+    struct Settings {
+        int delayMs = 0;                    // 片道の遅延（RTTの半分）
+        int jitterMs = 0;                   // 遅延の揺らぎ（±jitterMsの一様分布）
+        double bandwidthMbps = 0.0;         // 方向ごとの帯域（0で無制限）
+        size_t segmentBytes = 1448;         // ペーシングの単位（1パケット分）
+        size_t queueBytes = 4 * 1024 * 1024; // 方向ごとの滞留上限（超えたら読み取りを止めて送信側へ背圧をかける）
+    };
+
+    explicit ImpairmentProxy(const Settings& settings);
+    ~ImpairmentProxy();
+
+    ImpairmentProxy(const ImpairmentProxy&) = delete;
+    ImpairmentProxy& operator=(const ImpairmentProxy&) = delete;
+
+    bool start(int targetPort, std::string& error);
+    // 受付を止め、中継中の接続をすべて切る
+    void stop();
+
+    int port() const { return m_port; }
+    const Settings& settings() const { return m_settings; }
+
+private:
+    struct Link;
+    struct Connection;
+
+    void acceptLoop();
+    void readerThread(Connection* connection, Link* link);
+    void writerThread(Connection* connection, Link* link);
+    void abort(Connection* connection);
+
+    Settings m_settings;
+    int m_targetPort = 0;
+    int m_listenFd = -1;
+    int m_port = 0;
+
+    std::thread m_acceptThread;
+    std::mutex m_connectionsMutex;
+    std::vector<std::unique_ptr<Connection>> m_connections;
+    std::atomic<bool> m_stopping{false};
+};
+
+} // namespace pbterm
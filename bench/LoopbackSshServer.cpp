@@ -0,0 +1,613 @@
+#include "LoopbackSshServer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#if defined(__APPLE__)
+#include <util.h>
+#else
+#include <pty.h>
+#endif
+
+#include <libssh/callbacks.h>
+#ifndef WITH_SERVER
+#define WITH_SERVER
+#endif
+#include <libssh/sftp.h>
+#if __has_include(<libssh/sftpserver.h>)
+#include <libssh/sftpserver.h>
+#endif
+
+// SFTPサブシステムの既定ハンドラ（sftp_channel_default_*）はlibssh 0.11以降
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+#define PBTERM_BENCH_HAVE_SFTP_SERVER 1
+#endif
+
+namespace pbterm {
+
+namespace {
+
+constexpr int kPollTimeoutMs = 100;
+constexpr size_t kReadBufferSize = 65536;
+// 子プロセスの標準入力へ書き切れずに溜めておく上限
+// （超えたらチャンネルの受信バッファに残し、ウィンドウを開けずにクライアントを待たせる）
+constexpr size_t kMaxPendingInput = 4 * 1024 * 1024;
+
+// チャンネル1本分の状態（libsshのコールバックにはこのポインタを渡す）
+struct ChannelState {
+    ssh_channel channel = nullptr;
+    ssh_channel_callbacks_struct callbacks;
+
+    bool pty = false;
+    struct winsize winsize = {24, 80, 0, 0};
+
+    // シェル/execの子プロセス（PTYの場合はstdinFd == stdoutFdでstderrは無い）
+    // stdinFdは非ブロッキング（イベントループの中で子プロセスの読み取りを待たない）
+    pid_t pid = -1;
+    int stdinFd = -1;
+    int stdoutFd = -1;
+    int stderrFd = -1;
+    short stdinEvents = 0;      // ssh_eventに登録中のイベント（0なら未登録、PTYはstdoutEventsにまとめる）
+    short stdoutEvents = 0;
+    short stderrEvents = 0;
+    bool stdoutEof = true;
+    bool stderrEof = true;
+    bool finished = false;
+
+    // 標準入力へ書き切れなかったデータ（先頭のstdinSentバイトは書き込み済み）
+    std::string stdinPending;
+    size_t stdinSent = 0;
+    bool stdinDeferred = false; // 溜めすぎたので受信データをチャンネル側に残している
+    bool stdinEof = false;      // クライアントが入力を閉じた（書き終えたら閉じる）
+    bool stdinBroken = false;   // 子プロセスが入力を閉じた（以降の入力は捨てる）
+
+    sftp_session sftp = nullptr;
+};
+
+struct SessionState {
+    std::string user;
+    std::string password;
+    ssh_session session = nullptr;
+    std::vector<std::unique_ptr<ChannelState>> channels;
+};
+
+void closeFd(int& fd) {
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+size_t pendingInput(const ChannelState* ch) {
+    return ch->stdinPending.size() - ch->stdinSent;
+}
+
+// 溜めた入力を書けるだけ書く（パイプが一杯なら残りは書けるようになってから）
+void flushInput(ChannelState* ch) {
+    while (pendingInput(ch) > 0 && ch->stdinFd >= 0 && !ch->stdinBroken) {
+        ssize_t n = ::write(ch->stdinFd, ch->stdinPending.data() + ch->stdinSent, pendingInput(ch));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                if (ch->stdinSent > ch->stdinPending.size() / 2) {
+                    ch->stdinPending.erase(0, ch->stdinSent);
+                    ch->stdinSent = 0;
+                }
+                return;
+            }
+            ch->stdinBroken = true;
+            break;
+        }
+        ch->stdinSent += static_cast<size_t>(n);
+    }
+    ch->stdinPending.clear();
+    ch->stdinSent = 0;
+}
+
+void queueInput(ChannelState* ch, const char* data, size_t len) {
+    if (ch->stdinFd < 0 || ch->stdinBroken) {
+        return;
+    }
+    ch->stdinPending.append(data, len);
+    flushInput(ch);
+}
+
+void setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0) {
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+}
+
+// 子プロセス側: 継承したソケットなどを閉じて/bin/shを実行する
+[[noreturn]] void execShell(const char* command) {
+    for (int fd = 3; fd < 1024; ++fd) {
+        ::close(fd);
+    }
+    setenv("TERM", "xterm-256color", 1);
+    if (command) {
+        execl("/bin/sh", "sh", "-c", command, static_cast<char*>(nullptr));
+    } else {
+        execl("/bin/sh", "sh", static_cast<char*>(nullptr));
+    }
+    _exit(127);
+}
+
+// commandがnullptrならシェル（PTYが要求されていればPTY上で起動）
+bool startProcess(ChannelState* ch, const char* command) {
+    if (ch->pid > 0) {
+        return false;
+    }
+
+    if (ch->pty) {
+        int master = -1;
+        pid_t pid = forkpty(&master, nullptr, nullptr, &ch->winsize);
+        if (pid < 0) {
+            return false;
+        }
+        if (pid == 0) {
+            execShell(command);
+        }
+        ch->pid = pid;
+        ch->stdinFd = master;
+        ch->stdoutFd = master;
+        ch->stdoutEof = false;
+        setNonBlocking(master);
+        return true;
+    }
+
+    int in[2], out[2], err[2];
+    if (pipe(in) != 0) {
+        return false;
+    }
+    if (pipe(out) != 0) {
+        ::close(in[0]); ::close(in[1]);
+        return false;
+    }
+    if (pipe(err) != 0) {
+        ::close(in[0]); ::close(in[1]);
+        ::close(out[0]); ::close(out[1]);
+        return false;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        for (int fd : {in[0], in[1], out[0], out[1], err[0], err[1]}) {
+            ::close(fd);
+        }
+        return false;
+    }
+    if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(err[1], STDERR_FILENO);
+        execShell(command);
+    }
+
+    ::close(in[0]);
+    ::close(out[1]);
+    ::close(err[1]);
+    ch->pid = pid;
+    ch->stdinFd = in[1];
+    ch->stdoutFd = out[0];
+    ch->stderrFd = err[0];
+    ch->stdoutEof = false;
+    ch->stderrEof = false;
+    setNonBlocking(ch->stdinFd);
+    return true;
+}
+
+// 子プロセスの出力をチャンネルへ送り、溜めた入力を書く（ssh_eventから呼ばれる）
+int onChildIo(socket_t fd, int revents, void* userdata) {
+    auto* ch = static_cast<ChannelState*>(userdata);
+    if (fd == ch->stdinFd && fd != ch->stdoutFd) {
+        // 書き込み側のパイプ（POLLERRなら書き込みがEPIPEで失敗して閉じたと分かる）
+        flushInput(ch);
+        return 0;
+    }
+    if (revents & POLLOUT) {
+        flushInput(ch);
+    }
+    if (!(revents & (POLLIN | POLLHUP | POLLERR))) {
+        return 0;
+    }
+
+    bool isStderr = fd == ch->stderrFd;
+    char buffer[kReadBufferSize];
+    ssize_t n = ::read(fd, buffer, sizeof(buffer));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return 0;
+    }
+    if (n <= 0) {
+        // PTYは子プロセスの終了後にEIOを返す
+        (isStderr ? ch->stderrEof : ch->stdoutEof) = true;
+        return 0;
+    }
+    if (isStderr) {
+        ssh_channel_write_stderr(ch->channel, buffer, static_cast<uint32_t>(n));
+    } else {
+        ssh_channel_write(ch->channel, buffer, static_cast<uint32_t>(n));
+    }
+    return 0;
+}
+
+int onChannelData(ssh_session session, ssh_channel channel, void* data, uint32_t len,
+                  int isStderr, void* userdata) {
+    auto* ch = static_cast<ChannelState*>(userdata);
+#ifdef PBTERM_BENCH_HAVE_SFTP_SERVER
+    if (ch->sftp) {
+        return sftp_channel_default_data_callback(session, channel, data, len, isStderr, &ch->sftp);
+    }
+#endif
+    // イベントループの中なので書き込みで待たない（子プロセスが出力の送信待ちで止まっていると、
+    // 入力を書き切るまで待つとどちらも進まない）。書けない分は溜めて、fdが書けるようになったら送る
+    if (ch->stdinFd >= 0 && !ch->stdinBroken) {
+        if (ch->stdinDeferred || pendingInput(ch) >= kMaxPendingInput) {
+            // 受け取らずにチャンネルに残す（残りはserviceChannelで引き取る）
+            ch->stdinDeferred = true;
+            return 0;
+        }
+        queueInput(ch, static_cast<const char*>(data), len);
+    }
+    return static_cast<int>(len);
+}
+
+void onChannelEof(ssh_session session, ssh_channel channel, void* userdata) {
+    // 溜めた入力を書き終えてからserviceChannelで閉じる
+    static_cast<ChannelState*>(userdata)->stdinEof = true;
+}
+
+void onChannelClose(ssh_session session, ssh_channel channel, void* userdata) {
+    // 後始末はセッションループでssh_channel_is_closed()を見て行う
+}
+
+int onPtyRequest(ssh_session session, ssh_channel channel, const char* term, int width, int height,
+                 int pxWidth, int pxHeight, void* userdata) {
+    auto* ch = static_cast<ChannelState*>(userdata);
+    ch->pty = true;
+    ch->winsize.ws_col = static_cast<unsigned short>(width);
+    ch->winsize.ws_row = static_cast<unsigned short>(height);
+    ch->winsize.ws_xpixel = static_cast<unsigned short>(pxWidth);
+    ch->winsize.ws_ypixel = static_cast<unsigned short>(pxHeight);
+    return SSH_OK;
+}
+
+int onPtyWindowChange(ssh_session session, ssh_channel channel, int width, int height,
+                      int pxWidth, int pxHeight, void* userdata) {
+    auto* ch = static_cast<ChannelState*>(userdata);
+    ch->winsize.ws_col = static_cast<unsigned short>(width);
+    ch->winsize.ws_row = static_cast<unsigned short>(height);
+    ch->winsize.ws_xpixel = static_cast<unsigned short>(pxWidth);
+    ch->winsize.ws_ypixel = static_cast<unsigned short>(pxHeight);
+    if (ch->pty && ch->stdinFd >= 0) {
+        ioctl(ch->stdinFd, TIOCSWINSZ, &ch->winsize);
+    }
+    return SSH_OK;
+}
+
+int onShellRequest(ssh_session session, ssh_channel channel, void* userdata) {
+    return startProcess(static_cast<ChannelState*>(userdata), nullptr) ? SSH_OK : SSH_ERROR;
+}
+
+int onExecRequest(ssh_session session, ssh_channel channel, const char* command, void* userdata) {
+    return startProcess(static_cast<ChannelState*>(userdata), command) ? SSH_OK : SSH_ERROR;
+}
+
+int onSubsystemRequest(ssh_session session, ssh_channel channel, const char* subsystem, void* userdata) {
+#ifdef PBTERM_BENCH_HAVE_SFTP_SERVER
+    auto* ch = static_cast<ChannelState*>(userdata);
+    if (std::strcmp(subsystem, "sftp") == 0 && !ch->sftp && ch->pid < 0) {
+        return sftp_channel_default_subsystem_request(session, channel, subsystem, &ch->sftp);
+    }
+#endif
+    return SSH_ERROR;
+}
+
+int onAuthPassword(ssh_session session, const char* user, const char* password, void* userdata) {
+    auto* state = static_cast<SessionState*>(userdata);
+    if (state->user == user && state->password == password) {
+        return SSH_AUTH_SUCCESS;
+    }
+    return SSH_AUTH_DENIED;
+}
+
+ssh_channel onChannelOpen(ssh_session session, void* userdata) {
+    auto* state = static_cast<SessionState*>(userdata);
+    auto ch = std::make_unique<ChannelState>();
+    ch->channel = ssh_channel_new(session);
+    if (!ch->channel) {
+        return nullptr;
+    }
+
+    std::memset(&ch->callbacks, 0, sizeof(ch->callbacks));
+    ch->callbacks.userdata = ch.get();
+    ch->callbacks.channel_data_function = onChannelData;
+    ch->callbacks.channel_eof_function = onChannelEof;
+    ch->callbacks.channel_close_function = onChannelClose;
+    ch->callbacks.channel_pty_request_function = onPtyRequest;
+    ch->callbacks.channel_pty_window_change_function = onPtyWindowChange;
+    ch->callbacks.channel_shell_request_function = onShellRequest;
+    ch->callbacks.channel_exec_request_function = onExecRequest;
+    ch->callbacks.channel_subsystem_request_function = onSubsystemRequest;
+    ssh_callbacks_init(&ch->callbacks);
+    ssh_set_channel_callbacks(ch->channel, &ch->callbacks);
+
+    ssh_channel channel = ch->channel;
+    state->channels.push_back(std::move(ch));
+    return channel;
+}
+
+// fdの登録をwantedのイベントに合わせる（0なら外す）
+void watchFd(ssh_event event, ChannelState* ch, int fd, short& registered, short wanted) {
+    if (registered == wanted) {
+        return;
+    }
+    if (registered != 0) {
+        ssh_event_remove_fd(event, fd);
+        registered = 0;
+    }
+    if (wanted != 0 && ssh_event_add_fd(event, fd, wanted, onChildIo, ch) == SSH_OK) {
+        registered = wanted;
+    }
+}
+
+void unregisterFds(ssh_event event, ChannelState* ch) {
+    watchFd(event, ch, ch->stdinFd, ch->stdinEvents, 0);
+    watchFd(event, ch, ch->stdoutFd, ch->stdoutEvents, 0);
+    watchFd(event, ch, ch->stderrFd, ch->stderrEvents, 0);
+}
+
+// 溜めすぎて受け取らなかった入力を、書き出しが進んだ分だけチャンネルから引き取り、
+// 書き終えた（または子プロセスが閉じた）標準入力を閉じる
+void serviceInput(ssh_event event, ChannelState* ch) {
+    char buffer[kReadBufferSize];
+    while (ch->stdinDeferred && (pendingInput(ch) < kMaxPendingInput || ch->stdinFd < 0 || ch->stdinBroken)) {
+        int n = ssh_channel_read_nonblocking(ch->channel, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            // 残りなし（以降はコールバックで受け取る）
+            ch->stdinDeferred = false;
+            break;
+        }
+        queueInput(ch, buffer, static_cast<size_t>(n));
+    }
+
+    // PTYは出力と同じfdなので閉じない（シェルはexitで終わる）
+    if (ch->pty || ch->stdinFd < 0) {
+        return;
+    }
+    if (ch->stdinBroken || (ch->stdinEof && pendingInput(ch) == 0 && !ch->stdinDeferred)) {
+        watchFd(event, ch, ch->stdinFd, ch->stdinEvents, 0);
+        closeFd(ch->stdinFd);
+    }
+}
+
+void releaseChannel(ssh_event event, ChannelState* ch) {
+    unregisterFds(event, ch);
+    if (ch->pid > 0 && !ch->finished) {
+        kill(ch->pid, SIGKILL);
+        waitpid(ch->pid, nullptr, 0);
+    }
+    if (ch->stdinFd == ch->stdoutFd) {
+        ch->stdoutFd = -1;
+    }
+    closeFd(ch->stdinFd);
+    closeFd(ch->stdoutFd);
+    closeFd(ch->stderrFd);
+#ifdef PBTERM_BENCH_HAVE_SFTP_SERVER
+    if (ch->sftp) {
+        sftp_server_free(ch->sftp);
+        ch->sftp = nullptr;
+    }
+#endif
+    ssh_channel_free(ch->channel);
+    ch->channel = nullptr;
+}
+
+// 子プロセスの出力の登録と、終了したプロセスのチャンネルを閉じる処理
+void serviceChannel(ssh_event event, ChannelState* ch) {
+    if (ch->pid <= 0 || ch->finished) {
+        return;
+    }
+    serviceInput(event, ch);
+
+    // 溜めた入力があれば書けるようになるのを待つ（PTYは出力と同じfdの登録にまとめる）
+    short inputEvents = pendingInput(ch) > 0 ? POLLOUT : 0;
+    if (!ch->pty && ch->stdinFd >= 0) {
+        watchFd(event, ch, ch->stdinFd, ch->stdinEvents, inputEvents);
+    }
+    watchFd(event, ch, ch->stdoutFd, ch->stdoutEvents,
+            ch->stdoutEof ? 0 : static_cast<short>(POLLIN | (ch->pty ? inputEvents : 0)));
+    watchFd(event, ch, ch->stderrFd, ch->stderrEvents, ch->stderrEof ? 0 : POLLIN);
+    if (!ch->stdoutEof || !ch->stderrEof) {
+        return;
+    }
+
+    // 出力を送り終えたので終了ステータスを返して閉じる
+    unregisterFds(event, ch);
+    int status = 0;
+    int exitCode = -1;
+    if (waitpid(ch->pid, &status, 0) == ch->pid && WIFEXITED(status)) {
+        exitCode = WEXITSTATUS(status);
+    }
+    ch->finished = true;
+    if (exitCode >= 0) {
+        ssh_channel_request_send_exit_status(ch->channel, exitCode);
+    }
+    ssh_channel_send_eof(ch->channel);
+    ssh_channel_close(ch->channel);
+}
+
+} // namespace
+
+LoopbackSshServer::LoopbackSshServer(const std::string& user, const std::string& password)
+    : m_user(user)
+    , m_password(password)
+{
+}
+
+LoopbackSshServer::~LoopbackSshServer() {
+    stop();
+}
+
+bool LoopbackSshServer::start(std::string& error) {
+    if (m_bind) {
+        return true;
+    }
+
+    // 終了済みの子プロセスの標準入力へ書いてもプロセスごと落ちないようにする
+    std::signal(SIGPIPE, SIG_IGN);
+
+    m_bind = ssh_bind_new();
+    if (!m_bind) {
+        error = "ssh_bind_new failed";
+        return false;
+    }
+
+    ssh_key hostKey = nullptr;
+    if (ssh_pki_generate(SSH_KEYTYPE_ED25519, 0, &hostKey) != SSH_OK) {
+        error = "Failed to generate host key";
+        ssh_bind_free(m_bind);
+        m_bind = nullptr;
+        return false;
+    }
+    unsigned int port = 0;
+    ssh_bind_options_set(m_bind, SSH_BIND_OPTIONS_IMPORT_KEY, hostKey);
+    ssh_bind_options_set(m_bind, SSH_BIND_OPTIONS_BINDADDR, "127.0.0.1");
+    ssh_bind_options_set(m_bind, SSH_BIND_OPTIONS_BINDPORT, &port);
+
+    if (ssh_bind_listen(m_bind) != SSH_OK) {
+        error = std::string("Listen failed: ") + ssh_get_error(m_bind);
+        ssh_bind_free(m_bind);
+        m_bind = nullptr;
+        return false;
+    }
+
+    // ポート0で待ち受けたので、割り当てられたポートを調べる
+    sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    if (getsockname(ssh_bind_get_fd(m_bind), reinterpret_cast<sockaddr*>(&addr), &addrLen) != 0) {
+        error = std::string("getsockname failed: ") + std::strerror(errno);
+        ssh_bind_free(m_bind);
+        m_bind = nullptr;
+        return false;
+    }
+    m_port = ntohs(addr.sin_port);
+
+    m_stopping = false;
+    m_acceptThread = std::thread(&LoopbackSshServer::acceptLoop, this);
+    return true;
+}
+
+void LoopbackSshServer::stop() {
+    m_stopping = true;
+    if (m_acceptThread.joinable()) {
+        m_acceptThread.join();
+    }
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_sessionsMutex);
+        threads.swap(m_sessionThreads);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (m_bind) {
+        ssh_bind_free(m_bind);
+        m_bind = nullptr;
+    }
+}
+
+void LoopbackSshServer::acceptLoop() {
+    while (!m_stopping) {
+        pollfd pfd = {ssh_bind_get_fd(m_bind), POLLIN, 0};
+        if (poll(&pfd, 1, kPollTimeoutMs) <= 0) {
+            continue;
+        }
+
+        ssh_session session = ssh_new();
+        if (!session) {
+            continue;
+        }
+        if (ssh_bind_accept(m_bind, session) != SSH_OK) {
+            ssh_free(session);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(m_sessionsMutex);
+        m_sessionThreads.emplace_back(&LoopbackSshServer::sessionLoop, this, session);
+    }
+}
+
+void LoopbackSshServer::sessionLoop(ssh_session session) {
+    SessionState state;
+    state.user = m_user;
+    state.password = m_password;
+    state.session = session;
+
+    ssh_server_callbacks_struct callbacks;
+    std::memset(&callbacks, 0, sizeof(callbacks));
+    callbacks.userdata = &state;
+    callbacks.auth_password_function = onAuthPassword;
+    callbacks.channel_open_request_session_function = onChannelOpen;
+    ssh_callbacks_init(&callbacks);
+    ssh_set_server_callbacks(session, &callbacks);
+
+    if (ssh_handle_key_exchange(session) != SSH_OK) {
+        ssh_disconnect(session);
+        ssh_free(session);
+        return;
+    }
+    ssh_set_auth_methods(session, SSH_AUTH_METHOD_PASSWORD);
+
+    ssh_event event = ssh_event_new();
+    ssh_event_add_session(event, session);
+
+    while (!m_stopping) {
+        if (ssh_event_dopoll(event, kPollTimeoutMs) == SSH_ERROR) {
+            break;
+        }
+
+        for (auto& ch : state.channels) {
+            serviceChannel(event, ch.get());
+        }
+
+        // クライアントが閉じたチャンネルを片付ける
+        auto closed = std::remove_if(state.channels.begin(), state.channels.end(),
+            [&](const std::unique_ptr<ChannelState>& ch) {
+                if (!ssh_channel_is_closed(ch->channel)) {
+                    return false;
+                }
+                releaseChannel(event, ch.get());
+                return true;
+            });
+        state.channels.erase(closed, state.channels.end());
+
+        if (ssh_get_status(session) & (SSH_CLOSED | SSH_CLOSED_ERROR)) {
+            break;
+        }
+    }
+
+    for (auto& ch : state.channels) {
+        releaseChannel(event, ch.get());
+    }
+    state.channels.clear();
+
+    ssh_event_remove_session(event, session);
+    ssh_event_free(event);
+    ssh_disconnect(session);
+    ssh_free(session);
+}
+
+} // namespace pbterm
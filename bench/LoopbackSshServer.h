@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <atomic>
+#include <libssh/libssh.h>
+#include <libssh/server.h>
+
+namespace pbterm {
+
+// ベンチマーク用のループバックSSHサーバー（libsshのサーバー機能で実装）
+// 127.0.0.1の空きポートで待ち受け、パスワード認証・シェル（PTY）・exec・SFTPに対応する
+// シェルとexecはローカルの/bin/shで実行するので、sshdや鍵の準備、外部ネットワークは不要
+// ホスト鍵は起動ごとに生成する（ベンチマーク専用、ループバック以外では待ち受けない）
+class LoopbackSshServer {
+public:
+    LoopbackSshServer(const std::string& user, const std::string& password);
+    ~LoopbackSshServer();
+
+    LoopbackSshServer(const LoopbackSshServer&) = delete;
+    LoopbackSshServer& operator=(const LoopbackSshServer&) = delete;
+
+    // 待ち受けを開始する（port()で実際のポートを取得）
+    bool start(std::string& error);
+    // 待ち受けを止め、接続中のセッションと子プロセスを終了する
+    void stop();
+
+    int port() const { return m_port; }
+    const std::string& user() const { return m_user; }
+    const std::string& password() const { return m_password; }
+
+private:
+    void acceptLoop();
+    void sessionLoop(ssh_session session);
+
+    std::string m_user;
+    std::string m_password;
+    ssh_bind m_bind = nullptr;
+    int m_port = 0;
+
+    std::thread m_acceptThread;
+    std::mutex m_sessionsMutex;
+    std::vector<std::thread> m_sessionThreads;
+    std::atomic<bool> m_stopping{false};
+};
+
+} // namespace pbterm
@@ -0,0 +1,219 @@
+// 転送経路のローカルファイルI/Oコストの比較
+//
+// 旧実装: ifstream/ofstreamでチャンクごとに読み書き（受信データは一時バッファ経由）
+// 新実装: LocalFileReader（アラインしたバッファへのpread）/ WriteBehindFile（事前確保 + ライトビハインド）
+//
+// ネットワーク側は、送信時のパケットへのコピーと受信時のバッファへのコピーだけを模擬する
+// （どちらの実装でも同じだけ発生するので、差はローカルI/Oのコストになる）
+//
+// 使い方: local_io_bench [サイズMB (既定1024)] [作業ディレクトリ (既定/tmp)] [--sync]
+//   --sync を付けると書き込みの計測にfsyncまで含める
+// 前の計測で残ったダーティページの書き戻しが次の計測に混ざらないよう、計測の合間に
+// syncし、新旧を交互に数回ずつ実行して最良値を比べる
+
+#include "LocalFileIO.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+using namespace pbterm;
+
+namespace {
+
+// SFTPのチャンクサイズ（SftpTransferの既定値と同じ）
+constexpr size_t kChunkSize = 32768;
+constexpr double kBytesPerGB = 1024.0 * 1024.0 * 1024.0;
+constexpr int kRounds = 3;
+
+struct Cost {
+    double wall = 0.0;
+    double cpu = 0.0;
+};
+
+double cpuSeconds() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+           usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+Cost measure(const std::function<bool()>& body, bool& ok) {
+    ::sync();
+    auto wallStart = std::chrono::steady_clock::now();
+    double cpuStart = cpuSeconds();
+    ok = body();
+    Cost cost;
+    cost.cpu = cpuSeconds() - cpuStart;
+    cost.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    return cost;
+}
+
+bool syncFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+// 送信側: 読んだデータをパケットへコピーする
+uint64_t readWithStream(const std::string& path, std::vector<char>& packet) {
+    std::ifstream file(path, std::ios::binary);
+    std::vector<char> buffer(kChunkSize);
+    uint64_t total = 0;
+    while (file) {
+        file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        std::streamsize n = file.gcount();
+        if (n <= 0) break;
+        std::memcpy(packet.data(), buffer.data(), static_cast<size_t>(n));
+        total += static_cast<uint64_t>(n);
+    }
+    return total;
+}
+
+uint64_t readWithReader(const std::string& path, std::vector<char>& packet) {
+    LocalFileReader file;
+    if (!file.open(path)) {
+        return 0;
+    }
+    uint64_t total = 0;
+    const char* data = nullptr;
+    size_t n;
+    while ((n = file.read(data, kChunkSize)) > 0) {
+        std::memcpy(packet.data(), data, n);
+        total += n;
+    }
+    return file.bad() ? 0 : total;
+}
+
+// 受信側: 受信データ（network）を受け取ってファイルへ書く
+bool writeWithStream(const std::string& path, uint64_t size, const std::vector<char>& network,
+                     bool sync) {
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    std::vector<char> buffer(kChunkSize);
+    for (uint64_t done = 0; done < size; done += kChunkSize) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(kChunkSize, size - done));
+        std::memcpy(buffer.data(), network.data(), n);
+        file.write(buffer.data(), static_cast<std::streamsize>(n));
+        if (!file) {
+            return false;
+        }
+    }
+    file.close();
+    return !file.fail() && (!sync || syncFile(path));
+}
+
+bool writeWithWriteBehind(const std::string& path, uint64_t size, const std::vector<char>& network,
+                          bool sync) {
+    WriteBehindFile file;
+    if (!file.open(path, 0, size)) {
+        return false;
+    }
+    for (uint64_t done = 0; done < size; done += kChunkSize) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(kChunkSize, size - done));
+        char* target = file.reserve(n);
+        if (!target) {
+            return false;
+        }
+        std::memcpy(target, network.data(), n);
+        file.commit(n);
+    }
+    return file.close() && (!sync || syncFile(path));
+}
+
+void keepBest(Cost& best, const Cost& cost) {
+    if (best.wall == 0.0 || cost.wall < best.wall) {
+        best = cost;
+    }
+}
+
+void report(const char* label, const Cost& before, const Cost& after, uint64_t size) {
+    double gb = static_cast<double>(size) / kBytesPerGB;
+    std::printf("%-6s  before: %7.3f s/GB (cpu %7.3f)   after: %7.3f s/GB (cpu %7.3f)   x%.2f\n",
+                label, before.wall / gb, before.cpu / gb, after.wall / gb, after.cpu / gb,
+                after.wall > 0.0 ? before.wall / after.wall : 0.0);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    uint64_t sizeMB = 1024;
+    std::string dir = "/tmp";
+    bool sync = false;
+
+    int positional = 0;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--sync") {
+            sync = true;
+        } else if (positional == 0) {
+            sizeMB = std::strtoull(arg.c_str(), nullptr, 10);
+            ++positional;
+        } else {
+            dir = arg;
+            ++positional;
+        }
+    }
+    if (sizeMB == 0) {
+        std::fprintf(stderr, "usage: %s [sizeMB] [dir] [--sync]\n", argv[0]);
+        return 1;
+    }
+
+    const uint64_t size = sizeMB * 1024 * 1024;
+    const std::string beforePath = dir + "/pbterm_io_bench_before.bin";
+    const std::string afterPath = dir + "/pbterm_io_bench_after.bin";
+
+    std::vector<char> network(kChunkSize);
+    for (size_t i = 0; i < network.size(); ++i) {
+        network[i] = static_cast<char>(i * 131 + 7);
+    }
+    std::vector<char> packet(kChunkSize);
+
+    std::printf("local I/O cost: %llu MB, chunk %zu bytes, best of %d%s\n",
+                static_cast<unsigned long long>(sizeMB), kChunkSize, kRounds, sync ? ", fsync" : "");
+
+    bool ok = true;
+    bool step = false;
+    Cost writeBefore, writeAfter, readBefore, readAfter;
+
+    for (int round = 0; round < kRounds && ok; ++round) {
+        // 書き込み（ダウンロード相当）
+        keepBest(writeBefore, measure([&]() { return writeWithStream(beforePath, size, network, sync); }, step));
+        ok = ok && step;
+        keepBest(writeAfter, measure([&]() { return writeWithWriteBehind(afterPath, size, network, sync); }, step));
+        ok = ok && step;
+
+        // 読み取り（アップロード相当、直前に書いたファイルなのでページキャッシュ上にある）
+        keepBest(readBefore, measure([&]() { return readWithStream(beforePath, packet) == size; }, step));
+        ok = ok && step;
+        keepBest(readAfter, measure([&]() { return readWithReader(afterPath, packet) == size; }, step));
+        ok = ok && step;
+
+        std::remove(beforePath.c_str());
+        std::remove(afterPath.c_str());
+    }
+
+    if (!ok) {
+        std::fprintf(stderr, "benchmark failed (I/O error in %s)\n", dir.c_str());
+        return 1;
+    }
+
+    report("write", writeBefore, writeAfter, size);
+    report("read", readBefore, readAfter, size);
+    return 0;
+}
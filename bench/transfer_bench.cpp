@@ -0,0 +1,571 @@
+// SSH経路のスループットとレイテンシの計測
+//
+// LoopbackSshServer（libsshのサーバー機能）を127.0.0.1で起動し、アプリと同じ
+// SshConnection / TarTransport の経路で次を計測する
+//   connect             接続と認証
+//   exec round trip     exec("echo ok") の往復（チャンネルを開いてから閉じるまで）
+//   shell echo          PTY上のシェルへ1行送ってから出力が返るまで
+//   exec stream         execStreamで受け取る出力のスループット
+//   uploadFile / downloadFile         大きなファイル1つ
+//   uploadDirectory / downloadDirectory  小さなファイルが多いツリー（SFTPでファイルごと）
+//   tar upload / tar download          同じツリーをTarTransportで
+//
+// 外部ネットワーク・sshd・鍵は不要。データは固定シードで生成し、転送後は毎回内容を照合する
+// （不一致があれば終了コード1）。スループットは最大 --runs 回の中央値、レイテンシは中央値とp95
+//
+// --rtt で指定したRTTごとに、ImpairmentProxyを接続とサーバーの間に挟んで同じ計測を繰り返し、
+// 最後にRTTごとの一覧を出す（0は直結。--jitter / --bandwidth を指定した場合は0でもプロキシを通す）
+// 高RTTで時間がかかりすぎないよう、各項目は --budget 秒を超えたら（最低1回は実行して）打ち切る
+//
+// 使い方: transfer_bench [--size MB (既定64)] [--files N (既定200)] [--file-kb KB (既定4)]
+//                        [--runs N (既定3)] [--samples N (既定20)] [--budget 秒 (既定20)]
+//                        [--rtt ms,ms,... (既定0,20,50,100,200,300)] [--jitter ms (既定0)]
+//                        [--bandwidth Mbit/s (既定0=無制限)] [--segment バイト (既定1448)]
+//                        [--dir 作業ディレクトリ (既定/tmp)]
+
+#include "ImpairmentProxy.h"
+#include "LoopbackSshServer.h"
+#include "SshConnection.h"
+#include "SftpTransfer.h"
+#include "TarTransport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+using namespace pbterm;
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr double kMB = 1024.0 * 1024.0;
+constexpr uint64_t kSeed = 0x70627465726dULL;
+
+struct Options {
+    uint64_t sizeMB = 64;
+    int files = 200;
+    int fileKB = 4;
+    int runs = 3;
+    int samples = 20;
+    double budgetSeconds = 20.0;
+    std::vector<int> rttsMs = {0, 20, 50, 100, 200, 300};
+    int jitterMs = 0;
+    double bandwidthMbps = 0.0;
+    size_t segmentBytes = 1448;
+    std::string dir = "/tmp";
+};
+
+// RTT 1つ分の結果（一覧表示用、計測できなかった項目は0）
+struct SuiteResult {
+    int rttMs = 0;
+    double connectMs = 0.0;
+    double execMs = 0.0;
+    double echoMs = 0.0;
+    double streamMBps = 0.0;
+    double uploadMBps = 0.0;
+    double downloadMBps = 0.0;
+    double sftpUpFiles = 0.0;
+    double sftpDownFiles = 0.0;
+    double tarUpFiles = 0.0;
+    double tarDownFiles = 0.0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double median(std::vector<double> values) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t mid = values.size() / 2;
+    return values.size() % 2 ? values[mid] : (values[mid - 1] + values[mid]) / 2.0;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    size_t index = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[std::min(index, values.size() - 1)];
+}
+
+// 固定シードの擬似乱数（圧縮できない内容にする）
+struct Xorshift {
+    uint64_t state;
+    explicit Xorshift(uint64_t seed) : state(seed ? seed : 1) {}
+    uint64_t next() {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+    void fill(char* data, size_t len) {
+        for (size_t i = 0; i < len; i += 8) {
+            uint64_t v = next();
+            std::memcpy(data + i, &v, std::min<size_t>(8, len - i));
+        }
+    }
+};
+
+bool writeRandomFile(const std::string& path, uint64_t size, uint64_t seed) {
+    std::ofstream file(path, std::ios::binary);
+    Xorshift rng(seed);
+    std::vector<char> buffer(1024 * 1024);
+    for (uint64_t done = 0; done < size && file; done += buffer.size()) {
+        size_t n = static_cast<size_t>(std::min<uint64_t>(buffer.size(), size - done));
+        rng.fill(buffer.data(), n);
+        file.write(buffer.data(), static_cast<std::streamsize>(n));
+    }
+    file.close();
+    return !file.fail();
+}
+
+// 10ファイルごとにサブディレクトリを分けたツリー
+bool makeTree(const std::string& root, int files, size_t fileSize) {
+    std::error_code ec;
+    for (int i = 0; i < files; ++i) {
+        std::string dir = root + "/d" + std::to_string(i / 10);
+        fs::create_directories(dir, ec);
+        if (ec || !writeRandomFile(dir + "/f" + std::to_string(i) + ".bin", fileSize, kSeed + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool sameFile(const std::string& a, const std::string& b) {
+    std::ifstream fa(a, std::ios::binary), fb(b, std::ios::binary);
+    if (!fa || !fb) return false;
+    std::vector<char> ba(1024 * 1024), bb(1024 * 1024);
+    while (fa && fb) {
+        fa.read(ba.data(), static_cast<std::streamsize>(ba.size()));
+        fb.read(bb.data(), static_cast<std::streamsize>(bb.size()));
+        if (fa.gcount() != fb.gcount() ||
+            std::memcmp(ba.data(), bb.data(), static_cast<size_t>(fa.gcount())) != 0) {
+            return false;
+        }
+    }
+    return fa.eof() && fb.eof();
+}
+
+bool sameTree(const std::string& a, const std::string& b) {
+    std::vector<std::string> filesA, filesB;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(a, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file()) filesA.push_back(fs::relative(it->path(), a).generic_string());
+    }
+    for (fs::recursive_directory_iterator it(b, ec), end; !ec && it != end; it.increment(ec)) {
+        if (it->is_regular_file()) filesB.push_back(fs::relative(it->path(), b).generic_string());
+    }
+    std::sort(filesA.begin(), filesA.end());
+    std::sort(filesB.begin(), filesB.end());
+    if (ec || filesA != filesB) {
+        return false;
+    }
+    for (const auto& file : filesA) {
+        if (!sameFile(a + "/" + file, b + "/" + file)) return false;
+    }
+    return true;
+}
+
+void reportLatency(const char* label, const std::vector<double>& samples) {
+    std::printf("%-22s  median %8.3f ms   p95 %8.3f ms   (%zu samples)\n",
+                label, median(samples) * 1e3, percentile(samples, 0.95) * 1e3, samples.size());
+}
+
+void reportThroughput(const char* label, const std::vector<double>& seconds, double bytes, int files) {
+    double t = median(seconds);
+    if (files > 0) {
+        std::printf("%-22s  %8.1f MB/s   %8.0f files/s   (median of %zu)\n",
+                    label, bytes / kMB / t, files / t, seconds.size());
+    } else {
+        std::printf("%-22s  %8.1f MB/s   %8.3f s   (median of %zu)\n",
+                    label, bytes / kMB / t, t, seconds.size());
+    }
+}
+
+// PTY上のシェルへ1行ずつ送り、マーカーが返るまでの時間
+bool measureShellEcho(SshConnection& connection, int samples, std::vector<double>& latencies) {
+    auto channel = connection.createChannel(80, 24);
+    if (!channel) return false;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::string output;
+    channel->setDataCallback([&](const char* data, size_t len) {
+        std::lock_guard<std::mutex> lock(mutex);
+        output.append(data, len);
+        cv.notify_all();
+    });
+
+    bool ok = true;
+    // 1回目はシェルの起動待ちを含むので計測しない
+    for (int i = -1; i < samples && ok; ++i) {
+        // エコーバックされる入力行にはマーカーそのものが現れないようにする
+        std::string marker = "K" + std::to_string(i + 1) + "Q";
+        std::string line = "printf 'K%sQ\\n' " + std::to_string(i + 1) + "\n";
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            output.clear();
+        }
+        auto start = Clock::now();
+        channel->write(line.data(), line.size());
+        std::unique_lock<std::mutex> lock(mutex);
+        ok = cv.wait_for(lock, std::chrono::seconds(10),
+                         [&]() { return output.find(marker) != std::string::npos; });
+        if (ok && i >= 0) {
+            latencies.push_back(secondsSince(start));
+        }
+    }
+    channel->setDataCallback(nullptr);
+    channel->close();
+    return ok;
+}
+
+// 最大runs回、予算を超えたら打ち切って繰り返す（最低1回）
+bool repeat(const Options& options, std::vector<double>& seconds, const std::function<bool(int)>& body) {
+    seconds.clear();
+    auto start = Clock::now();
+    for (int run = 0; run < options.runs; ++run) {
+        if (run > 0 && secondsSince(start) > options.budgetSeconds) {
+            break;
+        }
+        auto runStart = Clock::now();
+        if (!body(run)) {
+            return false;
+        }
+        seconds.push_back(secondsSince(runStart));
+    }
+    return true;
+}
+
+// local/big.bin と local/tree を作業ディレクトリに置いてから呼ぶ
+bool runSuite(const SshConfig& config, const Options& options, const std::string& work,
+              SuiteResult& result) {
+    const uint64_t size = options.sizeMB * 1024 * 1024;
+    const double treeBytes = static_cast<double>(options.fileKB) * 1024 * options.files;
+    const std::string local = work + "/local";
+    const std::string bigFile = local + "/big.bin";
+    const std::string tree = local + "/tree";
+    // RTTごとに転送先を分ける
+    const std::string suite = work + "/rtt" + std::to_string(result.rttMs);
+    const std::string remote = suite + "/remote";
+    const std::string received = suite + "/received";
+    fs::create_directories(remote);
+    fs::create_directories(received);
+
+    SshConnection connection;
+    auto connectStart = Clock::now();
+    if (!connection.connect(config)) {
+        std::fprintf(stderr, "connect failed: %s\n", connection.lastError().c_str());
+        return false;
+    }
+    result.connectMs = secondsSince(connectStart) * 1e3;
+    std::printf("%-22s  %8.3f ms\n", "connect", result.connectMs);
+
+    bool ok = true;
+    auto fail = [&](const char* what, const std::string& detail) {
+        std::fprintf(stderr, "%s failed: %s\n", what, detail.c_str());
+        ok = false;
+        return false;
+    };
+
+    // exec の往復
+    std::vector<double> latencies;
+    auto budgetStart = Clock::now();
+    for (int i = 0; i < options.samples && ok; ++i) {
+        if (i > 0 && secondsSince(budgetStart) > options.budgetSeconds) break;
+        auto start = Clock::now();
+        std::string out = connection.exec("echo ok", 10000);
+        latencies.push_back(secondsSince(start));
+        if (out.find("ok") == std::string::npos) fail("exec", connection.lastError());
+    }
+    if (ok) {
+        reportLatency("exec round trip", latencies);
+        result.execMs = median(latencies) * 1e3;
+    }
+
+    // シェルのエコー
+    latencies.clear();
+    if (ok && !measureShellEcho(connection, options.samples, latencies)) fail("shell echo", "no echo");
+    if (ok) {
+        reportLatency("shell echo", latencies);
+        result.echoMs = median(latencies) * 1e3;
+    }
+
+    // execStream のスループット
+    std::vector<double> seconds;
+    if (ok) {
+        ok = repeat(options, seconds, [&](int) {
+            uint64_t bytes = 0;
+            ExecCallbacks callbacks;
+            callbacks.onStdout = [&](const char*, size_t len) { bytes += len; return true; };
+            int status = connection.execStream("head -c " + std::to_string(size) + " /dev/zero", callbacks, 30000);
+            return (status == 0 && bytes == size) || fail("exec stream", std::to_string(bytes) + " bytes");
+        });
+    }
+    if (ok) {
+        reportThroughput("exec stream", seconds, static_cast<double>(size), 0);
+        result.streamMBps = size / kMB / median(seconds);
+    }
+
+    // 単一ファイル
+    if (ok) {
+        ok = repeat(options, seconds, [&](int run) {
+            std::string target = remote + "/big-" + std::to_string(run) + ".bin";
+            return (connection.uploadFile(bigFile, target) && sameFile(bigFile, target)) ||
+                   fail("uploadFile", connection.lastError());
+        });
+    }
+    if (ok) {
+        reportThroughput("uploadFile", seconds, static_cast<double>(size), 0);
+        result.uploadMBps = size / kMB / median(seconds);
+    }
+
+    if (ok) {
+        ok = repeat(options, seconds, [&](int run) {
+            std::string target = received + "/big-" + std::to_string(run) + ".bin";
+            bool done = connection.downloadFile(remote + "/big-0.bin", target) && sameFile(bigFile, target);
+            std::remove(target.c_str());
+            return done || fail("downloadFile", connection.lastError());
+        });
+    }
+    if (ok) {
+        reportThroughput("downloadFile", seconds, static_cast<double>(size), 0);
+        result.downloadMBps = size / kMB / median(seconds);
+    }
+
+    // ディレクトリ（SFTP、ファイルごと）
+    if (ok) {
+        ok = repeat(options, seconds, [&](int run) {
+            std::string target = remote + "/sftp-" + std::to_string(run);
+            return (connection.uploadDirectory(tree, target) && sameTree(tree, target)) ||
+                   fail("uploadDirectory", connection.lastError());
+        });
+    }
+    if (ok) {
+        reportThroughput("uploadDirectory", seconds, treeBytes, options.files);
+        result.sftpUpFiles = options.files / median(seconds);
+    }
+
+    if (ok) {
+        ok = repeat(options, seconds, [&](int run) {
+            std::string target = received + "/sftp-" + std::to_string(run);
+            return (connection.downloadDirectory(remote + "/sftp-0", target) && sameTree(tree, target)) ||
+                   fail("downloadDirectory", connection.lastError());
+        });
+    }
+    if (ok) {
+        reportThroughput("downloadDirectory", seconds, treeBytes, options.files);
+        result.sftpDownFiles = options.files / median(seconds);
+    }
+
+    // ディレクトリ（tarストリーム）
+    TarTransport tar(&connection);
+    TransferHooks hooks;
+    std::string error;
+    if (ok) {
+        ok = repeat(options, seconds, [&](int run) {
+            std::string target = remote + "/tar-" + std::to_string(run);
+            return (tar.upload(tree, target, false, hooks, error) && sameTree(tree, target)) ||
+                   fail("tar upload", error);
+        });
+    }
+    if (ok) {
+        reportThroughput("tar upload", seconds, treeBytes, options.files);
+        result.tarUpFiles = options.files / median(seconds);
+    }
+
+    if (ok) {
+        ok = repeat(options, seconds, [&](int run) {
+            std::string target = received + "/tar-" + std::to_string(run);
+            return (tar.download(remote + "/tar-0", target, false, hooks, error) && sameTree(tree, target)) ||
+                   fail("tar download", error);
+        });
+    }
+    if (ok) {
+        reportThroughput("tar download", seconds, treeBytes, options.files);
+        result.tarDownFiles = options.files / median(seconds);
+    }
+
+    connection.disconnect();
+    // 次のRTTの計測に前の転送先が残らないようにする（ページキャッシュと容量のため）
+    fs::remove_all(suite);
+    return ok;
+}
+
+void reportSummary(const std::vector<SuiteResult>& results) {
+    std::printf("\n%6s %9s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n",
+                "rtt", "connect", "exec", "echo", "stream", "upload", "download",
+                "sftp up", "sftp dn", "tar up", "tar dn");
+    std::printf("%6s %9s %9s %9s %9s %9s %9s %9s %9s %9s %9s\n",
+                "ms", "ms", "ms", "ms", "MB/s", "MB/s", "MB/s",
+                "files/s", "files/s", "files/s", "files/s");
+    for (const auto& r : results) {
+        std::printf("%6d %9.1f %9.2f %9.2f %9.1f %9.1f %9.1f %9.0f %9.0f %9.0f %9.0f\n",
+                    r.rttMs, r.connectMs, r.execMs, r.echoMs, r.streamMBps, r.uploadMBps,
+                    r.downloadMBps, r.sftpUpFiles, r.sftpDownFiles, r.tarUpFiles, r.tarDownFiles);
+    }
+}
+
+bool parseRtts(const std::string& value, std::vector<int>& rtts) {
+    rtts.clear();
+    size_t start = 0;
+    while (start <= value.size()) {
+        size_t comma = value.find(',', start);
+        std::string item = value.substr(start, comma == std::string::npos ? std::string::npos : comma - start);
+        if (item.empty()) return false;
+        rtts.push_back(std::atoi(item.c_str()));
+        if (rtts.back() < 0) return false;
+        if (comma == std::string::npos) break;
+        start = comma + 1;
+    }
+    return !rtts.empty();
+}
+
+bool parseOptions(int argc, char** argv, Options& options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        std::string value = argv[++i];
+        if (arg == "--size") {
+            options.sizeMB = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--files") {
+            options.files = std::atoi(value.c_str());
+        } else if (arg == "--file-kb") {
+            options.fileKB = std::atoi(value.c_str());
+        } else if (arg == "--runs") {
+            options.runs = std::atoi(value.c_str());
+        } else if (arg == "--samples") {
+            options.samples = std::atoi(value.c_str());
+        } else if (arg == "--budget") {
+            options.budgetSeconds = std::atof(value.c_str());
+        } else if (arg == "--rtt") {
+            if (!parseRtts(value, options.rttsMs)) return false;
+        } else if (arg == "--jitter") {
+            options.jitterMs = std::atoi(value.c_str());
+        } else if (arg == "--bandwidth") {
+            options.bandwidthMbps = std::atof(value.c_str());
+        } else if (arg == "--segment") {
+            options.segmentBytes = std::strtoull(value.c_str(), nullptr, 10);
+        } else if (arg == "--dir") {
+            options.dir = value;
+        } else {
+            return false;
+        }
+    }
+    return options.sizeMB > 0 && options.files > 0 && options.fileKB > 0 &&
+           options.runs > 0 && options.samples > 0 && options.jitterMs >= 0 &&
+           options.bandwidthMbps >= 0.0 && options.segmentBytes > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        std::fprintf(stderr,
+                     "usage: %s [--size MB] [--files N] [--file-kb KB] [--runs N] [--samples N] [--budget s]\n"
+                     "       [--rtt ms,ms,...] [--jitter ms] [--bandwidth Mbit/s] [--segment bytes] [--dir PATH]\n",
+                     argv[0]);
+        return 1;
+    }
+
+    std::string pattern = options.dir + "/pbterm-bench-XXXXXX";
+    std::vector<char> workBuffer(pattern.begin(), pattern.end());
+    workBuffer.push_back('\0');
+    if (!mkdtemp(workBuffer.data())) {
+        std::fprintf(stderr, "cannot create work directory in %s\n", options.dir.c_str());
+        return 1;
+    }
+    const std::string work = workBuffer.data();
+
+    // ~/.ssh の設定やknown_hostsに左右されないよう、HOMEを作業ディレクトリにする
+    fs::create_directories(work + "/home");
+    setenv("HOME", (work + "/home").c_str(), 1);
+
+    const std::string local = work + "/local";
+    fs::create_directories(local);
+    if (!writeRandomFile(local + "/big.bin", options.sizeMB * 1024 * 1024, kSeed) ||
+        !makeTree(local + "/tree", options.files, static_cast<size_t>(options.fileKB) * 1024)) {
+        std::fprintf(stderr, "failed to create test data in %s\n", local.c_str());
+        fs::remove_all(work);
+        return 1;
+    }
+
+    LoopbackSshServer server("bench", "bench-" + std::to_string(getpid()));
+    std::string error;
+    if (!server.start(error)) {
+        std::fprintf(stderr, "server: %s\n", error.c_str());
+        fs::remove_all(work);
+        return 1;
+    }
+
+    std::printf("loopback ssh bench: libssh %s, file %llu MB, tree %d x %d KB, runs %d, samples %d, budget %.0f s\n",
+                ssh_version(0), static_cast<unsigned long long>(options.sizeMB),
+                options.files, options.fileKB, options.runs, options.samples, options.budgetSeconds);
+    std::printf("impairment: jitter %d ms, bandwidth %s, segment %zu bytes\n",
+                options.jitterMs,
+                options.bandwidthMbps > 0.0 ? (std::to_string(options.bandwidthMbps) + " Mbit/s").c_str() : "unlimited",
+                options.segmentBytes);
+
+    bool ok = true;
+    std::vector<SuiteResult> results;
+    for (int rtt : options.rttsMs) {
+        SuiteResult result;
+        result.rttMs = rtt;
+
+        SshConfig config;
+        config.host = "127.0.0.1";
+        config.port = server.port();
+        config.username = server.user();
+        config.password = server.password();
+        config.useKeyAuth = false;
+
+        // RTTは両方向の片道遅延の和として与える
+        std::unique_ptr<ImpairmentProxy> proxy;
+        if (rtt > 0 || options.jitterMs > 0 || options.bandwidthMbps > 0.0) {
+            ImpairmentProxy::Settings settings;
+            settings.delayMs = rtt / 2;
+            settings.jitterMs = options.jitterMs;
+            settings.bandwidthMbps = options.bandwidthMbps;
+            settings.segmentBytes = options.segmentBytes;
+            proxy = std::make_unique<ImpairmentProxy>(settings);
+            if (!proxy->start(server.port(), error)) {
+                std::fprintf(stderr, "proxy: %s\n", error.c_str());
+                ok = false;
+                break;
+            }
+            config.port = proxy->port();
+        }
+
+        std::printf("\n--- rtt %d ms%s ---\n", rtt, proxy ? " (via proxy)" : "");
+        bool suiteOk = runSuite(config, options, work, result);
+        if (proxy) {
+            proxy->stop();
+        }
+        if (!suiteOk) {
+            ok = false;
+            break;
+        }
+        results.push_back(result);
+    }
+
+    reportSummary(results);
+
+    server.stop();
+    fs::remove_all(work);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+// トリガーエンジンの照合の確認と、行あたりのコストの計測
+//
+// 確認: 規則ごとの正規表現を全行にそのまま当てた結果と、TriggerEngine（必須の文字列で候補を絞ってから試す）
+//       の結果が一致するか。必須の文字列の取り出しを誤ると、一致するはずの行が候補から漏れる
+//       （\x41 の "41" を文字列として拾う、など）
+// 計測: 既定の規則で、一致のない行・ある行をscanするのにかかる時間
+//
+// 使い方: trigger_bench [行数 (既定200000)]
+// 確認に失敗したら1を返す
+
+#include "TriggerEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <regex>
+#include <string>
+#include <vector>
+
+using namespace pbterm;
+
+namespace {
+
+struct Case {
+    const char* pattern;
+    bool ignoreCase;
+    std::vector<const char*> matching;      // 一致する行
+    std::vector<const char*> nonMatching;   // 一致しない行
+};
+
+// 引数を取るエスケープを含む規則（引数の文字が必須の文字列に混ざると一致を取りこぼす）
+const std::vector<Case> kCases = {
+    {"\\x41BC", false, {"xxABCxx", "ABC"}, {"41BC", "AB"}},
+    {"err\\x3aor", false, {"err:or"}, {"err3aor", "error"}},
+    {"\\u0041pple", false, {"Apple pie"}, {"0041pple", "apple"}},
+    {"id\\u003d\\d+", false, {"id=42"}, {"id003d42"}},
+    {"(\\w+)-\\1x", false, {"ab-abx"}, {"ab-1x"}},
+    {"(?:\\x2d\\x2d)verbose", false, {"--verbose"}, {"2d2dverbose"}},
+    {"WARN\\x5b", true, {"warn[ disk"}, {"warn5b"}},
+    {"\\berror\\b|\\bfatal\\b", true, {"Fatal: x", "an ERROR"}, {"errors", "fatality"}},
+    {"https?://[^\\s\"'<>]+", false, {"see http://a.b/c"}, {"http:/a"}},
+};
+
+std::vector<std::pair<size_t, size_t>> regexMatches(const std::regex& regex, const std::string& line) {
+    std::vector<std::pair<size_t, size_t>> result;
+    auto end = std::sregex_iterator();
+    for (auto it = std::sregex_iterator(line.begin(), line.end(), regex); it != end; ++it) {
+        if (it->length() > 0) {
+            size_t start = static_cast<size_t>(it->position());
+            result.emplace_back(start, start + static_cast<size_t>(it->length()));
+        }
+    }
+    return result;
+}
+
+bool checkCases() {
+    bool ok = true;
+    std::vector<TriggerMatch> matches;
+    for (const auto& c : kCases) {
+        TriggerRule rule;
+        rule.name = c.pattern;
+        rule.pattern = c.pattern;
+        rule.ignoreCase = c.ignoreCase;
+        TriggerEngine engine({rule});
+        auto flags = std::regex::ECMAScript;
+        if (c.ignoreCase) {
+            flags |= std::regex::icase;
+        }
+        std::regex regex(c.pattern, flags);
+
+        auto check = [&](const char* text, bool expectMatch) {
+            std::string line = text;
+            engine.scan(line, matches);
+            std::vector<std::pair<size_t, size_t>> got;
+            for (const auto& m : matches) {
+                got.emplace_back(m.start, m.end);
+            }
+            std::vector<std::pair<size_t, size_t>> want = regexMatches(regex, line);
+            if (got != want || want.empty() == expectMatch) {
+                std::printf("NG  %-28s  \"%s\": engine %zu / regex %zu\n", c.pattern, text, got.size(), want.size());
+                ok = false;
+            }
+        };
+        for (const char* text : c.matching) {
+            check(text, true);
+        }
+        for (const char* text : c.nonMatching) {
+            check(text, false);
+        }
+    }
+    std::printf("照合の確認: %s（%zu規則）\n", ok ? "OK" : "NG", kCases.size());
+    return ok;
+}
+
+void measure(size_t lineCount) {
+    TriggerEngine engine(TriggerEngine::defaultRules());
+    std::vector<TriggerRule> rules = TriggerEngine::defaultRules();
+    std::vector<std::regex> regexes;
+    for (const auto& rule : rules) {
+        auto flags = std::regex::ECMAScript | std::regex::optimize;
+        if (rule.ignoreCase) {
+            flags |= std::regex::icase;
+        }
+        regexes.emplace_back(rule.pattern, flags);
+    }
+
+    const std::vector<std::string> lines = {
+        "drwxr-xr-x  12 user  staff   384 Oct 18 10:02 Documents",
+        "  CC      kernel/sched/core.o",
+        "src/Terminal.cpp:812:17: warning: unused variable 'x'",
+        "make: *** [all] Error 2",
+        "fetching https://example.com/archive.tar.gz",
+    };
+
+    std::vector<TriggerMatch> matches;
+    size_t found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lineCount; ++i) {
+        engine.scan(lines[i % lines.size()], matches);
+        found += matches.size();
+    }
+    double engineSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t naiveFound = 0;
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < lineCount; ++i) {
+        const std::string& line = lines[i % lines.size()];
+        for (const auto& regex : regexes) {
+            naiveFound += regexMatches(regex, line).size();
+        }
+    }
+    double naiveSec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%zu行: エンジン %.1f ns/行（一致%zu）, 全規則の正規表現 %.1f ns/行（一致%zu）\n", lineCount,
+                engineSec * 1e9 / lineCount, found, naiveSec * 1e9 / lineCount, naiveFound);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t lineCount = 200000;
+    if (argc > 1) {
+        lineCount = std::max<size_t>(1, std::strtoull(argv[1], nullptr, 10));
+    }
+    if (!checkCases()) {
+        return 1;
+    }
+    measure(lineCount);
+    return 0;
+}
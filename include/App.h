@@ -16,6 +16,14 @@ class SshConnection;
 class TmuxController;
 class CommandDock;
 class FolderTreeDock;
+class TransferManager;
+class TransferDock;
+class SessionDock;
+class PollScheduler;
+class ConnectionPipeline;
+class HostFactsCache;
+class TriggerEngine;
+struct SshConfig;
 
 // アプリケーションメインクラス
 class App {
@@ -44,6 +52,12 @@ private:
     // 接続管理
     void connect();
     void disconnect();
+    // 接続処理をワーカーで始める（完了はpollConnectionで受け取る）
+    void startConnect(const SshConfig& config, const std::string& profileName);
+    // 毎フレーム呼び、接続が完了していればドックへ反映する（キャッシュの再検証結果も）
+    void pollConnection();
+    // 接続中の進捗・失敗を表示するモーダル
+    void renderConnectProgress();
 
     // 設定適用
     void onSettingsApplied(const AppSettings& settings);
@@ -59,12 +73,22 @@ private:
     std::unique_ptr<SettingsDialog> m_settingsDialog;
     std::unique_ptr<CommandDock> m_commandDock;
     std::unique_ptr<FolderTreeDock> m_folderTreeDock;
+    std::unique_ptr<TransferManager> m_transferManager;
+    std::unique_ptr<TransferDock> m_transferDock;
+    std::unique_ptr<SessionDock> m_sessionDock;
+    std::unique_ptr<PollScheduler> m_pollScheduler;
+    std::unique_ptr<HostFactsCache> m_hostFactsCache;
+    std::unique_ptr<ConnectionPipeline> m_connectionPipeline;
+    // 出力に当てるトリガー（起動時にtriggers.confから作り、全ターミナルで共有する）
+    std::shared_ptr<const TriggerEngine> m_triggers;
 
     AppSettings m_appSettings;
 
     bool m_showTerminal = true;
     bool m_showCommands = true;
     bool m_showFolders = true;
+    bool m_showTransfers = true;
+    bool m_showSessions = true;
 
     // アコーディオン状態
     bool m_commandsCollapsed = false;
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include "SshConnection.h"
+#include "TmuxController.h"
+#include "RemoteBootstrap.h"
+
+namespace pbterm {
+
+class Terminal;
+class HostFactsCache;
+
+// 接続の段階（この順に進む）
+enum class ConnectStage {
+    Idle,
+    Resolve,        // ssh_configの適用
+    Connect,        // 名前解決・TCP接続（プロキシ経由を含む）と鍵交換
+    Auth,           // ユーザー認証
+    Bootstrap,      // リモートの情報収集・tmuxセッションの作成（1往復）
+    OpenShell,      // シェルチャンネルを開いてtmuxにアタッチ
+    Done,
+    Failed,
+    Cancelled
+};
+
+// 接続が完了したときにUIスレッドへ渡すもの
+struct ConnectedShell {
+    std::unique_ptr<Terminal> terminal;
+    std::shared_ptr<SshChannel> channel;
+    bool tmuxAttached = false;          // falseならtmuxなしの直接シェル
+    bool controlMode = false;           // tmuxのコントロールモードで表示する（terminal・channelはnull）
+    bool tmuxMissing = false;           // リモートにtmuxがなかった
+    std::vector<TmuxWindow> windows;    // アタッチ時のウィンドウ一覧
+    RemoteFacts facts;                  // OS・ホームなど（フォルダツリーが使う）
+    bool fromCache = false;             // factsはキャッシュから（接続後に裏で確かめ直す）
+};
+
+// 接続処理をワーカースレッドで段階的に進める
+// 名前解決からシェルを開くまでをUIスレッドの外で行い、UIは毎フレームstage()を見て進捗を表示する
+// 各段階の待ちは短く区切ってあり、cancel()すると次の区切りで中断してセッションを閉じる
+// 完了したらtakeResult()でターミナルとチャンネルを受け取り、UIスレッドでドックへ渡す
+// ホスト情報のキャッシュがあればブートストラップを待たずにシェルを開き、
+// Doneの後にワーカーがブートストラップを実行して確かめ直す（結果はtakeRefreshedFacts()で受け取る）
+class ConnectionPipeline {
+public:
+    ConnectionPipeline(SshConnection* connection, TmuxController* tmux, HostFactsCache* cache);
+    ~ConnectionPipeline();
+
+    ConnectionPipeline(const ConnectionPipeline&) = delete;
+    ConnectionPipeline& operator=(const ConnectionPipeline&) = delete;
+
+    // 接続を始める（前回の接続処理が残っていれば中断して終わるのを待つ）
+    void start(const SshConfig& config, const std::string& profileName);
+    // 中断を要求する（実際に止まるとstage()がCancelledになる）
+    void cancel();
+
+    // 接続処理中か（Done/Failed/Cancelledになるまでtrue）
+    bool isBusy() const;
+    bool isCancelling() const { return m_cancel && isBusy(); }
+    ConnectStage stage() const { return m_stage; }
+    std::string error() const;
+    std::string profileName() const;
+    std::string host() const;
+
+    // Doneになっていれば結果を取り出してIdleに戻す（一度だけtrueを返す）
+    bool takeResult(ConnectedShell& shell);
+    // Failed/Cancelledの表示を終えてIdleに戻す
+    void acknowledge();
+
+    // キャッシュを確かめ直した結果があれば取り出す（一度だけtrueを返す）
+    bool takeRefreshedFacts(RemoteFacts& facts);
+    // 切断する（待たない）: ワーカーで確かめ直しを止め、tmuxの制御チャンネルを閉じ、
+    // quiesce（転送が止まるのを待つなど）を呼んでからセッションを閉じる
+    // 終わる前にstart()した場合は、新しいワーカーが切断の完了を待ってから接続する
+    void disconnect(std::function<void()> quiesce);
+    bool isDisconnecting() const { return m_disconnecting; }
+
+private:
+    void run(SshConfig config);
+    bool keepGoing() const { return !m_cancel; }
+    void setStage(ConnectStage stage) { m_stage = stage; }
+    void finish(ConnectStage stage, const std::string& error);
+    bool openShell(ConnectedShell& shell);
+    void revalidate(const std::string& endpoint, const RemoteFacts& cached);
+
+    SshConnection* m_connection;
+    TmuxController* m_tmux;
+    HostFactsCache* m_cache;
+
+    std::thread m_worker;
+    std::atomic<ConnectStage> m_stage{ConnectStage::Idle};
+    std::atomic<bool> m_cancel{false};
+    std::atomic<bool> m_disconnecting{false};
+
+    mutable std::mutex m_mutex;
+    std::string m_error;
+    std::string m_profileName;
+    std::string m_host;
+    ConnectedShell m_result;
+    RemoteFacts m_refreshed;
+    bool m_hasRefreshed = false;
+};
+
+} // namespace pbterm
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <cstdint>
+
+namespace pbterm {
+
+class SshConnection;
+struct TransferHooks;
+
+// 同期オプション
+struct SyncOptions {
+    bool compareHashes = false;                 // サイズ・更新時刻が同じでも内容（SHA-256）を比較
+    bool useDelta = true;                       // 大きな変更ファイルはブロック差分で送る
+    uint64_t deltaMinSize = 8 * 1024 * 1024;    // 差分転送を使う最小サイズ
+};
+
+enum class SyncAction {
+    Upload,     // 全体を転送
+    Delta,      // ブロック差分で転送
+    Skip        // 変更なし
+};
+
+// 同期計画の1ファイル分
+struct SyncEntry {
+    std::string relativePath;
+    std::string localPath;
+    std::string remotePath;
+    SyncAction action = SyncAction::Upload;
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    std::string reason;         // 判定理由（new / size / mtime / hash / same）
+};
+
+// 同期計画（ドライランの結果としてもそのまま表示できる）
+struct SyncPlan {
+    std::vector<std::string> directories;   // 作成が必要なリモートディレクトリ（親から順）
+    std::vector<SyncEntry> files;
+
+    uint64_t bytesToSend() const;
+    int count(SyncAction action) const;
+    std::string report() const;
+};
+
+// ディレクトリのアップロード同期（rsync相当）
+// ローカルとリモートのツリーを一括で比較して変更されたファイルだけを送り、
+// 大きな変更ファイルはリモートの既存内容をブロック単位で再利用する
+// リモート側は標準コマンド（find / cksum / dd / sha256sum）のみを使い、
+// 使えない環境ではSFTPでの一覧取得・全体転送にフォールバックする
+class DirectorySync {
+public:
+    explicit DirectorySync(SshConnection* connection);
+
+    // 比較して同期計画を作る（shouldContinueがfalseを返すと中断）
+    bool plan(const std::string& localDir, const std::string& remoteDir, const SyncOptions& options,
+              SyncPlan& plan, std::string& error, const std::function<bool()>& shouldContinue = nullptr);
+
+    // 1ファイルをブロック差分で転送（差分が使えない・効果がない場合は全体を転送）
+    bool deltaUpload(const std::string& localPath, const std::string& remotePath,
+                     const TransferHooks& hooks, std::string& error);
+
+    // リモートパスの結合（Windowsのパス表記で渡された場合は区切り文字を合わせる）
+    static std::string joinRemote(const std::string& base, const std::string& name);
+
+private:
+    struct RemoteInfo {
+        bool isDir = false;
+        uint64_t size = 0;
+        int64_t mtime = 0;
+    };
+
+    bool listRemoteTree(const std::string& remoteDir, std::map<std::string, RemoteInfo>& entries,
+                        bool& exists, std::string& error);
+    bool listRemoteTreeSftp(const std::string& remoteDir, std::map<std::string, RemoteInfo>& entries,
+                            std::string& error);
+    // リモートの複数ファイルのSHA-256を一括取得（相対パス -> ダイジェスト）
+    void remoteHashes(const std::string& remoteDir, const std::vector<std::string>& relativePaths,
+                      std::map<std::string, std::string>& hashes);
+
+    SshConnection* m_connection = nullptr;
+};
+
+} // namespace pbterm
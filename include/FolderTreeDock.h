@@ -8,6 +8,9 @@ namespace pbterm {
 
 class SshConnection;
 class TerminalDock;
+class TransferManager;
+class HostFactsCache;
+struct RemoteFacts;
 
 class FolderTreeDock {
 public:
@@ -15,9 +18,14 @@ public:
 
     void setConnection(SshConnection* connection);
     void setTerminalDock(TerminalDock* terminalDock);
+    void setTransferManager(TransferManager* transferManager) { m_transferManager = transferManager; }
+    void setHostFactsCache(HostFactsCache* cache) { m_hostFactsCache = cache; }
     void setLanguage(int language) { m_language = language; }
 
-    void onConnected();
+    // 接続時に集めたリモートの情報（OS・ホーム）を受け取る
+    void onConnected(const RemoteFacts& facts);
+    // キャッシュの情報で接続した後、確かめ直した情報を受け取る（OSが変わったときだけルートを作り直す）
+    void updateFacts(const RemoteFacts& facts);
     void onDisconnected();
 
     void render();
@@ -28,11 +36,6 @@ public:
     // 現在のドロップターゲットパス（マウス下のフォルダ）を取得
     std::string currentDropTargetPath() const { return m_dropTargetPath; }
 
-    // アップロード進行状況
-    bool isUploading() const { return m_uploading; }
-    float uploadProgress() const { return m_uploadProgress; }
-    std::string uploadCurrentFile() const { return m_uploadCurrentFile; }
-
 private:
     struct Node {
         std::string name;
@@ -67,15 +70,21 @@ private:
     void renderDownloadDialog();
     void refreshNodeByPath(const std::string& path);
     void downloadToLocal(const std::string& remotePath, bool isDir);
+    // 転送キューの進行状況表示と、終了した転送の後処理
+    void renderTransferProgress();
+    void processFinishedTransfers();
 
     bool isPathMatch(const std::string& path, const std::string& activePath) const;
     bool isAncestorPath(const std::string& path, const std::string& targetPath) const;
 
     SshConnection* m_connection = nullptr;
     TerminalDock* m_terminalDock = nullptr;
+    TransferManager* m_transferManager = nullptr;
+    HostFactsCache* m_hostFactsCache = nullptr;
     int m_language = 0;
 
     RemotePlatform m_platform = RemotePlatform::Unknown;
+    std::string m_home;     // リモートの$HOME（ドロップ先の既定）
     std::vector<std::unique_ptr<Node>> m_roots;
 
     bool m_showHiddenDirs = false;
@@ -93,16 +102,9 @@ private:
 
     // ドラッグ＆ドロップ
     std::string m_dropTargetPath;       // 現在のドロップターゲット
-    bool m_uploading = false;
-    float m_uploadProgress = 0.0f;
-    std::string m_uploadCurrentFile;
-    std::vector<std::string> m_pendingUploads;
     std::string m_uploadDestination;
 
     // ダウンロード
-    bool m_downloading = false;
-    float m_downloadProgress = 0.0f;
-    std::string m_downloadCurrentFile;
     bool m_showDownloadComplete = false;
     std::string m_downloadedPath;
 };
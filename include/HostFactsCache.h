@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include "RemoteBootstrap.h"
+
+namespace pbterm {
+
+// 接続先ごとに前回調べた情報（OS・ホーム・tmuxのパス・ウィンドウ一覧・Windowsのドライブ一覧）
+struct HostFactsEntry {
+    std::string endpoint;               // user@host:port
+    int64_t updated = 0;                // 最後に確認した時刻（UNIX秒）
+    RemoteFacts facts;
+    std::vector<std::string> drives;    // Windowsのドライブ一覧（フォルダツリーのルート）
+};
+
+// 接続先ごとの情報のキャッシュ
+// 再接続時はキャッシュを先に使ってフォルダツリーとtmuxのタブをすぐに表示し、
+// 裏でブートストラップを実行して確かめ直す（結果が変わっていれば差し替える）
+// 設定ディレクトリに保存し、kTtlSecondsより古いものは使わない
+// 接続処理のワーカーとUIスレッドの両方から使うため、内部でロックする
+class HostFactsCache {
+public:
+    static constexpr int64_t kTtlSeconds = 7 * 24 * 60 * 60;
+
+    HostFactsCache();
+
+    // 期限内の情報があればfactsに入れてtrue
+    bool lookup(const std::string& endpoint, RemoteFacts& facts) const;
+    void store(const std::string& endpoint, const RemoteFacts& facts);
+
+    bool lookupDrives(const std::string& endpoint, std::vector<std::string>& drives) const;
+    void storeDrives(const std::string& endpoint, const std::vector<std::string>& drives);
+
+    void save();
+    void load();
+
+private:
+    HostFactsEntry* findLocked(const std::string& endpoint);
+    const HostFactsEntry* findFreshLocked(const std::string& endpoint) const;
+    void saveLocked();
+    std::string configPath() const;
+
+    mutable std::mutex m_mutex;
+    std::vector<HostFactsEntry> m_entries;
+};
+
+} // namespace pbterm
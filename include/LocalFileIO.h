@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+namespace pbterm {
+
+// 転送用のローカルファイル読み取り
+// ページ境界にアラインした大きなバッファへpreadでまとめて読み、送信側へはその一部を指すポインタを渡す
+// （ifstreamのバッファ経由のコピーと小さなread呼び出しをなくす）
+// mmapは使わない（転送中に他のプロセスがファイルを切り詰めると、マップした範囲の読み取りでSIGBUSになる）
+class LocalFileReader {
+public:
+    LocalFileReader() = default;
+    ~LocalFileReader();
+
+    LocalFileReader(const LocalFileReader&) = delete;
+    LocalFileReader& operator=(const LocalFileReader&) = delete;
+
+    // offsetから読み始める
+    bool open(const std::string& path, uint64_t offset = 0);
+    void close();
+
+    // 次の最大maxLenバイトを指すポインタを返す（0で終端）
+    // ポインタは次のread()/close()まで有効
+    // 開いた時点のサイズより手前でファイルが終わった場合（転送中に短くなった）はbad()になる
+    size_t read(const char*& data, size_t maxLen);
+
+    bool bad() const { return m_bad; }
+    uint64_t position() const { return m_position; }
+
+private:
+    // positionから先をバッファへ読む
+    bool fill();
+
+    int m_fd = -1;
+    uint64_t m_size = 0;
+    uint64_t m_position = 0;
+    bool m_bad = false;
+
+    char* m_buffer = nullptr;
+    uint64_t m_bufferOffset = 0;
+    size_t m_bufferLength = 0;
+};
+
+// 転送用のローカルファイル書き込み（ライトビハインド）
+// 受信データは大きなアラインされたバッファへ直接受け取り、満杯になったバッファは
+// 専用のI/Oスレッドが書き出す（ネットワーク受信とディスク書き込みを重ねる）
+// 最終サイズが分かっている場合は事前に領域を確保して断片化と拡張のコストを避ける
+class WriteBehindFile {
+public:
+    WriteBehindFile() = default;
+    ~WriteBehindFile();
+
+    WriteBehindFile(const WriteBehindFile&) = delete;
+    WriteBehindFile& operator=(const WriteBehindFile&) = delete;
+
+    // offsetより後ろを切り詰めて、offsetから書き始める（expectedSizeは事前確保用、不明なら0）
+    bool open(const std::string& path, uint64_t offset, uint64_t expectedSize);
+    // 書き込み完了を待って閉じる（書き込みエラーがあればfalse）
+    bool close();
+
+    // 最大maxLenバイトを直接書き込める領域を返す（実際に書いた長さをcommit()で確定する）
+    char* reserve(size_t maxLen);
+    void commit(size_t len);
+    // コピーして書き込む
+    bool write(const char* data, size_t len);
+
+    bool failed() const;
+    const std::string& path() const { return m_path; }
+
+private:
+    struct Buffer {
+        char* data = nullptr;
+        size_t used = 0;
+        uint64_t fileOffset = 0;
+    };
+
+    // 現在のバッファをI/Oスレッドへ渡し、空きバッファに切り替える
+    bool submitCurrent();
+    bool writeBuffer(const Buffer& buffer);
+    void ioThread();
+    void preallocate(uint64_t size);
+
+    int m_fd = -1;
+    std::string m_path;
+    uint64_t m_writeOffset = 0;     // 次にバッファへ積むデータのファイル位置
+
+    std::vector<char*> m_allocated;
+    Buffer m_current;
+
+    std::thread m_thread;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Buffer> m_pending;   // 書き出し待ち
+    std::vector<char*> m_free;      // 空きバッファ
+    bool m_stopping = false;
+    bool m_error = false;
+};
+
+} // namespace pbterm
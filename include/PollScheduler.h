@@ -0,0 +1,71 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <chrono>
+#include "TmuxController.h"
+
+namespace pbterm {
+
+// リモートへの定期的な問い合わせをまとめて送るスケジューラ（UIスレッドから使う）
+// ドックは問い合わせを間隔の範囲（最短・最長）と一緒に登録し、期限の来たものは1回の往復にまとめて送る
+// 往復にかかった時間（RTT）を送るたびに測り、間隔はRTTに比例させて範囲内に収める（LANでは短く、遠い回線では長く）
+// ウィンドウが非アクティブのときと、応答が遅れて回線が詰まっているときは間隔を延ばす
+// 送った問い合わせの応答がすべて届くまで次は送らないので、登録側で応答待ちを管理しなくてよい
+class PollScheduler {
+public:
+    // 期限が来たときに呼ばれ、送るコマンドをbatchへ積む（積まなければ何も送らない）
+    // 応答はコントロールモードでは読み取りスレッドから、execではexec用のスレッドから呼ばれる
+    using PollFunction = std::function<void(std::vector<TmuxController::Command>& batch)>;
+
+    explicit PollScheduler(TmuxController* tmux);
+    ~PollScheduler();
+
+    // 問い合わせを登録して番号を返す（間隔はミリ秒）
+    int add(const std::string& name, int minIntervalMs, int maxIntervalMs, PollFunction poll);
+    void remove(int id);
+    // 次のtickで期限に関係なく送る（一覧を開いた直後など）
+    void trigger(int id);
+
+    // 期限の来た問い合わせを集めて送る（1フレームに1回呼ぶ）
+    void tick();
+
+    void setFocused(bool focused) { m_focused = focused; }
+    // 接続が変わったらRTTの測定をやり直す
+    void reset();
+
+    // 平滑化したRTT（まだ測っていなければ仮の値）
+    double rttMs() const;
+
+private:
+    struct Entry {
+        int id = 0;
+        std::string name;
+        int minIntervalMs = 0;
+        int maxIntervalMs = 0;
+        PollFunction poll;
+        std::chrono::steady_clock::time_point lastRun;
+        bool triggered = true;      // 登録直後は1回すぐ送る
+    };
+    // 読み取りスレッド・exec用のスレッドから届いた往復の結果
+    struct Shared;
+
+    int intervalMs(const Entry& entry) const;
+    void collectSample();
+
+    TmuxController* m_tmux = nullptr;
+    std::vector<Entry> m_entries;
+    int m_nextId = 0;
+    bool m_focused = true;
+
+    std::shared_ptr<Shared> m_shared;
+    bool m_inFlight = false;
+    bool m_stalled = false;         // 応答待ちが長引いて、この往復ではもう間隔を延ばした
+    std::chrono::steady_clock::time_point m_sentAt;
+    double m_srttMs = 0.0;          // 0はまだ測っていない
+    int m_backoff = 1;              // 回線が詰まっているときの倍率
+};
+
+} // namespace pbterm
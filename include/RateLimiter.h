@@ -0,0 +1,37 @@
+#pragma once
+
+#include <mutex>
+#include <chrono>
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+namespace pbterm {
+
+// 転送速度の上限（トークンバケット）
+// 複数の転送スレッドで共有し、合計の速度をbytesPerSecond以下に抑える
+// 短いバーストは0.25秒分まで許す（チャンク単位の待ちで速度が波打たないように）
+class RateLimiter {
+public:
+    RateLimiter() = default;
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // 0で無制限
+    void setRate(uint64_t bytesPerSecond);
+    uint64_t rate() const;
+
+    // bytes分の送受信を許可されるまで待つ（セッションロックの外で呼ぶこと）
+    // keepGoingがfalseを返したら待つのをやめてfalseを返す
+    bool acquire(size_t bytes, const std::function<bool()>& keepGoing = nullptr);
+
+private:
+    void refillLocked(std::chrono::steady_clock::time_point now);
+
+    mutable std::mutex m_mutex;
+    uint64_t m_rate = 0;
+    double m_tokens = 0.0;
+    std::chrono::steady_clock::time_point m_lastRefill;
+};
+
+} // namespace pbterm
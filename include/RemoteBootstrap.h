@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <functional>
+
+namespace pbterm {
+
+class SshConnection;
+
+// 接続直後に1回のexecで集めるリモートの情報
+struct RemoteFacts {
+    bool received = false;          // スクリプトの出力を受け取れた（POSIXシェルが使えた）
+    std::string os;                 // uname -s（Windowsなどでは空）
+    std::string home;               // $HOME
+    std::string shell;              // $SHELL（ログインシェル）
+    std::string tmuxPath;           // 見つからなければ空
+    std::string tmuxVersion;        // tmux -V（例: "tmux 3.4"）
+    bool sessionExisted = false;    // 接続前からセッションがあった
+    bool sessionReady = false;      // セッションがある（なければ作成した）
+    std::string windowListing;      // list-windowsの出力（TmuxController::parseWindowListの形式）
+
+    bool isUnix() const;
+};
+
+// リモートの環境を調べ、tmuxセッションがなければ作成して、ウィンドウ一覧までを1往復で取得する
+// OS・ホーム・シェル・tmuxのパスとバージョン・セッションの有無・ウィンドウ一覧を
+// "key=value" の行で返すスクリプトを sh -c で1回だけ実行する（ログインシェルがfishやcshでも動くように）
+// 個別にexecすると1項目ごとにチャンネルを開く往復がかかり、遅い回線では接続完了が数秒遅れる
+// createSession=falseのときはセッションを作らずに調べるだけ（キャッシュの再検証用）
+bool runRemoteBootstrap(SshConnection& connection, const std::string& sessionName,
+                        RemoteFacts& facts, std::string& error,
+                        bool createSession = true, const std::function<bool()>& keepGoing = nullptr);
+
+} // namespace pbterm
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include "TmuxController.h"
+
+namespace pbterm {
+
+class TerminalDock;
+class PollScheduler;
+
+// tmuxセッション一覧ドック
+// 全セッションとウィンドウを並べ、ウィンドウごとにアクティブなペインの縮小プレビューを表示する
+// 一覧もプレビューもPollSchedulerに登録してコントロールモードのストリームで裏で取り、描画は手元の写しを使うだけ
+// プレビューはwindow_activityが変わったペインだけを、数個ずつcapture-paneで取り直す（ドックを表示している間だけ）
+class SessionDock {
+public:
+    SessionDock();
+    ~SessionDock();
+
+    void setTmuxController(TmuxController* tmux) { m_tmux = tmux; }
+    void setTerminalDock(TerminalDock* dock) { m_terminalDock = dock; }
+    // 一覧とプレビューの取り直しを登録する（setTmuxControllerの後）
+    void setPollScheduler(PollScheduler* scheduler);
+    void setLanguage(int language) { m_language = language; }
+
+    void render();
+    void onDisconnected();
+
+private:
+    struct Preview {
+        long long activity = -1;        // 取り込んだときのwindow_activity
+        std::vector<std::string> lines;
+    };
+    // 読み取りスレッドから届いた一覧とプレビュー
+    struct Shared;
+
+    // 読み取りスレッドから届いたものを取り込む
+    void takeUpdates();
+    // 表示しているか（PollSchedulerから呼ばれる、隠れている間は取りに行かない）
+    bool isVisible() const;
+    void appendPreviewQueries(std::vector<TmuxController::Command>& batch);
+    void renderPreview(const std::string& paneId, bool current, float width, bool& clicked);
+    void pick(const TmuxSession& session, int windowIndex);
+
+    TmuxController* m_tmux = nullptr;
+    TerminalDock* m_terminalDock = nullptr;
+    PollScheduler* m_scheduler = nullptr;
+    int m_listPollId = 0;
+    int m_previewPollId = 0;
+    int m_language = 0;
+    int m_renderedFrame = -1;       // 最後に描いたフレーム
+
+    std::shared_ptr<Shared> m_shared;
+    std::vector<TmuxSession> m_sessions;
+    std::map<std::string, Preview> m_previews;      // pane_id → プレビュー
+};
+
+} // namespace pbterm
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+
+namespace pbterm {
+
+// セッションロックを待つときの優先度（小さいほど先に取得できる）
+enum class SessionPriority {
+    Interactive = 0,    // ターミナルの入出力
+    Control = 1,        // exec・一覧取得など（既定）
+    BulkHigh = 2,       // 転送（優先度: 高）
+    BulkNormal = 3,     // 転送（優先度: 通常）
+    BulkLow = 4         // 転送（優先度: 低）
+};
+
+// 1つのssh_sessionを共有するチャンネル間のロック
+// std::mutexと同じく lock()/unlock() で使い（std::lock_guard<SessionLock>）、
+// 解放時は待っているスレッドのうち最も優先度の高いものに渡す（同じ優先度の中では到着順）
+// 優先度はスレッドごとに PriorityScope で設定する（転送ワーカーはBulk*、ターミナルはInteractive）
+// 大きな転送がlibssh呼び出しのたびにロックを取り直しても、ターミナルの入出力が先に通る
+class SessionLock {
+public:
+    SessionLock() = default;
+    SessionLock(const SessionLock&) = delete;
+    SessionLock& operator=(const SessionLock&) = delete;
+
+    void lock();
+    void unlock();
+
+    static SessionPriority threadPriority();
+    // このスレッドの優先度を変える（PriorityScopeの中で使えば、抜けるときに元へ戻る）
+    static void setThreadPriority(SessionPriority priority);
+
+    // スコープの間だけ、このスレッドの優先度を変える
+    class PriorityScope {
+    public:
+        explicit PriorityScope(SessionPriority priority);
+        ~PriorityScope();
+
+        PriorityScope(const PriorityScope&) = delete;
+        PriorityScope& operator=(const PriorityScope&) = delete;
+
+    private:
+        SessionPriority m_previous;
+    };
+
+private:
+    static constexpr int kLevels = 5;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    bool m_locked = false;
+    int m_waiting[kLevels] = {};
+    uint64_t m_nextTicket[kLevels] = {};
+    uint64_t m_serving[kLevels] = {};
+};
+
+} // namespace pbterm
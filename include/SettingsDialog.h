@@ -50,6 +50,8 @@ struct Localization {
     const char* menuTerminal;
     const char* menuCommands;
     const char* menuFolders;
+    const char* menuTransfers;
+    const char* menuSessions;
     const char* menuOption;
 
     // 接続状態
@@ -97,6 +99,13 @@ struct Localization {
 
     // ターミナル
     const char* termPleaseConnect;
+    const char* termHistory;
+    const char* termHistoryEmpty;
+    const char* termCopyLastOutput;
+    const char* termHistoryExit;
+    const char* termHistoryTime;
+    const char* termHistoryCommand;
+    const char* termHistoryRunning;
 
     // フォルダツリー
     const char* dockFoldersTitle;
@@ -120,6 +129,55 @@ struct Localization {
     const char* folderDownload;
     const char* folderDownloadComplete;
     const char* folderOpenInFinder;
+
+    // 転送キュー
+    const char* transferQueued;
+    const char* transferScanning;
+    const char* transferRunning;
+    const char* transferPaused;
+    const char* transferCompleted;
+    const char* transferFailed;
+    const char* transferCancelled;
+    const char* transferPause;
+    const char* transferResume;
+    const char* transferCancel;
+    const char* transferRetry;
+    const char* transferClearFinished;
+    const char* transferEmpty;
+    const char* transferFiles;
+    const char* transferSyncMode;
+    const char* transferSyncHashes;
+    const char* transferDryRun;
+    const char* transferReport;
+    const char* transferReportTitle;
+    const char* transferClose;
+    const char* transferArchiveMode;
+    const char* transferCompress;
+    const char* transferVerify;
+    const char* transferVerifying;
+    const char* transferRateLimit;
+    const char* transferPriority;
+    const char* transferPriorityHigh;
+    const char* transferPriorityNormal;
+    const char* transferPriorityLow;
+
+    // 接続の進捗
+    const char* connectTitle;
+    const char* connectStageResolve;
+    const char* connectStageConnect;
+    const char* connectStageAuth;
+    const char* connectStageBootstrap;
+    const char* connectStageOpenShell;
+    const char* connectCancel;
+    const char* connectCancelling;
+    const char* connectFailed;
+    const char* connectClose;
+    const char* statusConnecting;
+
+    // tmuxセッション一覧
+    const char* sessionsUnavailable;
+    const char* sessionsEmpty;
+    const char* sessionsCurrent;
 };
 
 // 言語取得
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <libssh/libssh.h>
+#include <libssh/sftp.h>
+#include "SessionLock.h"
+
+namespace pbterm {
+
+// SFTPセッションプール
+// sftp_new/sftp_initはチャンネルオープンとサブシステムのハンドシェイクで
+// 数往復かかるため、初期化済みのセッションを接続ごとに使い回す
+// エラーで壊れたセッションは返却時に破棄され、次回の取得で自動的に作り直される
+class SftpSessionPool : public std::enable_shared_from_this<SftpSessionPool> {
+public:
+    // 借用中のSFTPセッション（スコープを抜けると自動的にプールへ返却）
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(std::shared_ptr<SftpSessionPool> pool, sftp_session sftp);
+        ~Lease();
+
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        sftp_session get() const { return m_sftp; }
+        explicit operator bool() const { return m_sftp != nullptr; }
+
+        // 直前の操作でセッションが使えなくなった可能性があれば破棄対象にする
+        // （ファイル単位のエラーではセッションを維持する）
+        void checkError();
+        // 無条件に破棄対象にする
+        void markBroken() { m_broken = true; }
+        bool isBroken() const { return m_broken; }
+
+        // 明示的に返却
+        void release();
+
+    private:
+        std::shared_ptr<SftpSessionPool> m_pool;
+        sftp_session m_sftp = nullptr;
+        bool m_broken = false;
+    };
+
+    SftpSessionPool(ssh_session session, SessionLock* sessionMutex, size_t maxSessions = 4);
+    ~SftpSessionPool();
+
+    // セッションを借りる（上限まで使用中なら返却を待つ）
+    // 呼び出し側はセッションミューテックスを保持していてはならない
+    Lease acquire(std::string* error = nullptr);
+
+    // プールを閉じて待機中のセッションを解放する
+    // ssh_freeの前に、セッションミューテックスを保持した状態で呼ぶこと
+    void shutdownLocked();
+
+    size_t maxSessions() const { return m_maxSessions; }
+
+    // SFTPのエラーがセッション自体の異常（ファイル単位ではない）かどうか
+    static bool isSessionError(sftp_session sftp);
+
+private:
+    void giveBack(sftp_session sftp, bool broken);
+
+    ssh_session m_session = nullptr;
+    SessionLock* m_sessionMutex = nullptr;
+    size_t m_maxSessions;
+
+    std::mutex m_poolMutex;
+    std::condition_variable m_poolCv;
+    std::vector<sftp_session> m_idle;
+    size_t m_total = 0;      // 使用中 + 待機中のセッション数
+    bool m_closed = false;
+};
+
+} // namespace pbterm
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <libssh/libssh.h>
+#include <libssh/sftp.h>
+#include "SessionLock.h"
+
+namespace pbterm {
+
+class RateLimiter;
+
+// 同時に投げておくSFTPリクエスト数（ウィンドウ）の自動調整
+// 完了したリクエストの往復時間の最小値をRTT、一定区間の完了バイト数から帯域を推定し、
+// 帯域遅延積（BDP）を満たすだけのリクエストを送りっぱなしにする
+class AdaptiveWindow {
+public:
+    AdaptiveWindow(size_t chunkSize, int minWindow = 4, int maxWindow = 128);
+
+    // リクエスト1件が完了した時に呼ぶ
+    void onComplete(size_t bytes, std::chrono::steady_clock::duration elapsed);
+
+    int window() const { return m_window; }
+    double rttMs() const { return m_minRttMs; }
+    double bytesPerSecond() const { return m_bytesPerSec; }
+
+private:
+    size_t m_chunkSize;
+    int m_minWindow;
+    int m_maxWindow;
+    int m_window;
+
+    double m_minRttMs = 0.0;
+    double m_bytesPerSec = 0.0;
+
+    // 帯域計測区間
+    std::chrono::steady_clock::time_point m_sampleStart;
+    uint64_t m_sampleBytes = 0;
+    int m_sampleCount = 0;
+};
+
+// 転送中の進捗通知と中断制御
+// onProgressはこのファイルの転送済みバイト数（累計）を通知する
+// checkpointはリクエストを送る前に呼ばれ、falseを返すと転送を中断する（一時停止はこの中で待つ）
+// resumeがtrueの場合、転送先に途中までのファイルがあれば末尾を照合して続きから転送する
+// rateLimiterを設定すると、送受信したバイト数に応じて待ち、速度を上限以下に抑える（ロック外で待つ）
+struct TransferHooks {
+    std::function<void(uint64_t)> onProgress;
+    std::function<bool()> checkpoint;
+    bool resume = false;
+    RateLimiter* rateLimiter = nullptr;
+};
+
+// パイプライン化されたSFTPファイル転送
+// libsshの非同期API（sftp_aio_*）で複数の読み書きリクエストを同時に送り、
+// 高遅延回線でもリクエスト毎の往復待ちで帯域が頭打ちにならないようにする
+// セッションミューテックスはlibssh呼び出しの間だけ保持する
+class SftpTransfer {
+public:
+    SftpTransfer(sftp_session sftp, SessionLock& sessionMutex);
+
+    void setHooks(const TransferHooks& hooks) { m_hooks = hooks; }
+
+    // リモートファイルをローカルにダウンロード（offset以降のみ転送し、ローカルはoffsetで切り詰めて追記）
+    bool download(const std::string& remotePath, const std::string& localPath, uint64_t offset = 0);
+    // ローカルファイルをリモートにアップロード（offset以降のみ転送し、リモートの先頭部分は残す）
+    bool upload(const std::string& localPath, const std::string& remotePath, uint64_t offset = 0);
+    // ファイルの一部だけを転送する（転送先の長さは変えず、範囲内を上書きする）
+    bool uploadRange(const std::string& localPath, const std::string& remotePath, uint64_t offset, uint64_t length);
+    bool downloadRange(const std::string& remotePath, const std::string& localPath, uint64_t offset, uint64_t length);
+
+    const std::string& lastError() const { return m_lastError; }
+    // 再開位置を含むファイル先頭からのバイト数
+    uint64_t bytesTransferred() const { return m_bytesTransferred; }
+    // checkpointにより中断されたかどうか
+    bool wasCancelled() const { return m_cancelled; }
+    // 応答を待たずに打ち切った（中断・タイムアウト）ため、セッションに未着の応答が残っているかどうか
+    bool abandonedSession() const { return m_abandoned; }
+
+private:
+    // サーバーが許容する1リクエストあたりの最大長を取得
+    void queryLimits();
+    // 進捗通知と中断確認（中断する場合はfalse）
+    void reportProgress();
+    bool checkpoint();
+    // 速度制限の待ち（待っている間に中断された場合はfalse）
+    bool throttle(size_t bytes);
+    // 応答が届きそうになるまでロックを持たずに待つ
+    void waitForSocket();
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+    // 非ブロッキングのファイルで応答を待つ（待つ間はセッションロックを手放す）
+    ssize_t waitRead(sftp_aio* aio, void* buffer, size_t length);
+    ssize_t waitWrite(sftp_aio* aio);
+    // 応答待ちを続けるか（中断・タイムアウトならリクエストを解放してfalse）
+    bool keepWaiting(sftp_aio* aio, std::chrono::steady_clock::time_point deadline);
+    void abandon(sftp_aio* aio);
+#endif
+
+    sftp_session m_sftp;
+    SessionLock& m_sessionMutex;
+
+    size_t m_readChunk = 32768;
+    size_t m_writeChunk = 32768;
+
+    TransferHooks m_hooks;
+
+    std::string m_lastError;
+    uint64_t m_bytesTransferred = 0;
+    bool m_cancelled = false;
+    bool m_abandoned = false;
+};
+
+} // namespace pbterm
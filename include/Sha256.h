@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace pbterm {
+
+// SHA-256（転送データの照合用）
+// リモート側のsha256sum/shasumと同じダイジェストを得るために使う
+class Sha256 {
+public:
+    Sha256();
+
+    void update(const void* data, size_t len);
+    // ダイジェストを16進文字列で返す（呼び出し後は再利用不可）
+    std::string hexDigest();
+
+    // ローカルファイルの指定範囲のダイジェスト（読み取り失敗時は空文字列）
+    static std::string hashFileRange(const std::string& path, uint64_t offset, uint64_t length);
+
+private:
+    void transform(const uint8_t* block);
+
+    uint32_t m_state[8];
+    uint8_t m_buffer[64];
+    size_t m_bufferLen = 0;
+    uint64_t m_totalLen = 0;
+};
+
+} // namespace pbterm
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace pbterm {
+
+// 書き手1つ・読み手1つのロックなしのリングバッファ
+// pushは書き手のスレッドだけ、popは読み手のスレッドだけが呼ぶ（書き手が複数なら外側で直列化する）
+// 満杯のときpushはfalseを返し、値は捨てる
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacityは2のべき乗にする");
+
+public:
+    bool push(T value) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        m_slots[tail & (Capacity - 1)] = std::move(value);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(m_slots[head & (Capacity - 1)]);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    std::array<T, Capacity> m_slots;
+    // 書き手と読み手が同じキャッシュラインを取り合わないように離す
+    alignas(64) std::atomic<size_t> m_head{0};
+    alignas(64) std::atomic<size_t> m_tail{0};
+};
+
+} // namespace pbterm
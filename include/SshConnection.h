@@ -7,10 +7,15 @@
 #include <mutex>
 #include <vector>
 #include <memory>
+#include <cstdint>
 #include <libssh/libssh.h>
+#include "SessionLock.h"
 
 namespace pbterm {
 
+class SftpSessionPool;
+struct TransferHooks;
+
 // SSH接続設定
 struct SshConfig {
     std::string host;
@@ -26,23 +31,64 @@ struct SshConfig {
     }
 };
 
+// exec出力のストリーミング受信用コールバック
+// onStdout/onStderrはデータ到着ごとに呼ばれる（falseを返すとコマンドを中断）
+// onExitは終了ステータス確定時に一度だけ呼ばれる（不明な場合は-1）
+// onStdinを設定するとコマンドの標準入力へ送るデータを要求する（bufferに書いたバイト数を返す、0で入力終了）
+// onStdinはデータが用意できるまでブロックしてよい（セッションロック外で呼ばれる）
+// keepGoingを設定すると読み取りの区切りごとに呼び、falseならコマンドを中断する（出力が来なくても止められる）
+struct ExecCallbacks {
+    std::function<bool(const char*, size_t)> onStdout;
+    std::function<bool(const char*, size_t)> onStderr;
+    std::function<void(int)> onExit;
+    std::function<size_t(char*, size_t)> onStdin;
+    std::function<bool()> keepGoing;
+};
+
+// リモートディレクトリのエントリ（SFTP経由で取得）
+struct RemoteEntry {
+    std::string name;
+    bool isDir = false;
+    uint64_t size = 0;
+    uint64_t mtime = 0;       // 更新時刻（UNIX秒）
+    uint32_t permissions = 0;
+};
+
+// 接続の段階（進捗表示用）
+enum class ConnectPhase {
+    Resolve,    // ssh_configの適用（HostName・Port・ProxyCommand/ProxyJump）
+    Connect,    // 名前解決・TCP接続（プロキシ経由を含む）と鍵交換
+    Auth        // ユーザー認証
+};
+
+// 段階の通知と中断に対応した接続用フック（UIスレッド以外から接続するとき用）
+struct ConnectHooks {
+    std::function<bool()> keepGoing;              // falseを返すと中断
+    std::function<void(ConnectPhase)> onPhase;    // 段階が進むたびに呼ばれる
+};
+
 // SSHチャンネル（個別のシェルセッション）
 class SshChannel {
 public:
     using DataCallback = std::function<void(const char*, size_t)>;
 
-    SshChannel(ssh_session session, std::mutex* sessionMutex);
+    SshChannel(ssh_session session, SessionLock* sessionMutex);
     ~SshChannel();
 
     // シェルを開く
     bool openShell(int cols, int rows);
     // コマンド実行用チャンネルを開く（PTYなし）
     bool openExec();
+    // コマンドを実行したまま開いておく（PTYなし、標準出力は読み取りスレッドからDataCallbackへ、writeで標準入力へ）
+    // tmux -C のように1本のストリームでやり取りを続けるコマンド用
+    bool openCommand(const std::string& cmd);
     void close();
     bool isOpen() const { return m_channel != nullptr && m_running; }
 
     // コマンドを実行して結果を取得（execモード用）
     std::string exec(const std::string& cmd, int timeoutMs = 5000);
+    // コマンドを実行し、出力を逐次コールバックで受け取る（戻り値は終了ステータス、失敗時は-1）
+    int execStream(const std::string& cmd, const ExecCallbacks& callbacks, int timeoutMs = 5000);
 
     // データ送受信
     void write(const char* data, size_t len);
@@ -56,7 +102,7 @@ private:
 
     ssh_session m_session = nullptr;
     ssh_channel m_channel = nullptr;
-    std::mutex* m_sessionMutex = nullptr;  // セッション全体のミューテックス（共有）
+    SessionLock* m_sessionMutex = nullptr;  // セッション全体のロック（共有、優先度付き）
     std::thread m_readerThread;
     std::atomic<bool> m_running{false};
     DataCallback m_dataCallback;
@@ -73,11 +119,18 @@ public:
 
     // 接続/切断
     bool connect(const SshConfig& config);
+    // 段階ごとに通知しながら接続する（待ちはすべて短く区切り、keepGoingで中断できる）
+    bool connect(const SshConfig& config, const ConnectHooks& hooks);
     void disconnect();
     bool isConnected() const;
+    // 接続先の識別子（user@host:port、転送ジャーナルの照合用）
+    std::string endpoint() const { return m_endpoint; }
 
     // 新しいチャンネル（シェル）を作成
-    std::shared_ptr<SshChannel> createChannel(int cols, int rows);
+    // onDataを渡すと読み取り開始前に設定する（後からsetDataCallbackすると最初の出力を取りこぼしうる）
+    std::shared_ptr<SshChannel> createChannel(int cols, int rows, DataCallback onData = nullptr);
+    // コマンドを実行し続けるチャンネルを作成（SshChannel::openCommand、切断時にまとめて閉じる）
+    std::shared_ptr<SshChannel> createCommandChannel(const std::string& cmd, DataCallback onData);
 
     // 後方互換性のための旧API（最初のチャンネルを使用）
     bool openShell(int cols, int rows);
@@ -88,27 +141,59 @@ public:
 
     // コマンドを実行して結果を取得（execモード、PTYなし）
     std::string exec(const std::string& cmd, int timeoutMs = 5000);
+    // コマンドを実行し、stdout/stderrを到着順にコールバックで受け取る（execモード、PTYなし）
+    // 出力全体をメモリに保持しないため、大きな出力も一定メモリで処理できる
+    // timeoutMsは無通信状態が続いた場合のタイムアウト
+    int execStream(const std::string& cmd, const ExecCallbacks& callbacks, int timeoutMs = 5000);
 
-    // エラーメッセージ
-    std::string lastError() const { return m_lastError; }
+    // エラーメッセージ（転送ワーカーなど複数スレッドから更新されうる）
+    std::string lastError() const;
 
     // SCPファイル転送
     // ローカルファイルをリモートにアップロード
     bool uploadFile(const std::string& localPath, const std::string& remotePath);
     // リモートファイルをローカルにダウンロード
     bool downloadFile(const std::string& remotePath, const std::string& localPath);
+    // 進捗通知・中断に対応した単一ファイル転送（並列実行用、エラーはerrorに格納しlastErrorは更新しない）
+    bool uploadFile(const std::string& localPath, const std::string& remotePath,
+                    const TransferHooks& hooks, std::string& error);
+    bool downloadFile(const std::string& remotePath, const std::string& localPath,
+                      const TransferHooks& hooks, std::string& error);
+    // ファイルの一部だけを転送先へ上書きする（検証で不一致だったチャンクの修復用）
+    bool transferRange(bool upload, const std::string& localPath, const std::string& remotePath,
+                       uint64_t offset, uint64_t length, const TransferHooks& hooks, std::string& error);
     // ディレクトリをアップロード（再帰的）
     bool uploadDirectory(const std::string& localPath, const std::string& remotePath);
     // ディレクトリをダウンロード（再帰的）
     bool downloadDirectory(const std::string& remotePath, const std::string& localPath);
 
+    // リモートディレクトリの一覧を取得（SFTP、"."と".."は除く）
+    bool listDirectory(const std::string& remotePath, std::vector<RemoteEntry>& entries);
+    // リモートパスの情報を取得（SFTP stat、シンボリックリンクは辿る）
+    bool statRemote(const std::string& remotePath, RemoteEntry& entry);
+    // リモートディレクトリを順に作成（既存のものは成功扱い、親を先に並べること）
+    bool makeRemoteDirectories(const std::vector<std::string>& remotePaths, std::string& error);
+    // 小さなリモートファイルを内容ごと書き込む（既存の場合は上書き）
+    bool writeRemoteFile(const std::string& remotePath, const std::string& data, std::string& error);
+    // リモートファイルの更新時刻を設定（同期の比較に使う）
+    bool setRemoteMtime(const std::string& remotePath, int64_t mtime);
+
 private:
     ssh_session m_session = nullptr;
     std::vector<std::shared_ptr<SshChannel>> m_channels;
     std::shared_ptr<SshChannel> m_defaultChannel;
     std::atomic<bool> m_connected{false};
+    std::string m_endpoint;
+    void setLastError(const std::string& error);
+    // 途中まで転送済みのファイルの末尾をSHA-256で照合し、再開できる位置を返す（不可なら0）
+    uint64_t findResumeOffset(bool upload, const std::string& localPath, const std::string& remotePath);
+
     std::string m_lastError;
-    std::mutex m_mutex;
+    mutable std::mutex m_errorMutex;
+    SessionLock m_mutex;
+
+    // 転送・一覧取得で使い回すSFTPセッション
+    std::shared_ptr<SftpSessionPool> m_sftpPool;
 };
 
 } // namespace pbterm
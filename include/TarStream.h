@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <functional>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+namespace pbterm {
+
+// tarアーカイブのストリーミング作成
+// GNU形式（100バイトを超える名前は././@LongLink）で書き出し、GNU tar / bsdtar / busyboxで展開できる
+// 出力はsinkへ順に渡すので、アーカイブ全体をメモリやディスクに置かない
+class TarWriter {
+public:
+    using Sink = std::function<bool(const char*, size_t)>;
+    // ファイル内容を書き込むたびに書き込んだバイト数で呼ばれる（falseを返すと中断）
+    using ProgressCallback = std::function<bool(uint64_t)>;
+
+    explicit TarWriter(Sink sink);
+
+    bool addDirectory(const std::string& name, uint32_t mode, int64_t mtime);
+    // ファイルを追加（読み取り中にサイズが変わった場合も宣言したサイズで書き、lastErrorに記録する）
+    bool addFile(const std::string& name, const std::string& localPath, uint64_t size,
+                 uint32_t mode, int64_t mtime, const ProgressCallback& onBytes);
+    // 終端ブロックを書く
+    bool finish();
+
+    const std::string& lastError() const { return m_lastError; }
+
+private:
+    bool writeHeader(const std::string& name, char type, uint64_t size, uint32_t mode, int64_t mtime);
+    bool writePadding(uint64_t size);
+
+    Sink m_sink;
+    std::string m_lastError;
+};
+
+// tarアーカイブのストリーミング展開
+// 受信したデータを順にfeed()へ渡すと、ヘッダを解釈しながらdestination以下へ書き出す
+// 通常ファイルとディレクトリのみを展開し、絶対パスや".."を含むエントリは拒否する
+class TarReader {
+public:
+    // ファイル内容を書き出すたびに書き出したバイト数で呼ばれる（falseを返すと中断）
+    using ProgressCallback = std::function<bool(uint64_t)>;
+
+    explicit TarReader(const std::string& destination);
+    ~TarReader();
+
+    void setProgressCallback(ProgressCallback callback) { m_onBytes = std::move(callback); }
+
+    bool feed(const char* data, size_t len);
+    // 終端まで読み終えたか確認（途中で切れたアーカイブはエラー）
+    bool finish();
+
+    int fileCount() const { return m_fileCount; }
+    const std::string& lastError() const { return m_lastError; }
+
+private:
+    enum class Phase {
+        Header,
+        FileData,   // 通常ファイルの内容
+        SkipData,   // 展開しないエントリの内容
+        LongName,   // GNUの長いファイル名
+        PaxHeader,  // pax拡張ヘッダ
+        Padding,
+        End
+    };
+
+    bool processHeader();
+    void applyPaxRecords(const std::string& records);
+    bool beginEntry(const std::string& name, char type, uint64_t size, uint32_t mode, int64_t mtime);
+    bool finishFile();
+    // アーカイブ内のパスを展開先のパスに変換（不正なパスは空文字列）
+    std::string resolvePath(const std::string& name) const;
+
+    std::string m_destination;
+    ProgressCallback m_onBytes;
+
+    Phase m_phase = Phase::Header;
+    char m_header[512];
+    size_t m_headerFill = 0;
+    int m_zeroBlocks = 0;
+
+    uint64_t m_remaining = 0;     // 現在のエントリの残りデータ長
+    uint64_t m_padding = 0;       // 512バイト境界までの残り
+    std::string m_extended;       // LongName/PaxHeaderの内容
+    std::string m_nextName;       // 次のエントリに使う名前（LongName/pax）
+    uint64_t m_nextSize = 0;      // paxで指定された次のエントリのサイズ
+    bool m_hasNextSize = false;
+
+    std::ofstream m_file;
+    std::string m_filePath;
+    uint32_t m_fileMode = 0;
+    int64_t m_fileMtime = 0;
+
+    int m_fileCount = 0;
+    std::string m_lastError;
+};
+
+} // namespace pbterm
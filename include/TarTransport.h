@@ -0,0 +1,38 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+namespace pbterm {
+
+class SshConnection;
+struct TransferHooks;
+
+// tarストリームによるディレクトリ転送
+// ファイルごとにSFTPの往復を繰り返さず、1本のexecチャンネルでアーカイブを流す
+// （リモートはtar -x / tar -c、ローカルはワーカースレッドで逐次作成・展開）
+// 多数の小さなファイルを含むツリーで有効。リモートにtarが無い場合は呼び出し側がSFTPに切り替える
+class TarTransport {
+public:
+    explicit TarTransport(SshConnection* connection);
+
+    // リモートでtarが使えるか
+    bool remoteHasTar();
+    // gzip圧縮に対応しているか（zlib付きでビルドされた場合）
+    static bool compressionSupported();
+
+    // リモートディレクトリ内のファイル数と合計サイズ（進捗表示用の概算、取得できない項目は0）
+    bool remoteTreeSize(const std::string& remoteDir, int& fileCount, uint64_t& totalBytes);
+
+    // localDirの中身をremoteDir以下へ展開する（remoteDirは無ければ作る）
+    bool upload(const std::string& localDir, const std::string& remoteDir, bool compress,
+                const TransferHooks& hooks, std::string& error);
+    // remoteDirの中身をlocalDir以下へ展開する
+    bool download(const std::string& remoteDir, const std::string& localDir, bool compress,
+                  const TransferHooks& hooks, std::string& error);
+
+private:
+    SshConnection* m_connection = nullptr;
+};
+
+} // namespace pbterm
@@ -2,11 +2,16 @@
 
 #include <string>
 #include <vector>
+#include <deque>
 #include <memory>
 #include <mutex>
 #include <chrono>
+#include <functional>
+#include <map>
 #include <vterm.h>
 #include "imgui.h"
+#include "SpscQueue.h"
+#include "TriggerEngine.h"
 
 namespace pbterm {
 
@@ -51,20 +56,49 @@ struct TerminalCell {
     bool underline = false;
     bool reverse = false;
     int width = 1;  // セル幅（全角=2, 半角=1）
+    uint8_t trigger = 0;    // 一致したトリガーの規則番号+1（0はなし、スクロールバックの行だけで使う）
+};
+
+// 読み取りスレッド（パーサ）からUIスレッドへ渡す通知（OSC）
+struct TerminalEvent {
+    enum class Type {
+        Directory,      // OSC 7（file://host/path のパス）
+        Title,          // OSC 0 / 2
+        Trigger         // 通知するトリガーが一致した（"規則名: 行"）
+    };
+
+    Type type = Type::Title;
+    std::string text;
+};
+
+// シェル統合（OSC 133）で記録したコマンド（commandHistoryで返す写し）
+struct TerminalCommand {
+    std::string command;
+    int exitCode = -1;          // 不明なら-1
+    double durationMs = 0.0;    // 実行中なら今までの経過時間
+    bool running = false;
+    int64_t promptLine = 0;     // jumpToLineに渡す行
 };
 
 // ターミナルエミュレータ（libvterm使用）
 class Terminal {
 public:
+    using InputHandler = std::function<void(const char*, size_t)>;
+
     Terminal(int cols = 80, int rows = 24);
     ~Terminal();
 
     // SSHチャンネルを設定
-    void setChannel(std::shared_ptr<SshChannel> channel);
+    // bindOutput=falseのときは受信コールバックを設定しない（createChannelで既にonDataへつないだ場合）
+    void setChannel(std::shared_ptr<SshChannel> channel, bool bindOutput = true);
 
     // 後方互換性（旧API）
     void setConnection(SshConnection* connection);
 
+    // キー入力の送り先をチャンネルの代わりに設定する（tmuxのコントロールモードでペインへsend-keysする用）
+    // 設定中はlibvtermが返す応答（DA・DSRなど）を送らない（アプリへの応答はtmux自身が返している）
+    void setInputHandler(InputHandler handler) { m_inputHandler = std::move(handler); }
+
     // データ受信（SSH経由）
     void onData(const char* data, size_t len);
 
@@ -77,23 +111,46 @@ public:
 
     // 描画
     void render(ImFont* font);
+    // 分割表示用: posに今の画面だけを描く（子ウィンドウ・スクロールバック・マウス選択なし）
+    // 複数のペインを呼び出し側の1つの描画リストへまとめて描く。focusedならキー入力も受け取る
+    void renderPane(ImDrawList* drawList, const ImVec2& pos, ImFont* font, bool focused);
 
     // カラーテーマ設定
     void setColorTheme(const std::string& themeId);
     const TerminalColorTheme& getColorTheme() const { return m_colorTheme; }
 
+    // 出力に当てるトリガー（nullptrで外す、スクロールバックと画面は当て直す）
+    void setTriggers(std::shared_ptr<const TriggerEngine> triggers);
+
     // 画面クリア（タブ切り替え用）
     void clearScreen();
 
+    // スクロールバックの先頭（古い側）へ行を足す（tmuxの capture-pane -e の出力、古い行が先）
+    // epochはscrollbackEpoch()で取ったもの。リサイズ・クリアでスクロールバックを捨てていたら足さない
+    // これ以上足せない（epochが違う・スクロールバックがいっぱい）ならfalse
+    bool prependScrollback(const std::string& captured, unsigned epoch);
+    // スクロールバックを捨てるたびに増える
+    unsigned scrollbackEpoch();
+
     // サイズ取得
     int cols() const { return m_cols; }
     int rows() const { return m_rows; }
 
-    // カレントディレクトリ（OSC経由で取得）
-    std::string currentDirectory() const { return m_currentDirectory; }
+    // OSCの通知を届いた順に1つ取り出す（UIスレッドから呼ぶ、なければfalse）
+    bool takeEvent(TerminalEvent& event) { return m_events.pop(event); }
+
+    // シェル統合（OSC 133）の索引
+    // 古い順のコマンド一覧（スクロールバックから落ちたものは含まない）
+    std::vector<TerminalCommand> commandHistory();
+    // 最後に終わったコマンドの出力（なければ空）
+    std::string lastCommandOutput();
+    // 前（direction<0）・次のプロンプトへスクロールする（次の描画で反映、Ctrl+Shift+↑↓でも呼ばれる）
+    void jumpToPrompt(int direction);
+    void jumpToLine(int64_t line);
 
     // libvtermコールバック（publicにする必要がある）
     static int onDamage(VTermRect rect, void* user);
+    static int onMoveRect(VTermRect dest, VTermRect src, void* user);
     static int onMoveCursor(VTermPos pos, VTermPos oldpos, int visible, void* user);
     static int onSetTermProp(VTermProp prop, VTermValue* val, void* user);
     static int onBell(void* user);
@@ -104,16 +161,52 @@ public:
 
     // 出力コールバック用（vterm経由でSSHに送信）
     void sendToConnection(const char* data, size_t len);
+    // libvtermからの応答（端末への問い合わせに対する返答）
+    void sendReply(const char* data, size_t len);
 
 private:
     // 内部ヘルパー
     void updateScreen();
+    // 描画の共通部分（originは画面の左上、m_mutexを取って呼ぶ）
+    void drawScreenCells(ImDrawList* drawList, const ImVec2& origin, const ImVec2& charSize);
+    void drawCursor(ImDrawList* drawList, const ImVec2& origin, const ImVec2& charSize, bool focused);
+    void handleKeyboard(const ImVec2& origin, const ImVec2& charSize);
     TerminalColor vtermColorToTerminalColor(VTermColor color);
+    // libvtermのセル1行をスクロールバックの行にする
+    std::vector<TerminalCell> scrollbackRow(int cols, const VTermScreenCell* cells);
+    // OSC 8の開始・終了（"params;URI"、URIが空なら終了）
+    void setHyperlink(const std::string& payload);
+    // OSC 133（"A" プロンプト / "B" コマンド入力 / "C" 出力開始 / "D;終了コード"）
+    void onShellMark(const std::string& payload);
+    // 通し番号の行のテキスト（画面ならlibvtermから読む、末尾の空白は除く、m_mutexを取って呼ぶ）
+    std::string lineText(int64_t line, int startCol) const;
+    // スクロールバックから落ちた行のコマンドを索引から除く
+    void trimCommandMarks();
+    // 画面のセルのリンク（なければ空、m_mutexを取って呼ぶ）
+    const std::string* linkAt(int row, int col) const;
+
+    // トリガー（m_mutexを取って呼ぶ）
+    // 行のテキストと、そのバイトごとの桁を作る
+    void screenRowText(int row, std::string& text, std::vector<int>& cols) const;
+    static void cellsRowText(const std::vector<TerminalCell>& cells, std::string& text, std::vector<int>& cols);
+    // textの一致をセルごとの規則番号+1へ書き、一致した通知の規則のビットを返す
+    uint64_t matchTriggers(const std::string& text, const std::vector<int>& cols, uint8_t* triggers, int count);
+    // スクロールバックへ押し出す行に当てる（まだ知らせていなければ通知も出す）
+    void triggerPushedRow(std::vector<TerminalCell>& row);
+    // 書き換わった画面の行だけに当て直す
+    void scanDirtyRows(bool notify);
+    // 通知するトリガーのうち、その行でまだ知らせていないものをUIスレッドへ送る
+    void notifyTriggers(int64_t line, uint64_t rules, const std::string& text);
+    // 一致したトリガーで文字の色と下線を変える
+    void applyTriggerStyle(uint8_t trigger, ImU32& color, bool& underline) const;
+    // セルを含むリンクのトリガーの文字列（なければ空、rowが負ならスクロールバック）
+    std::string triggerLinkAt(int row, int col) const;
 
     VTerm* m_vterm = nullptr;
     VTermScreen* m_screen = nullptr;
     std::shared_ptr<SshChannel> m_channel;
     SshConnection* m_connection = nullptr;  // 後方互換性用
+    InputHandler m_inputHandler;
 
     int m_cols;
     int m_rows;
@@ -124,15 +217,56 @@ private:
     std::vector<std::vector<TerminalCell>> m_cells;
     std::mutex m_mutex;
 
-    std::string m_currentDirectory;
+    // OSC（読み取りスレッドがm_mutexを取ったまま積み、UIスレッドがロックなしで取り出す）
+    // 断片に分かれて届くので、最後の断片まで貯めてから積む
+    SpscQueue<TerminalEvent, 64> m_events;
+    std::string m_oscBuffer;
+    std::string m_titleBuffer;
+
+    // OSC 8のリンク（画面のセルごとのリンク番号、0はなし）
+    // 書かれたセル（damage）に今のリンクを付け、スクロール（moverect）で一緒に動かす
+    std::vector<std::vector<uint16_t>> m_cellLinks;
+    std::vector<std::string> m_links;   // リンク番号-1 → URI
+    uint16_t m_activeLink = 0;
+
+    // トリガー（画面のセルごとの規則番号+1、リンクと同じくmoverectで一緒に動かす）
+    // damageで書き換わった行に印を付け、onDataの最後にその行だけ当て直す（押し出す行はonSbPushlineで当てる）
+    std::shared_ptr<const TriggerEngine> m_triggers;
+    std::vector<std::vector<uint8_t>> m_cellTriggers;
+    std::vector<uint8_t> m_rowDirty;
+    std::map<int64_t, uint64_t> m_notifiedRules;     // 画面の行の通し番号 → 知らせた規則のビット
+    std::string m_triggerText;                      // 当てるときの作業用
+    std::vector<int> m_triggerCols;
+    std::vector<TriggerMatch> m_triggerMatches;
+
+    // OSC 133の索引（行はスクロールバックへ押し出した行数からの通し番号なので、押し出しても書き換えない）
+    // 画面の行rowの通し番号は m_linesPushed + row、スクロールバックのi行目は m_linesPushed - size + i
+    struct CommandMark {
+        int64_t promptLine = -1;
+        int64_t commandLine = -1;
+        int64_t outputLine = -1;
+        int64_t endLine = -1;           // 出力の次の行（終わっていなければ-1）
+        int commandCol = 0;
+        int exitCode = -1;
+        std::chrono::steady_clock::time_point start;
+        std::chrono::steady_clock::time_point end;
+        std::string command;
+    };
+    std::deque<CommandMark> m_marks;
+    int64_t m_linesPushed = 0;
+    int m_pendingJump = 0;              // UIスレッドだけが触る
+    int64_t m_pendingJumpLine = -1;
 
     // カラーテーマ
     TerminalColorTheme m_colorTheme;
 
     // スクロールバック
-    std::vector<std::vector<TerminalCell>> m_scrollback;
+    // 先頭へも足すのでdeque
+    std::deque<std::vector<TerminalCell>> m_scrollback;
     static constexpr int MAX_SCROLLBACK = 10000;
     bool m_autoScroll = false;
+    unsigned m_scrollbackEpoch = 0;
+    int m_prependedRows = 0;        // 先頭へ足した行数（表示位置がずれないよう次の描画でスクロールを送る）
 
     // リサイズ中フラグ（リサイズ中はスクロールバックへのプッシュを抑制）
     bool m_resizing = false;
@@ -3,8 +3,8 @@
 #include <string>
 #include <vector>
 #include <memory>
-#include <chrono>
 #include "imgui.h"
+#include "TmuxController.h"
 
 namespace pbterm {
 
@@ -12,15 +12,24 @@ class Terminal;
 class SshConnection;
 class SshChannel;
 class TmuxController;
-struct TmuxWindow;
+class TmuxPaneTerminals;
+class PollScheduler;
+class TriggerEngine;
+struct ConnectedShell;
 
 // ターミナルタブ情報（tmuxウィンドウに対応）
-// 実際のターミナル表示は共有（tmuxの仕様上、同時に複数ウィンドウを見ることはできない）
+// コントロールモードではウィンドウのアクティブなペインごとにTerminalを持つ（切り替えは表示を差し替えるだけ）
+// シェルからアタッチした場合は1つのターミナルを共有する（tmuxのクライアントは1度に1ウィンドウしか映さない）
 struct TerminalTabInfo {
     int id;                          // ローカルID
     int tmuxWindowIndex = -1;        // tmuxウィンドウインデックス
     std::string name;                // タブ名（tmuxウィンドウ名）
     std::string currentPath;         // アクティブな作業ディレクトリ
+    std::string paneId;              // アクティブなペイン（コントロールモードのみ）
+    std::vector<TmuxPaneRect> panes; // ペインの配置（コントロールモードで2つ以上なら分割して表示）
+    std::string title;               // アクティブなペインがOSC 0/2で付けた題名（あればタブ名の代わりに出す）
+    bool pathFromOsc = false;        // currentPathをOSC 7で受け取った（tmuxの一覧より新しいので上書きしない）
+    std::string notice;              // 裏にある間に一致した通知のトリガー（表示すると消す）
 };
 
 // ターミナルドック
@@ -34,15 +43,19 @@ public:
     // SSH接続とtmuxコントローラを設定
     void setConnection(SshConnection* connection);
     void setTmuxController(TmuxController* tmux);
+    // 通知で届かない分のウィンドウ一覧の取り直しを登録する（setTmuxControllerの後）
+    void setPollScheduler(PollScheduler* scheduler);
 
     // 言語設定
     void setLanguage(int language) { m_language = language; }
 
     // カラーテーマ設定
     void setColorTheme(const std::string& themeId);
+    // 出力に当てるトリガー（今あるターミナルと、これから作るペインのターミナルに当てる）
+    void setTriggers(const std::shared_ptr<const TriggerEngine>& triggers);
 
-    // 接続状態
-    void onConnected();
+    // 接続状態（接続処理で開いたターミナルとチャンネルを受け取る）
+    void onConnected(ConnectedShell& shell);
     void onDisconnected();
     bool isConnected() const { return m_connected; }
 
@@ -66,19 +79,33 @@ public:
     // tmuxウィンドウ一覧が更新された時のコールバック
     void onTmuxWindowListChanged(const std::vector<TmuxWindow>& windows);
 
+    // 別のtmuxセッション（windowIndexが0以上ならそのウィンドウ）を表示する（コントロールモードのみ）
+    // windowsはセッション一覧で取ってあるもので、応答を待たずにタブを作り直す
+    void showTmuxSession(const std::string& session, const std::vector<TmuxWindow>& windows, int windowIndex);
+
 private:
     void renderTabs(ImFont* font);
     void renderTerminal(ImFont* font);
+    // アクティブなターミナルのコマンド履歴（OSC 133）のポップアップ
+    void renderCommandHistory();
+    // 分割されたウィンドウの全ペインを1つの描画リストへ描く
+    void renderSplitPanes(TerminalTabInfo& tab, ImFont* font);
+    // フレーム中に決まった表示の大きさを、変わっていれば1回だけtmuxへ知らせる
+    void flushClientSize();
+    // ターミナルに届いたOSCの通知でタブのパスと題名を更新する
+    void pumpTerminalEvents();
+    // tabがnullptrなら捨てるだけ、activePaneでなければトリガーの通知だけを使う
+    void applyTerminalEvents(TerminalTabInfo* tab, Terminal* terminal, bool activePane = true);
+    // 全タブのパスがOSC 7で届いている（ウィンドウ一覧でパスを取り直さなくてよい）
+    bool pathsFromOsc() const;
     std::string generateTabName();
 
-    // tmuxセッションにアタッチするSSHチャンネルを開く
-    bool openTmuxSession();
-
-    // tmuxなしで直接シェルを開く
-    bool openDirectShell();
-
     // 現在のタブに対応するtmuxウィンドウを選択
     void selectTmuxWindow(int windowIndex);
+    // タブに表示するターミナル（コントロールモードならペインごと、そうでなければ共有のもの）
+    Terminal* terminalForTab(const TerminalTabInfo& tab);
+    // タブの全ペインのターミナルを作っておく（コントロールモードのみ）
+    void preparePaneTerminals(const TerminalTabInfo& tab, std::vector<std::string>& paneIds);
 
     std::vector<TerminalTabInfo> m_tabs;
     int m_activeTab = -1;
@@ -88,16 +115,22 @@ private:
     bool m_connected = false;
     int m_language = 0;
 
-    // 共有のターミナル（tmuxの画面を表示）
+    // 共有のターミナル（シェルからアタッチしたtmuxの画面、またはtmuxなしのシェル）
     std::unique_ptr<Terminal> m_terminal;
     std::shared_ptr<SshChannel> m_channel;
 
+    // コントロールモードのペインごとのターミナル
+    std::unique_ptr<TmuxPaneTerminals> m_paneTerminals;
+    bool m_controlMode = false;
+    int m_clientCols = 0;           // tmuxへ知らせた表示の大きさ
+    int m_clientRows = 0;
+    int m_wantedCols = 0;           // このフレームで求めた表示の大きさ（render()の最後に送る）
+    int m_wantedRows = 0;
+
     // タブ幅計算用
     float m_tabHeight = 0;
     float m_closeButtonSize = 16.0f;
     float m_addButtonSize = 20.0f;
-
-    std::chrono::steady_clock::time_point m_lastWindowPoll;
 };
 
 } // namespace pbterm
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace pbterm {
+
+class SshChannel;
+class SshConnection;
+
+// tmuxコントロールモードの通知（%で始まる行）
+struct TmuxNotification {
+    enum class Type {
+        Output,                 // %output %pane data
+        WindowAdd,              // %window-add @window
+        WindowClose,            // %window-close / %unlinked-window-close @window
+        WindowRenamed,          // %window-renamed @window name
+        LayoutChange,           // %layout-change @window layout visible-layout flags
+        SessionWindowChanged,   // %session-window-changed $session @window（アクティブなウィンドウが変わった）
+        WindowPaneChanged,      // %window-pane-changed @window %pane
+        SubscriptionChanged,    // %subscription-changed name $session @window index %pane : value
+        SessionChanged,         // %session-changed $session name（アタッチ完了）
+        Exit,                   // %exit（クライアントが終了した）
+        Other
+    };
+
+    Type type = Type::Other;
+    std::string windowId;   // "@3"
+    std::string paneId;     // "%5"
+    std::string name;       // 購読名・セッション名
+    std::string value;      // 出力データ（エスケープを戻したもの）・新しい名前・表示中のレイアウト・購読の値
+};
+
+// tmux -C（コントロールモード）のクライアント
+// 1本のexecチャンネルでtmuxにアタッチしたままにし、コマンドも同じストリームへ書く
+// 応答は %begin ... %end（失敗時は %error）で囲まれて送った順に返るので、先入れ先出しで対応付ける
+// " ; " でつないだ1行はコマンドごとに応答が返り、%errorになるとその行の残りは実行されない
+// ウィンドウの追加・削除・改名などはtmuxから通知が届くため、一覧を定期的に取り直す必要がない
+// 通知と応答のコールバックはチャンネルの読み取りスレッドから呼ばれる
+// PTYを取らないので -CC ではなく -C を使う（-CCは端末の設定を前提にしている）
+class TmuxControlClient {
+public:
+    using NotifyCallback = std::function<void(const TmuxNotification&)>;
+    using ReplyCallback = std::function<void(bool ok, const std::string& output)>;
+
+    struct Command {
+        std::string text;
+        ReplyCallback onReply;
+    };
+
+    TmuxControlClient();
+    ~TmuxControlClient();
+    TmuxControlClient(const TmuxControlClient&) = delete;
+    TmuxControlClient& operator=(const TmuxControlClient&) = delete;
+
+    // セッションにアタッチする（なければ作成する、%session-changedが届くまで最大timeoutMs待つ）
+    // tmuxがすぐ終了した場合はfalse
+    bool start(SshConnection& connection, const std::string& tmuxPath, const std::string& sessionName,
+               NotifyCallback onNotify, int timeoutMs = 3000);
+    // デタッチして閉じる（応答待ちのコマンドは失敗扱いにする）
+    void stop();
+    bool isRunning() const;
+
+    // コマンドを送り、応答はonReplyで受け取る（待たない）
+    bool send(const std::string& command, ReplyCallback onReply = nullptr);
+    // 複数のコマンドを " ; " でつないだ1行で送る（応答はコマンドごと、途中で失敗すると残りもfalse）
+    bool sendBatch(std::vector<Command> commands);
+    // コマンドを送り、応答が届くまで待つ（コールバックの中から呼ばないこと）
+    bool run(const std::string& command, std::string& output, int timeoutMs = 2000);
+
+    // %outputのデータを元に戻す（"\\ooo" の8進エスケープ）
+    static std::string unescapeOutput(const std::string& data);
+
+private:
+    void onData(const char* data, size_t len);
+    void handleLine(const std::string& line);
+    void handleNotification(const std::string& line);
+    void finishReply(bool ok);
+    void failPending();
+
+    std::shared_ptr<SshChannel> m_channel;
+    NotifyCallback m_onNotify;
+
+    // 読み取りスレッドだけが触る
+    std::string m_lineBuffer;
+    bool m_inBlock = false;         // %begin ... %end の間
+    bool m_blockIsReply = false;    // このクライアントが送ったコマンドの応答か
+    std::string m_blockGuard;       // %beginの "時刻 番号"（%end / %errorと照合する）
+    std::string m_blockOutput;
+
+    // 送信順と応答待ちの列（送信はm_sendMutexで直列化し、列はm_mutexで守る）
+    std::mutex m_sendMutex;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    struct PendingReply {
+        ReplyCallback onReply;
+        unsigned long long line = 0;    // 送った行の番号（同じ行のコマンドは%errorでまとめて失敗する）
+    };
+    std::deque<PendingReply> m_pending;
+    unsigned long long m_nextLine = 0;
+    bool m_sessionAttached = false;
+    std::atomic<bool> m_exited{false};
+};
+
+} // namespace pbterm
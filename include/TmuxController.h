@@ -6,12 +6,25 @@
 #include <memory>
 #include <mutex>
 #include <atomic>
+#include <deque>
 #include <thread>
+#include <condition_variable>
 
 namespace pbterm {
 
-class SshChannel;
 class SshConnection;
+class TmuxControlClient;
+struct TmuxNotification;
+struct RemoteFacts;
+
+// ウィンドウの中のペインの位置と大きさ（セル単位、window_layoutから求める）
+struct TmuxPaneRect {
+    std::string paneId;     // "%5"
+    int x = 0;
+    int y = 0;
+    int cols = 0;
+    int rows = 0;
+};
 
 // tmuxウィンドウ情報
 struct TmuxWindow {
@@ -19,6 +32,10 @@ struct TmuxWindow {
     std::string name;
     bool active;
     std::string currentPath;  // pane_current_path
+    std::string id;           // window_id（"@3"、コントロールモードで取得したときのみ）
+    std::string layout;       // window_visible_layout（コントロールモードで取得したときのみ、ズーム中は1ペイン）
+    std::string paneId;       // アクティブなペインのpane_id（"%5"、コントロールモードで取得したときのみ）
+    long long activity = 0;   // window_activity（最後に出力があった時刻、sessionListQueryで取得したときのみ）
 };
 
 // tmuxセッション情報
@@ -30,11 +47,23 @@ struct TmuxSession {
 };
 
 // tmux制御クラス
-// SSHの制御チャンネルを使ってtmuxコマンドを実行し、結果をパースする
+// アタッチ後はtmux -C（TmuxControlClient）の1本のストリームでコマンドを送り、
+// ウィンドウの追加・削除・改名・パスの変化を通知で受け取る（一覧を定期的に取り直さない）
+// ペインの出力も同じストリームで届くので、表示はペインごとのTerminalで行う（TmuxPaneTerminals）
+// コントロールモードを開けなかった場合は、コマンドごとにexecしてtmuxを実行する
+// （UIスレッドを待たせないよう専用のスレッドで順に実行し、応答はそのスレッドからonReplyへ返す）
+// ウィンドウ操作は手元の一覧へ先に反映して列に積み、フレームの最後にまとめて1行で送る（flushCommands）
 class TmuxController {
 public:
     using WindowListCallback = std::function<void(const std::vector<TmuxWindow>&)>;
     using SessionListCallback = std::function<void(const std::vector<TmuxSession>&)>;
+    using PaneOutputCallback = std::function<void(const std::string& paneId, const std::string& data)>;
+    using ReplyCallback = std::function<void(bool ok, const std::string& output)>;
+
+    struct Command {
+        std::string args;
+        ReplyCallback onReply;
+    };
 
     TmuxController();
     ~TmuxController();
@@ -47,13 +76,43 @@ public:
     void closeControlChannel();
     bool isControlChannelOpen() const { return m_controlChannelOpen; }
 
-    // セッション名を設定/取得
-    void setSessionName(const std::string& name) { m_sessionName = name; }
-    std::string sessionName() const { return m_sessionName; }
+    // セッション名を設定/取得（裏で動く確かめ直しからも読むのでロックする）
+    void setSessionName(const std::string& name);
+    std::string sessionName() const;
 
-    // tmuxセッションを開始またはアタッチ（非同期）
+    // tmuxセッションを開始またはアタッチ（runRemoteBootstrapを実行してadoptBootstrapする、同期）
     // 成功するとonAttachedコールバックが呼ばれる
     bool startOrAttachSession();
+    // ブートストラップの結果（tmuxのパス・セッション・ウィンドウ一覧）を取り込む
+    // tmuxがない、またはセッションを作れなかった場合はfalse
+    bool adoptBootstrap(const RemoteFacts& facts);
+
+    // コントロールモードでセッションにアタッチする（adoptBootstrapの後、同期、セッションがなければ作る）
+    // tmux 3.2以降はパスの変化も購読（refresh-client -B）で受け取る
+    // 3.0より古い・開けなければfalse（その場合はシェルからアタッチし、コマンドはexecで動く）
+    bool startControlMode();
+    bool isControlMode() const;
+    // ウィンドウ一覧もパスも通知で届く（appendWindowListQueryで取り直す必要がない）
+    bool isPushBased() const;
+
+    // 前回取り出してからウィンドウ一覧が変わっていればwindowsに入れてtrue（UIスレッドから呼ぶ）
+    bool takeWindowUpdate(std::vector<TmuxWindow>& windows);
+
+    // ペインの出力（%output、エスケープを戻したもの）の受け取り先（読み取りスレッドから呼ばれる）
+    void setOnPaneOutput(PaneOutputCallback callback);
+    // コントロールモードでtmuxのコマンドを送る（応答は読み取りスレッドからonReplyへ、待たない）
+    bool sendCommand(const std::string& args, ReplyCallback onReply = nullptr);
+    // 複数のコマンドを1行で送る（続けて実行されるので、間にペインの出力が挟まらない）
+    bool sendCommands(std::vector<Command> commands);
+    // 問い合わせをまとめて1往復で送る（PollScheduler用）
+    // コントロールモードではsendCommandsと同じ、execではexec用のスレッドで1回のexecにまとめて実行し、
+    // 出力をコマンドごとに分ける（どちらも待たない）
+    // 送れなかったときも各onReplyをfalseで呼ぶ（応答待ちを必ず解けるように）
+    bool sendQueries(std::vector<Command> commands);
+    // ペインへキー入力を送る（send-keys -H、待たない）
+    void sendKeys(const std::string& paneId, const char* data, size_t len);
+    // 表示する大きさをtmuxへ知らせる（refresh-client -C、ウィンドウがこの大きさに合わせられる）
+    void setClientSize(int cols, int rows);
 
     // tmuxセッションからデタッチ
     void detach();
@@ -61,17 +120,43 @@ public:
     // セッションにアタッチしているか
     bool isAttached() const { return m_attached; }
 
-    // ウィンドウ操作（createWindowは作成されたウィンドウのインデックスを返す、失敗時は-1）
+    // ウィンドウ操作（待たない）
+    // windows()へすぐ反映してコマンドは列に積み、tmuxの結果はflushCommandsの後に届く一覧で確かめ直す
+    // createWindowは作るウィンドウのインデックスを返す（空いている番号を指定して作る、失敗時は-1）
     int createWindow(const std::string& name = "");
     bool selectWindow(int index);
     bool closeWindow(int index);
     bool renameWindow(int index, const std::string& name);
 
+    // tmuxのコマンドを列に積む（応答はonReplyへ、コントロールモードでは読み取りスレッドから呼ばれる）
+    void queueCommand(const std::string& args, ReplyCallback onReply = nullptr);
+    // 積んだコマンドを " ; " でつないだ1回の送信にまとめる（UIスレッドから1フレームに1回呼ぶ、待たない）
+    // execのときはexec用のスレッドで1回のexecで実行し、ウィンドウを変える操作があれば一覧も取り直す
+    // （応答はそのスレッドからonReplyへ、一覧はtakeWindowUpdateで受け取る）
+    void flushCommands();
+
     // ウィンドウ一覧を取得（同期）
     std::vector<TmuxWindow> listWindows();
 
     // 既存セッション一覧を取得（同期）
     std::vector<TmuxSession> listSessions();
+    // 全セッションのウィンドウ一覧を1回の list-windows -a で取るコマンド（コントロールモードのみ）
+    // onListは読み取りスレッドから呼ばれる（各ウィンドウのactivityも入る）
+    Command sessionListQuery(SessionListCallback onList);
+    // 表示するセッションを切り替える（コントロールモードのみ、switch-client）
+    // windowsが分かっていれば先に一覧へ反映し、応答を待たずにタブを作れるようにする
+    bool switchSession(const std::string& name, const std::vector<TmuxWindow>& windows);
+
+    // tmuxコマンドのパスとバージョン（adoptBootstrap後に有効）
+    const std::string& tmuxPath() const { return m_tmuxPath; }
+    const std::string& tmuxVersion() const { return m_tmuxVersion; }
+
+    // 直近に取得したウィンドウ一覧
+    const std::vector<TmuxWindow>& windows() const { return m_windows; }
+
+    // レイアウト文字列（"b25d,80x24,0,0{40x24,0,0,1,39x24,41,0,2}"）をペインの矩形に分解する
+    // 形式が崩れていれば空
+    static std::vector<TmuxPaneRect> parseLayout(const std::string& layout);
 
     // 現在のウィンドウインデックス
     int currentWindowIndex() const { return m_currentWindowIndex; }
@@ -80,38 +165,91 @@ public:
     void setOnAttached(std::function<void()> callback) { m_onAttached = callback; }
     void setOnWindowListChanged(WindowListCallback callback) { m_onWindowListChanged = callback; }
 
-    // ウィンドウ一覧を定期的に更新するためのタイマー処理
-    void pollWindowList();
+    // 通知で届かない分のウィンドウ一覧を取り直すコマンドをbatchへ積む（isPushBased()がfalseのときだけ定期的に呼ぶ）
+    // 結果はtakeWindowUpdateで受け取る（取り直し中なら積まない）
+    void appendWindowListQuery(std::vector<Command>& batch);
 
 private:
     // 制御チャンネルでコマンドを実行し、結果を取得
     std::string executeCommand(const std::string& cmd, int timeoutMs = 2000);
+    // tmuxのサブコマンドを実行（コントロールモードならそのストリームで、そうでなければexecで）
+    std::string runTmux(const std::string& args, int timeoutMs = 2000);
+
+    // execでまとめて実行するコマンド（exec用のスレッドで順に実行する）
+    struct ExecBatch {
+        std::vector<Command> commands;
+        std::string tmuxPath;
+        std::string sessionName;
+        bool relist = false;                // 実行後にウィンドウ一覧を取り直す
+        unsigned long long generation = 0;  // 積んだときのm_localGeneration
+    };
+    // exec用のスレッドへ積む（スレッドは最初に積んだときに起こす）
+    void postExec(ExecBatch batch);
+    // exec用のスレッドを止める（実行していないものは各onReplyをfalseで呼んで捨てる）
+    void stopExecThread();
+    void execThread();
+    // 1回のtmux起動で続けて実行し、コマンドごとに目印の行を出して出力と成否を分ける
+    void runExecBatch(ExecBatch& batch);
+    // tmuxのサブコマンドをexecで実行して終了ステータスを返す（-1はexecできなかった）
+    int execTmux(const std::string& tmuxPath, const std::string& args, std::string& output, std::string& error,
+                 int timeoutMs = 2000);
 
     // tmux出力をパース
-    std::vector<TmuxWindow> parseWindowList(const std::string& output);
+    std::vector<TmuxWindow> parseWindowList(const std::string& output) const;
+    // UIスレッドの一覧と現在のウィンドウを置き換える
+    void setWindows(const std::vector<TmuxWindow>& windows);
+    std::vector<TmuxWindow> parseControlWindowList(const std::string& output) const;
     std::vector<TmuxSession> parseSessionList(const std::string& output);
 
-    // 制御チャンネル読み取りスレッド
-    void controlReaderThread();
+    // コントロールモードの通知を処理する（読み取りスレッドから呼ばれる）
+    void onControlNotification(const TmuxNotification& notification);
+    // ウィンドウ一覧を応答を待たずに取り直す（実行中なら終わってからもう一度）
+    void requestWindowList();
+    // コントロールモードのlist-windowsコマンド（m_listPendingを立ててから作る）
+    Command windowListCommand();
+    // 読み取りスレッド側の一覧をUIスレッドへ渡す（m_pushMutexを取って呼ぶ）
+    void publishWindowsLocked();
+    // ウィンドウ操作を手元の一覧（UIスレッド・読み取りスレッド・受け渡し中のもの）へ先に反映する
+    void applyLocalChange(const std::function<void(std::vector<TmuxWindow>&)>& change);
 
     SshConnection* m_connection = nullptr;
-    std::shared_ptr<SshChannel> m_controlChannel;
+    mutable std::mutex m_sessionMutex;
     std::string m_sessionName = "pbterm";
     std::string m_tmuxPath = "tmux";  // tmuxコマンドのパス
+    std::string m_tmuxVersion;        // tmux -V の出力
     std::vector<TmuxWindow> m_windows;
     int m_currentWindowIndex = 0;
     std::atomic<bool> m_attached{false};
     std::atomic<bool> m_controlChannelOpen{false};
 
-    // 制御チャンネル用スレッド
-    std::thread m_controlThread;
-    std::atomic<bool> m_controlRunning{false};
+    // コントロールモード
+    std::unique_ptr<TmuxControlClient> m_control;
+    std::atomic<bool> m_pushPaths{false};       // パスも購読で届く（tmux 3.2以降）
+    std::atomic<bool> m_listPending{false};     // list-windowsの応答待ち
+    std::atomic<bool> m_listAgain{false};       // 応答待ちの間に変化があった
+    // 手元で先に反映した回数（それより前に送ったlist-windowsの応答は古いので使わない）
+    std::atomic<unsigned long long> m_localGeneration{0};
+
+    // exec用のスレッド
+    std::thread m_execThread;
+    std::mutex m_execMutex;
+    std::condition_variable m_execCv;
+    std::deque<ExecBatch> m_execQueue;
+    bool m_execStopping = false;
+
+    // まだ送っていないコマンド（UIスレッドだけが触る）
+    std::vector<Command> m_commandQueue;
+    bool m_queueChangesWindows = false;
+
+    // 読み取りスレッドで組み立てた一覧と、UIスレッドへの受け渡し
+    std::mutex m_pushMutex;
+    std::vector<TmuxWindow> m_controlWindows;
+    std::vector<TmuxWindow> m_pushedWindows;
+    bool m_hasPushedWindows = false;
 
-    // コマンド応答待ち用
-    std::mutex m_responseMutex;
-    std::string m_responseBuffer;
-    std::atomic<bool> m_waitingResponse{false};
-    std::string m_responseMarker;  // 応答の終端マーカー
+    // ペインの出力の受け取り先（読み取りスレッドで呼ぶので、差し替えとはロックで分ける）
+    std::mutex m_outputMutex;
+    PaneOutputCallback m_onPaneOutput;
 
     // コールバック
     std::function<void()> m_onAttached;
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+
+namespace pbterm {
+
+class Terminal;
+class TmuxController;
+class TriggerEngine;
+
+// tmuxのペインごとのTerminal（コントロールモードの%outputで更新する）
+// タブを切り替えても画面とスクロールバックは手元に残るので、再描画を待たずにすぐ表示できる
+// 作成時にcapture-paneで今の画面を取り込み、それまでに届いた出力は取り込み後に流す
+// 取り込んだ後はtmuxの履歴も新しい側から少しずつ取り、スクロールバックの先頭へ足していく
+// （リサイズでスクロールバックを捨てたら、次に表示したときに取り直す）
+class TmuxPaneTerminals {
+public:
+    explicit TmuxPaneTerminals(TmuxController* tmux);
+    ~TmuxPaneTerminals();
+
+    // ペインのTerminalを返す（なければcols×rowsで作って画面の取り込みを始める、UIスレッドから呼ぶ）
+    // 履歴がまだ取り込まれていなければ、ここで取り込みを始める
+    // 返したポインタはretain/clearで捨てるまで有効
+    Terminal* terminal(const std::string& paneId, int cols, int rows);
+    // 既にあるペインのTerminalを返す（作らない、なければnullptr）
+    Terminal* find(const std::string& paneId);
+    // paneIdsにないペインのTerminalを捨てる
+    void retain(const std::vector<std::string>& paneIds);
+    void clear();
+
+    void setColorTheme(const std::string& themeId);
+    void setTriggers(const std::shared_ptr<const TriggerEngine>& triggers);
+
+    // ペインの出力（TmuxController::setOnPaneOutputから、読み取りスレッドで呼ばれる）
+    void onOutput(const std::string& paneId, const std::string& data);
+
+private:
+    struct Pane;
+    struct HistoryImport;
+
+    void startCapture(const std::string& paneId, const std::shared_ptr<Pane>& pane);
+    // 履歴の取り込み（応答から次を頼むので、読み取りスレッドからも呼ばれる）
+    static void startHistoryImport(TmuxController* tmux, const std::string& paneId, const std::shared_ptr<Pane>& pane);
+    static void requestHistory(TmuxController* tmux, const std::weak_ptr<Pane>& weak,
+                               const std::shared_ptr<HistoryImport>& import);
+    static void onHistoryChunk(TmuxController* tmux, const std::weak_ptr<Pane>& weak,
+                               const std::shared_ptr<HistoryImport>& import,
+                               int start, int last, int historySize, bool ok, const std::string& output);
+    static void finishHistoryImport(const std::weak_ptr<Pane>& weak);
+
+    TmuxController* m_tmux = nullptr;
+    std::string m_themeId;
+    std::shared_ptr<const TriggerEngine> m_triggers;
+
+    std::mutex m_mutex;
+    std::map<std::string, std::shared_ptr<Pane>> m_panes;
+};
+
+} // namespace pbterm
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <string>
+
+namespace pbterm {
+
+class TransferManager;
+
+// 転送キュードック（進捗・速度・残り時間の表示と、一時停止/キャンセル/再試行の操作）
+// ディレクトリのアップロードを同期モードにする設定と、同期計画のレポート表示も行う
+// 転送全体の速度制限と、項目ごとの優先度もここで設定する
+class TransferDock {
+public:
+    TransferDock() = default;
+
+    void setTransferManager(TransferManager* manager) { m_manager = manager; }
+    void setLanguage(int language) { m_language = language; }
+
+    void render();
+
+private:
+    void renderSyncOptions();
+    void renderArchiveOptions();
+    void renderVerifyOptions();
+    void renderRateLimitOptions();
+    void renderReportPopup();
+
+    TransferManager* m_manager = nullptr;
+    int m_language = 0;
+
+    // ディレクトリのアップロードの同期モード
+    bool m_syncEnabled = false;
+    bool m_syncHashes = false;
+    bool m_syncDryRun = false;
+
+    // ファイル数が多いディレクトリのtarストリーム転送
+    bool m_archiveEnabled = true;
+    bool m_archiveCompress = false;
+
+    // 転送後の内容検証
+    bool m_verifyEnabled = false;
+
+    // 転送全体の速度制限
+    bool m_rateLimitEnabled = false;
+    int m_rateLimitMBps = 10;
+
+    bool m_showReport = false;
+    std::string m_reportText;
+};
+
+} // namespace pbterm
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace pbterm {
+
+// 未完了の転送の記録
+struct TransferJournalEntry {
+    std::string endpoint;       // 接続先（user@host:port）
+    bool upload = true;
+    std::string source;
+    std::string destination;
+    bool isDir = false;
+    bool sync = false;          // 同期モードのアップロード
+    bool syncHashes = false;    // 同期時に内容も比較する
+};
+
+// 転送ジャーナル
+// 未完了の転送を設定ディレクトリに記録し、再接続やアプリ再起動後に続きから再開できるようにする
+// （途中ファイルの照合と再開位置の決定はSshConnection側で行う）
+// add/removeは記録を変えて印を付けるだけで、ファイルへは書き出し用のスレッドが少し待ってまとめて書く
+// （多数のファイルを登録・完了するときに、変更のたびに全体を書き直さない。呼び出し側のロックの中でI/Oをしない）
+class TransferJournal {
+public:
+    TransferJournal();
+    // 書き出していない変更があれば書いてから終わる
+    ~TransferJournal();
+
+    TransferJournal(const TransferJournal&) = delete;
+    TransferJournal& operator=(const TransferJournal&) = delete;
+
+    void add(const TransferJournalEntry& entry);
+    void remove(const TransferJournalEntry& entry);
+    // 指定した接続先の記録を取得
+    std::vector<TransferJournalEntry> entriesFor(const std::string& endpoint) const;
+
+    void load();
+
+private:
+    // 変更があったことを書き出し用のスレッドへ知らせる（m_mutexを取って呼ぶ）
+    void markDirtyLocked();
+    void writerThread();
+    void write(const std::vector<TransferJournalEntry>& entries);
+    std::string configPath() const;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    // 記録は登録順に並べ（再開もこの順）、同じ転送の検索は索引で行う
+    std::map<uint64_t, TransferJournalEntry> m_entries;
+    std::unordered_map<std::string, uint64_t> m_index;
+    uint64_t m_nextSequence = 0;
+    bool m_dirty = false;
+    bool m_stopping = false;
+    std::thread m_writer;
+};
+
+} // namespace pbterm
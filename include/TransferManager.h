@@ -0,0 +1,248 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "TransferJournal.h"
+#include "DirectorySync.h"
+#include "TransferVerifier.h"
+#include "RateLimiter.h"
+#include "SessionLock.h"
+
+namespace pbterm {
+
+class SshConnection;
+
+enum class TransferDirection {
+    Upload,
+    Download
+};
+
+// 転送どうしの優先度（ターミナルの入出力はどの転送よりも優先される）
+enum class TransferPriority {
+    High,
+    Normal,
+    Low
+};
+
+enum class TransferState {
+    Queued,      // 開始待ち
+    Scanning,    // ディレクトリを走査中
+    Running,     // 転送中
+    Verifying,   // 転送後の内容検証中
+    Paused,      // 一時停止中
+    Completed,
+    Failed,
+    Cancelled
+};
+
+// UI表示用の転送項目の状態（スナップショット）
+struct TransferItemStatus {
+    int id = 0;
+    TransferDirection direction = TransferDirection::Upload;
+    TransferState state = TransferState::Queued;
+    std::string name;               // 表示名（ドロップ/選択したファイル・フォルダ名）
+    std::string sourcePath;
+    std::string destinationPath;
+    bool isDir = false;
+    bool sync = false;              // 同期モード（変更されたファイルだけを送る）
+    bool dryRun = false;            // 同期計画の作成のみ
+    bool verify = false;            // 転送後に内容を検証する
+    TransferPriority priority = TransferPriority::Normal;
+    std::string report;             // 同期計画の内容
+
+    uint64_t totalBytes = 0;
+    uint64_t transferredBytes = 0;
+    int totalFiles = 0;
+    int completedFiles = 0;
+    int failedFiles = 0;
+    int verifyingFiles = 0;         // 検証待ち・検証中のファイル数
+
+    double bytesPerSecond = 0.0;
+    double etaSeconds = -1.0;       // 不明な場合は負
+    std::string error;
+
+    bool isFinished() const {
+        return state == TransferState::Completed || state == TransferState::Failed ||
+               state == TransferState::Cancelled;
+    }
+};
+
+// ファイル転送キュー
+// アップロード/ダウンロードの項目をファイル単位のジョブに展開し、
+// 固定数のワーカースレッドで並列に転送する（多数の小さなファイルでも往復待ちが重ならない）
+// 進捗はバイト単位で集計し、項目ごとに一時停止・再開・キャンセル・再試行ができる
+// 未完了の項目はジャーナルに記録し、再接続・再起動後に途中ファイルの続きから再開する
+// 検証を有効にすると、転送を終えたファイルを後続の転送と並行して検証し、不一致のチャンクだけ送り直す
+// 優先度の高い項目のファイルから割り当て、セッションロックも優先度順に渡す（ターミナルが最優先）
+// 速度制限はすべての転送の合計に対してかかる
+class TransferManager {
+public:
+    // workerCountはSFTPセッションプールの上限と揃える（それ以上はセッション待ちになるだけ）
+    explicit TransferManager(SshConnection* connection, int workerCount = 4);
+    ~TransferManager();
+
+    TransferManager(const TransferManager&) = delete;
+    TransferManager& operator=(const TransferManager&) = delete;
+
+    // 転送を登録（戻り値は項目ID）
+    int enqueueUpload(const std::string& localPath, const std::string& remotePath);
+    int enqueueDownload(const std::string& remotePath, const std::string& localPath, bool isDir);
+    // 以降に登録するディレクトリのアップロードを同期モードにする
+    // （リモートと比較して変更されたファイルだけを送る、dryRunでは計画の作成のみ）
+    void setSyncMode(bool enabled, const SyncOptions& options, bool dryRun);
+    // 以降に登録するディレクトリの転送で、ファイル数が多い場合にtarストリームを使う
+    void setArchiveMode(bool enabled, bool compress);
+    // 以降に登録する転送で、転送後にファイルの内容を検証する
+    void setVerifyMode(bool enabled);
+    // 転送全体の速度の上限（0で無制限）
+    void setRateLimit(uint64_t bytesPerSecond);
+    // 項目の優先度を変える（実行中のファイルにも次のリクエストから反映）
+    void setPriority(int id, TransferPriority priority);
+
+    void pause(int id);
+    void resume(int id);
+    void cancel(int id);
+    // 失敗・キャンセルしたファイルだけをやり直す
+    void retry(int id);
+    // 完了・失敗・キャンセル済みの項目を一覧から消す
+    void clearFinished();
+
+    // すべての転送に中断を要求する（待たない、切断前に呼ぶ）
+    // 中断した項目はジャーナルに残り、resumeInterrupted()で再開される
+    void cancelAll();
+    // 実行中のジョブと検証が止まるまで待つ（cancelAllの後、セッションを閉じる前に呼ぶ）
+    // 応答待ちの上限まで待つことがあるので、UIスレッドからは呼ばない
+    void waitIdle();
+    // 接続後に呼ぶ: 切断で中断した項目と、ジャーナルに残っている同じ接続先の転送を再開する
+    void resumeInterrupted();
+
+    // 現在の状態を取得（UIスレッドから毎フレーム呼ぶ想定、速度はここで計測する）
+    std::vector<TransferItemStatus> snapshot();
+    // 前回の呼び出し以降に終了した項目を取得
+    std::vector<TransferItemStatus> takeFinished();
+    bool hasActive() const;
+
+private:
+    struct FileJob {
+        enum class State { Pending, Running, Verifying, Done, Failed };
+
+        std::string source;
+        std::string destination;
+        uint64_t size = 0;
+        uint64_t reported = 0;    // 実行中の試行で進捗に計上済みのバイト数
+        State state = State::Pending;
+        bool delta = false;       // ブロック差分で送る
+        // 転送先に途中までのファイルがあれば照合して続きから送る
+        // 新しい転送では照合しない（既存の別ファイルを途中ファイルと取り違えず、ファイルごとの往復も増やさない）
+        // 一時停止・中断・回線断で打ち切ったファイルと、ジャーナルから戻した項目のファイルだけtrueにする
+        bool resume = false;
+        int64_t mtime = 0;        // 転送後にリモートへ設定する更新時刻（0なら設定しない）
+        bool archive = false;     // ディレクトリ全体をtarストリームで送る
+        std::shared_ptr<LocalDigest> digest;  // 転送と並行して計算したローカルのハッシュ
+    };
+
+    struct Item {
+        int id = 0;
+        TransferDirection direction = TransferDirection::Upload;
+        TransferState state = TransferState::Queued;
+        std::string name;
+        std::string source;
+        std::string destination;
+        bool isDir = false;
+        std::string endpoint;     // 登録時の接続先
+        bool interrupted = false; // 切断・回線断で中断または失敗した（再接続時に自動で再開）
+        bool restored = false;    // 前回の起動のジャーナルから戻した（途中ファイルが残っていれば続きから）
+        int autoRetries = 0;      // 失敗から自動で再開した回数（kMaxAutoRetriesまで）
+        bool sync = false;
+        bool dryRun = false;
+        SyncOptions syncOptions;
+        std::string report;
+        bool archive = false;     // ファイル数が多ければtarストリームで転送
+        bool compress = false;
+        bool verify = false;      // 転送後に内容を検証
+        std::atomic<TransferPriority> priority{TransferPriority::Normal};
+
+        bool expanded = false;    // ファイル単位のジョブに展開済み
+        bool scanning = false;
+        std::vector<FileJob> files;
+        size_t nextFile = 0;      // 未割り当てジョブの探索開始位置
+        int running = 0;
+        int verifying = 0;        // 検証待ち・検証中のファイル数
+
+        std::atomic<uint64_t> transferred{0};
+        uint64_t totalBytes = 0;
+        int completedFiles = 0;
+        int failedFiles = 0;
+        std::string error;
+
+        std::atomic<bool> cancelRequested{false};
+        std::atomic<bool> pauseRequested{false};
+        bool finishedReported = false;
+
+        // 速度計測
+        std::chrono::steady_clock::time_point sampleTime;
+        uint64_t sampleBytes = 0;
+        double bytesPerSecond = 0.0;
+    };
+
+    int enqueue(TransferDirection direction, const std::string& source,
+                const std::string& destination, bool isDir);
+    // 失敗・中断したファイルを未実行に戻す（m_mutex保持中に呼ぶ）
+    void resetForRetryLocked(Item& item);
+    TransferJournalEntry journalEntry(const Item& item) const;
+
+    void workerLoop();
+    // 次に実行するジョブを選ぶ（m_mutex保持中に呼ぶ）
+    bool pickWorkLocked(Item*& item, size_t& fileIndex, bool& needScan);
+    bool pickWorkLocked(TransferPriority level, Item*& item, size_t& fileIndex, bool& needScan);
+    // ディレクトリを走査してファイルジョブを作る（ロック外で呼ぶ）
+    bool scanItem(Item& item, std::vector<FileJob>& files, std::string& error);
+    bool scanLocalTree(Item& item, std::vector<FileJob>& files, std::string& error);
+    bool scanRemoteTree(Item& item, std::vector<FileJob>& files, std::string& error);
+    bool scanSyncTree(Item& item, std::vector<FileJob>& files, std::string& error);
+    // tarストリームで転送する場合は1つのジョブにまとめる（使わない場合はfalse）
+    bool planArchiveJob(Item& item, std::vector<FileJob>& files);
+    bool runFileJob(Item& item, FileJob& job, std::string& error);
+    static SessionPriority sessionPriority(TransferPriority priority);
+    // 検証が有効なジョブか（tarは1ファイル単位でなく、差分転送は組み立て後に照合済み）
+    static bool shouldVerify(const Item& item, const FileJob& job);
+    // 検証結果の反映（検証スレッドから呼ばれる）
+    void onVerified(const TransferVerifier::Request& request, VerifyResult result, const std::string& error);
+    // 終了判定と状態更新（m_mutex保持中に呼ぶ）
+    void updateItemStateLocked(Item& item);
+
+    Item* findItemLocked(int id);
+    TransferItemStatus makeStatusLocked(const Item& item) const;
+
+    SshConnection* m_connection = nullptr;
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<std::unique_ptr<Item>> m_items;
+    std::vector<std::thread> m_workers;
+    TransferJournal m_journal;
+    int m_nextId = 1;
+    int m_busyWorkers = 0;
+    std::atomic<bool> m_stopping{false};   // checkpointからはロックなしで読む
+
+    bool m_syncEnabled = false;
+    bool m_syncDryRun = false;
+    SyncOptions m_syncOptions;
+
+    bool m_archiveEnabled = true;
+    bool m_archiveCompress = false;
+
+    bool m_verifyEnabled = false;
+    std::unique_ptr<TransferVerifier> m_verifier;
+
+    RateLimiter m_rateLimiter;
+};
+
+} // namespace pbterm
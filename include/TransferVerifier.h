@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+namespace pbterm {
+
+class SshConnection;
+struct LocalDigest;
+
+// 検証に使うハッシュ（リモートで使えるコマンドに合わせて選ぶ）
+enum class VerifyAlgorithm {
+    None,       // リモートで計算できない
+    Xxh64,      // xxh64sum / xxhsum -H1
+    Sha256      // sha256sum / shasum -a 256
+};
+
+enum class VerifyResult {
+    Verified,       // 一致
+    Repaired,       // 不一致のチャンクだけ再転送して一致
+    Failed,         // 修復できなかった
+    Unavailable,    // リモートでハッシュを計算できない（未検証）
+    Cancelled
+};
+
+// 転送後の内容検証
+// ファイルをチャンクに分け、ローカルはハッシュ用のスレッドで並列に、
+// リモートは同じディレクトリのファイルをまとめて1回のexecで計算して比較する
+// 一致しなかったチャンクだけを再転送し、もう一度比較する
+// 検証は専用スレッドで行い、後続ファイルの転送と並行して進む
+// （アップロードはローカルのハッシュを転送開始と同時に計算し始める）
+class TransferVerifier {
+public:
+    struct Request {
+        int itemId = 0;
+        size_t fileIndex = 0;
+        bool upload = true;
+        std::string localPath;
+        std::string remotePath;
+        std::shared_ptr<LocalDigest> local;     // hashLocal()で計算を始めていれば渡す
+    };
+    // 結果の通知（検証スレッドから呼ばれる）
+    using ResultCallback = std::function<void(const Request&, VerifyResult, const std::string&)>;
+
+    TransferVerifier(SshConnection* connection, ResultCallback onResult);
+    ~TransferVerifier();
+
+    TransferVerifier(const TransferVerifier&) = delete;
+    TransferVerifier& operator=(const TransferVerifier&) = delete;
+
+    // ローカルファイルのハッシュ計算を始める（初回はリモートのハッシュコマンドを調べる）
+    std::shared_ptr<LocalDigest> hashLocal(const std::string& path);
+    // 転送が終わったファイルを検証待ちに加える
+    void submit(Request request);
+    // 検証待ちを破棄してCancelledを通知し、実行中の検証が終わるまで待つ
+    void cancelAll();
+
+private:
+    struct HashTask {
+        std::shared_ptr<LocalDigest> digest;
+        std::string path;
+        size_t chunk = 0;
+    };
+
+    // リモートのファイル1つ分のハッシュ
+    struct RemoteChunks {
+        bool sizeKnown = false;
+        uint64_t size = 0;
+        std::vector<std::string> chunks;
+    };
+
+    VerifyAlgorithm algorithm();
+    void hashThread();
+    void verifyThread();
+    void verifyBatch(std::vector<Request>& batch, uint64_t generation);
+    // 同じディレクトリのファイルのチャンク（indexの組）をまとめて計算する
+    bool remoteChunkHashes(const std::string& remoteDir, const std::vector<Request*>& files,
+                           const std::vector<std::vector<size_t>>& chunks,
+                           std::vector<RemoteChunks>& results, uint64_t generation);
+    bool cancelled(uint64_t generation) const;
+
+    SshConnection* m_connection = nullptr;
+    ResultCallback m_onResult;
+
+    // リモートのハッシュコマンド（接続先が変わったら調べ直す）
+    std::mutex m_algorithmMutex;
+    std::string m_algorithmEndpoint;
+    VerifyAlgorithm m_algorithm = VerifyAlgorithm::None;
+
+    // ローカルのハッシュ計算
+    std::vector<std::thread> m_hashThreads;
+    std::mutex m_hashMutex;
+    std::condition_variable m_hashCv;
+    std::deque<HashTask> m_hashQueue;
+
+    // 検証待ち
+    std::thread m_verifyThread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::vector<Request> m_pending;
+    bool m_busy = false;
+    std::atomic<uint64_t> m_generation{0};
+    std::atomic<bool> m_stopping{false};
+};
+
+} // namespace pbterm
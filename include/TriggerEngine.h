@@ -0,0 +1,72 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <array>
+#include <regex>
+#include <cstdint>
+
+namespace pbterm {
+
+// トリガーが一致したときの扱い
+enum class TriggerAction {
+    Highlight,      // 文字を色付けする
+    Link,           // 下線を引き、Ctrl+クリックでコピーできるようにする（URL・ファイル名:行）
+    Notify,         // 色付けし、画面に出たらタブへ知らせる
+};
+
+// トリガーの規則（triggers.confの[trigger]1つ分）
+struct TriggerRule {
+    std::string name;
+    std::string pattern;            // 正規表現（ECMAScript）
+    std::string literal;            // 一致に必ず含まれる文字列（"|"区切りで複数、空ならpatternから取り出す）
+    TriggerAction action = TriggerAction::Highlight;
+    uint32_t color = 0xFF5050;      // 0xRRGGBB
+    bool ignoreCase = false;
+};
+
+// 行のテキストの一致した範囲（バイト位置、endは含まない）
+struct TriggerMatch {
+    size_t rule = 0;
+    size_t start = 0;
+    size_t end = 0;
+};
+
+// 出力の行に全規則をまとめて当てるエンジン
+// 規則ごとの必須の文字列を1つのAho-Corasickオートマトン（失敗遷移を畳んだ256列の遷移表）にまとめ、
+// 行を1回なめて候補に残った規則の正規表現だけを試す（必須の文字列を取り出せない規則は毎回試す）
+// 作った後は変えないので、読み取りスレッドから共有して使ってよい
+class TriggerEngine {
+public:
+    static constexpr size_t kMaxRules = 64;
+
+    explicit TriggerEngine(const std::vector<TriggerRule>& rules);
+
+    // triggers.confを読む（なければ既定の規則）
+    static std::vector<TriggerRule> loadRules(const std::string& path);
+    static std::vector<TriggerRule> defaultRules();
+
+    // 一致を位置の順に返す（重なったら先に始まるもの、同じなら先の規則を残す）
+    void scan(const std::string& line, std::vector<TriggerMatch>& matches) const;
+
+    size_t ruleCount() const { return m_rules.size(); }
+    const TriggerRule& rule(size_t index) const { return m_rules[index].rule; }
+
+private:
+    struct CompiledRule {
+        TriggerRule rule;
+        std::regex regex;
+    };
+
+    // 選択肢（トップレベルの"|"）ごとに必ず現れる最長の文字列（取り出せない選択肢があれば空）
+    static std::vector<std::string> requiredLiterals(const std::string& pattern);
+    void addLiteral(const std::string& literal, size_t rule);
+    void buildAutomaton();
+
+    std::vector<CompiledRule> m_rules;
+    std::vector<std::array<int32_t, 256>> m_next;   // 状態×バイト → 次の状態
+    std::vector<uint64_t> m_output;                 // その状態で見つかった規則のビット
+    uint64_t m_unfiltered = 0;                      // 必須の文字列がなく毎回試す規則のビット
+};
+
+} // namespace pbterm
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+namespace pbterm {
+
+// XXH64（転送データの検証用の高速ハッシュ）
+// リモート側のxxhsum -H1 / xxh64sumと同じ値（16進表記も同じ）を得るために使う
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0);
+
+    void update(const void* data, size_t len);
+    uint64_t digest() const;
+    // ダイジェストを16進文字列で返す（xxhsumの正規表記、ビッグエンディアン）
+    std::string hexDigest() const;
+
+private:
+    uint64_t m_acc[4];
+    uint8_t m_buffer[32];
+    size_t m_bufferLen = 0;
+    uint64_t m_totalLen = 0;
+    uint64_t m_seed;
+};
+
+} // namespace pbterm
@@ -7,6 +7,15 @@
 #include "SettingsDialog.h"
 #include "CommandDock.h"
 #include "FolderTreeDock.h"
+#include "TransferManager.h"
+#include "TransferDock.h"
+#include "SessionDock.h"
+#include "PollScheduler.h"
+#include "ConnectionPipeline.h"
+#include "HostFactsCache.h"
+#include "RemoteBootstrap.h"
+#include "Terminal.h"
+#include "TriggerEngine.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -201,6 +210,7 @@ bool App::init() {
     m_profileManager->load();
 
     m_sshConnection = std::make_unique<SshConnection>();
+    m_transferManager = std::make_unique<TransferManager>(m_sshConnection.get());
     m_tmuxController = std::make_unique<TmuxController>();
     m_tmuxController->setConnection(m_sshConnection.get());
 
@@ -208,28 +218,20 @@ bool App::init() {
     m_terminalDock->setConnection(m_sshConnection.get());
     m_terminalDock->setTmuxController(m_tmuxController.get());
 
+    // リモートへの定期的な問い合わせ（各ドックが登録する）
+    m_pollScheduler = std::make_unique<PollScheduler>(m_tmuxController.get());
+    m_terminalDock->setPollScheduler(m_pollScheduler.get());
+
+    m_hostFactsCache = std::make_unique<HostFactsCache>();
+    m_hostFactsCache->load();
+    m_triggers = std::make_shared<const TriggerEngine>(
+        TriggerEngine::loadRules(AppSettings::configDir() + "/triggers.conf"));
+    m_connectionPipeline = std::make_unique<ConnectionPipeline>(
+        m_sshConnection.get(), m_tmuxController.get(), m_hostFactsCache.get());
+
     m_connectionDialog = std::make_unique<ConnectionDialog>(m_profileManager.get());
     m_connectionDialog->setConnectCallback([this](const SshConfig& config, const std::string& profileName) {
-        if (m_connected) {
-            disconnect();
-        }
-        if (m_sshConnection->connect(config)) {
-            // tmuxセッションにアタッチ
-            m_tmuxController->setConnection(m_sshConnection.get());
-            if (m_tmuxController->startOrAttachSession()) {
-                std::cout << "tmuxセッションにアタッチしました" << std::endl;
-            } else {
-                m_showTmuxMissing = true;
-            }
-            m_connected = true;
-            m_connectedProfileName = profileName;
-            m_terminalDock->onConnected();
-            m_terminalDock->setColorTheme(m_appSettings.colorTheme);
-            if (m_folderTreeDock) {
-                m_folderTreeDock->onConnected();
-            }
-            m_showConnectionDialog = false;
-        }
+        startConnect(config, profileName);
     });
 
     // 設定ダイアログ初期化
@@ -253,26 +255,23 @@ bool App::init() {
     m_folderTreeDock = std::make_unique<FolderTreeDock>();
     m_folderTreeDock->setConnection(m_sshConnection.get());
     m_folderTreeDock->setTerminalDock(m_terminalDock.get());
+    m_folderTreeDock->setTransferManager(m_transferManager.get());
+    m_folderTreeDock->setHostFactsCache(m_hostFactsCache.get());
+
+    // 転送キュードック初期化
+    m_transferDock = std::make_unique<TransferDock>();
+    m_transferDock->setTransferManager(m_transferManager.get());
 
-    // オート接続
+    // tmuxセッション一覧ドック初期化
+    m_sessionDock = std::make_unique<SessionDock>();
+    m_sessionDock->setTmuxController(m_tmuxController.get());
+    m_sessionDock->setTerminalDock(m_terminalDock.get());
+    m_sessionDock->setPollScheduler(m_pollScheduler.get());
+
+    // オート接続（ウィンドウを表示したまま裏で接続する）
     const Profile* autoProfile = m_profileManager->autoConnectProfile();
     if (autoProfile) {
-        if (m_sshConnection->connect(autoProfile->config)) {
-            // tmuxセッションにアタッチ
-            m_tmuxController->setConnection(m_sshConnection.get());
-            if (m_tmuxController->startOrAttachSession()) {
-                std::cout << "tmuxセッションにアタッチしました（オート接続）" << std::endl;
-            } else {
-                m_showTmuxMissing = true;
-            }
-            m_connected = true;
-            m_connectedProfileName = autoProfile->name;
-            m_terminalDock->onConnected();
-            m_terminalDock->setColorTheme(m_appSettings.colorTheme);
-            if (m_folderTreeDock) {
-                m_folderTreeDock->onConnected();
-            }
-        }
+        startConnect(autoProfile->config, autoProfile->name);
     }
 
     return true;
@@ -532,19 +531,24 @@ void App::setupDocking() {
             ImGui::DockBuilderSetNodeSize(dockspaceId, viewport->WorkSize);
 
             ImGuiID dockLeft = 0;
+            ImGuiID dockLeftBottom = 0;
             ImGuiID dockRight = 0;
             ImGuiID dockMain = dockspaceId;
 
             // 左右に分割
             ImGui::DockBuilderSplitNode(dockMain, ImGuiDir_Left, 0.20f, &dockLeft, &dockMain);
             ImGui::DockBuilderSplitNode(dockMain, ImGuiDir_Right, 0.20f, &dockRight, &dockMain);
+            // 転送キューはフォルダツリーの下
+            ImGui::DockBuilderSplitNode(dockLeft, ImGuiDir_Down, 0.30f, &dockLeftBottom, &dockLeft);
 
             m_foldersDockNodeId = dockLeft;
             m_commandsDockNodeId = dockRight;
 
             // ドッキング
             ImGui::DockBuilderDockWindow("###Folders", dockLeft);
+            ImGui::DockBuilderDockWindow("###Transfers", dockLeftBottom);
             ImGui::DockBuilderDockWindow("###Commands", dockRight);
+            ImGui::DockBuilderDockWindow("###Sessions", dockRight);
             ImGui::DockBuilderDockWindow("###Terminal", dockMain);
 
             ImGui::DockBuilderFinish(dockspaceId);
@@ -562,7 +566,7 @@ void App::renderMenuBar() {
 
     if (ImGui::BeginMenuBar()) {
         if (ImGui::BeginMenu(loc.menuConnect)) {
-            if (ImGui::MenuItem(loc.menuStart, nullptr, false, !m_connected)) {
+            if (ImGui::MenuItem(loc.menuStart, nullptr, false, !m_connected && !m_connectionPipeline->isBusy())) {
                 m_connectionDialog->initForShow();
                 m_showConnectionDialog = true;
             }
@@ -576,6 +580,8 @@ void App::renderMenuBar() {
             ImGui::MenuItem(loc.menuTerminal, nullptr, &m_showTerminal);
             ImGui::MenuItem(loc.menuCommands, nullptr, &m_showCommands);
             ImGui::MenuItem(loc.menuFolders, nullptr, &m_showFolders);
+            ImGui::MenuItem(loc.menuTransfers, nullptr, &m_showTransfers);
+            ImGui::MenuItem(loc.menuSessions, nullptr, &m_showSessions);
             ImGui::EndMenu();
         }
 
@@ -588,7 +594,9 @@ void App::renderMenuBar() {
 
         // 接続状態表示（右寄せ + 色付きインジケータ + プロファイル名）
         std::string statusText;
-        if (m_connected && !m_connectedProfileName.empty()) {
+        if (m_connectionPipeline->isBusy()) {
+            statusText = loc.statusConnecting;
+        } else if (m_connected && !m_connectedProfileName.empty()) {
             statusText = std::string(loc.statusConnected) + ": " + m_connectedProfileName;
         } else if (m_connected) {
             statusText = loc.statusConnected;
@@ -611,6 +619,10 @@ void App::renderMenuBar() {
         ImVec4 textColor = m_connected
             ? ImVec4(0.3f, 0.85f, 0.5f, 1.0f)
             : ImVec4(0.85f, 0.35f, 0.35f, 1.0f);
+        if (m_connectionPipeline->isBusy()) {
+            dotColor = IM_COL32(230, 180, 60, 255);
+            textColor = ImVec4(0.9f, 0.7f, 0.25f, 1.0f);
+        }
 
         float lineH = ImGui::GetTextLineHeight();
         ImGui::GetWindowDrawList()->AddCircleFilled(
@@ -629,6 +641,8 @@ void App::renderMenuBar() {
 void App::renderUI() {
     const Localization& loc = getLocalization(m_appSettings.language);
 
+    // 接続処理の完了をドックへ反映
+    pollConnection();
 
     // ターミナルドック（###でIDを固定、表示名は言語に応じて変更）
     if (m_showTerminal) {
@@ -678,6 +692,30 @@ void App::renderUI() {
         ImGui::End();
     }
 
+    // 転送キュードック
+    if (m_showTransfers) {
+        char title[128];
+        snprintf(title, sizeof(title), "%s###Transfers", loc.menuTransfers);
+        ImGui::Begin(title, &m_showTransfers);
+        m_transferDock->setLanguage(m_appSettings.language);
+        m_transferDock->render();
+        ImGui::End();
+    }
+
+    // tmuxセッション一覧ドック
+    if (m_showSessions) {
+        char title[128];
+        snprintf(title, sizeof(title), "%s###Sessions", loc.menuSessions);
+        ImGui::Begin(title, &m_showSessions);
+        m_sessionDock->setLanguage(m_appSettings.language);
+        m_sessionDock->render();
+        ImGui::End();
+    }
+
+    // 期限の来たリモートへの問い合わせを1往復にまとめて送る（ドックを描いた後、非アクティブの間は間隔を延ばす）
+    m_pollScheduler->setFocused(glfwGetWindowAttrib(m_window, GLFW_FOCUSED) != 0);
+    m_pollScheduler->tick();
+
     // 接続設定ダイアログ
     if (m_showConnectionDialog) {
         m_connectionDialog->setLanguage(m_appSettings.language);
@@ -689,6 +727,9 @@ void App::renderUI() {
         m_settingsDialog->render(&m_showSettings);
     }
 
+    // 接続の進捗
+    renderConnectProgress();
+
     // tmux未インストールダイアログ
     if (m_showTmuxMissing) {
         ImGui::OpenPopup(loc.dlgTmuxMissingTitle);
@@ -709,38 +750,151 @@ void App::connect() {
     if (m_profileManager->profileCount() > 0) {
         const Profile* profile = m_profileManager->getProfile(0);
         if (profile) {
-            if (m_connected) {
-                disconnect();
-            }
-            if (m_sshConnection->connect(profile->config)) {
-            // tmuxセッションにアタッチ
-            m_tmuxController->setConnection(m_sshConnection.get());
-            if (m_tmuxController->startOrAttachSession()) {
-                std::cout << "tmuxセッションにアタッチしました" << std::endl;
-            } else {
-                m_showTmuxMissing = true;
-            }
-            m_connected = true;
-            m_terminalDock->onConnected();
+            startConnect(profile->config, profile->name);
             return;
-            }
         }
     }
     m_connectionDialog->initForShow();
     m_showConnectionDialog = true;
 }
 
+void App::startConnect(const SshConfig& config, const std::string& profileName) {
+    if (m_connected) {
+        disconnect();
+    }
+    m_connectionPipeline->start(config, profileName);
+}
+
+void App::pollConnection() {
+    // キャッシュで接続した後、確かめ直した結果が届いたら差し替える
+    RemoteFacts refreshed;
+    if (m_connected && m_connectionPipeline->takeRefreshedFacts(refreshed)) {
+        if (m_tmuxController->isAttached()) {
+            if (refreshed.tmuxPath.empty()) {
+                // tmuxがなくなっていた（シェル側のアタッチも失敗している）
+                m_tmuxController->detach();
+                m_showTmuxMissing = true;
+            } else if (refreshed.sessionReady && m_tmuxController->adoptBootstrap(refreshed)) {
+                m_terminalDock->onTmuxWindowListChanged(m_tmuxController->windows());
+            }
+        }
+        if (m_folderTreeDock) {
+            m_folderTreeDock->updateFacts(refreshed);
+        }
+    }
+
+    ConnectedShell shell;
+    if (!m_connectionPipeline->takeResult(shell)) {
+        return;
+    }
+
+    if (shell.tmuxAttached) {
+        std::cout << "tmuxセッションにアタッチしました" << std::endl;
+    } else if (shell.tmuxMissing) {
+        m_showTmuxMissing = true;
+    }
+    m_connected = true;
+    m_connectedProfileName = m_connectionPipeline->profileName();
+    m_pollScheduler->reset();
+    m_terminalDock->onConnected(shell);
+    m_terminalDock->setColorTheme(m_appSettings.colorTheme);
+    m_terminalDock->setTriggers(m_triggers);
+    if (m_folderTreeDock) {
+        m_folderTreeDock->onConnected(shell.facts);
+    }
+    m_transferManager->resumeInterrupted();
+    m_showConnectionDialog = false;
+}
+
+void App::renderConnectProgress() {
+    const Localization& loc = getLocalization(m_appSettings.language);
+
+    char title[128];
+    snprintf(title, sizeof(title), "%s###ConnectProgress", loc.connectTitle);
+
+    ConnectStage stage = m_connectionPipeline->stage();
+    bool failed = (stage == ConnectStage::Failed);
+    bool show = failed || m_connectionPipeline->isBusy();
+    if (show && !ImGui::IsPopupOpen(title)) {
+        ImGui::OpenPopup(title);
+    }
+
+    if (!ImGui::BeginPopupModal(title, nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+        return;
+    }
+    if (!show) {
+        // キャンセル完了・接続完了
+        m_connectionPipeline->acknowledge();
+        ImGui::CloseCurrentPopup();
+        ImGui::EndPopup();
+        return;
+    }
+
+    ImGui::TextUnformatted(m_connectionPipeline->host().c_str());
+    ImGui::Spacing();
+
+    if (failed) {
+        ImGui::TextColored(ImVec4(0.85f, 0.35f, 0.35f, 1.0f), "%s", loc.connectFailed);
+        std::string error = m_connectionPipeline->error();
+        if (!error.empty()) {
+            ImGui::TextUnformatted(error.c_str());
+        }
+        ImGui::Spacing();
+        if (ImGui::Button(loc.connectClose, ImVec2(100, 0))) {
+            m_connectionPipeline->acknowledge();
+            ImGui::CloseCurrentPopup();
+        }
+        ImGui::EndPopup();
+        return;
+    }
+
+    // 段階ごとの表示（Resolve〜OpenShellの5段階）
+    const char* label = loc.connectStageResolve;
+    switch (stage) {
+        case ConnectStage::Connect: label = loc.connectStageConnect; break;
+        case ConnectStage::Auth: label = loc.connectStageAuth; break;
+        case ConnectStage::Bootstrap: label = loc.connectStageBootstrap; break;
+        case ConnectStage::OpenShell: label = loc.connectStageOpenShell; break;
+        default: break;
+    }
+    const int stageCount = static_cast<int>(ConnectStage::OpenShell) - static_cast<int>(ConnectStage::Resolve) + 1;
+    int stageNumber = static_cast<int>(stage) - static_cast<int>(ConnectStage::Resolve) + 1;
+    if (m_connectionPipeline->isCancelling()) {
+        label = loc.connectCancelling;
+    }
+
+    char overlay[32];
+    snprintf(overlay, sizeof(overlay), "%d / %d", stageNumber, stageCount);
+    ImGui::TextUnformatted(label);
+    ImGui::ProgressBar(static_cast<float>(stageNumber) / static_cast<float>(stageCount), ImVec2(300, 0), overlay);
+    ImGui::Spacing();
+
+    if (ImGui::Button(loc.connectCancel, ImVec2(100, 0))) {
+        m_connectionPipeline->cancel();
+    }
+    ImGui::EndPopup();
+}
+
 void App::disconnect() {
     // tmuxからデタッチ（セッションは維持）
     m_tmuxController->detach();
-    m_tmuxController->closeControlChannel();
-    m_sshConnection->disconnect();
+    // 実行中の転送に中断を要求する（キャンセルした項目は再接続後に再試行できる）
+    m_transferManager->cancelAll();
+    // 止まるのを待ってセッションを閉じるのは接続処理のワーカーで行う（応答待ちの上限までUIを止めない）
+    TransferManager* transfers = m_transferManager.get();
+    m_connectionPipeline->disconnect([transfers]() {
+        transfers->waitIdle();
+    });
     m_connected = false;
     m_connectedProfileName.clear();
     m_terminalDock->onDisconnected();
     if (m_folderTreeDock) {
         m_folderTreeDock->onDisconnected();
     }
+    if (m_sessionDock) {
+        m_sessionDock->onDisconnected();
+    }
+    m_pollScheduler->reset();
 }
 
 void App::framebufferSizeCallback(GLFWwindow* window, int width, int height) {
@@ -792,10 +946,18 @@ void App::shutdown() {
         m_appSettings.save();
     }
 
+    // 接続処理のワーカーを先に止める（セッションとtmuxコントローラを使っているため）
+    m_connectionPipeline.reset();
+    // 登録した問い合わせがドックを指しているので、ドックより先に破棄する
+    m_pollScheduler.reset();
+    m_hostFactsCache.reset();
     m_terminalDock.reset();
     m_connectionDialog.reset();
     m_settingsDialog.reset();
     m_commandDock.reset();
+    m_transferDock.reset();
+    m_sessionDock.reset();
+    m_transferManager.reset();
     m_tmuxController.reset();
     m_sshConnection.reset();
     m_profileManager->save();
@@ -0,0 +1,324 @@
+#include "ConnectionPipeline.h"
+#include "Terminal.h"
+#include "HostFactsCache.h"
+#include <iostream>
+#include <chrono>
+
+namespace pbterm {
+
+namespace {
+
+// シェルの最初の出力（プロンプト）を待つ上限と、待ちを区切る単位
+constexpr int kShellReadyTimeoutMs = 2000;
+constexpr int kShellReadySliceMs = 20;
+
+std::string shellQuote(const std::string& s) {
+    std::string out = "'";
+    for (char c : s) {
+        if (c == '\'') {
+            out += "'\\''";
+        } else {
+            out += c;
+        }
+    }
+    out += "'";
+    return out;
+}
+
+ConnectStage stageForPhase(ConnectPhase phase) {
+    switch (phase) {
+        case ConnectPhase::Resolve: return ConnectStage::Resolve;
+        case ConnectPhase::Connect: return ConnectStage::Connect;
+        case ConnectPhase::Auth: return ConnectStage::Auth;
+    }
+    return ConnectStage::Connect;
+}
+
+// 読み取りスレッドがターミナルへ書き込まないよう、チャンネルを閉じてから破棄する
+void releaseShell(ConnectedShell& shell) {
+    if (shell.channel) {
+        shell.channel->close();
+        shell.channel.reset();
+    }
+    shell.terminal.reset();
+}
+
+} // namespace
+
+ConnectionPipeline::ConnectionPipeline(SshConnection* connection, TmuxController* tmux, HostFactsCache* cache)
+    : m_connection(connection)
+    , m_tmux(tmux)
+    , m_cache(cache)
+{
+}
+
+ConnectionPipeline::~ConnectionPipeline() {
+    m_cancel = true;
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+    releaseShell(m_result);
+}
+
+void ConnectionPipeline::start(const SshConfig& config, const std::string& profileName) {
+    // 切断の途中ならUIスレッドでは待たず、新しいワーカーが終わるのを待ってから接続する
+    std::thread teardown;
+    if (m_disconnecting) {
+        teardown = std::move(m_worker);
+    }
+    m_cancel = true;
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+    releaseShell(m_result);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error.clear();
+        m_profileName = profileName;
+        m_host = config.username + "@" + config.host;
+        m_result = ConnectedShell();
+        m_hasRefreshed = false;
+    }
+    m_cancel = false;
+    m_stage = ConnectStage::Resolve;
+    m_worker = std::thread([this, config, teardown = std::move(teardown)]() mutable {
+        if (teardown.joinable()) {
+            teardown.join();
+        }
+        run(config);
+    });
+}
+
+void ConnectionPipeline::cancel() {
+    m_cancel = true;
+}
+
+bool ConnectionPipeline::isBusy() const {
+    ConnectStage stage = m_stage;
+    return stage != ConnectStage::Idle && stage != ConnectStage::Done &&
+           stage != ConnectStage::Failed && stage != ConnectStage::Cancelled;
+}
+
+std::string ConnectionPipeline::error() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_error;
+}
+
+std::string ConnectionPipeline::profileName() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_profileName;
+}
+
+std::string ConnectionPipeline::host() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_host;
+}
+
+bool ConnectionPipeline::takeResult(ConnectedShell& shell) {
+    if (m_stage != ConnectStage::Done) {
+        return false;
+    }
+    // ワーカーはこの後も確かめ直しを続けていることがあるので、ここでは待たない
+    std::lock_guard<std::mutex> lock(m_mutex);
+    shell = std::move(m_result);
+    m_result = ConnectedShell();
+    m_stage = ConnectStage::Idle;
+    return true;
+}
+
+void ConnectionPipeline::acknowledge() {
+    ConnectStage stage = m_stage;
+    if (stage != ConnectStage::Failed && stage != ConnectStage::Cancelled) {
+        return;
+    }
+    if (m_worker.joinable()) {
+        m_worker.join();
+    }
+    m_stage = ConnectStage::Idle;
+}
+
+bool ConnectionPipeline::takeRefreshedFacts(RemoteFacts& facts) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_hasRefreshed) {
+        return false;
+    }
+    facts = m_refreshed;
+    m_hasRefreshed = false;
+    return true;
+}
+
+void ConnectionPipeline::disconnect(std::function<void()> quiesce) {
+    // 確かめ直しは同じセッションでexecしているので、先に止めてからセッションを閉じる
+    m_cancel = true;
+    std::thread previous = std::move(m_worker);
+    m_disconnecting = true;
+    m_worker = std::thread([this, quiesce, previous = std::move(previous)]() mutable {
+        if (previous.joinable()) {
+            previous.join();
+        }
+        m_tmux->closeControlChannel();
+        if (quiesce) {
+            quiesce();
+        }
+        m_connection->disconnect();
+        m_disconnecting = false;
+    });
+}
+
+void ConnectionPipeline::finish(ConnectStage stage, const std::string& error) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_error = error;
+    }
+    m_stage = stage;
+}
+
+void ConnectionPipeline::run(SshConfig config) {
+    ConnectHooks hooks;
+    hooks.keepGoing = [this]() { return keepGoing(); };
+    hooks.onPhase = [this](ConnectPhase phase) { setStage(stageForPhase(phase)); };
+
+    if (!m_connection->connect(config, hooks)) {
+        std::string error = m_connection->lastError();
+        std::cerr << "ConnectionPipeline: " << error << std::endl;
+        finish(keepGoing() ? ConnectStage::Failed : ConnectStage::Cancelled, error);
+        return;
+    }
+
+    ConnectedShell shell;
+    m_tmux->setConnection(m_connection);
+    std::string endpoint = m_connection->endpoint();
+
+    if (m_cache && m_cache->lookup(endpoint, shell.facts)) {
+        // 前回の情報でタブを先に出す（セッションはアタッチ時にnew-session -Aで作られる）
+        shell.fromCache = true;
+        shell.facts.sessionReady = !shell.facts.tmuxPath.empty();
+        std::cout << "ConnectionPipeline: キャッシュしたホスト情報を使用: " << endpoint << std::endl;
+    } else if (keepGoing()) {
+        // リモートの情報収集とtmuxセッションの準備を1回のexecで行う
+        // （POSIXシェルがない・tmuxがない場合は直接シェルで続ける）
+        setStage(ConnectStage::Bootstrap);
+        std::string error;
+        if (runRemoteBootstrap(*m_connection, m_tmux->sessionName(), shell.facts, error,
+                               true, [this]() { return keepGoing(); })) {
+            if (m_cache) {
+                m_cache->store(endpoint, shell.facts);
+            }
+        } else {
+            std::cerr << "ConnectionPipeline: " << error << std::endl;
+        }
+    }
+    shell.tmuxAttached = m_tmux->adoptBootstrap(shell.facts);
+    shell.tmuxMissing = shell.facts.received && shell.facts.tmuxPath.empty();
+    if (shell.tmuxAttached) {
+        shell.windows = m_tmux->windows();
+    }
+
+    bool opened = false;
+    if (keepGoing()) {
+        setStage(ConnectStage::OpenShell);
+        if (shell.tmuxAttached && m_tmux->startControlMode()) {
+            // ペインの出力はコントロールモードで受け取り、ウィンドウごとのTerminalに描く（シェルは開かない）
+            shell.controlMode = true;
+            shell.windows = m_tmux->listWindows();
+            opened = true;
+        } else {
+            opened = openShell(shell);
+        }
+    }
+
+    if (!opened || !keepGoing()) {
+        // 途中で止めたときは開いたものをすべて閉じ、未接続の状態に戻す
+        std::string error = keepGoing() ? m_connection->lastError() : "";
+        releaseShell(shell);
+        m_tmux->detach();
+        m_tmux->closeControlChannel();
+        m_connection->disconnect();
+        finish(keepGoing() ? ConnectStage::Failed : ConnectStage::Cancelled, error);
+        return;
+    }
+
+    bool fromCache = shell.fromCache;
+    RemoteFacts cached = shell.facts;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_result = std::move(shell);
+    }
+    finish(ConnectStage::Done, "");
+
+    if (fromCache) {
+        revalidate(endpoint, cached);
+    }
+}
+
+void ConnectionPipeline::revalidate(const std::string& endpoint, const RemoteFacts& cached) {
+    // シェル側のnew-session -Aと競合しないよう、ここではセッションを作らない
+    RemoteFacts facts;
+    std::string error;
+    bool ok = runRemoteBootstrap(*m_connection, m_tmux->sessionName(), facts, error,
+                                 false, [this]() { return keepGoing(); });
+    if (!keepGoing()) {
+        return;
+    }
+    if (!ok) {
+        // POSIXシェルのないホスト（Windows）はドライブ一覧だけをキャッシュしている
+        std::cerr << "ConnectionPipeline: 再検証: " << error << std::endl;
+        return;
+    }
+    if (!facts.sessionReady) {
+        // アタッチがまだ終わっていなければ、ウィンドウ一覧は前回のものを残す
+        facts.windowListing = cached.windowListing;
+    }
+    if (m_cache) {
+        m_cache->store(endpoint, facts);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_refreshed = facts;
+    m_hasRefreshed = true;
+}
+
+bool ConnectionPipeline::openShell(ConnectedShell& shell) {
+    shell.terminal = std::make_unique<Terminal>(80, 24);
+
+    // 最初の出力からターミナルへ流す（プロンプトが出たらシェルの準備ができたとみなす）
+    Terminal* terminal = shell.terminal.get();
+    auto ready = std::make_shared<std::atomic<bool>>(false);
+    shell.channel = m_connection->createChannel(80, 24, [terminal, ready](const char* data, size_t len) {
+        ready->store(true);
+        terminal->onData(data, len);
+    });
+    if (!shell.channel) {
+        std::cerr << "ConnectionPipeline: チャンネル作成失敗" << std::endl;
+        return false;
+    }
+    shell.terminal->setChannel(shell.channel, false);
+
+    if (!shell.tmuxAttached) {
+        std::cout << "ConnectionPipeline: 直接シェル接続" << std::endl;
+        return true;
+    }
+
+    // 固定時間待つ代わりに、プロンプトが届くまで（最大kShellReadyTimeoutMs）待ってから送る
+    for (int waitedMs = 0; !ready->load() && waitedMs < kShellReadyTimeoutMs; waitedMs += kShellReadySliceMs) {
+        if (!keepGoing()) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(kShellReadySliceMs));
+    }
+
+    // tmuxセッションにアタッチ（ブートストラップで見つけたパスを使うので、ログインシェルのPATHに依存しない）
+    std::string sessionName = m_tmux->sessionName();
+    std::string tmux = m_tmux->tmuxPath();
+    // -A: セッションがあればアタッチ、なければ作成（キャッシュで接続したときは作成もここで行う）
+    // ログインシェルの入力として解釈されるので、パスも名前も引用符で囲む
+    // （-sは-tと違って前方一致をせず、そのままの名前で探すので = は付けない）
+    std::string attachCmd = shellQuote(tmux) + " new-session -A -s " + shellQuote(sessionName) + "\n";
+    shell.channel->write(attachCmd.c_str(), attachCmd.size());
+
+    std::cout << "ConnectionPipeline: tmuxセッション '" << sessionName << "' に接続" << std::endl;
+    return true;
+}
+
+} // namespace pbterm
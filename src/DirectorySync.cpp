@@ -0,0 +1,874 @@
+#include "DirectorySync.h"
+#include "SshConnection.h"
+#include "SftpTransfer.h"
+#include "Sha256.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace pbterm {
+
+namespace {
+
+// 更新時刻の比較で許容する差（FAT等の2秒精度・小数部の切り捨てを考慮）
+constexpr int64_t kMtimeToleranceSec = 1;
+
+// 差分転送のブロックサイズ（リモートファイルを最大kMaxBlocks個に分割）
+constexpr uint64_t kMinBlockSize = 64 * 1024;
+constexpr uint64_t kMaxBlockSize = 8 * 1024 * 1024;
+constexpr uint64_t kMaxBlocks = 4096;
+
+// 一致したブロックがこの割合未満なら差分を使わず全体を転送する
+constexpr double kMinReuseRatio = 0.1;
+
+// 照合中に中断・一時停止を確認する間隔
+constexpr uint64_t kCheckpointInterval = 16 * 1024 * 1024;
+
+// 照合時にローカルファイルを一度に読む量
+constexpr uint64_t kLocalWindowSize = 32 * 1024 * 1024;
+
+// 1回のexecに渡すコマンドラインの上限（ARG_MAXより十分小さく）
+constexpr size_t kMaxCommandLength = 64 * 1024;
+
+// リモートのexec（無通信タイムアウト）
+constexpr int kListTimeoutMs = 30000;
+constexpr int kHashTimeoutMs = 120000;
+constexpr int kAssembleTimeoutMs = 600000;
+
+// sha256sumが無い環境（macOS等）ではshasumを使う
+const char* kHashToolSetup =
+    "if command -v sha256sum >/dev/null 2>&1; then H=sha256sum; else H='shasum -a 256'; fi; ";
+
+std::string shellQuote(const std::string& s) {
+    std::string out = "'";
+    for (char c : s) {
+        if (c == '\'') {
+            out += "'\\''";
+        } else {
+            out += c;
+        }
+    }
+    out += "'";
+    return out;
+}
+
+bool isHexDigest(const std::string& s) {
+    if (s.size() != 64) {
+        return false;
+    }
+    return std::all_of(s.begin(), s.end(), [](char c) { return std::isxdigit(static_cast<unsigned char>(c)) != 0; });
+}
+
+std::string toLower(std::string s) {
+    for (char& c : s) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return s;
+}
+
+std::string formatBytes(uint64_t bytes) {
+    const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    double value = static_cast<double>(bytes);
+    int unit = 0;
+    while (value >= 1024.0 && unit < 4) {
+        value /= 1024.0;
+        unit++;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), unit == 0 ? "%.0f %s" : "%.1f %s", value, units[unit]);
+    return buf;
+}
+
+// POSIX cksumと同じCRC-32（リモートのcksumでブロックの弱いチェックサムを計算できる）
+// 末尾の1バイトを追加し先頭の1バイトを取り除く更新が定数時間でできるので、
+// 1バイトずつずらしながら一致するブロックを探せる
+class CksumCrc {
+public:
+    CksumCrc() {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i << 24;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 0x80000000u) ? ((c << 1) ^ 0x04C11DB7u) : (c << 1);
+            }
+            m_table[i] = c;
+        }
+    }
+
+    uint32_t update(uint32_t crc, uint8_t byte) const {
+        return (crc << 8) ^ m_table[((crc >> 24) ^ byte) & 0xff];
+    }
+
+    // cksumは最後にデータ長（下位バイトから）を加えて反転する
+    uint32_t finish(uint32_t crc, uint64_t length) const {
+        while (length != 0) {
+            crc = update(crc, static_cast<uint8_t>(length & 0xff));
+            length >>= 8;
+        }
+        return ~crc;
+    }
+
+    // 窓の先頭から外れるバイトの寄与（そのバイトの後ろにwindowバイトの0が続いた場合のCRC）
+    // CRCは線形なので、各ビットの寄与のXORで256通りを作る
+    void buildRemoveTable(uint64_t window, uint32_t* table) const {
+        uint32_t bits[8];
+        for (int k = 0; k < 8; ++k) {
+            uint32_t c = update(0, static_cast<uint8_t>(1u << k));
+            for (uint64_t i = 0; i < window; ++i) {
+                c = update(c, 0);
+            }
+            bits[k] = c;
+        }
+        for (int b = 0; b < 256; ++b) {
+            uint32_t c = 0;
+            for (int k = 0; k < 8; ++k) {
+                if (b & (1 << k)) {
+                    c ^= bits[k];
+                }
+            }
+            table[b] = c;
+        }
+    }
+
+private:
+    uint32_t m_table[256];
+};
+
+const CksumCrc& cksumCrc() {
+    static const CksumCrc crc;
+    return crc;
+}
+
+// ローカルファイルの一部をバッファへ読んで照合する（ブロックの一致探しは前から順に進むので、
+// 読み直すのは窓の外へ出たときだけ）
+// mmapは使わない（照合中にファイルが切り詰められるとSIGBUSになる）。短くなっていればload()が失敗する
+class LocalWindow {
+public:
+    ~LocalWindow() {
+        if (m_fd >= 0) {
+            ::close(m_fd);
+        }
+    }
+
+    bool open(const std::string& path, uint64_t blockSize) {
+        m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (m_fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(m_fd, &st) != 0) {
+            return false;
+        }
+        m_size = static_cast<uint64_t>(st.st_size);
+        // 1ブロックと次の1バイト（ローリングチェックサムの更新分）が必ず収まる大きさ
+        m_buffer.resize(static_cast<size_t>(std::max(kLocalWindowSize, blockSize * 2)));
+#ifdef POSIX_FADV_SEQUENTIAL
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        return true;
+    }
+
+    bool contains(uint64_t from, uint64_t to) const {
+        return from >= m_offset && to <= m_offset + m_length;
+    }
+
+    // fromから窓いっぱい（ファイル末尾まで）を読む
+    bool load(uint64_t from) {
+        m_offset = from;
+        m_length = 0;
+        size_t want = static_cast<size_t>(std::min<uint64_t>(m_buffer.size(), m_size - from));
+        while (m_length < want) {
+            ssize_t n = pread(m_fd, m_buffer.data() + m_length, want - m_length,
+                              static_cast<off_t>(from + m_length));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                return false;
+            }
+            m_length += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    const uint8_t* at(uint64_t offset) const { return m_buffer.data() + (offset - m_offset); }
+    uint64_t size() const { return m_size; }
+    size_t capacity() const { return m_buffer.size(); }
+
+private:
+    int m_fd = -1;
+    uint64_t m_size = 0;
+    std::vector<uint8_t> m_buffer;
+    uint64_t m_offset = 0;
+    size_t m_length = 0;
+};
+
+// 組み立て手順（既存ファイルのブロックのコピー、または送ったデータの切り出し）
+struct DeltaOp {
+    bool copy = false;
+    uint64_t first = 0;     // copy: 先頭ブロック番号 / literal: 送信データ内のオフセット
+    uint64_t count = 0;     // copy: ブロック数 / literal: バイト数
+};
+
+uint64_t chooseBlockSize(uint64_t size) {
+    uint64_t block = (size + kMaxBlocks - 1) / kMaxBlocks;
+    block = (block + kMinBlockSize - 1) / kMinBlockSize * kMinBlockSize;
+    return std::clamp(block, kMinBlockSize, kMaxBlockSize);
+}
+
+// sha256sumの出力行からファイル名を取り出す（特殊文字を含む名前は先頭に\が付きエスケープされる）
+bool parseHashLine(const std::string& line, std::string& digest, std::string& name) {
+    bool escaped = !line.empty() && line[0] == '\\';
+    size_t start = escaped ? 1 : 0;
+    if (line.size() < start + 66) {
+        return false;
+    }
+    digest = toLower(line.substr(start, 64));
+    if (!isHexDigest(digest)) {
+        return false;
+    }
+    // "digest  name"（バイナリモードは"digest *name"）
+    std::string raw = line.substr(start + 66);
+    if (!escaped) {
+        name = raw;
+        return true;
+    }
+    name.clear();
+    for (size_t i = 0; i < raw.size(); ++i) {
+        if (raw[i] == '\\' && i + 1 < raw.size()) {
+            ++i;
+            name += (raw[i] == 'n') ? '\n' : raw[i];
+        } else {
+            name += raw[i];
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+uint64_t SyncPlan::bytesToSend() const {
+    uint64_t total = 0;
+    for (const auto& entry : files) {
+        if (entry.action != SyncAction::Skip) {
+            total += entry.size;
+        }
+    }
+    return total;
+}
+
+int SyncPlan::count(SyncAction action) const {
+    return static_cast<int>(std::count_if(files.begin(), files.end(), [action](const SyncEntry& entry) {
+        return entry.action == action;
+    }));
+}
+
+std::string SyncPlan::report() const {
+    std::ostringstream out;
+    for (const auto& dir : directories) {
+        out << "mkdir   " << dir << "\n";
+    }
+    for (const auto& entry : files) {
+        if (entry.action == SyncAction::Skip) continue;
+        out << (entry.action == SyncAction::Delta ? "delta   " : "upload  ") << entry.relativePath
+            << "  (" << formatBytes(entry.size) << ", " << entry.reason << ")\n";
+    }
+    out << "転送: " << (count(SyncAction::Upload) + count(SyncAction::Delta)) << " ファイル（"
+        << formatBytes(bytesToSend()) << "、うち差分転送 " << count(SyncAction::Delta) << "）、"
+        << "変更なし: " << count(SyncAction::Skip) << " ファイル、"
+        << "作成するディレクトリ: " << directories.size() << "\n";
+    return out.str();
+}
+
+DirectorySync::DirectorySync(SshConnection* connection)
+    : m_connection(connection)
+{
+}
+
+std::string DirectorySync::joinRemote(const std::string& base, const std::string& name) {
+    char sep = (base.find('\\') != std::string::npos && base.find('/') == std::string::npos) ? '\\' : '/';
+    std::string rel = name;
+    if (sep == '\\') {
+        std::replace(rel.begin(), rel.end(), '/', '\\');
+    }
+    if (base.empty()) return rel;
+    if (base.back() == sep) return base + rel;
+    return base + sep + rel;
+}
+
+bool DirectorySync::plan(const std::string& localDir, const std::string& remoteDir, const SyncOptions& options,
+                         SyncPlan& plan, std::string& error, const std::function<bool()>& shouldContinue) {
+    namespace fs = std::filesystem;
+
+    plan = SyncPlan();
+    auto cancelled = [&]() {
+        if (shouldContinue && !shouldContinue()) {
+            error = "転送が中断されました";
+            return true;
+        }
+        return false;
+    };
+
+    if (!m_connection || !m_connection->isConnected()) {
+        error = "未接続";
+        return false;
+    }
+
+    std::map<std::string, RemoteInfo> remote;
+    bool exists = false;
+    if (!listRemoteTree(remoteDir, remote, exists, error)) {
+        return false;
+    }
+    if (!exists) {
+        plan.directories.push_back(remoteDir);
+    }
+
+    // ローカルツリーと突き合わせる（ディレクトリは親から順に並ぶ）
+    std::vector<size_t> hashCandidates;
+    fs::path root(localDir);
+    std::error_code ec;
+    fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec);
+    fs::recursive_directory_iterator end;
+    for (; !ec && it != end; it.increment(ec)) {
+        if (cancelled()) {
+            return false;
+        }
+
+        std::string rel = it->path().lexically_relative(root).generic_string();
+        auto found = remote.find(rel);
+
+        std::error_code typeEc;
+        if (it->is_directory(typeEc)) {
+            if (found == remote.end() || !found->second.isDir) {
+                plan.directories.push_back(joinRemote(remoteDir, rel));
+            }
+            continue;
+        }
+        if (!it->is_regular_file(typeEc)) {
+            continue;
+        }
+
+        struct stat st;
+        if (::stat(it->path().c_str(), &st) != 0) {
+            continue;
+        }
+
+        SyncEntry entry;
+        entry.relativePath = rel;
+        entry.localPath = it->path().string();
+        entry.remotePath = joinRemote(remoteDir, rel);
+        entry.size = static_cast<uint64_t>(st.st_size);
+        entry.mtime = static_cast<int64_t>(st.st_mtime);
+
+        if (found == remote.end() || found->second.isDir) {
+            entry.action = SyncAction::Upload;
+            entry.reason = "new";
+        } else {
+            const RemoteInfo& info = found->second;
+            bool sizeChanged = info.size != entry.size;
+            bool mtimeChanged = std::llabs(info.mtime - entry.mtime) > kMtimeToleranceSec;
+            if (sizeChanged || mtimeChanged) {
+                entry.reason = sizeChanged ? "size" : "mtime";
+                bool deltaWorthIt = options.useDelta && entry.size >= options.deltaMinSize &&
+                                    info.size >= options.deltaMinSize;
+                entry.action = deltaWorthIt ? SyncAction::Delta : SyncAction::Upload;
+            } else {
+                entry.action = SyncAction::Skip;
+                entry.reason = "same";
+                if (options.compareHashes) {
+                    hashCandidates.push_back(plan.files.size());
+                }
+            }
+        }
+        plan.files.push_back(std::move(entry));
+    }
+    if (ec) {
+        error = "ローカルディレクトリ走査エラー: " + localDir;
+        return false;
+    }
+
+    // サイズ・更新時刻が同じファイルも内容を比較（リモート側は一括で計算）
+    if (!hashCandidates.empty()) {
+        std::vector<std::string> rels;
+        rels.reserve(hashCandidates.size());
+        for (size_t index : hashCandidates) {
+            rels.push_back(plan.files[index].relativePath);
+        }
+        std::map<std::string, std::string> hashes;
+        remoteHashes(remoteDir, rels, hashes);
+
+        for (size_t index : hashCandidates) {
+            if (cancelled()) {
+                return false;
+            }
+            SyncEntry& entry = plan.files[index];
+            auto remoteHash = hashes.find(entry.relativePath);
+            std::string localHash = Sha256::hashFileRange(entry.localPath, 0, entry.size);
+            if (remoteHash == hashes.end() || localHash.empty() || remoteHash->second != localHash) {
+                entry.reason = "hash";
+                bool deltaWorthIt = options.useDelta && entry.size >= options.deltaMinSize;
+                entry.action = deltaWorthIt ? SyncAction::Delta : SyncAction::Upload;
+            }
+        }
+    }
+
+    std::cout << "同期計画: " << localDir << " -> " << remoteDir << "（転送 "
+              << (plan.count(SyncAction::Upload) + plan.count(SyncAction::Delta)) << " / "
+              << plan.files.size() << " ファイル）" << std::endl;
+    return true;
+}
+
+bool DirectorySync::listRemoteTree(const std::string& remoteDir, std::map<std::string, RemoteInfo>& entries,
+                                   bool& exists, std::string& error) {
+    entries.clear();
+
+    RemoteEntry root;
+    if (!m_connection->statRemote(remoteDir, root)) {
+        // 存在しない場合は空のツリーとして扱う
+        exists = false;
+        return true;
+    }
+    if (!root.isDir) {
+        error = "同期先がディレクトリではありません: " + remoteDir;
+        return false;
+    }
+    exists = true;
+
+    // GNU findで一括取得（1往復で済む）: 種別\tサイズ\t更新時刻\t相対パス\0
+    std::string pending;
+    auto parseRecord = [&](const std::string& record) {
+        size_t t1 = record.find('\t');
+        size_t t2 = (t1 == std::string::npos) ? t1 : record.find('\t', t1 + 1);
+        size_t t3 = (t2 == std::string::npos) ? t2 : record.find('\t', t2 + 1);
+        if (t3 == std::string::npos || t3 + 1 >= record.size()) {
+            return;
+        }
+        RemoteInfo info;
+        char type = record[0];
+        info.isDir = (type == 'd');
+        info.size = std::strtoull(record.c_str() + t1 + 1, nullptr, 10);
+        info.mtime = static_cast<int64_t>(std::strtod(record.c_str() + t2 + 1, nullptr));
+        if (type != 'd' && type != 'f') {
+            // シンボリックリンク等は内容を比較できないので常に転送対象にする
+            info.size = UINT64_MAX;
+        }
+        entries[record.substr(t3 + 1)] = info;
+    };
+
+    ExecCallbacks callbacks;
+    callbacks.onStdout = [&](const char* data, size_t len) {
+        pending.append(data, len);
+        size_t start = 0;
+        size_t pos;
+        while ((pos = pending.find('\0', start)) != std::string::npos) {
+            parseRecord(pending.substr(start, pos - start));
+            start = pos + 1;
+        }
+        pending.erase(0, start);
+        return true;
+    };
+
+    std::string cmd = "cd " + shellQuote(remoteDir) +
+                      " && find . -mindepth 1 -printf '%y\\t%s\\t%T@\\t%P\\0'";
+    int status = m_connection->execStream(cmd, callbacks, kListTimeoutMs);
+    if (status == 0) {
+        return true;
+    }
+
+    // findが使えない環境（BSD find等）はSFTPで辿る
+    entries.clear();
+    return listRemoteTreeSftp(remoteDir, entries, error);
+}
+
+bool DirectorySync::listRemoteTreeSftp(const std::string& remoteDir, std::map<std::string, RemoteInfo>& entries,
+                                       std::string& error) {
+    std::deque<std::string> pending;
+    pending.push_back("");
+
+    while (!pending.empty()) {
+        std::string rel = pending.front();
+        pending.pop_front();
+
+        std::vector<RemoteEntry> list;
+        if (!m_connection->listDirectory(rel.empty() ? remoteDir : joinRemote(remoteDir, rel), list)) {
+            error = m_connection->lastError();
+            return false;
+        }
+
+        for (const auto& entry : list) {
+            std::string childRel = rel.empty() ? entry.name : rel + "/" + entry.name;
+            RemoteInfo info;
+            info.isDir = entry.isDir;
+            info.size = entry.size;
+            info.mtime = static_cast<int64_t>(entry.mtime);
+            entries[childRel] = info;
+            if (entry.isDir) {
+                pending.push_back(childRel);
+            }
+        }
+    }
+    return true;
+}
+
+void DirectorySync::remoteHashes(const std::string& remoteDir, const std::vector<std::string>& relativePaths,
+                                 std::map<std::string, std::string>& hashes) {
+    std::string prefix = std::string(kHashToolSetup) + "cd " + shellQuote(remoteDir) + " && $H --";
+
+    size_t index = 0;
+    while (index < relativePaths.size()) {
+        // コマンドライン長の上限に収まる分ずつまとめて計算
+        std::string cmd = prefix;
+        while (index < relativePaths.size() &&
+               (cmd.size() == prefix.size() || cmd.size() + relativePaths[index].size() + 3 < kMaxCommandLength)) {
+            cmd += " " + shellQuote(relativePaths[index]);
+            ++index;
+        }
+
+        std::string pending;
+        ExecCallbacks callbacks;
+        callbacks.onStdout = [&](const char* data, size_t len) {
+            pending.append(data, len);
+            size_t start = 0;
+            size_t pos;
+            while ((pos = pending.find('\n', start)) != std::string::npos) {
+                std::string digest, name;
+                if (parseHashLine(pending.substr(start, pos - start), digest, name)) {
+                    hashes[name] = digest;
+                }
+                start = pos + 1;
+            }
+            pending.erase(0, start);
+            return true;
+        };
+        // 読めないファイルがあると終了ステータスは0以外になるが、計算できた分は使う
+        m_connection->execStream(cmd, callbacks, kHashTimeoutMs);
+    }
+}
+
+bool DirectorySync::deltaUpload(const std::string& localPath, const std::string& remotePath,
+                                const TransferHooks& hooks, std::string& error) {
+    TransferHooks fullHooks = hooks;
+    fullHooks.resume = false;
+    auto fullUpload = [&]() {
+        return m_connection->uploadFile(localPath, remotePath, fullHooks, error);
+    };
+    auto checkpoint = [&]() {
+        if (hooks.checkpoint && !hooks.checkpoint()) {
+            error = "転送が中断されました";
+            return false;
+        }
+        return true;
+    };
+
+    RemoteEntry old;
+    if (!m_connection->statRemote(remotePath, old) || old.isDir) {
+        return fullUpload();
+    }
+
+    uint64_t blockSize = chooseBlockSize(old.size);
+    LocalWindow local;
+    if (!local.open(localPath, blockSize)) {
+        error = "ローカルファイルを開けません: " + localPath;
+        return false;
+    }
+
+    uint64_t blockCount = old.size / blockSize;
+    if (blockCount == 0 || local.size() < blockSize) {
+        return fullUpload();
+    }
+
+    // 1. リモートの既存ファイルのブロックごとのチェックサム（cksumのCRCとSHA-256）
+    std::unordered_map<uint32_t, std::vector<uint32_t>> weak;
+    std::vector<std::string> strong(blockCount);
+    {
+        std::string bs = std::to_string(blockSize);
+        std::string cmd = std::string(kHashToolSetup) + "f=" + shellQuote(remotePath) + "; i=0; " +
+                          "while [ $i -lt " + std::to_string(blockCount) + " ]; do " +
+                          "c=$(dd if=\"$f\" bs=" + bs + " skip=$i count=1 2>/dev/null | cksum | cut -d' ' -f1); " +
+                          "h=$(dd if=\"$f\" bs=" + bs + " skip=$i count=1 2>/dev/null | $H | cut -c1-64); " +
+                          "echo \"$i $c $h\"; i=$((i+1)); done";
+
+        uint64_t received = 0;
+        std::string pending;
+        ExecCallbacks callbacks;
+        callbacks.onStdout = [&](const char* data, size_t len) {
+            pending.append(data, len);
+            size_t start = 0;
+            size_t pos;
+            while ((pos = pending.find('\n', start)) != std::string::npos) {
+                std::istringstream line(pending.substr(start, pos - start));
+                uint64_t index = 0;
+                uint32_t crc = 0;
+                std::string digest;
+                if (line >> index >> crc >> digest && index < blockCount && isHexDigest(digest)) {
+                    weak[crc].push_back(static_cast<uint32_t>(index));
+                    strong[index] = toLower(digest);
+                    received++;
+                }
+                start = pos + 1;
+            }
+            pending.erase(0, start);
+            return !hooks.checkpoint || hooks.checkpoint();
+        };
+        int status = m_connection->execStream(cmd, callbacks, kHashTimeoutMs);
+        if (!checkpoint()) {
+            return false;
+        }
+        if (status != 0 || received != blockCount) {
+            std::cout << "ブロックチェックサムを取得できないため全体を転送します: " << remotePath << std::endl;
+            return fullUpload();
+        }
+    }
+
+    // 2. ローカルファイルを1バイトずつずらしながら一致するブロックを探す
+    std::filesystem::path payloadTemplate = std::filesystem::temp_directory_path() / "pbterm-delta-XXXXXX";
+    std::string payloadPath = payloadTemplate.string();
+    int payloadFd = mkstemp(payloadPath.data());
+    if (payloadFd < 0) {
+        return fullUpload();
+    }
+    FILE* payload = fdopen(payloadFd, "wb");
+    if (!payload) {
+        ::close(payloadFd);
+        ::unlink(payloadPath.c_str());
+        return fullUpload();
+    }
+    auto removePayload = [&]() {
+        if (payload) {
+            fclose(payload);
+            payload = nullptr;
+        }
+        ::unlink(payloadPath.c_str());
+    };
+
+    const CksumCrc& crc = cksumCrc();
+    uint32_t removeTable[256];
+    crc.buildRemoveTable(blockSize, removeTable);
+
+    const uint64_t size = local.size();
+    std::vector<DeltaOp> ops;
+    uint64_t payloadSize = 0;
+    uint64_t reusedBytes = 0;
+    bool writeFailed = false;
+    bool readFailed = false;
+
+    // 窓の外の範囲は読み直しながら書く（一致のない長い範囲でも窓の大きさずつ）
+    auto flushLiteral = [&](uint64_t from, uint64_t to) {
+        if (to <= from) return;
+        for (uint64_t at = from; at < to && !writeFailed && !readFailed;) {
+            uint64_t chunk = std::min<uint64_t>(to - at, local.capacity());
+            if (!local.contains(at, at + chunk) && !local.load(at)) {
+                readFailed = true;
+                break;
+            }
+            if (fwrite(local.at(at), 1, chunk, payload) != chunk) {
+                writeFailed = true;
+            }
+            at += chunk;
+        }
+        if (!ops.empty() && !ops.back().copy) {
+            ops.back().count += to - from;
+        } else {
+            ops.push_back({false, payloadSize, to - from});
+        }
+        payloadSize += to - from;
+    };
+
+    uint64_t pos = 0;
+    uint64_t literalStart = 0;
+    uint64_t nextCheckpoint = kCheckpointInterval;
+    int64_t previousBlock = -1;
+    uint32_t rolling = 0;
+    bool rollingValid = false;
+
+    while (pos + blockSize <= size && !writeFailed && !readFailed) {
+        if (pos >= nextCheckpoint) {
+            nextCheckpoint = pos + kCheckpointInterval;
+            if (!checkpoint()) {
+                removePayload();
+                return false;
+            }
+        }
+
+        // 現在のブロックと次の1バイトを窓に入れる（窓を進める前に、その手前の未送信分を書き出す）
+        uint64_t needed = std::min(pos + blockSize + 1, size);
+        if (!local.contains(pos, needed)) {
+            flushLiteral(literalStart, pos);
+            literalStart = pos;
+            if (!local.load(pos)) {
+                readFailed = true;
+                break;
+            }
+        }
+        const uint8_t* data = local.at(pos);
+
+        if (!rollingValid) {
+            rolling = 0;
+            for (uint64_t i = 0; i < blockSize; ++i) {
+                rolling = crc.update(rolling, data[i]);
+            }
+            rollingValid = true;
+        }
+
+        auto candidates = weak.find(crc.finish(rolling, blockSize));
+        if (candidates != weak.end()) {
+            // 弱いチェックサムが一致したらSHA-256で確定（直前のブロックの次を優先）
+            Sha256 hasher;
+            hasher.update(data, static_cast<size_t>(blockSize));
+            std::string digest = hasher.hexDigest();
+
+            int64_t match = -1;
+            int64_t expected = previousBlock + 1;
+            if (expected < static_cast<int64_t>(blockCount) && strong[expected] == digest &&
+                std::find(candidates->second.begin(), candidates->second.end(),
+                          static_cast<uint32_t>(expected)) != candidates->second.end()) {
+                match = expected;
+            } else {
+                for (uint32_t index : candidates->second) {
+                    if (strong[index] == digest) {
+                        match = index;
+                        break;
+                    }
+                }
+            }
+
+            if (match >= 0) {
+                flushLiteral(literalStart, pos);
+                if (!ops.empty() && ops.back().copy &&
+                    ops.back().first + ops.back().count == static_cast<uint64_t>(match)) {
+                    ops.back().count++;
+                } else {
+                    ops.push_back({true, static_cast<uint64_t>(match), 1});
+                }
+                reusedBytes += blockSize;
+                previousBlock = match;
+                pos += blockSize;
+                literalStart = pos;
+                rollingValid = false;
+                continue;
+            }
+        }
+
+        if (pos + blockSize < size) {
+            rolling = crc.update(rolling, data[blockSize]) ^ removeTable[data[0]];
+        }
+        ++pos;
+    }
+    flushLiteral(literalStart, size);
+
+    if (readFailed) {
+        // 照合中にファイルが短くなった（書き換え中）。送っても壊れたファイルになるので中止する
+        removePayload();
+        error = "照合中にローカルファイルが変更されました: " + localPath;
+        return false;
+    }
+    if (writeFailed || fflush(payload) != 0) {
+        removePayload();
+        return fullUpload();
+    }
+    fclose(payload);
+    payload = nullptr;
+
+    if (static_cast<double>(reusedBytes) < static_cast<double>(size) * kMinReuseRatio) {
+        std::cout << "一致するブロックが少ないため全体を転送します: " << remotePath << std::endl;
+        removePayload();
+        return fullUpload();
+    }
+
+    std::cout << "差分転送: " << remotePath << "（再利用 " << formatBytes(reusedBytes) << "、送信 "
+              << formatBytes(payloadSize) << "）" << std::endl;
+
+    // 3. 差分データと組み立てスクリプトを送り、リモートで新しいファイルを作る
+    std::string remotePayload = remotePath + ".pbterm-delta";
+    std::string remoteScript = remotePath + ".pbterm-delta.sh";
+    std::string remoteNew = remotePath + ".pbterm-delta.new";
+    auto cleanupRemote = [&]() {
+        m_connection->exec("rm -f " + shellQuote(remotePayload) + " " + shellQuote(remoteScript) + " " +
+                           shellQuote(remoteNew), 10000);
+    };
+
+    if (payloadSize > 0) {
+        TransferHooks payloadHooks = hooks;
+        payloadHooks.resume = false;
+        if (!m_connection->uploadFile(payloadPath, remotePayload, payloadHooks, error)) {
+            removePayload();
+            cleanupRemote();
+            return false;
+        }
+    }
+    removePayload();
+
+    std::ostringstream script;
+    script << "set -e\n"
+           << "f=" << shellQuote(remotePath) << "\n"
+           << "p=" << shellQuote(remotePayload) << "\n"
+           << "n=" << shellQuote(remoteNew) << "\n"
+           << "{\n";
+    for (const auto& op : ops) {
+        if (op.copy) {
+            script << "dd if=\"$f\" bs=" << blockSize << " skip=" << op.first << " count=" << op.count
+                   << " 2>/dev/null\n";
+        } else {
+            script << "tail -c +" << (op.first + 1) << " \"$p\" | head -c " << op.count << "\n";
+        }
+    }
+    script << "} > \"$n\"\n";
+    char mode[16];
+    snprintf(mode, sizeof(mode), "%o", old.permissions & 07777);
+    script << "chmod " << mode << " \"$n\"\n"
+           << kHashToolSetup << "$H \"$n\"\n";
+
+    if (!m_connection->writeRemoteFile(remoteScript, script.str(), error)) {
+        cleanupRemote();
+        return fullUpload();
+    }
+
+    std::string output;
+    ExecCallbacks callbacks;
+    callbacks.onStdout = [&output](const char* chunk, size_t len) {
+        output.append(chunk, len);
+        return true;
+    };
+    int status = m_connection->execStream("sh " + shellQuote(remoteScript), callbacks, kAssembleTimeoutMs);
+
+    // 4. 組み立て結果をローカルファイル全体のハッシュと照合してから置き換える
+    Sha256 hasher;
+    for (uint64_t at = 0; at < size; at += local.capacity()) {
+        if (!local.load(at)) {
+            cleanupRemote();
+            error = "照合中にローカルファイルが変更されました: " + localPath;
+            return false;
+        }
+        hasher.update(local.at(at), static_cast<size_t>(std::min<uint64_t>(local.capacity(), size - at)));
+    }
+    std::string expected = hasher.hexDigest();
+    std::string actual = output.size() >= 64 ? toLower(output.substr(0, 64)) : "";
+
+    if (status != 0 || actual != expected) {
+        std::cerr << "差分の組み立て結果が一致しないため全体を転送します: " << remotePath << std::endl;
+        cleanupRemote();
+        return fullUpload();
+    }
+
+    int moved = m_connection->execStream("mv -f " + shellQuote(remoteNew) + " " + shellQuote(remotePath) +
+                                         " && rm -f " + shellQuote(remotePayload) + " " + shellQuote(remoteScript),
+                                         ExecCallbacks(), 10000);
+    if (moved != 0) {
+        cleanupRemote();
+        error = "差分転送したファイルを置き換えられません: " + remotePath;
+        return false;
+    }
+
+    if (hooks.onProgress) {
+        hooks.onProgress(size);
+    }
+    return true;
+}
+
+} // namespace pbterm
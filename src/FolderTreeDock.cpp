@@ -2,6 +2,9 @@
 #include "SshConnection.h"
 #include "TerminalDock.h"
 #include "SettingsDialog.h"
+#include "TransferManager.h"
+#include "RemoteBootstrap.h"
+#include "HostFactsCache.h"
 #include "imgui.h"
 #include <algorithm>
 #include <cctype>
@@ -9,7 +12,6 @@
 #include <cstring>
 #include <sstream>
 #include <filesystem>
-#include <thread>
 #include <iostream>
 #include <cstdlib>
 
@@ -35,18 +37,35 @@ void FolderTreeDock::setTerminalDock(TerminalDock* terminalDock) {
     m_terminalDock = terminalDock;
 }
 
-void FolderTreeDock::onConnected() {
+void FolderTreeDock::onConnected(const RemoteFacts& facts) {
+    // 接続時のブートストラップで分かったOSとホームを使い、ここではexecしない
+    m_platform = facts.isUnix() ? RemotePlatform::Unix : RemotePlatform::Windows;
+    m_home = facts.home;
     refreshRoots();
 }
 
+void FolderTreeDock::updateFacts(const RemoteFacts& facts) {
+    RemotePlatform platform = facts.isUnix() ? RemotePlatform::Unix : RemotePlatform::Windows;
+    if (!facts.home.empty()) {
+        m_home = facts.home;
+    }
+    if (platform != m_platform) {
+        m_platform = platform;
+        refreshRoots();
+    }
+}
+
 void FolderTreeDock::onDisconnected() {
     m_roots.clear();
     m_platform = RemotePlatform::Unknown;
+    m_home.clear();
 }
 
 void FolderTreeDock::render() {
     const Localization& loc = getLocalization(m_language);
 
+    processFinishedTransfers();
+
     if (!m_connection || !m_connection->isConnected()) {
         ImGui::TextUnformatted(loc.termPleaseConnect);
         return;
@@ -128,29 +147,8 @@ void FolderTreeDock::render() {
 
     ImGui::Separator();
 
-    // アップロード進行状況表示
-    if (m_uploading) {
-        ImGui::Separator();
-        ImGui::TextUnformatted(u8"\ue2c6");  // upload アイコン
-        ImGui::SameLine();
-        if (!m_uploadCurrentFile.empty()) {
-            ImGui::Text("%s", m_uploadCurrentFile.c_str());
-        }
-        ImGui::ProgressBar(m_uploadProgress, ImVec2(-1, 0));
-        ImGui::Separator();
-    }
-
-    // ダウンロード進行状況表示
-    if (m_downloading) {
-        ImGui::Separator();
-        ImGui::TextUnformatted(u8"\ue2c4");  // download アイコン
-        ImGui::SameLine();
-        if (!m_downloadCurrentFile.empty()) {
-            ImGui::Text("%s", m_downloadCurrentFile.c_str());
-        }
-        ImGui::ProgressBar(m_downloadProgress, ImVec2(-1, 0));
-        ImGui::Separator();
-    }
+    // 転送の進行状況表示（詳細は転送ドック）
+    renderTransferProgress();
 
     // ドロップターゲットをリセット（次のフレームで更新される）
     m_dropTargetPath.clear();
@@ -182,19 +180,11 @@ void FolderTreeDock::render() {
 void FolderTreeDock::refreshRoots() {
     m_roots.clear();
 
-    std::string uname = trim(exec("uname -s"));
-    if (!uname.empty()) {
-        std::string lower = uname;
-        std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c){ return std::tolower(c); });
-        if (lower.find("linux") != std::string::npos ||
-            lower.find("darwin") != std::string::npos ||
-            lower.find("bsd") != std::string::npos) {
-            m_platform = RemotePlatform::Unix;
-        }
-    }
-
+    // OSが分かっていなければ調べる（通常はonConnectedで設定済み）
     if (m_platform == RemotePlatform::Unknown) {
-        m_platform = RemotePlatform::Windows;
+        RemoteFacts facts;
+        facts.os = trim(exec("uname -s"));
+        m_platform = facts.isUnix() ? RemotePlatform::Unix : RemotePlatform::Windows;
     }
 
     if (m_platform == RemotePlatform::Unix) {
@@ -204,15 +194,27 @@ void FolderTreeDock::refreshRoots() {
         root->isDir = true;
         m_roots.push_back(std::move(root));
     } else {
-        std::string drives = exec("powershell -NoProfile -Command \"Get-PSDrive -PSProvider FileSystem | ForEach-Object { $_.Root }\"");
-        std::istringstream iss(drives);
-        std::string line;
-        while (std::getline(iss, line)) {
-            line = trim(line);
-            if (line.empty()) continue;
+        // ドライブ一覧はほとんど変わらないため、接続先ごとにキャッシュする
+        std::string endpoint = m_connection ? m_connection->endpoint() : "";
+        std::vector<std::string> drives;
+        if (!m_hostFactsCache || !m_hostFactsCache->lookupDrives(endpoint, drives)) {
+            std::string output = exec("powershell -NoProfile -Command \"Get-PSDrive -PSProvider FileSystem | ForEach-Object { $_.Root }\"");
+            std::istringstream iss(output);
+            std::string line;
+            while (std::getline(iss, line)) {
+                line = trim(line);
+                if (!line.empty()) {
+                    drives.push_back(line);
+                }
+            }
+            if (m_hostFactsCache && !drives.empty()) {
+                m_hostFactsCache->storeDrives(endpoint, drives);
+            }
+        }
+        for (const auto& drive : drives) {
             auto root = std::make_unique<Node>();
-            root->name = line;
-            root->path = line;
+            root->name = drive;
+            root->path = drive;
             root->isDir = true;
             m_roots.push_back(std::move(root));
         }
@@ -704,34 +706,9 @@ void FolderTreeDock::downloadToLocal(const std::string& remotePath, bool isDir)
 
     std::cout << "ダウンロード開始: " << remotePath << " -> " << localPath << std::endl;
 
-    m_downloading = true;
-    m_downloadProgress = 0.0f;
-    m_downloadCurrentFile = filename;
-
-    // 別スレッドでダウンロードを実行
-    std::thread downloadThread([this, remotePath, localPath, isDir]() {
-        bool success = false;
-
-        if (isDir) {
-            success = m_connection->downloadDirectory(remotePath, localPath);
-        } else {
-            success = m_connection->downloadFile(remotePath, localPath);
-        }
-
-        m_downloading = false;
-        m_downloadProgress = 1.0f;
-        m_downloadCurrentFile.clear();
-
-        if (success) {
-            std::cout << "ダウンロード完了: " << localPath << std::endl;
-            m_downloadedPath = localPath;
-            m_showDownloadComplete = true;
-        } else {
-            std::cerr << "ダウンロード失敗: " << m_connection->lastError() << std::endl;
-        }
-    });
-
-    downloadThread.detach();
+    if (m_transferManager) {
+        m_transferManager->enqueueDownload(remotePath, localPath, isDir);
+    }
 }
 
 void FolderTreeDock::handleExternalFileDrop(const std::vector<std::string>& paths) {
@@ -747,8 +724,7 @@ void FolderTreeDock::handleExternalFileDrop(const std::vector<std::string>& path
     std::string destination = m_dropTargetPath;
     if (destination.empty()) {
         if (m_platform == RemotePlatform::Unix) {
-            destination = exec("echo $HOME");
-            destination = trim(destination);
+            destination = m_home.empty() ? trim(exec("echo $HOME")) : m_home;
             if (destination.empty()) {
                 destination = "/tmp";
             }
@@ -765,58 +741,69 @@ void FolderTreeDock::handleExternalFileDrop(const std::vector<std::string>& path
 
     std::cout << "ファイルドロップ: " << paths.size() << " 件を " << destination << " にアップロード" << std::endl;
 
-    namespace fs = std::filesystem;
-
-    m_uploading = true;
-    m_uploadProgress = 0.0f;
+    if (!m_transferManager) {
+        return;
+    }
 
-    // 別スレッドでアップロードを実行
-    std::thread uploadThread([this, paths, destination]() {
-        int completed = 0;
-        int total = static_cast<int>(paths.size());
+    namespace fs = std::filesystem;
 
-        for (const auto& localPath : paths) {
-            fs::path p(localPath);
-            std::string filename = p.filename().string();
-            m_uploadCurrentFile = filename;
+    // 転送キューに登録（ディレクトリはファイル単位に展開されて並列に転送される）
+    for (const auto& localPath : paths) {
+        std::string filename = fs::path(localPath).filename().string();
 
-            std::string remotePath;
-            if (m_platform == RemotePlatform::Unix) {
-                remotePath = joinPathUnix(destination, filename);
-            } else {
-                remotePath = joinPathWindows(destination, filename);
-            }
+        std::string remotePath;
+        if (m_platform == RemotePlatform::Unix) {
+            remotePath = joinPathUnix(destination, filename);
+        } else {
+            remotePath = joinPathWindows(destination, filename);
+        }
 
-            std::cout << "アップロード中: " << localPath << " -> " << remotePath << std::endl;
+        std::cout << "アップロード登録: " << localPath << " -> " << remotePath << std::endl;
+        m_transferManager->enqueueUpload(localPath, remotePath);
+    }
+}
 
-            bool success = false;
-            if (fs::is_directory(localPath)) {
-                success = m_connection->uploadDirectory(localPath, remotePath);
-            } else {
-                success = m_connection->uploadFile(localPath, remotePath);
-            }
+void FolderTreeDock::renderTransferProgress() {
+    if (!m_transferManager || !m_transferManager->hasActive()) {
+        return;
+    }
 
-            if (success) {
-                std::cout << "完了: " << filename << std::endl;
-            } else {
-                std::cerr << "失敗: " << filename << " - " << m_connection->lastError() << std::endl;
-            }
+    for (const auto& item : m_transferManager->snapshot()) {
+        if (item.isFinished()) continue;
 
-            completed++;
-            m_uploadProgress = static_cast<float>(completed) / static_cast<float>(total);
-        }
+        ImGui::Separator();
+        ImGui::TextUnformatted(item.direction == TransferDirection::Upload ? u8"\ue2c6" : u8"\ue2c4");  // upload / download アイコン
+        ImGui::SameLine();
+        ImGui::Text("%s", item.name.c_str());
+        float fraction = item.totalBytes > 0
+            ? static_cast<float>(static_cast<double>(item.transferredBytes) / static_cast<double>(item.totalBytes))
+            : 0.0f;
+        ImGui::ProgressBar(fraction, ImVec2(-1, 0));
+    }
+    ImGui::Separator();
+}
 
-        m_uploading = false;
-        m_uploadCurrentFile.clear();
-        m_uploadProgress = 1.0f;
+void FolderTreeDock::processFinishedTransfers() {
+    if (!m_transferManager) {
+        return;
+    }
 
-        // ツリーを更新
-        for (auto& root : m_roots) {
-            root->loaded = false;
+    for (const auto& item : m_transferManager->takeFinished()) {
+        if (item.direction == TransferDirection::Upload) {
+            // アップロード先を表示し直す
+            if (item.completedFiles > 0) {
+                for (auto& root : m_roots) {
+                    root->loaded = false;
+                }
+            }
+        } else if (item.state == TransferState::Completed) {
+            std::cout << "ダウンロード完了: " << item.destinationPath << std::endl;
+            m_downloadedPath = item.destinationPath;
+            m_showDownloadComplete = true;
+        } else if (item.state == TransferState::Failed) {
+            std::cerr << "ダウンロード失敗: " << item.error << std::endl;
         }
-    });
-
-    uploadThread.detach();
+    }
 }
 
 } // namespace pbterm
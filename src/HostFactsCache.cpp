@@ -0,0 +1,210 @@
+#include "HostFactsCache.h"
+#include "SettingsDialog.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+
+namespace pbterm {
+
+namespace {
+
+int64_t nowSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool isFresh(const HostFactsEntry& entry, int64_t now) {
+    return now - entry.updated < HostFactsCache::kTtlSeconds;
+}
+
+} // namespace
+
+HostFactsCache::HostFactsCache() = default;
+
+bool HostFactsCache::lookup(const std::string& endpoint, RemoteFacts& facts) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const HostFactsEntry* entry = findFreshLocked(endpoint);
+    if (!entry) {
+        return false;
+    }
+    facts = entry->facts;
+    return true;
+}
+
+void HostFactsCache::store(const std::string& endpoint, const RemoteFacts& facts) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    HostFactsEntry* entry = findLocked(endpoint);
+    if (!entry) {
+        m_entries.push_back(HostFactsEntry());
+        entry = &m_entries.back();
+        entry->endpoint = endpoint;
+    }
+    entry->facts = facts;
+    entry->updated = nowSeconds();
+    saveLocked();
+}
+
+bool HostFactsCache::lookupDrives(const std::string& endpoint, std::vector<std::string>& drives) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const HostFactsEntry* entry = findFreshLocked(endpoint);
+    if (!entry || entry->drives.empty()) {
+        return false;
+    }
+    drives = entry->drives;
+    return true;
+}
+
+void HostFactsCache::storeDrives(const std::string& endpoint, const std::vector<std::string>& drives) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    HostFactsEntry* entry = findLocked(endpoint);
+    if (!entry) {
+        m_entries.push_back(HostFactsEntry());
+        entry = &m_entries.back();
+        entry->endpoint = endpoint;
+        entry->updated = nowSeconds();
+    }
+    entry->drives = drives;
+    saveLocked();
+}
+
+HostFactsEntry* HostFactsCache::findLocked(const std::string& endpoint) {
+    for (auto& entry : m_entries) {
+        if (entry.endpoint == endpoint) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+const HostFactsEntry* HostFactsCache::findFreshLocked(const std::string& endpoint) const {
+    int64_t now = nowSeconds();
+    for (const auto& entry : m_entries) {
+        if (entry.endpoint == endpoint) {
+            return isFresh(entry, now) ? &entry : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+void HostFactsCache::save() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    saveLocked();
+}
+
+void HostFactsCache::saveLocked() {
+    // 期限切れのものは保存しない
+    int64_t now = nowSeconds();
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(), [now](const HostFactsEntry& e) {
+        return !isFresh(e, now);
+    }), m_entries.end());
+
+    std::string path = configPath();
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "ホスト情報キャッシュを開けません: " << path << std::endl;
+        return;
+    }
+
+    // シンプルなテキスト形式で保存（ウィンドウとドライブは1行ずつ）
+    for (const auto& e : m_entries) {
+        file << "[host]\n";
+        file << "endpoint=" << e.endpoint << "\n";
+        file << "updated=" << e.updated << "\n";
+        file << "posix=" << (e.facts.received ? "1" : "0") << "\n";
+        file << "os=" << e.facts.os << "\n";
+        file << "home=" << e.facts.home << "\n";
+        file << "shell=" << e.facts.shell << "\n";
+        file << "tmux=" << e.facts.tmuxPath << "\n";
+        file << "tmux_version=" << e.facts.tmuxVersion << "\n";
+        std::string listing = e.facts.windowListing;
+        size_t start = 0;
+        while (start < listing.size()) {
+            size_t end = listing.find('\n', start);
+            if (end == std::string::npos) {
+                end = listing.size();
+            }
+            if (end > start) {
+                file << "window=" << listing.substr(start, end - start) << "\n";
+            }
+            start = end + 1;
+        }
+        for (const auto& drive : e.drives) {
+            file << "drive=" << drive << "\n";
+        }
+    }
+}
+
+void HostFactsCache::load() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::string path = configPath();
+    std::ifstream file(path);
+
+    m_entries.clear();
+    if (!file.is_open()) {
+        return;
+    }
+
+    std::string line;
+    HostFactsEntry current;
+    bool inEntry = false;
+
+    auto flush = [&]() {
+        if (inEntry && !current.endpoint.empty()) {
+            m_entries.push_back(current);
+        }
+    };
+
+    while (std::getline(file, line)) {
+        // 改行を削除
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+            line.pop_back();
+        }
+
+        if (line == "[host]") {
+            flush();
+            current = HostFactsEntry();
+            inEntry = true;
+            continue;
+        }
+        if (!inEntry) continue;
+
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+        std::string key = line.substr(0, eq);
+        std::string val = line.substr(eq + 1);
+
+        if (key == "endpoint") {
+            current.endpoint = val;
+        } else if (key == "updated") {
+            try {
+                current.updated = std::stoll(val);
+            } catch (...) {
+                current.updated = 0;
+            }
+        } else if (key == "posix") {
+            current.facts.received = (val == "1");
+        } else if (key == "os") {
+            current.facts.os = val;
+        } else if (key == "home") {
+            current.facts.home = val;
+        } else if (key == "shell") {
+            current.facts.shell = val;
+        } else if (key == "tmux") {
+            current.facts.tmuxPath = val;
+        } else if (key == "tmux_version") {
+            current.facts.tmuxVersion = val;
+        } else if (key == "window") {
+            current.facts.windowListing += val + "\n";
+        } else if (key == "drive") {
+            current.drives.push_back(val);
+        }
+    }
+    flush();
+}
+
+std::string HostFactsCache::configPath() const {
+    return AppSettings::configDir() + "/host_facts.cache";
+}
+
+} // namespace pbterm
@@ -0,0 +1,331 @@
+#include "LocalFileIO.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace pbterm {
+
+namespace {
+
+// 読み取りバッファ（一度のpreadで読む量。送信側のチャンクより十分大きくしてシステムコールを減らす）
+constexpr size_t kReadBufferSize = 1024 * 1024;
+
+// ライトビハインドのバッファ（ページ境界にアラインし、I/Oスレッドと交互に使う）
+constexpr size_t kWriteBufferSize = 4 * 1024 * 1024;
+constexpr size_t kWriteBufferCount = 4;
+constexpr size_t kBufferAlignment = 4096;
+
+} // namespace
+
+// ============================================================================
+// LocalFileReader 実装
+// ============================================================================
+
+LocalFileReader::~LocalFileReader() {
+    close();
+}
+
+bool LocalFileReader::open(const std::string& path, uint64_t offset) {
+    close();
+
+    m_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (m_fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0) {
+        close();
+        return false;
+    }
+
+    void* memory = nullptr;
+    if (posix_memalign(&memory, kBufferAlignment, kReadBufferSize) != 0) {
+        close();
+        return false;
+    }
+    m_buffer = static_cast<char*>(memory);
+    m_bufferOffset = offset;
+    m_bufferLength = 0;
+
+    m_size = static_cast<uint64_t>(st.st_size);
+    m_position = offset;
+    m_bad = false;
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    return true;
+}
+
+void LocalFileReader::close() {
+    if (m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    std::free(m_buffer);
+    m_buffer = nullptr;
+    m_bufferLength = 0;
+}
+
+size_t LocalFileReader::read(const char*& data, size_t maxLen) {
+    if (m_fd < 0 || m_bad || maxLen == 0) {
+        return 0;
+    }
+
+    if (m_position < m_bufferOffset || m_position >= m_bufferOffset + m_bufferLength) {
+        if (!fill()) {
+            return 0;
+        }
+    }
+
+    uint64_t available = m_bufferOffset + m_bufferLength - m_position;
+    size_t n = static_cast<size_t>(std::min<uint64_t>(maxLen, available));
+    data = m_buffer + (m_position - m_bufferOffset);
+    m_position += n;
+    return n;
+}
+
+bool LocalFileReader::fill() {
+    m_bufferOffset = m_position;
+    m_bufferLength = 0;
+
+    // 短い読み取りは続けて読む（バッファを埋めてから返し、システムコールの回数を抑える）
+    while (m_bufferLength < kReadBufferSize) {
+        ssize_t n = pread(m_fd, m_buffer + m_bufferLength, kReadBufferSize - m_bufferLength,
+                          static_cast<off_t>(m_bufferOffset + m_bufferLength));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            m_bad = true;
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        m_bufferLength += static_cast<size_t>(n);
+    }
+
+    if (m_bufferLength == 0) {
+        // 開いた時点より短くなっていれば、途中までのファイルを完了扱いにしない
+        if (m_position < m_size) {
+            m_bad = true;
+        }
+        return false;
+    }
+    return true;
+}
+
+// ============================================================================
+// WriteBehindFile 実装
+// ============================================================================
+
+WriteBehindFile::~WriteBehindFile() {
+    close();
+}
+
+bool WriteBehindFile::open(const std::string& path, uint64_t offset, uint64_t expectedSize) {
+    close();
+
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    if (offset == 0) {
+        flags |= O_TRUNC;
+    }
+    m_fd = ::open(path.c_str(), flags, 0644);
+    if (m_fd < 0) {
+        return false;
+    }
+    if (offset > 0 && ftruncate(m_fd, static_cast<off_t>(offset)) != 0) {
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    m_path = path;
+    m_writeOffset = offset;
+    m_stopping = false;
+    m_error = false;
+    if (expectedSize > offset) {
+        preallocate(expectedSize);
+    }
+    return true;
+}
+
+void WriteBehindFile::preallocate(uint64_t size) {
+    // ファイルサイズは変えずに領域だけ確保する
+    // （中断時のサイズが受信済みの長さのままなので、再開位置の判定に影響しない）
+#if defined(__APPLE__)
+    fstore_t store = {F_ALLOCATECONTIG, F_PEOFPOSMODE, 0, static_cast<off_t>(size - m_writeOffset), 0};
+    if (fcntl(m_fd, F_PREALLOCATE, &store) == -1) {
+        store.fst_flags = F_ALLOCATEALL;
+        fcntl(m_fd, F_PREALLOCATE, &store);
+    }
+#elif defined(__linux__)
+    fallocate(m_fd, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(m_writeOffset),
+              static_cast<off_t>(size - m_writeOffset));
+#else
+    (void)size;
+#endif
+}
+
+bool WriteBehindFile::close() {
+    if (m_fd < 0) {
+        return true;
+    }
+
+    bool ok = true;
+    if (m_thread.joinable()) {
+        ok = submitCurrent();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_cv.notify_all();
+        m_thread.join();
+    } else if (m_current.data && m_current.used > 0) {
+        // バッファ1つに収まった小さなファイルはスレッドを起こさずに書く
+        m_current.fileOffset = m_writeOffset;
+        m_writeOffset += m_current.used;
+        ok = writeBuffer(m_current);
+    }
+
+    if (::close(m_fd) != 0) {
+        ok = false;
+    }
+    m_fd = -1;
+    if (m_error) {
+        ok = false;
+    }
+
+    for (char* buffer : m_allocated) {
+        std::free(buffer);
+    }
+    m_allocated.clear();
+    m_free.clear();
+    m_pending.clear();
+    m_current = Buffer();
+    return ok;
+}
+
+char* WriteBehindFile::reserve(size_t maxLen) {
+    if (m_fd < 0 || maxLen > kWriteBufferSize) {
+        return nullptr;
+    }
+    if (m_current.data && kWriteBufferSize - m_current.used < maxLen) {
+        if (!submitCurrent()) {
+            return nullptr;
+        }
+    }
+
+    if (!m_current.data) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (m_free.empty() && m_allocated.size() < kWriteBufferCount) {
+            void* memory = nullptr;
+            if (posix_memalign(&memory, kBufferAlignment, kWriteBufferSize) != 0) {
+                return nullptr;
+            }
+            m_allocated.push_back(static_cast<char*>(memory));
+            m_free.push_back(static_cast<char*>(memory));
+        }
+        // すべてのバッファが書き出し待ちならディスクが追いつくまで待つ
+        m_cv.wait(lock, [this]() { return m_error || !m_free.empty(); });
+        if (m_error) {
+            return nullptr;
+        }
+        m_current.data = m_free.back();
+        m_free.pop_back();
+        m_current.used = 0;
+    }
+    return m_current.data + m_current.used;
+}
+
+void WriteBehindFile::commit(size_t len) {
+    m_current.used += len;
+    if (m_current.used >= kWriteBufferSize) {
+        submitCurrent();
+    }
+}
+
+bool WriteBehindFile::write(const char* data, size_t len) {
+    while (len > 0) {
+        size_t chunk = std::min(len, kWriteBufferSize);
+        char* target = reserve(chunk);
+        if (!target) {
+            return false;
+        }
+        std::memcpy(target, data, chunk);
+        commit(chunk);
+        data += chunk;
+        len -= chunk;
+    }
+    return !failed();
+}
+
+bool WriteBehindFile::failed() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_error;
+}
+
+bool WriteBehindFile::submitCurrent() {
+    if (!m_current.data || m_current.used == 0) {
+        return !failed();
+    }
+
+    Buffer buffer = m_current;
+    buffer.fileOffset = m_writeOffset;
+    m_writeOffset += buffer.used;
+    m_current = Buffer();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(buffer);
+        if (!m_thread.joinable()) {
+            m_thread = std::thread(&WriteBehindFile::ioThread, this);
+        }
+    }
+    m_cv.notify_all();
+    return !failed();
+}
+
+bool WriteBehindFile::writeBuffer(const Buffer& buffer) {
+    size_t written = 0;
+    while (written < buffer.used) {
+        ssize_t n = pwrite(m_fd, buffer.data + written, buffer.used - written,
+                           static_cast<off_t>(buffer.fileOffset + written));
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void WriteBehindFile::ioThread() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [this]() { return m_stopping || !m_pending.empty(); });
+        if (m_pending.empty()) {
+            break;
+        }
+
+        Buffer buffer = m_pending.front();
+        m_pending.pop_front();
+
+        // 一度失敗したら以降は書かずにバッファを返すだけにする
+        bool skip = m_error;
+        lock.unlock();
+        bool ok = !skip && writeBuffer(buffer);
+        lock.lock();
+
+        if (!ok) {
+            m_error = true;
+        }
+        m_free.push_back(buffer.data);
+        m_cv.notify_all();
+    }
+}
+
+} // namespace pbterm
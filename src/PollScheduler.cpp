@@ -0,0 +1,181 @@
+#include "PollScheduler.h"
+#include <algorithm>
+#include <mutex>
+
+namespace pbterm {
+
+namespace {
+
+// まだ測っていないときのRTT（従来の1秒間隔になる値）
+constexpr double kDefaultRttMs = 50.0;
+// 間隔はRTTのこの倍（回線を問い合わせに使う時間を数%に抑える）
+constexpr double kRttMultiple = 20.0;
+// RTTの平滑化の重み（TCPのSRTTと同じ1/8）
+constexpr double kRttGain = 0.125;
+// 応答がSRTTのこの倍より遅れたら回線が詰まっているとみなす
+constexpr double kSaturatedRatio = 2.0;
+// 詰まっているとみなすまでの余裕（RTTが小さいときのゆらぎで延ばさない）
+constexpr double kSaturatedSlackMs = 50.0;
+constexpr int kMaxBackoff = 8;
+// ウィンドウが非アクティブのときの倍率
+constexpr int kUnfocusedFactor = 4;
+
+double toMs(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // namespace
+
+struct PollScheduler::Shared {
+    std::mutex mutex;
+    bool done = false;
+    bool ok = false;
+    std::chrono::steady_clock::time_point doneAt;
+};
+
+PollScheduler::PollScheduler(TmuxController* tmux)
+    : m_tmux(tmux)
+    , m_shared(std::make_shared<Shared>())
+{
+}
+
+PollScheduler::~PollScheduler() = default;
+
+int PollScheduler::add(const std::string& name, int minIntervalMs, int maxIntervalMs, PollFunction poll) {
+    Entry entry;
+    entry.id = ++m_nextId;
+    entry.name = name;
+    entry.minIntervalMs = minIntervalMs;
+    entry.maxIntervalMs = std::max(minIntervalMs, maxIntervalMs);
+    entry.poll = std::move(poll);
+    m_entries.push_back(std::move(entry));
+    return m_nextId;
+}
+
+void PollScheduler::remove(int id) {
+    m_entries.erase(std::remove_if(m_entries.begin(), m_entries.end(),
+                                   [id](const Entry& entry) { return entry.id == id; }),
+                    m_entries.end());
+}
+
+void PollScheduler::trigger(int id) {
+    for (auto& entry : m_entries) {
+        if (entry.id == id) {
+            entry.triggered = true;
+        }
+    }
+}
+
+void PollScheduler::reset() {
+    // 前の接続の応答は古い受け渡し先へ書かせる
+    m_shared = std::make_shared<Shared>();
+    m_inFlight = false;
+    m_srttMs = 0.0;
+    m_backoff = 1;
+    for (auto& entry : m_entries) {
+        entry.triggered = true;
+    }
+}
+
+double PollScheduler::rttMs() const {
+    return m_srttMs > 0.0 ? m_srttMs : kDefaultRttMs;
+}
+
+int PollScheduler::intervalMs(const Entry& entry) const {
+    int interval = static_cast<int>(rttMs() * kRttMultiple);
+    interval = std::clamp(interval, entry.minIntervalMs, entry.maxIntervalMs);
+    interval *= m_backoff;
+    if (!m_focused) {
+        interval *= kUnfocusedFactor;
+    }
+    return interval;
+}
+
+void PollScheduler::collectSample() {
+    if (!m_inFlight) {
+        return;
+    }
+    bool ok = false;
+    std::chrono::steady_clock::time_point doneAt;
+    {
+        std::lock_guard<std::mutex> lock(m_shared->mutex);
+        if (!m_shared->done) {
+            return;
+        }
+        ok = m_shared->ok;
+        doneAt = m_shared->doneAt;
+        m_shared->done = false;
+    }
+    m_inFlight = false;
+    if (!ok) {
+        return;
+    }
+
+    // コントロールモードの応答はペインの出力の後ろに並ぶので、出力が多くて詰まっていればRTTが伸びて見える
+    double sample = toMs(doneAt - m_sentAt);
+    if (m_srttMs <= 0.0) {
+        m_srttMs = sample;
+        return;
+    }
+    if (sample > m_srttMs * kSaturatedRatio + kSaturatedSlackMs) {
+        // 待っている間にtickで延ばしていれば、同じ往復で二重に延ばさない
+        if (!m_stalled) {
+            m_backoff = std::min(m_backoff * 2, kMaxBackoff);
+        }
+    } else if (m_backoff > 1) {
+        m_backoff /= 2;
+    }
+    m_srttMs += kRttGain * (sample - m_srttMs);
+}
+
+void PollScheduler::tick() {
+    collectSample();
+    if (!m_tmux || !m_tmux->isAttached()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (m_inFlight) {
+        // 前の往復が終わるまで次は送らない（応答がなかなか来なければ、その時点で間隔を延ばす）
+        if (!m_stalled && toMs(now - m_sentAt) > rttMs() * kSaturatedRatio + kSaturatedSlackMs) {
+            m_backoff = std::min(m_backoff * 2, kMaxBackoff);
+            m_stalled = true;
+        }
+        return;
+    }
+
+    std::vector<TmuxController::Command> batch;
+    for (auto& entry : m_entries) {
+        if (!entry.triggered && toMs(now - entry.lastRun) < intervalMs(entry)) {
+            continue;
+        }
+        entry.triggered = false;
+        entry.lastRun = now;
+        entry.poll(batch);
+    }
+    if (batch.empty()) {
+        return;
+    }
+
+    // 最後の応答が届いたら1往復が終わったとみなす（途中で失敗しても残りはfalseで返る）
+    std::shared_ptr<Shared> shared = m_shared;
+    TmuxController::ReplyCallback lastReply = std::move(batch.back().onReply);
+    batch.back().onReply = [shared, lastReply](bool ok, const std::string& output) {
+        auto doneAt = std::chrono::steady_clock::now();
+        if (lastReply) {
+            lastReply(ok, output);
+        }
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->done = true;
+        shared->ok = ok;
+        shared->doneAt = doneAt;
+    };
+
+    m_inFlight = true;
+    m_stalled = false;
+    m_sentAt = now;
+    // 送れなかったときも応答はfalseで呼ばれるので、待ちは後のtickのcollectSampleで解ける
+    m_tmux->sendQueries(std::move(batch));
+}
+
+} // namespace pbterm
@@ -0,0 +1,62 @@
+#include "RateLimiter.h"
+#include <algorithm>
+#include <thread>
+
+namespace pbterm {
+
+namespace {
+
+constexpr double kBurstSeconds = 0.25;
+// 中断と速度変更に気付けるよう、長い待ちはこの単位に区切る
+constexpr auto kMaxSleep = std::chrono::milliseconds(50);
+
+} // namespace
+
+void RateLimiter::setRate(uint64_t bytesPerSecond) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (bytesPerSecond == m_rate) {
+        return;
+    }
+    m_rate = bytesPerSecond;
+    m_tokens = 0.0;
+    m_lastRefill = std::chrono::steady_clock::now();
+}
+
+uint64_t RateLimiter::rate() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_rate;
+}
+
+void RateLimiter::refillLocked(std::chrono::steady_clock::time_point now) {
+    double elapsed = std::chrono::duration<double>(now - m_lastRefill).count();
+    m_lastRefill = now;
+    double burst = static_cast<double>(m_rate) * kBurstSeconds;
+    m_tokens = std::min(burst, m_tokens + elapsed * static_cast<double>(m_rate));
+}
+
+bool RateLimiter::acquire(size_t bytes, const std::function<bool()>& keepGoing) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_rate == 0) {
+        return true;
+    }
+
+    // 先に差し引いて（マイナスになってよい）、残高が戻るまで待つ
+    // 1チャンクがバースト量より大きくても、平均速度は上限に収まる
+    refillLocked(std::chrono::steady_clock::now());
+    m_tokens -= static_cast<double>(bytes);
+
+    while (m_tokens < 0.0 && m_rate != 0) {
+        auto wait = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(-m_tokens / static_cast<double>(m_rate)));
+        lock.unlock();
+        std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(wait, kMaxSleep));
+        if (keepGoing && !keepGoing()) {
+            return false;
+        }
+        lock.lock();
+        refillLocked(std::chrono::steady_clock::now());
+    }
+    return true;
+}
+
+} // namespace pbterm
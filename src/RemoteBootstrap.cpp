@@ -0,0 +1,130 @@
+#include "RemoteBootstrap.h"
+#include "SshConnection.h"
+#include <algorithm>
+#include <cctype>
+#include <iostream>
+#include <sstream>
+
+namespace pbterm {
+
+namespace {
+
+// スクリプト全体の上限（セッション作成とウィンドウ一覧を含む）
+constexpr int kBootstrapTimeoutMs = 8000;
+
+// ウィンドウ一覧の行に付ける接頭辞
+constexpr const char* kWindowPrefix = "window=";
+
+std::string shellQuote(const std::string& s) {
+    std::string out = "'";
+    for (char c : s) {
+        if (c == '\'') {
+            out += "'\\''";
+        } else {
+            out += c;
+        }
+    }
+    out += "'";
+    return out;
+}
+
+// 1回のexecで実行するスクリプト（出力は "key=value" の行）
+std::string bootstrapScript(const std::string& sessionName, bool createSession) {
+    std::string session = shellQuote(sessionName);
+    // -t は前方一致なので = を付けて同名のセッションだけを指す
+    std::string target = shellQuote("=" + sessionName);
+    return
+        "printf 'os=%s\\n' \"$(uname -s 2>/dev/null)\"\n"
+        "printf 'home=%s\\n' \"$HOME\"\n"
+        "printf 'shell=%s\\n' \"$SHELL\"\n"
+        "T=\n"
+        "for p in /opt/homebrew/bin/tmux /usr/local/bin/tmux /usr/bin/tmux; do\n"
+        "  if [ -x \"$p\" ]; then T=$p; break; fi\n"
+        "done\n"
+        "[ -n \"$T\" ] || T=$(command -v tmux 2>/dev/null)\n"
+        "printf 'tmux=%s\\n' \"$T\"\n"
+        "[ -n \"$T\" ] || exit 0\n"
+        "printf 'tmux_version=%s\\n' \"$(\"$T\" -V 2>/dev/null)\"\n"
+        "if \"$T\" has-session -t " + target + " 2>/dev/null; then\n"
+        "  echo session=exists\n" +
+        (createSession ? "elif \"$T\" new-session -d -s " + session + " 2>/dev/null; then\n"
+                         "  echo session=created\n" : "") +
+        "else\n"
+        "  echo session=missing\n"
+        "fi\n"
+        "\"$T\" list-windows -t " + target + " -F '" + kWindowPrefix +
+        "#{window_index}:#{window_name}:#{window_active}:#{pane_current_path}' 2>/dev/null\n";
+}
+
+} // namespace
+
+bool RemoteFacts::isUnix() const {
+    std::string lower = os;
+    std::transform(lower.begin(), lower.end(), lower.begin(), [](unsigned char c){ return std::tolower(c); });
+    return lower.find("linux") != std::string::npos ||
+           lower.find("darwin") != std::string::npos ||
+           lower.find("bsd") != std::string::npos;
+}
+
+bool runRemoteBootstrap(SshConnection& connection, const std::string& sessionName,
+                        RemoteFacts& facts, std::string& error,
+                        bool createSession, const std::function<bool()>& keepGoing) {
+    facts = RemoteFacts();
+
+    std::string output;
+    ExecCallbacks callbacks;
+    callbacks.onStdout = [&output](const char* data, size_t len) {
+        output.append(data, len);
+        return true;
+    };
+    callbacks.keepGoing = keepGoing;
+    std::string cmd = "sh -c " + shellQuote(bootstrapScript(sessionName, createSession));
+    int status = connection.execStream(cmd, callbacks, kBootstrapTimeoutMs);
+
+    std::istringstream iss(output);
+    std::string line;
+    while (std::getline(iss, line)) {
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.compare(0, 7, kWindowPrefix) == 0) {
+            facts.windowListing += line.substr(7) + "\n";
+            continue;
+        }
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+        if (key == "os") {
+            facts.os = value;
+        } else if (key == "home") {
+            facts.home = value;
+        } else if (key == "shell") {
+            facts.shell = value;
+        } else if (key == "tmux") {
+            // ここまで届けば、途中で切れていても環境の情報はそろっている
+            facts.tmuxPath = value;
+            facts.received = true;
+        } else if (key == "tmux_version") {
+            facts.tmuxVersion = value;
+        } else if (key == "session") {
+            facts.sessionExisted = (value == "exists");
+            facts.sessionReady = (value == "exists" || value == "created");
+        }
+    }
+
+    if (!facts.received) {
+        // Windows（cmd/PowerShell）などPOSIXシェルがない環境
+        error = "リモート情報を取得できませんでした（終了ステータス: " + std::to_string(status) + "）";
+        return false;
+    }
+
+    std::cout << "RemoteBootstrap: os=" << facts.os << " home=" << facts.home
+              << " shell=" << facts.shell << " tmux=" << facts.tmuxPath
+              << " (" << facts.tmuxVersion << ")" << std::endl;
+    return true;
+}
+
+} // namespace pbterm
@@ -0,0 +1,252 @@
+#include "SessionDock.h"
+#include "TerminalDock.h"
+#include "SettingsDialog.h"
+#include "PollScheduler.h"
+#include "imgui.h"
+#include <algorithm>
+#include <mutex>
+#include <set>
+
+namespace pbterm {
+
+namespace {
+// 一覧とプレビューを取り直す間隔の範囲（RTTに合わせてこの間で決まる）、1回に取るプレビューの数
+constexpr int kListPollMinMs = 1000;
+constexpr int kListPollMaxMs = 10000;
+constexpr int kPreviewPollMinMs = 250;
+constexpr int kPreviewPollMaxMs = 5000;
+constexpr size_t kPreviewBatch = 8;
+// プレビューの文字の大きさ（ドックのフォントに対する倍率）
+constexpr float kPreviewScale = 0.4f;
+
+std::vector<std::string> splitLines(const std::string& text) {
+    std::vector<std::string> lines;
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find('\n', start);
+        if (end == std::string::npos) {
+            end = text.size();
+        }
+        lines.push_back(text.substr(start, end - start));
+        start = end + 1;
+    }
+    return lines;
+}
+} // namespace
+
+struct SessionDock::Shared {
+    std::mutex mutex;
+    bool hasSessions = false;
+    std::vector<TmuxSession> sessions;
+    std::map<std::string, Preview> previews;
+};
+
+SessionDock::SessionDock()
+    : m_shared(std::make_shared<Shared>())
+{
+}
+
+SessionDock::~SessionDock() = default;
+
+void SessionDock::onDisconnected() {
+    // 遅れて届く応答は古い受け渡し先へ書かせる
+    m_shared = std::make_shared<Shared>();
+    m_sessions.clear();
+    m_previews.clear();
+}
+
+void SessionDock::setPollScheduler(PollScheduler* scheduler) {
+    m_scheduler = scheduler;
+    m_listPollId = scheduler->add("sessions", kListPollMinMs, kListPollMaxMs,
+                                  [this](std::vector<TmuxController::Command>& batch) {
+        if (!isVisible() || !m_tmux->isControlMode()) {
+            return;
+        }
+        std::shared_ptr<Shared> shared = m_shared;
+        batch.push_back(m_tmux->sessionListQuery([shared](const std::vector<TmuxSession>& sessions) {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->sessions = sessions;
+            shared->hasSessions = true;
+        }));
+    });
+    m_previewPollId = scheduler->add("previews", kPreviewPollMinMs, kPreviewPollMaxMs,
+                                     [this](std::vector<TmuxController::Command>& batch) {
+        if (isVisible() && m_tmux->isControlMode()) {
+            appendPreviewQueries(batch);
+        }
+    });
+}
+
+bool SessionDock::isVisible() const {
+    // PollSchedulerはドックを描いた後に同じフレームで呼ばれる
+    return m_renderedFrame >= 0 && ImGui::GetFrameCount() - m_renderedFrame <= 1;
+}
+
+void SessionDock::takeUpdates() {
+    std::lock_guard<std::mutex> lock(m_shared->mutex);
+    if (m_shared->hasSessions) {
+        m_sessions = std::move(m_shared->sessions);
+        m_shared->sessions.clear();
+        m_shared->hasSessions = false;
+
+        // なくなったペインのプレビューを捨てる
+        std::set<std::string> alive;
+        for (const auto& session : m_sessions) {
+            for (const auto& win : session.windows) {
+                alive.insert(win.paneId);
+            }
+        }
+        for (auto it = m_previews.begin(); it != m_previews.end();) {
+            if (alive.count(it->first) == 0) {
+                it = m_previews.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (auto& entry : m_shared->previews) {
+        Preview& preview = m_previews[entry.first];
+        preview.activity = entry.second.activity;
+        // 中身が変わっていなければ行を入れ替えない
+        if (preview.lines != entry.second.lines) {
+            preview.lines = std::move(entry.second.lines);
+        }
+    }
+    m_shared->previews.clear();
+}
+
+void SessionDock::appendPreviewQueries(std::vector<TmuxController::Command>& batch) {
+    // 前回取り込んだ後に出力のあったペインだけを取り直す
+    std::vector<std::pair<std::string, long long>> stale;
+    for (const auto& session : m_sessions) {
+        for (const auto& win : session.windows) {
+            if (win.paneId.empty()) {
+                continue;
+            }
+            auto it = m_previews.find(win.paneId);
+            if (it == m_previews.end() || it->second.activity != win.activity) {
+                stale.emplace_back(win.paneId, win.activity);
+            }
+            if (stale.size() >= kPreviewBatch) {
+                break;
+            }
+        }
+        if (stale.size() >= kPreviewBatch) {
+            break;
+        }
+    }
+
+    // PollSchedulerは応答が揃うまで次を送らないので、取り込む前に同じペインをもう一度頼むことはない
+    std::shared_ptr<Shared> shared = m_shared;
+    for (const auto& entry : stale) {
+        std::string paneId = entry.first;
+        long long activity = entry.second;
+        batch.push_back(TmuxController::Command{
+            "capture-pane -p -t " + paneId,
+            [shared, paneId, activity](bool ok, const std::string& output) {
+                std::lock_guard<std::mutex> lock(shared->mutex);
+                // 失敗したペイン（閉じられた）も取り込んだことにして、次の一覧で消えるのを待つ
+                Preview& preview = shared->previews[paneId];
+                preview.activity = activity;
+                preview.lines = ok ? splitLines(output) : std::vector<std::string>();
+            }});
+    }
+}
+
+void SessionDock::render() {
+    const Localization& loc = getLocalization(m_language);
+
+    if (!m_tmux || !m_tmux->isControlMode()) {
+        ImGui::TextDisabled("%s", loc.sessionsUnavailable);
+        return;
+    }
+
+    // 隠れていた間は取りに行っていないので、開いたらすぐ取り直す
+    if (!isVisible() && m_scheduler) {
+        m_scheduler->trigger(m_listPollId);
+        m_scheduler->trigger(m_previewPollId);
+    }
+    m_renderedFrame = ImGui::GetFrameCount();
+    takeUpdates();
+
+    if (m_sessions.empty()) {
+        ImGui::TextDisabled("%s", loc.sessionsEmpty);
+        return;
+    }
+
+    std::string currentSession = m_tmux->sessionName();
+    int currentWindow = m_tmux->currentWindowIndex();
+    float width = ImGui::GetContentRegionAvail().x;
+
+    ImGui::BeginChild("##sessionList", ImVec2(0, 0), ImGuiChildFlags_None);
+    for (const auto& session : m_sessions) {
+        bool isCurrent = (session.name == currentSession);
+        ImGui::PushID(session.name.c_str());
+
+        ImGuiTreeNodeFlags flags = ImGuiTreeNodeFlags_DefaultOpen | ImGuiTreeNodeFlags_SpanAvailWidth;
+        bool open = ImGui::TreeNodeEx("##session", flags, "%s (%d)%s", session.name.c_str(), session.windowCount,
+                                      isCurrent ? loc.sessionsCurrent : "");
+        // ダブルクリックでセッションを表示する
+        if (ImGui::IsItemHovered() && ImGui::IsMouseDoubleClicked(0)) {
+            pick(session, -1);
+        }
+
+        if (open) {
+            for (const auto& win : session.windows) {
+                ImGui::PushID(win.index);
+                ImGui::Text("%d: %s", win.index, win.name.c_str());
+                bool clicked = false;
+                renderPreview(win.paneId, isCurrent && win.index == currentWindow, width, clicked);
+                if (clicked) {
+                    pick(session, win.index);
+                }
+                ImGui::PopID();
+            }
+            ImGui::TreePop();
+        }
+        ImGui::PopID();
+    }
+    ImGui::EndChild();
+}
+
+void SessionDock::renderPreview(const std::string& paneId, bool current, float width, bool& clicked) {
+    static const std::vector<std::string> kNoLines;
+    auto it = m_previews.find(paneId);
+    const std::vector<std::string>& lines = (it != m_previews.end()) ? it->second.lines : kNoLines;
+
+    // ドックと同じフォントを縮めて描く（グリフは共有）
+    ImFont* font = ImGui::GetFont();
+    float fontSize = ImGui::GetFontSize() * kPreviewScale;
+    float height = fontSize * static_cast<float>(std::max<size_t>(lines.size(), 1)) + 4.0f;
+    width = std::max(width - ImGui::GetStyle().ItemSpacing.x, 1.0f);
+
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    clicked = ImGui::InvisibleButton("##preview", ImVec2(width, height));
+    if (!ImGui::IsItemVisible()) {
+        return;
+    }
+
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    ImVec2 end(pos.x + width, pos.y + height);
+    drawList->AddRectFilled(pos, end, ImGui::GetColorU32(ImGuiCol_FrameBg));
+    drawList->AddRect(pos, end, ImGui::GetColorU32(current || ImGui::IsItemHovered() ? ImGuiCol_ButtonActive : ImGuiCol_Border));
+
+    drawList->PushClipRect(pos, end, true);
+    ImU32 textColor = ImGui::GetColorU32(ImGuiCol_Text);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        if (lines[i].empty()) {
+            continue;
+        }
+        ImVec2 linePos(pos.x + 2.0f, pos.y + 2.0f + fontSize * static_cast<float>(i));
+        drawList->AddText(font, fontSize, linePos, textColor, lines[i].c_str());
+    }
+    drawList->PopClipRect();
+}
+
+void SessionDock::pick(const TmuxSession& session, int windowIndex) {
+    if (m_terminalDock) {
+        m_terminalDock->showTmuxSession(session.name, session.windows, windowIndex);
+    }
+}
+
+} // namespace pbterm
@@ -0,0 +1,60 @@
+#include "SessionLock.h"
+
+namespace pbterm {
+
+namespace {
+
+thread_local SessionPriority t_priority = SessionPriority::Control;
+
+} // namespace
+
+void SessionLock::lock() {
+    const int level = static_cast<int>(t_priority);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    uint64_t ticket = m_nextTicket[level]++;
+    m_waiting[level]++;
+    m_cv.wait(lock, [&]() {
+        if (m_locked || ticket != m_serving[level]) {
+            return false;
+        }
+        for (int higher = 0; higher < level; ++higher) {
+            if (m_waiting[higher] > 0) {
+                return false;
+            }
+        }
+        return true;
+    });
+    m_waiting[level]--;
+    m_serving[level]++;
+    m_locked = true;
+}
+
+void SessionLock::unlock() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_locked = false;
+    }
+    // 待機中は数スレッド程度なので、全員起こして優先度の判定に任せる
+    m_cv.notify_all();
+}
+
+SessionPriority SessionLock::threadPriority() {
+    return t_priority;
+}
+
+void SessionLock::setThreadPriority(SessionPriority priority) {
+    t_priority = priority;
+}
+
+SessionLock::PriorityScope::PriorityScope(SessionPriority priority)
+    : m_previous(t_priority)
+{
+    t_priority = priority;
+}
+
+SessionLock::PriorityScope::~PriorityScope() {
+    t_priority = m_previous;
+}
+
+} // namespace pbterm
@@ -19,6 +19,8 @@ static const Localization englishLocalization = {
     "Terminal",
     "Commands",
     "Folders",
+    "Transfers",
+    "Sessions",
     "Option",
 
     // 接続状態
@@ -66,6 +68,13 @@ static const Localization englishLocalization = {
 
     // ターミナル
     "Please connect to a server",
+    "Command History",
+    "No commands recorded. Enable shell integration (OSC 133) in the remote shell.",
+    "Copy Last Output",
+    "Exit",
+    "Time",
+    "Command",
+    "running",
 
     // フォルダツリー
     "Folder Tree",
@@ -89,6 +98,55 @@ static const Localization englishLocalization = {
     "Download",
     "Download Complete!",
     "Open in Finder",
+
+    // 転送キュー
+    "Queued",
+    "Scanning",
+    "Transferring",
+    "Paused",
+    "Completed",
+    "Failed",
+    "Cancelled",
+    "Pause",
+    "Resume",
+    "Cancel",
+    "Retry",
+    "Clear finished",
+    "No transfers",
+    "files",
+    "Sync (changed files only)",
+    "Compare contents",
+    "Dry run",
+    "Report",
+    "Sync Report",
+    "Close",
+    "Stream folders as tar",
+    "Compress",
+    "Verify",
+    "Verifying",
+    "Limit speed",
+    "Priority",
+    "High",
+    "Normal",
+    "Low",
+
+    // 接続の進捗
+    "Connecting",
+    "Reading SSH config...",
+    "Connecting...",
+    "Authenticating...",
+    "Inspecting remote host...",
+    "Opening shell...",
+    "Cancel",
+    "Cancelling...",
+    "Connection failed",
+    "Close",
+    "Connecting...",
+
+    // tmuxセッション一覧
+    "Available when connected to tmux 3.0 or later",
+    "No sessions",
+    " (current)",
 };
 
 // 日本語ローカライゼーション
@@ -102,6 +160,8 @@ static const Localization japaneseLocalization = {
     "ターミナル",
     "コマンド",
     "フォルダ",
+    "転送",
+    "セッション",
     "オプション",
 
     // 接続状態
@@ -149,6 +209,13 @@ static const Localization japaneseLocalization = {
 
     // ターミナル
     "接続してください",
+    "コマンド履歴",
+    "コマンドの記録がありません。リモートのシェルでシェル統合（OSC 133）を有効にしてください。",
+    "直前の出力をコピー",
+    "終了",
+    "時間",
+    "コマンド",
+    "実行中",
 
     // フォルダツリー
     "フォルダツリー",
@@ -172,6 +239,55 @@ static const Localization japaneseLocalization = {
     "ダウンロード",
     "ダウンロード完了！",
     "Finderで開く",
+
+    // 転送キュー
+    "待機中",
+    "走査中",
+    "転送中",
+    "一時停止中",
+    "完了",
+    "失敗",
+    "キャンセル済み",
+    "一時停止",
+    "再開",
+    "キャンセル",
+    "再試行",
+    "完了分を消去",
+    "転送はありません",
+    "ファイル",
+    "同期（変更分のみ）",
+    "内容も比較",
+    "ドライラン",
+    "レポート",
+    "同期レポート",
+    "閉じる",
+    "フォルダをtarで一括転送",
+    "圧縮",
+    "検証",
+    "検証中",
+    "速度制限",
+    "優先度",
+    "高",
+    "通常",
+    "低",
+
+    // 接続の進捗
+    "接続中",
+    "SSH設定を読み込んでいます...",
+    "接続しています...",
+    "認証しています...",
+    "リモートの環境を確認しています...",
+    "シェルを開いています...",
+    "キャンセル",
+    "キャンセルしています...",
+    "接続できませんでした",
+    "閉じる",
+    "接続中...",
+
+    // tmuxセッション一覧
+    "tmux 3.0以降に接続すると表示されます",
+    "セッションがありません",
+    "（表示中）",
 };
 
 const Localization& getLocalization(int language) {
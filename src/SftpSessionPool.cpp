@@ -0,0 +1,171 @@
+#include "SftpSessionPool.h"
+#include <iostream>
+
+namespace pbterm {
+
+// ============================================================================
+// Lease 実装
+// ============================================================================
+
+SftpSessionPool::Lease::Lease(std::shared_ptr<SftpSessionPool> pool, sftp_session sftp)
+    : m_pool(std::move(pool)), m_sftp(sftp)
+{
+}
+
+SftpSessionPool::Lease::~Lease() {
+    release();
+}
+
+SftpSessionPool::Lease::Lease(Lease&& other) noexcept
+    : m_pool(std::move(other.m_pool)), m_sftp(other.m_sftp), m_broken(other.m_broken)
+{
+    other.m_sftp = nullptr;
+    other.m_broken = false;
+}
+
+SftpSessionPool::Lease& SftpSessionPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_pool = std::move(other.m_pool);
+        m_sftp = other.m_sftp;
+        m_broken = other.m_broken;
+        other.m_sftp = nullptr;
+        other.m_broken = false;
+    }
+    return *this;
+}
+
+void SftpSessionPool::Lease::checkError() {
+    if (m_sftp && SftpSessionPool::isSessionError(m_sftp)) {
+        m_broken = true;
+    }
+}
+
+void SftpSessionPool::Lease::release() {
+    if (m_pool && m_sftp) {
+        m_pool->giveBack(m_sftp, m_broken);
+    }
+    m_pool.reset();
+    m_sftp = nullptr;
+    m_broken = false;
+}
+
+// ============================================================================
+// SftpSessionPool 実装
+// ============================================================================
+
+SftpSessionPool::SftpSessionPool(ssh_session session, SessionLock* sessionMutex, size_t maxSessions)
+    : m_session(session), m_sessionMutex(sessionMutex), m_maxSessions(maxSessions > 0 ? maxSessions : 1)
+{
+}
+
+SftpSessionPool::~SftpSessionPool() {
+    // shutdownLocked()が呼ばれていない場合でもSSHセッションは有効なので解放できる
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    if (!m_closed) {
+        for (sftp_session sftp : m_idle) {
+            sftp_free(sftp);
+        }
+    }
+    m_idle.clear();
+}
+
+SftpSessionPool::Lease SftpSessionPool::acquire(std::string* error) {
+    std::unique_lock<std::mutex> lock(m_poolMutex);
+
+    // 空きがなく上限に達している場合は返却を待つ
+    m_poolCv.wait(lock, [this]() {
+        return m_closed || !m_idle.empty() || m_total < m_maxSessions;
+    });
+
+    if (m_closed) {
+        if (error) *error = "SFTPセッションプールは閉じられています";
+        return Lease();
+    }
+
+    if (!m_idle.empty()) {
+        sftp_session sftp = m_idle.back();
+        m_idle.pop_back();
+        return Lease(shared_from_this(), sftp);
+    }
+
+    // 新しいセッションを作成（作成中は枠を確保しておく）
+    m_total++;
+    lock.unlock();
+
+    sftp_session sftp = nullptr;
+    std::string failure;
+    {
+        std::lock_guard<SessionLock> sessionLock(*m_sessionMutex);
+        sftp = sftp_new(m_session);
+        if (!sftp) {
+            failure = "SFTPセッション作成失敗";
+        } else if (sftp_init(sftp) != SSH_OK) {
+            failure = "SFTP初期化失敗";
+            sftp_free(sftp);
+            sftp = nullptr;
+        }
+    }
+
+    if (!sftp) {
+        lock.lock();
+        m_total--;
+        m_poolCv.notify_one();
+        if (error) *error = failure;
+        return Lease();
+    }
+
+    return Lease(shared_from_this(), sftp);
+}
+
+void SftpSessionPool::giveBack(sftp_session sftp, bool broken) {
+    std::unique_lock<std::mutex> lock(m_poolMutex);
+
+    if (m_closed) {
+        // SSHセッションは既に解放済み。sftp構造体はssh_freeと共に無効になっているので触らない
+        m_total--;
+        return;
+    }
+
+    if (broken) {
+        m_total--;
+        lock.unlock();
+        std::cout << "SFTPセッションを破棄しました（次回の利用時に再接続）" << std::endl;
+        {
+            std::lock_guard<SessionLock> sessionLock(*m_sessionMutex);
+            sftp_free(sftp);
+        }
+        lock.lock();
+    } else {
+        m_idle.push_back(sftp);
+    }
+
+    m_poolCv.notify_one();
+}
+
+void SftpSessionPool::shutdownLocked() {
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    if (m_closed) return;
+
+    for (sftp_session sftp : m_idle) {
+        sftp_free(sftp);
+    }
+    m_total -= m_idle.size();
+    m_idle.clear();
+    m_closed = true;
+    m_poolCv.notify_all();
+}
+
+bool SftpSessionPool::isSessionError(sftp_session sftp) {
+    if (!sftp) return true;
+    switch (sftp_get_error(sftp)) {
+        case SSH_FX_BAD_MESSAGE:
+        case SSH_FX_NO_CONNECTION:
+        case SSH_FX_CONNECTION_LOST:
+            return true;
+        default:
+            return false;
+    }
+}
+
+} // namespace pbterm
@@ -0,0 +1,755 @@
+#include "SftpTransfer.h"
+#include "LocalFileIO.h"
+#include "RateLimiter.h"
+#include <algorithm>
+#include <deque>
+#include <vector>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace pbterm {
+
+namespace {
+
+// 1リクエストあたりの上限（サーバーがより大きな値を許しても、この値で頭打ち）
+constexpr size_t kMaxChunkSize = 256 * 1024;
+// limits拡張に対応していないサーバー向けの安全な値
+constexpr size_t kDefaultChunkSize = 32768;
+// 応答待ちでソケットを監視する間隔（ロックを手放している間の1回分）
+constexpr int kResponsePollMs = 2;
+// 1つの応答を待つ上限（回線が黙って切れた場合に転送を止める）
+constexpr auto kResponseTimeout = std::chrono::seconds(60);
+// 帯域の計測区間
+constexpr double kSampleIntervalMs = 100.0;
+
+double toMs(std::chrono::steady_clock::duration d) {
+    return std::chrono::duration<double, std::milli>(d).count();
+}
+} // namespace
+
+// ============================================================================
+// AdaptiveWindow 実装
+// ============================================================================
+
+AdaptiveWindow::AdaptiveWindow(size_t chunkSize, int minWindow, int maxWindow)
+    : m_chunkSize(chunkSize > 0 ? chunkSize : kDefaultChunkSize),
+      m_minWindow(minWindow),
+      m_maxWindow(maxWindow),
+      m_window(minWindow),
+      m_sampleStart(std::chrono::steady_clock::now())
+{
+}
+
+void AdaptiveWindow::onComplete(size_t bytes, std::chrono::steady_clock::duration elapsed) {
+    // パイプライン内の待ち時間を含まない最小値をRTTとみなす
+    double ms = toMs(elapsed);
+    if (m_minRttMs <= 0.0 || ms < m_minRttMs) {
+        m_minRttMs = ms;
+    }
+
+    m_sampleBytes += bytes;
+    m_sampleCount++;
+
+    auto now = std::chrono::steady_clock::now();
+    double sampleMs = toMs(now - m_sampleStart);
+    if (sampleMs < kSampleIntervalMs || m_sampleCount < m_window) {
+        return;
+    }
+
+    double bps = static_cast<double>(m_sampleBytes) * 1000.0 / sampleMs;
+    // 指数移動平均で揺らぎを抑える
+    m_bytesPerSec = (m_bytesPerSec <= 0.0) ? bps : (m_bytesPerSec * 0.7 + bps * 0.3);
+
+    // BDPの2倍を目標にする（計測誤差と帯域増加の余地）
+    double bdp = m_bytesPerSec * (m_minRttMs / 1000.0);
+    int target = static_cast<int>(bdp * 2.0 / static_cast<double>(m_chunkSize)) + 1;
+
+    // ウィンドウが律速している間は倍々で広げ、縮小は緩やかに行う
+    if (target > m_window) {
+        m_window = std::min(target, m_window * 2);
+    } else if (target < m_window) {
+        m_window = std::max(target, (m_window * 3) / 4);
+    }
+    m_window = std::max(m_minWindow, std::min(m_window, m_maxWindow));
+
+    m_sampleStart = now;
+    m_sampleBytes = 0;
+    m_sampleCount = 0;
+}
+
+// ============================================================================
+// SftpTransfer 実装
+// ============================================================================
+
+SftpTransfer::SftpTransfer(sftp_session sftp, SessionLock& sessionMutex)
+    : m_sftp(sftp), m_sessionMutex(sessionMutex)
+{
+}
+
+void SftpTransfer::queryLimits() {
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+    std::lock_guard<SessionLock> lock(m_sessionMutex);
+    sftp_limits_t limits = sftp_limits(m_sftp);
+    if (limits) {
+        if (limits->max_read_length > 0) {
+            m_readChunk = std::min<size_t>(limits->max_read_length, kMaxChunkSize);
+        }
+        if (limits->max_write_length > 0) {
+            m_writeChunk = std::min<size_t>(limits->max_write_length, kMaxChunkSize);
+        }
+        sftp_limits_free(limits);
+    }
+#endif
+}
+
+void SftpTransfer::reportProgress() {
+    if (m_hooks.onProgress) {
+        m_hooks.onProgress(m_bytesTransferred);
+    }
+}
+
+bool SftpTransfer::checkpoint() {
+    if (m_hooks.checkpoint && !m_hooks.checkpoint()) {
+        m_cancelled = true;
+        m_lastError = "転送が中断されました";
+        return false;
+    }
+    return true;
+}
+
+bool SftpTransfer::throttle(size_t bytes) {
+    if (!m_hooks.rateLimiter || m_hooks.rateLimiter->acquire(bytes, m_hooks.checkpoint)) {
+        return true;
+    }
+    m_cancelled = true;
+    m_lastError = "転送が中断されました";
+    return false;
+}
+
+void SftpTransfer::waitForSocket() {
+    // 他のスレッドが先に受信した場合に備えて短く区切る
+    pollfd pfd = {ssh_get_fd(m_sftp->session), POLLIN, 0};
+    poll(&pfd, 1, kResponsePollMs);
+}
+
+#if LIBSSH_VERSION_INT >= SSH_VERSION_INT(0, 11, 0)
+
+namespace {
+
+// 送信済みで応答待ちのリクエスト
+struct PendingRequest {
+    sftp_aio aio = nullptr;
+    size_t length = 0;
+    std::chrono::steady_clock::time_point issuedAt;
+};
+
+} // namespace
+
+// 応答待ちの間はセッションロックを手放す（ファイルは非ブロッキングにしておく）
+// ロックを持ったまま1往復待つと、その間ターミナルの入出力が止まる
+ssize_t SftpTransfer::waitRead(sftp_aio* aio, void* buffer, size_t length) {
+    auto deadline = std::chrono::steady_clock::now() + kResponseTimeout;
+    for (;;) {
+        ssize_t n;
+        {
+            std::lock_guard<SessionLock> lock(m_sessionMutex);
+            n = sftp_aio_wait_read(aio, buffer, length);
+        }
+        if (n != SSH_AGAIN) {
+            return n;
+        }
+        if (!keepWaiting(aio, deadline)) {
+            return SSH_ERROR;
+        }
+        waitForSocket();
+    }
+}
+
+ssize_t SftpTransfer::waitWrite(sftp_aio* aio) {
+    auto deadline = std::chrono::steady_clock::now() + kResponseTimeout;
+    for (;;) {
+        ssize_t n;
+        {
+            std::lock_guard<SessionLock> lock(m_sessionMutex);
+            n = sftp_aio_wait_write(aio);
+        }
+        if (n != SSH_AGAIN) {
+            return n;
+        }
+        if (!keepWaiting(aio, deadline)) {
+            return SSH_ERROR;
+        }
+        waitForSocket();
+    }
+}
+
+bool SftpTransfer::keepWaiting(sftp_aio* aio, std::chrono::steady_clock::time_point deadline) {
+    bool timedOut = std::chrono::steady_clock::now() >= deadline;
+    if (!timedOut && checkpoint()) {
+        return true;
+    }
+    if (timedOut) {
+        m_lastError = "サーバーの応答がタイムアウトしました";
+    }
+    // 応答を待たずに打ち切る（未着の応答が残るセッションは返却時に破棄してもらう）
+    abandon(aio);
+    return false;
+}
+
+void SftpTransfer::abandon(sftp_aio* aio) {
+    m_abandoned = true;
+    std::lock_guard<SessionLock> lock(m_sessionMutex);
+    sftp_aio_free(*aio);
+    *aio = nullptr;
+}
+
+bool SftpTransfer::download(const std::string& remotePath, const std::string& localPath, uint64_t offset) {
+    m_bytesTransferred = offset;
+    m_cancelled = false;
+    m_abandoned = false;
+    queryLimits();
+
+    sftp_file remoteFile = nullptr;
+    uint64_t remoteSize = 0;
+    {
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        remoteFile = sftp_open(m_sftp, remotePath.c_str(), O_RDONLY, 0);
+        if (remoteFile && offset > 0) {
+            sftp_seek64(remoteFile, offset);
+        }
+        if (remoteFile) {
+            sftp_file_set_nonblocking(remoteFile);
+        }
+        if (remoteFile) {
+            sftp_attributes attrs = sftp_fstat(remoteFile);
+            if (attrs) {
+                remoteSize = attrs->size;
+                sftp_attributes_free(attrs);
+            }
+        }
+    }
+    if (!remoteFile) {
+        m_lastError = "リモートファイルを開けません: " + remotePath;
+        return false;
+    }
+
+    // 受信データはライトビハインドのバッファへ直接読み込む
+    WriteBehindFile file;
+    if (!file.open(localPath, offset, remoteSize)) {
+        m_lastError = "ローカルファイル作成失敗: " + localPath;
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        sftp_close(remoteFile);
+        return false;
+    }
+
+    AdaptiveWindow window(m_readChunk);
+    std::deque<PendingRequest> inflight;
+    std::vector<char> buffer(m_readChunk);
+    uint64_t issuedOffset = offset;
+    bool eof = false;
+    bool success = true;
+
+    while (success) {
+        if (!checkpoint()) {
+            success = false;
+            break;
+        }
+
+        // ウィンドウに空きがある分だけ読み取りリクエストを送る
+        // サイズ到達後は1件ずつ読み、EOF応答で終端を確認する（転送中に伸びたファイル対策）
+        {
+            std::lock_guard<SessionLock> lock(m_sessionMutex);
+            while (!eof && static_cast<int>(inflight.size()) < window.window() &&
+                   (issuedOffset < remoteSize || inflight.empty())) {
+                PendingRequest req;
+                ssize_t requested = sftp_aio_begin_read(remoteFile, m_readChunk, &req.aio);
+                if (requested < 0) {
+                    m_lastError = "読み取り要求エラー";
+                    success = false;
+                    break;
+                }
+                req.length = static_cast<size_t>(requested);
+                req.issuedAt = std::chrono::steady_clock::now();
+                issuedOffset += req.length;
+                inflight.push_back(req);
+            }
+        }
+
+        if (!success || inflight.empty()) {
+            break;
+        }
+
+        // 最も古いリクエストの応答を待つ（応答は送信順に処理するので書き込みは常に順次）
+        char* target = file.reserve(m_readChunk);
+        if (!target) {
+            m_lastError = "ローカルファイル書き込みエラー: " + localPath;
+            success = false;
+            break;
+        }
+        PendingRequest req = inflight.front();
+        inflight.pop_front();
+
+        ssize_t bytesRead = waitRead(&req.aio, target, m_readChunk);
+        window.onComplete(bytesRead > 0 ? static_cast<size_t>(bytesRead) : 0,
+                          std::chrono::steady_clock::now() - req.issuedAt);
+
+        if (bytesRead < 0) {
+            if (!m_abandoned) {
+                m_lastError = "読み取りエラー";
+            }
+            success = false;
+            break;
+        }
+
+        if (bytesRead > 0) {
+            file.commit(static_cast<size_t>(bytesRead));
+            if (file.failed()) {
+                m_lastError = "ローカルファイル書き込みエラー: " + localPath;
+                success = false;
+                break;
+            }
+            m_bytesTransferred += static_cast<uint64_t>(bytesRead);
+            reportProgress();
+            if (!throttle(static_cast<size_t>(bytesRead))) {
+                success = false;
+                break;
+            }
+        }
+
+        if (bytesRead == 0) {
+            eof = true;
+        } else if (static_cast<size_t>(bytesRead) < req.length) {
+            // 短い読み取り: 先行リクエストを捨てて、不足分の位置から読み直す
+            // （破棄する応答は一度に受け取るのでブロッキングに戻して待つ）
+            std::lock_guard<SessionLock> lock(m_sessionMutex);
+            sftp_file_set_blocking(remoteFile);
+            for (auto& pending : inflight) {
+                sftp_aio_wait_read(&pending.aio, buffer.data(), buffer.size());
+            }
+            sftp_file_set_nonblocking(remoteFile);
+            inflight.clear();
+            issuedOffset = m_bytesTransferred;
+            sftp_seek64(remoteFile, issuedOffset);
+        }
+    }
+
+    {
+        // 残ったリクエストの応答を受け取ってからハンドルを閉じる
+        // （応答を放置するとプールに戻したセッションに不要なメッセージが残る）
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        // （sftp_aio_wait_readは成否にかかわらずハンドルを解放する。非ブロッキングのままだと
+        //   未着の応答でSSH_AGAINが返りハンドルが残るため、ブロッキングに戻す）
+        // 応答待ちを打ち切った後は届くとは限らないので待たずに解放する（セッションは破棄される）
+        sftp_file_set_blocking(remoteFile);
+        for (auto& pending : inflight) {
+            if (m_abandoned) {
+                sftp_aio_free(pending.aio);
+            } else {
+                sftp_aio_wait_read(&pending.aio, buffer.data(), buffer.size());
+            }
+        }
+        sftp_close(remoteFile);
+    }
+
+    // 書き出し待ちのバッファをすべて書き終えるまで待つ
+    if (!file.close() && success) {
+        m_lastError = "ローカルファイル書き込みエラー: " + localPath;
+        success = false;
+    }
+    return success;
+}
+
+bool SftpTransfer::upload(const std::string& localPath, const std::string& remotePath, uint64_t offset) {
+    m_bytesTransferred = offset;
+    m_cancelled = false;
+    m_abandoned = false;
+    queryLimits();
+
+    // 読み取りバッファの内容をそのまま送信要求に渡す
+    LocalFileReader file;
+    if (!file.open(localPath, offset)) {
+        m_lastError = "ローカルファイルを開けません: " + localPath;
+        return false;
+    }
+
+    // 再開時はリモートの転送済み部分を残す
+    int openFlags = (offset > 0) ? (O_WRONLY | O_CREAT) : (O_WRONLY | O_CREAT | O_TRUNC);
+
+    sftp_file remoteFile = nullptr;
+    {
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        remoteFile = sftp_open(m_sftp, remotePath.c_str(), openFlags, S_IRWXU);
+        if (remoteFile && offset > 0) {
+            sftp_seek64(remoteFile, offset);
+        }
+        if (remoteFile) {
+            sftp_file_set_nonblocking(remoteFile);
+        }
+    }
+    if (!remoteFile) {
+        m_lastError = "リモートファイル作成失敗: " + remotePath;
+        return false;
+    }
+
+    AdaptiveWindow window(m_writeChunk);
+    std::deque<PendingRequest> inflight;
+    bool success = true;
+
+    // 最も古い書き込みの完了を待つ
+    auto completeOldest = [&]() -> bool {
+        PendingRequest req = inflight.front();
+        inflight.pop_front();
+        ssize_t written = waitWrite(&req.aio);
+        window.onComplete(req.length, std::chrono::steady_clock::now() - req.issuedAt);
+        if (written < 0 || static_cast<size_t>(written) != req.length) {
+            if (!m_abandoned) {
+                m_lastError = "書き込みエラー";
+            }
+            return false;
+        }
+        m_bytesTransferred += req.length;
+        reportProgress();
+        return true;
+    };
+
+    while (success) {
+        if (!checkpoint()) {
+            success = false;
+            break;
+        }
+
+        const char* data = nullptr;
+        size_t bytesRead = file.read(data, m_writeChunk);
+        if (bytesRead == 0) {
+            if (file.bad()) {
+                m_lastError = "ローカルファイル読み取りエラー: " + localPath;
+                success = false;
+            }
+            break;
+        }
+
+        // ウィンドウが埋まっていれば空くまで待つ
+        while (success && static_cast<int>(inflight.size()) >= window.window()) {
+            success = completeOldest();
+        }
+        if (!success || !throttle(bytesRead)) {
+            success = false;
+            break;
+        }
+
+        PendingRequest req;
+        ssize_t queued;
+        {
+            // libsshは送信時にデータをパケットへコピーするので、読み取りバッファはすぐ進めてよい
+            std::lock_guard<SessionLock> lock(m_sessionMutex);
+            queued = sftp_aio_begin_write(remoteFile, data, bytesRead, &req.aio);
+        }
+        if (queued != static_cast<ssize_t>(bytesRead)) {
+            m_lastError = "書き込み要求エラー";
+            if (req.aio) sftp_aio_free(req.aio);
+            success = false;
+            break;
+        }
+        req.length = static_cast<size_t>(queued);
+        req.issuedAt = std::chrono::steady_clock::now();
+        inflight.push_back(req);
+    }
+
+    // 残りの書き込み完了を待つ（応答待ちを打ち切った後は待たずに解放する）
+    while (!inflight.empty()) {
+        if (m_abandoned) {
+            abandon(&inflight.front().aio);
+            inflight.pop_front();
+        } else if (!completeOldest()) {
+            success = false;
+        }
+    }
+
+    {
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        sftp_close(remoteFile);
+    }
+    return success;
+}
+
+#else
+
+// libssh 0.11未満: 非同期APIがないため逐次転送
+// （一時停止中にシェルを止めないよう、ロックはリクエスト毎に取る）
+bool SftpTransfer::download(const std::string& remotePath, const std::string& localPath, uint64_t offset) {
+    m_bytesTransferred = offset;
+    m_cancelled = false;
+    m_abandoned = false;
+    queryLimits();
+
+    sftp_file remoteFile = nullptr;
+    {
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        remoteFile = sftp_open(m_sftp, remotePath.c_str(), O_RDONLY, 0);
+        if (remoteFile && offset > 0) {
+            sftp_seek64(remoteFile, offset);
+        }
+    }
+    if (!remoteFile) {
+        m_lastError = "リモートファイルを開けません: " + remotePath;
+        return false;
+    }
+
+    WriteBehindFile file;
+    if (!file.open(localPath, offset, 0)) {
+        m_lastError = "ローカルファイル作成失敗: " + localPath;
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        sftp_close(remoteFile);
+        return false;
+    }
+
+    bool success = true;
+    while (success) {
+        if (!checkpoint()) {
+            success = false;
+            break;
+        }
+        char* target = file.reserve(m_readChunk);
+        if (!target) {
+            m_lastError = "ローカルファイル書き込みエラー: " + localPath;
+            success = false;
+            break;
+        }
+        ssize_t bytesRead;
+        {
+            std::lock_guard<SessionLock> lock(m_sessionMutex);
+            bytesRead = sftp_read(remoteFile, target, m_readChunk);
+        }
+        if (bytesRead == 0) break;
+        if (bytesRead < 0) {
+            m_lastError = "読み取りエラー";
+            success = false;
+            break;
+        }
+        file.commit(static_cast<size_t>(bytesRead));
+        m_bytesTransferred += static_cast<uint64_t>(bytesRead);
+        reportProgress();
+        if (!throttle(static_cast<size_t>(bytesRead))) {
+            success = false;
+            break;
+        }
+    }
+
+    {
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        sftp_close(remoteFile);
+    }
+    if (!file.close() && success) {
+        m_lastError = "ローカルファイル書き込みエラー: " + localPath;
+        success = false;
+    }
+    return success;
+}
+
+bool SftpTransfer::upload(const std::string& localPath, const std::string& remotePath, uint64_t offset) {
+    m_bytesTransferred = offset;
+    m_cancelled = false;
+    m_abandoned = false;
+    queryLimits();
+
+    // 読み取りバッファの内容をそのまま送信要求に渡す
+    LocalFileReader file;
+    if (!file.open(localPath, offset)) {
+        m_lastError = "ローカルファイルを開けません: " + localPath;
+        return false;
+    }
+
+    // 再開時はリモートの転送済み部分を残す
+    int openFlags = (offset > 0) ? (O_WRONLY | O_CREAT) : (O_WRONLY | O_CREAT | O_TRUNC);
+
+    sftp_file remoteFile = nullptr;
+    {
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        remoteFile = sftp_open(m_sftp, remotePath.c_str(), openFlags, S_IRWXU);
+        if (remoteFile && offset > 0) {
+            sftp_seek64(remoteFile, offset);
+        }
+    }
+    if (!remoteFile) {
+        m_lastError = "リモートファイル作成失敗: " + remotePath;
+        return false;
+    }
+
+    bool success = true;
+    while (true) {
+        if (!checkpoint()) {
+            success = false;
+            break;
+        }
+        const char* data = nullptr;
+        size_t bytesRead = file.read(data, m_writeChunk);
+        if (bytesRead == 0) {
+            if (file.bad()) {
+                m_lastError = "ローカルファイル読み取りエラー: " + localPath;
+                success = false;
+            }
+            break;
+        }
+        if (!throttle(bytesRead)) {
+            success = false;
+            break;
+        }
+        ssize_t written;
+        {
+            std::lock_guard<SessionLock> lock(m_sessionMutex);
+            written = sftp_write(remoteFile, data, bytesRead);
+        }
+        if (written != static_cast<ssize_t>(bytesRead)) {
+            m_lastError = "書き込みエラー";
+            success = false;
+            break;
+        }
+        m_bytesTransferred += static_cast<uint64_t>(bytesRead);
+        reportProgress();
+    }
+
+    std::lock_guard<SessionLock> lock(m_sessionMutex);
+    sftp_close(remoteFile);
+    return success;
+}
+
+#endif
+
+// 範囲の転送は検証で不一致だったチャンクの修復にだけ使う（頻度が低いのでパイプライン化しない）
+
+bool SftpTransfer::uploadRange(const std::string& localPath, const std::string& remotePath,
+                               uint64_t offset, uint64_t length) {
+    m_bytesTransferred = 0;
+    m_cancelled = false;
+    queryLimits();
+
+    LocalFileReader file;
+    if (!file.open(localPath, offset)) {
+        m_lastError = "ローカルファイルを開けません: " + localPath;
+        return false;
+    }
+
+    // 既存の内容は残し、範囲だけを上書きする
+    sftp_file remoteFile = nullptr;
+    {
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        remoteFile = sftp_open(m_sftp, remotePath.c_str(), O_WRONLY, 0);
+        if (remoteFile) {
+            sftp_seek64(remoteFile, offset);
+        }
+    }
+    if (!remoteFile) {
+        m_lastError = "リモートファイルを開けません: " + remotePath;
+        return false;
+    }
+
+    bool success = true;
+    while (success && m_bytesTransferred < length) {
+        if (!checkpoint()) {
+            success = false;
+            break;
+        }
+
+        const char* data = nullptr;
+        size_t want = static_cast<size_t>(std::min<uint64_t>(m_writeChunk, length - m_bytesTransferred));
+        size_t bytesRead = file.read(data, want);
+        if (bytesRead == 0) {
+            m_lastError = "ローカルファイル読み取りエラー: " + localPath;
+            success = false;
+            break;
+        }
+        if (!throttle(bytesRead)) {
+            success = false;
+            break;
+        }
+
+        ssize_t written;
+        {
+            std::lock_guard<SessionLock> lock(m_sessionMutex);
+            written = sftp_write(remoteFile, data, bytesRead);
+        }
+        if (written != static_cast<ssize_t>(bytesRead)) {
+            m_lastError = "書き込みエラー";
+            success = false;
+            break;
+        }
+        m_bytesTransferred += static_cast<uint64_t>(bytesRead);
+    }
+
+    std::lock_guard<SessionLock> lock(m_sessionMutex);
+    sftp_close(remoteFile);
+    return success;
+}
+
+bool SftpTransfer::downloadRange(const std::string& remotePath, const std::string& localPath,
+                                 uint64_t offset, uint64_t length) {
+    m_bytesTransferred = 0;
+    m_cancelled = false;
+    queryLimits();
+
+    sftp_file remoteFile = nullptr;
+    {
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        remoteFile = sftp_open(m_sftp, remotePath.c_str(), O_RDONLY, 0);
+        if (remoteFile) {
+            sftp_seek64(remoteFile, offset);
+        }
+    }
+    if (!remoteFile) {
+        m_lastError = "リモートファイルを開けません: " + remotePath;
+        return false;
+    }
+
+    int fd = ::open(localPath.c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        m_lastError = "ローカルファイルを開けません: " + localPath;
+        std::lock_guard<SessionLock> lock(m_sessionMutex);
+        sftp_close(remoteFile);
+        return false;
+    }
+
+    std::vector<char> buffer(m_readChunk);
+    bool success = true;
+    while (success && m_bytesTransferred < length) {
+        if (!checkpoint()) {
+            success = false;
+            break;
+        }
+
+        size_t want = static_cast<size_t>(std::min<uint64_t>(buffer.size(), length - m_bytesTransferred));
+        ssize_t bytesRead;
+        {
+            std::lock_guard<SessionLock> lock(m_sessionMutex);
+            bytesRead = sftp_read(remoteFile, buffer.data(), want);
+        }
+        if (bytesRead <= 0) {
+            m_lastError = "読み取りエラー";
+            success = false;
+            break;
+        }
+
+        off_t position = static_cast<off_t>(offset + m_bytesTransferred);
+        if (pwrite(fd, buffer.data(), static_cast<size_t>(bytesRead), position) != bytesRead) {
+            m_lastError = "ローカルファイル書き込みエラー: " + localPath;
+            success = false;
+            break;
+        }
+        m_bytesTransferred += static_cast<uint64_t>(bytesRead);
+        if (!throttle(static_cast<size_t>(bytesRead))) {
+            success = false;
+            break;
+        }
+    }
+
+    if (::close(fd) != 0 && success) {
+        m_lastError = "ローカルファイル書き込みエラー: " + localPath;
+        success = false;
+    }
+    std::lock_guard<SessionLock> lock(m_sessionMutex);
+    sftp_close(remoteFile);
+    return success;
+}
+
+} // namespace pbterm
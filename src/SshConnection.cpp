@@ -1,19 +1,278 @@
 #include "SshConnection.h"
+#include "SftpSessionPool.h"
+#include "SftpTransfer.h"
+#include "Sha256.h"
 #include <iostream>
+#include <algorithm>
+#include <cctype>
 #include <cstring>
 #include <fstream>
 #include <filesystem>
+#include <cerrno>
 #include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <libssh/sftp.h>
 
 namespace pbterm {
 
+namespace {
+
+// exec読み取り時に一度にセッションロックを保持する最大時間
+// （長時間の出力中もシェルチャンネルの読み取りスレッドを止めないため）
+constexpr int kExecPollSliceMs = 20;
+
+// execの標準入力へ一度に送る最大サイズ
+constexpr size_t kExecStdinChunk = 64 * 1024;
+
+// 転送再開時に照合する末尾の長さ
+constexpr uint64_t kResumeVerifyBytes = 1024 * 1024;
+
+// 接続・認証の待ちを区切る単位（中断に気付けるように）
+constexpr int kConnectPollSliceMs = 50;
+
+// 接続と鍵交換・認証それぞれの上限
+constexpr int kConnectTimeoutMs = 15000;
+
+bool stillGoing(const std::function<bool()>& keepGoing) {
+    return !keepGoing || keepGoing();
+}
+
+// ノンブロッキングのlibssh呼び出しを、againが返る間ソケットを待ちながらくり返す
+// 中断された場合はinterruptedをtrueにし、タイムアウトはSSH_ERRORとして返す
+int pumpNonblocking(ssh_session session, int again, const std::function<int()>& call,
+                    const std::function<bool()>& keepGoing, bool& interrupted) {
+    int waitedMs = 0;
+    int rc;
+    while ((rc = call()) == again) {
+        if (!stillGoing(keepGoing)) {
+            interrupted = true;
+            return rc;
+        }
+        if (waitedMs >= kConnectTimeoutMs) {
+            return SSH_ERROR;
+        }
+        pollfd pfd{ssh_get_fd(session), POLLIN, 0};
+        poll(&pfd, 1, kConnectPollSliceMs);
+        waitedMs += kConnectPollSliceMs;
+    }
+    return rc;
+}
+
+std::string shellQuote(const std::string& s) {
+    std::string out = "'";
+    for (char c : s) {
+        if (c == '\'') {
+            out += "'\\''";
+        } else {
+            out += c;
+        }
+    }
+    out += "'";
+    return out;
+}
+
+// sha256sum/shasumの出力から16進ダイジェストを取り出す
+std::string parseHexDigest(const std::string& output) {
+    if (output.size() < 64) {
+        return "";
+    }
+    std::string digest = output.substr(0, 64);
+    for (char c : digest) {
+        if (!std::isxdigit(static_cast<unsigned char>(c))) {
+            return "";
+        }
+    }
+    for (char& c : digest) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return digest;
+}
+
+// SFTPでリモートファイルの指定範囲を読み取ってSHA-256を計算（execが使えない環境向け）
+std::string sftpRangeHash(sftp_session sftp, SessionLock& sessionMutex,
+                          const std::string& remotePath, uint64_t offset, uint64_t length) {
+    sftp_file file = nullptr;
+    {
+        std::lock_guard<SessionLock> lock(sessionMutex);
+        file = sftp_open(sftp, remotePath.c_str(), O_RDONLY, 0);
+        if (file) {
+            sftp_seek64(file, offset);
+        }
+    }
+    if (!file) {
+        return "";
+    }
+
+    Sha256 hasher;
+    char buffer[32768];
+    uint64_t remaining = length;
+    bool ok = true;
+    while (remaining > 0) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, sizeof(buffer)));
+        ssize_t got;
+        {
+            std::lock_guard<SessionLock> lock(sessionMutex);
+            got = sftp_read(file, buffer, want);
+        }
+        if (got <= 0) {
+            ok = false;
+            break;
+        }
+        hasher.update(buffer, static_cast<size_t>(got));
+        remaining -= static_cast<uint64_t>(got);
+    }
+
+    {
+        std::lock_guard<SessionLock> lock(sessionMutex);
+        sftp_close(file);
+    }
+    return ok ? hasher.hexDigest() : "";
+}
+
+// execチャンネルを開いてコマンドを実行し、出力をコールバックへ逐次渡す
+// セッションロックはlibssh呼び出しの間だけ保持し、コールバックはロック外で呼ぶ
+int runExecStream(ssh_session session, SessionLock& sessionMutex,
+                  const std::string& cmd, const ExecCallbacks& callbacks, int timeoutMs) {
+    ssh_channel execChannel = nullptr;
+    bool opened = false;
+
+    {
+        std::lock_guard<SessionLock> lock(sessionMutex);
+
+        // 新しいチャンネルを作成（exec用）
+        execChannel = ssh_channel_new(session);
+        if (execChannel) {
+            if (ssh_channel_open_session(execChannel) != SSH_OK) {
+                ssh_channel_free(execChannel);
+            } else if (ssh_channel_request_exec(execChannel, cmd.c_str()) != SSH_OK) {
+                // コマンド実行要求失敗
+                ssh_channel_close(execChannel);
+                ssh_channel_free(execChannel);
+            } else {
+                opened = true;
+            }
+        }
+    }
+
+    if (!opened) {
+        if (callbacks.onExit) {
+            callbacks.onExit(-1);
+        }
+        return -1;
+    }
+
+    // 結果を読み取る（バイナリセーフ、NULを含んでもそのまま渡す）
+    char outBuffer[16384];
+    char errBuffer[4096];
+    bool aborted = false;
+    bool finished = false;
+    int idleMs = 0;
+
+    // 標準入力はチャンネルのウィンドウに収まる分だけ書き込む（ロックを長く保持しない）
+    std::vector<char> inBuffer(callbacks.onStdin ? kExecStdinChunk : 0);
+    size_t inOffset = 0;
+    size_t inLength = 0;
+    bool inputDone = !callbacks.onStdin;
+
+    while (!finished && !aborted) {
+        int outBytes = 0;
+        int errBytes = 0;
+        bool isEof = false;
+        bool wroteInput = false;
+
+        if (!inputDone) {
+            uint32_t window;
+            {
+                std::lock_guard<SessionLock> lock(sessionMutex);
+                window = ssh_channel_window_size(execChannel);
+            }
+            if (window > 0 && inOffset == inLength) {
+                inLength = callbacks.onStdin(inBuffer.data(), inBuffer.size());
+                inOffset = 0;
+                if (inLength == 0) {
+                    inputDone = true;
+                    std::lock_guard<SessionLock> lock(sessionMutex);
+                    ssh_channel_send_eof(execChannel);
+                }
+            }
+            if (window > 0 && inOffset < inLength) {
+                uint32_t len = static_cast<uint32_t>(std::min<size_t>(inLength - inOffset, window));
+                int written;
+                {
+                    std::lock_guard<SessionLock> lock(sessionMutex);
+                    written = ssh_channel_write(execChannel, inBuffer.data() + inOffset, len);
+                }
+                if (written == SSH_ERROR) {
+                    break;
+                }
+                inOffset += static_cast<size_t>(written);
+                wroteInput = written > 0;
+            }
+        }
+
+        {
+            std::lock_guard<SessionLock> lock(sessionMutex);
+            // 入力を送っている間は待たずに読み取る
+            outBytes = ssh_channel_read_timeout(execChannel, outBuffer, sizeof(outBuffer), 0,
+                                                wroteInput ? 0 : kExecPollSliceMs);
+            errBytes = ssh_channel_read_nonblocking(execChannel, errBuffer, sizeof(errBuffer), 1);
+            isEof = ssh_channel_is_eof(execChannel);
+        }
+
+        if (outBytes == SSH_ERROR || errBytes == SSH_ERROR) {
+            break;
+        }
+
+        if (outBytes > 0 && callbacks.onStdout) {
+            aborted = !callbacks.onStdout(outBuffer, static_cast<size_t>(outBytes));
+        }
+        if (!aborted && errBytes > 0 && callbacks.onStderr) {
+            aborted = !callbacks.onStderr(errBuffer, static_cast<size_t>(errBytes));
+        }
+
+        if (outBytes > 0 || errBytes > 0 || wroteInput) {
+            idleMs = 0;
+        } else if (isEof || outBytes == SSH_EOF) {
+            finished = true;
+        } else {
+            idleMs += kExecPollSliceMs;
+            if (idleMs >= timeoutMs) {
+                break;
+            }
+        }
+
+        if (callbacks.keepGoing && !callbacks.keepGoing()) {
+            aborted = true;
+        }
+    }
+
+    int exitStatus = -1;
+    {
+        std::lock_guard<SessionLock> lock(sessionMutex);
+        if (finished) {
+            exitStatus = ssh_channel_get_exit_status(execChannel);
+        }
+        ssh_channel_send_eof(execChannel);
+        ssh_channel_close(execChannel);
+        ssh_channel_free(execChannel);
+    }
+
+    if (callbacks.onExit) {
+        callbacks.onExit(exitStatus);
+    }
+    return exitStatus;
+}
+
+} // namespace
+
 // ============================================================================
 // SshChannel 実装
 // ============================================================================
 
-SshChannel::SshChannel(ssh_session session, std::mutex* sessionMutex)
+SshChannel::SshChannel(ssh_session session, SessionLock* sessionMutex)
     : m_session(session), m_sessionMutex(sessionMutex)
 {
 }
@@ -27,7 +286,7 @@ bool SshChannel::openShell(int cols, int rows) {
         return false;
     }
 
-    std::lock_guard<std::mutex> lock(*m_sessionMutex);
+    std::lock_guard<SessionLock> lock(*m_sessionMutex);
 
     // チャンネル作成
     m_channel = ssh_channel_new(m_session);
@@ -78,56 +337,59 @@ bool SshChannel::openExec() {
     return true;
 }
 
-std::string SshChannel::exec(const std::string& cmd, int timeoutMs) {
+bool SshChannel::openCommand(const std::string& cmd) {
     if (!m_session || !m_sessionMutex) {
-        return "";
-    }
-
-    std::lock_guard<std::mutex> sessionLock(*m_sessionMutex);
-
-    // 新しいチャンネルを作成（exec用）
-    ssh_channel execChannel = ssh_channel_new(m_session);
-    if (!execChannel) {
-        return "";
+        return false;
     }
 
-    int rc = ssh_channel_open_session(execChannel);
-    if (rc != SSH_OK) {
-        ssh_channel_free(execChannel);
-        return "";
-    }
+    {
+        std::lock_guard<SessionLock> lock(*m_sessionMutex);
 
-    // コマンド実行
-    rc = ssh_channel_request_exec(execChannel, cmd.c_str());
-    if (rc != SSH_OK) {
-        ssh_channel_close(execChannel);
-        ssh_channel_free(execChannel);
-        return "";
-    }
+        m_channel = ssh_channel_new(m_session);
+        if (!m_channel) {
+            return false;
+        }
 
-    // 結果を読み取る
-    std::string result;
-    char buffer[4096];
+        int rc = ssh_channel_open_session(m_channel);
+        if (rc != SSH_OK) {
+            ssh_channel_free(m_channel);
+            m_channel = nullptr;
+            return false;
+        }
 
-    while (true) {
-        int nbytes = ssh_channel_read_timeout(execChannel, buffer, sizeof(buffer) - 1, 0, timeoutMs);
-        if (nbytes > 0) {
-            buffer[nbytes] = '\0';
-            result += buffer;
-        } else if (nbytes == 0 || nbytes == SSH_EOF) {
-            break;
-        } else {
-            break;
+        rc = ssh_channel_request_exec(m_channel, cmd.c_str());
+        if (rc != SSH_OK) {
+            ssh_channel_close(m_channel);
+            ssh_channel_free(m_channel);
+            m_channel = nullptr;
+            return false;
         }
     }
 
-    ssh_channel_send_eof(execChannel);
-    ssh_channel_close(execChannel);
-    ssh_channel_free(execChannel);
+    // 出力はシェルと同じ読み取りスレッドで受ける
+    m_running = true;
+    m_readerThread = std::thread(&SshChannel::readerThread, this);
+    return true;
+}
 
+std::string SshChannel::exec(const std::string& cmd, int timeoutMs) {
+    std::string result;
+    ExecCallbacks callbacks;
+    callbacks.onStdout = [&result](const char* data, size_t len) {
+        result.append(data, len);
+        return true;
+    };
+    execStream(cmd, callbacks, timeoutMs);
     return result;
 }
 
+int SshChannel::execStream(const std::string& cmd, const ExecCallbacks& callbacks, int timeoutMs) {
+    if (!m_session || !m_sessionMutex) {
+        return -1;
+    }
+    return runExecStream(m_session, *m_sessionMutex, cmd, callbacks, timeoutMs);
+}
+
 void SshChannel::close() {
     m_running = false;
 
@@ -148,7 +410,9 @@ void SshChannel::write(const char* data, size_t len) {
 
     std::lock_guard<std::mutex> lock(m_writeMutex);
     if (m_sessionMutex) {
-        std::lock_guard<std::mutex> sessionLock(*m_sessionMutex);
+        // キー入力は転送より先に送る
+        SessionLock::PriorityScope priority(SessionPriority::Interactive);
+        std::lock_guard<SessionLock> sessionLock(*m_sessionMutex);
         ssh_channel_write(m_channel, data, static_cast<uint32_t>(len));
     } else {
         ssh_channel_write(m_channel, data, static_cast<uint32_t>(len));
@@ -157,11 +421,14 @@ void SshChannel::write(const char* data, size_t len) {
 
 void SshChannel::resize(int cols, int rows) {
     if (!m_channel || !m_sessionMutex) return;
-    std::lock_guard<std::mutex> lock(*m_sessionMutex);
+    SessionLock::PriorityScope priority(SessionPriority::Interactive);
+    std::lock_guard<SessionLock> lock(*m_sessionMutex);
     ssh_channel_change_pty_size(m_channel, cols, rows);
 }
 
 void SshChannel::readerThread() {
+    // ターミナル出力の読み取りは転送より優先してロックを取る
+    SessionLock::PriorityScope priority(SessionPriority::Interactive);
     char buffer[4096];
 
     while (m_running && m_channel && m_sessionMutex) {
@@ -169,7 +436,7 @@ void SshChannel::readerThread() {
         bool isEof = false;
 
         {
-            std::lock_guard<std::mutex> lock(*m_sessionMutex);
+            std::lock_guard<SessionLock> lock(*m_sessionMutex);
             if (!m_channel) break;
             nbytes = ssh_channel_read_nonblocking(m_channel, buffer, sizeof(buffer), 0);
             isEof = ssh_channel_is_eof(m_channel);
@@ -186,6 +453,9 @@ void SshChannel::readerThread() {
         // CPU使用率を下げるため少し待機
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
+
+    // 相手が閉じたらisOpen()で分かるようにする（以後のwriteは捨てる）
+    m_running = false;
 }
 
 // ============================================================================
@@ -199,73 +469,109 @@ SshConnection::~SshConnection() {
 }
 
 bool SshConnection::connect(const SshConfig& config) {
+    return connect(config, ConnectHooks());
+}
+
+bool SshConnection::connect(const SshConfig& config, const ConnectHooks& hooks) {
     if (m_connected) {
         disconnect();
     }
 
-    // セッション作成
+    auto notify = [&hooks](ConnectPhase phase) {
+        if (hooks.onPhase) {
+            hooks.onPhase(phase);
+        }
+    };
+    // 途中で失敗・中断したときはセッションを破棄する
+    auto fail = [this](const std::string& error, bool sessionOpen) {
+        setLastError(error);
+        if (m_session) {
+            if (sessionOpen) {
+                ssh_disconnect(m_session);
+            }
+            ssh_free(m_session);
+            m_session = nullptr;
+        }
+        return false;
+    };
+
+    // セッション作成とssh_configの適用
+    // （HostNameの別名、Port/User、ProxyCommand/ProxyJumpを反映させるため、ソケットはlibsshに張らせる）
+    notify(ConnectPhase::Resolve);
     m_session = ssh_new();
     if (!m_session) {
-        m_lastError = "SSHセッション作成失敗";
-        return false;
+        return fail("SSHセッション作成失敗", false);
     }
-
-    // オプション設定
+    // 先に設定した値はssh_configより優先される（ポートは既定の22のままならssh_configのPortに任せる）
     ssh_options_set(m_session, SSH_OPTIONS_HOST, config.host.c_str());
-    ssh_options_set(m_session, SSH_OPTIONS_PORT, &config.port);
     ssh_options_set(m_session, SSH_OPTIONS_USER, config.username.c_str());
+    if (config.port != 22) {
+        ssh_options_set(m_session, SSH_OPTIONS_PORT, &config.port);
+    }
+    if (ssh_options_parse_config(m_session, nullptr) != SSH_OK) {
+        std::cerr << "ssh_configを読めませんでした（既定の設定で接続します）" << std::endl;
+    }
+    if (!stillGoing(hooks.keepGoing)) {
+        return fail("接続を中断しました", false);
+    }
 
-    // 接続
-    int rc = ssh_connect(m_session);
+    // 名前解決・TCP接続（またはプロキシの起動）と鍵交換
+    // ノンブロッキングで進め、待つ間に中断を確認する（名前解決の間だけはlibssh内で待つ）
+    notify(ConnectPhase::Connect);
+    ssh_set_blocking(m_session, 0);
+    bool interrupted = false;
+    int rc = pumpNonblocking(m_session, SSH_AGAIN, [this]() { return ssh_connect(m_session); },
+                             hooks.keepGoing, interrupted);
+    if (interrupted) {
+        return fail("接続を中断しました", false);
+    }
     if (rc != SSH_OK) {
-        m_lastError = std::string("接続失敗: ") + ssh_get_error(m_session);
-        ssh_free(m_session);
-        m_session = nullptr;
-        return false;
+        return fail(std::string("接続失敗: ") + ssh_get_error(m_session), false);
     }
 
     // ユーザー認証
+    notify(ConnectPhase::Auth);
     bool authenticated = false;
+    auto authenticate = [&](const std::function<int()>& method) {
+        rc = pumpNonblocking(m_session, SSH_AUTH_AGAIN, method, hooks.keepGoing, interrupted);
+        authenticated = (rc == SSH_AUTH_SUCCESS);
+    };
 
     if (config.useKeyAuth && !config.privateKeyPath.empty()) {
         // 公開鍵認証
-        rc = ssh_userauth_publickey_auto(m_session, nullptr, nullptr);
-        if (rc == SSH_AUTH_SUCCESS) {
-            authenticated = true;
-        }
+        authenticate([this]() { return ssh_userauth_publickey_auto(m_session, nullptr, nullptr); });
     }
 
-    if (!authenticated && !config.password.empty()) {
+    if (!authenticated && !interrupted && !config.password.empty()) {
         // パスワード認証
-        rc = ssh_userauth_password(m_session, nullptr, config.password.c_str());
-        if (rc == SSH_AUTH_SUCCESS) {
-            authenticated = true;
-        }
+        authenticate([this, &config]() { return ssh_userauth_password(m_session, nullptr, config.password.c_str()); });
     }
 
-    if (!authenticated) {
+    if (!authenticated && !interrupted) {
         // エージェント認証を試す
-        rc = ssh_userauth_agent(m_session, nullptr);
-        if (rc == SSH_AUTH_SUCCESS) {
-            authenticated = true;
-        }
+        authenticate([this]() { return ssh_userauth_agent(m_session, nullptr); });
     }
 
+    if (interrupted) {
+        return fail("接続を中断しました", true);
+    }
     if (!authenticated) {
-        m_lastError = "認証失敗";
-        ssh_disconnect(m_session);
-        ssh_free(m_session);
-        m_session = nullptr;
-        return false;
+        return fail("認証失敗", true);
     }
 
+    // 以降のチャンネル・SFTP処理はブロッキング前提
+    ssh_set_blocking(m_session, 1);
+
+    m_sftpPool = std::make_shared<SftpSessionPool>(m_session, &m_mutex);
+    m_endpoint = config.username + "@" + config.host + ":" + std::to_string(config.port);
+
     m_connected = true;
     std::cout << "SSH接続成功: " << config.username << "@" << config.host << std::endl;
     return true;
 }
 
 void SshConnection::disconnect() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::lock_guard<SessionLock> lock(m_mutex);
 
     // すべてのチャンネルを閉じる
     if (m_defaultChannel) {
@@ -279,6 +585,12 @@ void SshConnection::disconnect() {
     }
     m_channels.clear();
 
+    // SFTPセッションはssh_freeより前に解放する
+    if (m_sftpPool) {
+        m_sftpPool->shutdownLocked();
+        m_sftpPool.reset();
+    }
+
     if (m_session) {
         if (m_connected) {
             ssh_disconnect(m_session);
@@ -293,26 +605,48 @@ bool SshConnection::isConnected() const {
     return m_connected && m_session != nullptr;
 }
 
-std::shared_ptr<SshChannel> SshConnection::createChannel(int cols, int rows) {
+std::shared_ptr<SshChannel> SshConnection::createChannel(int cols, int rows, DataCallback onData) {
     if (!m_session || !m_connected) {
-        m_lastError = "未接続";
+        setLastError("未接続");
         return nullptr;
     }
 
     auto channel = std::make_shared<SshChannel>(m_session, &m_mutex);
+    // 読み取りスレッドが動き出す前に設定する（シェルの最初の出力を取りこぼさない）
+    channel->setDataCallback(std::move(onData));
     if (!channel->openShell(cols, rows)) {
-        m_lastError = "チャンネル作成失敗";
+        setLastError("チャンネル作成失敗");
         return nullptr;
     }
 
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
+        std::lock_guard<SessionLock> lock(m_mutex);
         m_channels.push_back(channel);
     }
     std::cout << "新しいシェルセッションを開きました（合計: " << m_channels.size() << "）" << std::endl;
     return channel;
 }
 
+std::shared_ptr<SshChannel> SshConnection::createCommandChannel(const std::string& cmd, DataCallback onData) {
+    if (!m_session || !m_connected) {
+        setLastError("未接続");
+        return nullptr;
+    }
+
+    auto channel = std::make_shared<SshChannel>(m_session, &m_mutex);
+    channel->setDataCallback(std::move(onData));
+    if (!channel->openCommand(cmd)) {
+        setLastError("チャンネル作成失敗");
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<SessionLock> lock(m_mutex);
+        m_channels.push_back(channel);
+    }
+    return channel;
+}
+
 // 後方互換性のための旧API
 bool SshConnection::openShell(int cols, int rows) {
     m_defaultChannel = createChannel(cols, rows);
@@ -320,7 +654,7 @@ bool SshConnection::openShell(int cols, int rows) {
 }
 
 void SshConnection::closeShell() {
-    std::lock_guard<std::mutex> lock(m_mutex);
+    std::lock_guard<SessionLock> lock(m_mutex);
     if (m_defaultChannel) {
         m_defaultChannel->close();
         m_defaultChannel.reset();
@@ -346,202 +680,385 @@ void SshConnection::resize(int cols, int rows) {
 }
 
 std::string SshConnection::exec(const std::string& cmd, int timeoutMs) {
+    std::string result;
+    ExecCallbacks callbacks;
+    callbacks.onStdout = [&result](const char* data, size_t len) {
+        result.append(data, len);
+        return true;
+    };
+    execStream(cmd, callbacks, timeoutMs);
+
+    // 末尾の改行を削除
+    while (!result.empty() && (result.back() == '\n' || result.back() == '\r')) {
+        result.pop_back();
+    }
+
+    return result;
+}
+
+int SshConnection::execStream(const std::string& cmd, const ExecCallbacks& callbacks, int timeoutMs) {
     if (!m_session || !m_connected) {
-        return "";
+        return -1;
     }
+    return runExecStream(m_session, m_mutex, cmd, callbacks, timeoutMs);
+}
 
-    std::lock_guard<std::mutex> lock(m_mutex);
+std::string SshConnection::lastError() const {
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    return m_lastError;
+}
 
-    // 新しいチャンネルを作成（exec用）
-    ssh_channel execChannel = ssh_channel_new(m_session);
-    if (!execChannel) {
-        return "";
+void SshConnection::setLastError(const std::string& error) {
+    std::lock_guard<std::mutex> lock(m_errorMutex);
+    m_lastError = error;
+}
+
+bool SshConnection::uploadFile(const std::string& localPath, const std::string& remotePath) {
+    std::string error;
+    if (!uploadFile(localPath, remotePath, TransferHooks(), error)) {
+        setLastError(error);
+        return false;
     }
+    return true;
+}
 
-    int rc = ssh_channel_open_session(execChannel);
-    if (rc != SSH_OK) {
-        ssh_channel_free(execChannel);
-        return "";
+bool SshConnection::downloadFile(const std::string& remotePath, const std::string& localPath) {
+    std::string error;
+    if (!downloadFile(remotePath, localPath, TransferHooks(), error)) {
+        setLastError(error);
+        return false;
     }
+    return true;
+}
 
-    // コマンド実行
-    rc = ssh_channel_request_exec(execChannel, cmd.c_str());
-    if (rc != SSH_OK) {
-        ssh_channel_close(execChannel);
-        ssh_channel_free(execChannel);
-        return "";
+bool SshConnection::uploadFile(const std::string& localPath, const std::string& remotePath,
+                               const TransferHooks& hooks, std::string& error) {
+    std::shared_ptr<SftpSessionPool> pool = m_sftpPool;
+    if (!m_session || !m_connected || !pool) {
+        error = "未接続";
+        return false;
     }
 
-    // 結果を読み取る
-    std::string result;
-    char buffer[4096];
+    // セッション異常で失敗した場合は、新しいSFTPセッションで一度だけやり直す
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        uint64_t offset = hooks.resume ? findResumeOffset(true, localPath, remotePath) : 0;
 
-    while (true) {
-        int nbytes = ssh_channel_read_timeout(execChannel, buffer, sizeof(buffer) - 1, 0, timeoutMs);
-        if (nbytes > 0) {
-            buffer[nbytes] = '\0';
-            result += buffer;
-        } else if (nbytes == 0 || nbytes == SSH_EOF) {
-            break;
-        } else {
-            break;
+        SftpSessionPool::Lease sftp = pool->acquire(&error);
+        if (!sftp) {
+            return false;
         }
-    }
 
-    ssh_channel_send_eof(execChannel);
-    ssh_channel_close(execChannel);
-    ssh_channel_free(execChannel);
+        SftpTransfer transfer(sftp.get(), m_mutex);
+        transfer.setHooks(hooks);
+        if (transfer.upload(localPath, remotePath, offset)) {
+            std::cout << "アップロード完了: " << localPath << " -> " << remotePath << std::endl;
+            return true;
+        }
 
-    // 末尾の改行を削除
-    while (!result.empty() && (result.back() == '\n' || result.back() == '\r')) {
-        result.pop_back();
+        error = transfer.lastError();
+        sftp.checkError();
+        // 応答を待たずに打ち切ったセッションには未着の応答が残るので使い回さない
+        if (transfer.abandonedSession()) {
+            sftp.markBroken();
+        }
+        if (transfer.wasCancelled() || !sftp.isBroken()) {
+            return false;
+        }
     }
 
-    return result;
+    return false;
 }
 
-bool SshConnection::uploadFile(const std::string& localPath, const std::string& remotePath) {
-    if (!m_session || !m_connected) {
-        m_lastError = "未接続";
+bool SshConnection::downloadFile(const std::string& remotePath, const std::string& localPath,
+                                 const TransferHooks& hooks, std::string& error) {
+    std::shared_ptr<SftpSessionPool> pool = m_sftpPool;
+    if (!m_session || !m_connected || !pool) {
+        error = "未接続";
         return false;
     }
 
-    // ローカルファイルを開く
-    std::ifstream file(localPath, std::ios::binary | std::ios::ate);
-    if (!file.is_open()) {
-        m_lastError = "ローカルファイルを開けません: " + localPath;
+    // セッション異常で失敗した場合は、新しいSFTPセッションで一度だけやり直す
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        uint64_t offset = hooks.resume ? findResumeOffset(false, localPath, remotePath) : 0;
+
+        SftpSessionPool::Lease sftp = pool->acquire(&error);
+        if (!sftp) {
+            return false;
+        }
+
+        SftpTransfer transfer(sftp.get(), m_mutex);
+        transfer.setHooks(hooks);
+        if (transfer.download(remotePath, localPath, offset)) {
+            std::cout << "ダウンロード完了: " << remotePath << " -> " << localPath << std::endl;
+            return true;
+        }
+
+        // 失敗した場合は不完全なファイルを削除（再開可能な転送と、中断・切断で打ち切った転送は続きに使うので残す）
+        if (!hooks.resume && !transfer.wasCancelled() && isConnected()) {
+            std::error_code ec;
+            std::filesystem::remove(localPath, ec);
+        }
+
+        error = transfer.lastError();
+        sftp.checkError();
+        // 応答を待たずに打ち切ったセッションには未着の応答が残るので使い回さない
+        if (transfer.abandonedSession()) {
+            sftp.markBroken();
+        }
+        if (transfer.wasCancelled() || !sftp.isBroken()) {
+            return false;
+        }
+    }
+
+    return false;
+}
+
+bool SshConnection::transferRange(bool upload, const std::string& localPath, const std::string& remotePath,
+                                  uint64_t offset, uint64_t length, const TransferHooks& hooks, std::string& error) {
+    std::shared_ptr<SftpSessionPool> pool = m_sftpPool;
+    if (!m_session || !m_connected || !pool) {
+        error = "未接続";
         return false;
     }
 
-    // ファイルサイズ取得
-    std::streamsize fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        SftpSessionPool::Lease sftp = pool->acquire(&error);
+        if (!sftp) {
+            return false;
+        }
 
-    std::lock_guard<std::mutex> lock(m_mutex);
+        SftpTransfer transfer(sftp.get(), m_mutex);
+        transfer.setHooks(hooks);
+        bool ok = upload ? transfer.uploadRange(localPath, remotePath, offset, length)
+                         : transfer.downloadRange(remotePath, localPath, offset, length);
+        if (ok) {
+            return true;
+        }
 
-    // SFTPセッションを開く
-    sftp_session sftp = sftp_new(m_session);
-    if (!sftp) {
-        m_lastError = "SFTPセッション作成失敗";
-        return false;
+        error = transfer.lastError();
+        sftp.checkError();
+        // 応答を待たずに打ち切ったセッションには未着の応答が残るので使い回さない
+        if (transfer.abandonedSession()) {
+            sftp.markBroken();
+        }
+        if (transfer.wasCancelled() || !sftp.isBroken()) {
+            return false;
+        }
     }
 
-    if (sftp_init(sftp) != SSH_OK) {
-        m_lastError = "SFTP初期化失敗";
-        sftp_free(sftp);
-        return false;
+    return false;
+}
+
+uint64_t SshConnection::findResumeOffset(bool upload, const std::string& localPath, const std::string& remotePath) {
+    std::shared_ptr<SftpSessionPool> pool = m_sftpPool;
+    if (!pool) {
+        return 0;
     }
 
-    // リモートファイルを作成
-    sftp_file remoteFile = sftp_open(sftp, remotePath.c_str(),
-                                      O_WRONLY | O_CREAT | O_TRUNC, S_IRWXU);
-    if (!remoteFile) {
-        m_lastError = "リモートファイル作成失敗: " + remotePath;
-        sftp_free(sftp);
-        return false;
+    std::error_code ec;
+    uint64_t localSize = std::filesystem::file_size(localPath, ec);
+    if (ec) {
+        return 0;
     }
 
-    // データを転送
-    const size_t bufferSize = 65536;
-    char buffer[bufferSize];
-    bool success = true;
+    SftpSessionPool::Lease sftp = pool->acquire();
+    if (!sftp) {
+        return 0;
+    }
 
-    while (file && fileSize > 0) {
-        file.read(buffer, bufferSize);
-        std::streamsize bytesRead = file.gcount();
-        if (bytesRead > 0) {
-            ssize_t written = sftp_write(remoteFile, buffer, static_cast<size_t>(bytesRead));
-            if (written != bytesRead) {
-                m_lastError = "書き込みエラー";
-                success = false;
-                break;
-            }
-            fileSize -= bytesRead;
+    uint64_t remoteSize = 0;
+    {
+        std::lock_guard<SessionLock> lock(m_mutex);
+        sftp_attributes attrs = sftp_stat(sftp.get(), remotePath.c_str());
+        if (!attrs) {
+            return 0;
         }
+        remoteSize = attrs->size;
+        sftp_attributes_free(attrs);
     }
 
-    sftp_close(remoteFile);
-    sftp_free(sftp);
+    // 転送先の途中ファイルが転送元の先頭部分と一致する場合のみ再開できる
+    uint64_t partial = upload ? remoteSize : localSize;
+    uint64_t full = upload ? localSize : remoteSize;
+    // 同じ長さなら末尾が一致しても完了とはみなさない（それより前が古い内容のままかもしれない）
+    if (partial == 0 || partial >= full) {
+        return 0;
+    }
 
-    if (success) {
-        std::cout << "アップロード完了: " << localPath << " -> " << remotePath << std::endl;
+    uint64_t window = std::min(partial, kResumeVerifyBytes);
+    uint64_t start = partial - window;
+
+    std::string localHash = Sha256::hashFileRange(localPath, start, window);
+    if (localHash.empty()) {
+        return 0;
     }
 
-    return success;
+    // リモート側で計算できればデータを転送せずに済む
+    std::string cmd = "tail -c +" + std::to_string(start + 1) + " " + shellQuote(remotePath) +
+                      " 2>/dev/null | head -c " + std::to_string(window) +
+                      " | { sha256sum 2>/dev/null || shasum -a 256; }";
+    std::string remoteHash = parseHexDigest(exec(cmd, 10000));
+    if (remoteHash.empty()) {
+        remoteHash = sftpRangeHash(sftp.get(), m_mutex, remotePath, start, window);
+    }
+
+    if (remoteHash.empty() || remoteHash != localHash) {
+        std::cout << "途中ファイルの末尾が一致しないため最初から転送します: "
+                  << (upload ? remotePath : localPath) << std::endl;
+        return 0;
+    }
+
+    std::cout << "転送を再開します: " << (upload ? remotePath : localPath)
+              << "（" << partial << " / " << full << " バイト）" << std::endl;
+    return partial;
 }
 
-bool SshConnection::downloadFile(const std::string& remotePath, const std::string& localPath) {
-    if (!m_session || !m_connected) {
-        m_lastError = "未接続";
+bool SshConnection::statRemote(const std::string& remotePath, RemoteEntry& entry) {
+    std::shared_ptr<SftpSessionPool> pool = m_sftpPool;
+    if (!m_session || !m_connected || !pool) {
+        setLastError("未接続");
         return false;
     }
 
-    std::lock_guard<std::mutex> lock(m_mutex);
-
-    // SFTPセッションを開く
-    sftp_session sftp = sftp_new(m_session);
+    std::string error;
+    SftpSessionPool::Lease sftp = pool->acquire(&error);
     if (!sftp) {
-        m_lastError = "SFTPセッション作成失敗";
+        setLastError(error);
+        return false;
+    }
+
+    std::lock_guard<SessionLock> lock(m_mutex);
+    sftp_attributes attrs = sftp_stat(sftp.get(), remotePath.c_str());
+    if (!attrs) {
+        setLastError("リモートファイル情報を取得できません: " + remotePath);
+        sftp.checkError();
         return false;
     }
 
-    if (sftp_init(sftp) != SSH_OK) {
-        m_lastError = "SFTP初期化失敗";
-        sftp_free(sftp);
+    size_t pos = remotePath.find_last_of("/\\");
+    entry.name = (pos != std::string::npos) ? remotePath.substr(pos + 1) : remotePath;
+    entry.isDir = (attrs->type == SSH_FILEXFER_TYPE_DIRECTORY);
+    entry.size = attrs->size;
+    entry.mtime = attrs->mtime64 ? attrs->mtime64 : attrs->mtime;
+    entry.permissions = attrs->permissions;
+    sftp_attributes_free(attrs);
+    return true;
+}
+
+bool SshConnection::makeRemoteDirectories(const std::vector<std::string>& remotePaths, std::string& error) {
+    std::shared_ptr<SftpSessionPool> pool = m_sftpPool;
+    if (!m_session || !m_connected || !pool) {
+        error = "未接続";
         return false;
     }
+    if (remotePaths.empty()) {
+        return true;
+    }
 
-    // リモートファイルを開く
-    sftp_file remoteFile = sftp_open(sftp, remotePath.c_str(), O_RDONLY, 0);
-    if (!remoteFile) {
-        m_lastError = "リモートファイルを開けません: " + remotePath;
-        sftp_free(sftp);
+    SftpSessionPool::Lease sftp = pool->acquire(&error);
+    if (!sftp) {
         return false;
     }
 
-    // ローカルファイルを作成
-    std::ofstream file(localPath, std::ios::binary);
-    if (!file.is_open()) {
-        m_lastError = "ローカルファイル作成失敗: " + localPath;
-        sftp_close(remoteFile);
-        sftp_free(sftp);
+    for (const auto& path : remotePaths) {
+        std::lock_guard<SessionLock> lock(m_mutex);
+        if (sftp_mkdir(sftp.get(), path.c_str(), 0755) == SSH_OK) {
+            continue;
+        }
+
+        // 既に存在する場合のエラーコードはサーバーによって異なるので、実際に確認する
+        sftp_attributes attrs = sftp_stat(sftp.get(), path.c_str());
+        bool isDir = attrs && attrs->type == SSH_FILEXFER_TYPE_DIRECTORY;
+        if (attrs) {
+            sftp_attributes_free(attrs);
+        }
+        if (!isDir) {
+            error = "リモートディレクトリ作成失敗: " + path;
+            sftp.checkError();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SshConnection::writeRemoteFile(const std::string& remotePath, const std::string& data, std::string& error) {
+    std::shared_ptr<SftpSessionPool> pool = m_sftpPool;
+    if (!m_session || !m_connected || !pool) {
+        error = "未接続";
         return false;
     }
 
-    // データを転送
-    const size_t bufferSize = 65536;
-    char buffer[bufferSize];
-    bool success = true;
+    SftpSessionPool::Lease sftp = pool->acquire(&error);
+    if (!sftp) {
+        return false;
+    }
 
-    while (true) {
-        ssize_t bytesRead = sftp_read(remoteFile, buffer, bufferSize);
-        if (bytesRead == 0) {
-            break;  // EOF
-        } else if (bytesRead < 0) {
-            m_lastError = "読み取りエラー";
-            success = false;
+    sftp_file file = nullptr;
+    {
+        std::lock_guard<SessionLock> lock(m_mutex);
+        file = sftp_open(sftp.get(), remotePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    if (!file) {
+        error = "リモートファイルを作成できません: " + remotePath;
+        sftp.checkError();
+        return false;
+    }
+
+    size_t offset = 0;
+    bool ok = true;
+    while (offset < data.size()) {
+        size_t chunk = std::min<size_t>(data.size() - offset, 32768);
+        ssize_t written;
+        {
+            std::lock_guard<SessionLock> lock(m_mutex);
+            written = sftp_write(file, data.data() + offset, chunk);
+        }
+        if (written <= 0) {
+            ok = false;
             break;
         }
-        file.write(buffer, bytesRead);
+        offset += static_cast<size_t>(written);
     }
 
-    sftp_close(remoteFile);
-    sftp_free(sftp);
-    file.close();
+    {
+        std::lock_guard<SessionLock> lock(m_mutex);
+        sftp_close(file);
+    }
+    if (!ok) {
+        error = "リモートファイルへの書き込みに失敗: " + remotePath;
+        sftp.checkError();
+    }
+    return ok;
+}
 
-    if (success) {
-        std::cout << "ダウンロード完了: " << remotePath << " -> " << localPath << std::endl;
-    } else {
-        // 失敗した場合は不完全なファイルを削除
-        std::filesystem::remove(localPath);
+bool SshConnection::setRemoteMtime(const std::string& remotePath, int64_t mtime) {
+    std::shared_ptr<SftpSessionPool> pool = m_sftpPool;
+    if (!m_session || !m_connected || !pool) {
+        return false;
     }
 
-    return success;
+    SftpSessionPool::Lease sftp = pool->acquire();
+    if (!sftp) {
+        return false;
+    }
+
+    struct timeval times[2];
+    times[0].tv_sec = static_cast<time_t>(mtime);
+    times[0].tv_usec = 0;
+    times[1] = times[0];
+
+    std::lock_guard<SessionLock> lock(m_mutex);
+    if (sftp_utimes(sftp.get(), remotePath.c_str(), times) != SSH_OK) {
+        sftp.checkError();
+        return false;
+    }
+    return true;
 }
 
 bool SshConnection::uploadDirectory(const std::string& localPath, const std::string& remotePath) {
     if (!m_session || !m_connected) {
-        m_lastError = "未接続";
+        setLastError("未接続");
         return false;
     }
 
@@ -551,88 +1068,124 @@ bool SshConnection::uploadDirectory(const std::string& localPath, const std::str
         return uploadFile(localPath, remotePath);
     }
 
-    // リモートにディレクトリを作成
-    std::string mkdirCmd = "mkdir -p '" + remotePath + "'";
-    exec(mkdirCmd, 5000);
-
-    bool success = true;
+    // ディレクトリは先にまとめて作成する（1ディレクトリごとにexecを起動しない）
+    std::vector<std::string> directories{remotePath};
+    std::vector<std::pair<std::string, std::string>> files;
+    std::error_code ec;
+    for (fs::recursive_directory_iterator it(localPath, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string relative = fs::relative(it->path(), localPath, ec).generic_string();
+        if (ec) {
+            break;
+        }
+        std::string remoteSubPath = remotePath + "/" + relative;
+        if (it->is_directory()) {
+            directories.push_back(remoteSubPath);
+        } else {
+            files.emplace_back(it->path().string(), remoteSubPath);
+        }
+    }
+    if (ec) {
+        setLastError("フォルダの走査に失敗: " + localPath);
+        return false;
+    }
 
-    for (const auto& entry : fs::directory_iterator(localPath)) {
-        std::string name = entry.path().filename().string();
-        std::string localSubPath = localPath + "/" + name;
-        std::string remoteSubPath = remotePath + "/" + name;
+    std::string error;
+    if (!makeRemoteDirectories(directories, error)) {
+        setLastError(error);
+        return false;
+    }
 
-        if (entry.is_directory()) {
-            if (!uploadDirectory(localSubPath, remoteSubPath)) {
-                success = false;
-            }
-        } else {
-            if (!uploadFile(localSubPath, remoteSubPath)) {
-                success = false;
-            }
+    bool success = true;
+    for (const auto& file : files) {
+        if (!uploadFile(file.first, file.second)) {
+            success = false;
         }
     }
 
     return success;
 }
 
-bool SshConnection::downloadDirectory(const std::string& remotePath, const std::string& localPath) {
-    if (!m_session || !m_connected) {
-        m_lastError = "未接続";
+bool SshConnection::listDirectory(const std::string& remotePath, std::vector<RemoteEntry>& entries) {
+    entries.clear();
+
+    if (!m_session || !m_connected || !m_sftpPool) {
+        setLastError("未接続");
         return false;
     }
 
-    namespace fs = std::filesystem;
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        std::string error;
+        SftpSessionPool::Lease sftp = m_sftpPool->acquire(&error);
+        if (!sftp) {
+            setLastError(error);
+            return false;
+        }
 
-    // ローカルにディレクトリを作成
-    fs::create_directories(localPath);
+        std::lock_guard<SessionLock> lock(m_mutex);
 
-    std::lock_guard<std::mutex> lock(m_mutex);
+        // リモートディレクトリを開く
+        sftp_dir dir = sftp_opendir(sftp.get(), remotePath.c_str());
+        if (!dir) {
+            setLastError("リモートディレクトリを開けません: " + remotePath);
+            sftp.checkError();
+            if (sftp.isBroken()) continue;
+            return false;
+        }
 
-    // SFTPセッションを開く
-    sftp_session sftp = sftp_new(m_session);
-    if (!sftp) {
-        m_lastError = "SFTPセッション作成失敗";
-        return false;
-    }
+        sftp_attributes attrs;
+        while ((attrs = sftp_readdir(sftp.get(), dir)) != nullptr) {
+            std::string name = attrs->name;
+            if (name != "." && name != "..") {
+                RemoteEntry entry;
+                entry.name = name;
+                entry.isDir = (attrs->type == SSH_FILEXFER_TYPE_DIRECTORY);
+                entry.size = attrs->size;
+                entry.mtime = attrs->mtime64 ? attrs->mtime64 : attrs->mtime;
+                entry.permissions = attrs->permissions;
+                entries.push_back(std::move(entry));
+            }
+            sftp_attributes_free(attrs);
+        }
 
-    if (sftp_init(sftp) != SSH_OK) {
-        m_lastError = "SFTP初期化失敗";
-        sftp_free(sftp);
-        return false;
+        bool complete = sftp_dir_eof(dir) != 0;
+        sftp_closedir(dir);
+
+        if (!complete) {
+            setLastError("ディレクトリ読み取りエラー: " + remotePath);
+            sftp.checkError();
+            entries.clear();
+            if (sftp.isBroken()) continue;
+            return false;
+        }
+        return true;
     }
 
-    // リモートディレクトリを開く
-    sftp_dir dir = sftp_opendir(sftp, remotePath.c_str());
-    if (!dir) {
-        // ファイルかもしれない
-        sftp_free(sftp);
-        // mutexをアンロックしてからダウンロード
-        return false;  // 別途ファイルとして処理
+    return false;
+}
+
+bool SshConnection::downloadDirectory(const std::string& remotePath, const std::string& localPath) {
+    if (!m_session || !m_connected) {
+        setLastError("未接続");
+        return false;
     }
 
-    std::vector<std::pair<std::string, bool>> entries;  // name, isDir
+    namespace fs = std::filesystem;
 
-    sftp_attributes attrs;
-    while ((attrs = sftp_readdir(sftp, dir)) != nullptr) {
-        std::string name = attrs->name;
-        if (name != "." && name != "..") {
-            bool isDir = (attrs->type == SSH_FILEXFER_TYPE_DIRECTORY);
-            entries.emplace_back(name, isDir);
-        }
-        sftp_attributes_free(attrs);
+    std::vector<RemoteEntry> entries;
+    if (!listDirectory(remotePath, entries)) {
+        return false;  // ファイルかもしれない（別途ファイルとして処理）
     }
 
-    sftp_closedir(dir);
-    sftp_free(sftp);
+    // ローカルにディレクトリを作成
+    fs::create_directories(localPath);
 
-    // エントリを処理（mutexをアンロックした状態で）
+    // エントリを処理（一覧取得のSFTPセッションは返却済み）
     bool success = true;
-    for (const auto& [name, isDir] : entries) {
-        std::string remoteSubPath = remotePath + "/" + name;
-        std::string localSubPath = localPath + "/" + name;
+    for (const auto& entry : entries) {
+        std::string remoteSubPath = remotePath + "/" + entry.name;
+        std::string localSubPath = localPath + "/" + entry.name;
 
-        if (isDir) {
+        if (entry.isDir) {
             if (!downloadDirectory(remoteSubPath, localSubPath)) {
                 success = false;
             }
@@ -0,0 +1,502 @@
+#include "TarStream.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+namespace pbterm {
+
+namespace {
+
+constexpr size_t kBlockSize = 512;
+constexpr size_t kReadChunk = 64 * 1024;
+
+// ヘッダのフィールド位置
+constexpr size_t kNameOffset = 0;
+constexpr size_t kNameLength = 100;
+constexpr size_t kModeOffset = 100;
+constexpr size_t kUidOffset = 108;
+constexpr size_t kGidOffset = 116;
+constexpr size_t kSizeOffset = 124;
+constexpr size_t kMtimeOffset = 136;
+constexpr size_t kChecksumOffset = 148;
+constexpr size_t kTypeOffset = 156;
+constexpr size_t kMagicOffset = 257;
+constexpr size_t kPrefixOffset = 345;
+constexpr size_t kPrefixLength = 155;
+
+const char kGnuMagic[8] = {'u', 's', 't', 'a', 'r', ' ', ' ', '\0'};
+const char kLongLinkName[] = "././@LongLink";
+
+// 8進数で収まらない値はGNUの256進数表現にする
+void writeNumber(char* field, size_t width, uint64_t value) {
+    uint64_t limit = 1;
+    for (size_t i = 0; i < width - 1; ++i) {
+        limit *= 8;
+    }
+    if (value < limit) {
+        field[width - 1] = '\0';
+        for (size_t i = width - 1; i-- > 0;) {
+            field[i] = static_cast<char>('0' + (value & 7));
+            value >>= 3;
+        }
+        return;
+    }
+    std::memset(field, 0, width);
+    field[0] = static_cast<char>(0x80);
+    for (size_t i = width - 1; i > 0 && value != 0; --i) {
+        field[i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+}
+
+uint64_t parseNumber(const char* field, size_t width) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(field);
+    uint64_t value = 0;
+    if (p[0] & 0x80) {
+        for (size_t i = 1; i < width; ++i) {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+    size_t i = 0;
+    while (i < width && (p[i] == ' ' || p[i] == '\0')) {
+        ++i;
+    }
+    for (; i < width && p[i] >= '0' && p[i] <= '7'; ++i) {
+        value = (value << 3) | (p[i] - '0');
+    }
+    return value;
+}
+
+std::string fieldString(const char* field, size_t width) {
+    return std::string(field, strnlen(field, width));
+}
+
+uint64_t paddingFor(uint64_t size) {
+    return (kBlockSize - size % kBlockSize) % kBlockSize;
+}
+
+} // namespace
+
+// ============================================================================
+// TarWriter
+// ============================================================================
+
+TarWriter::TarWriter(Sink sink)
+    : m_sink(std::move(sink))
+{
+}
+
+bool TarWriter::writeHeader(const std::string& name, char type, uint64_t size, uint32_t mode, int64_t mtime) {
+    char header[kBlockSize];
+
+    // 100バイトを超える名前は直前に././@LongLinkエントリで渡す
+    if (name.size() > kNameLength) {
+        std::memset(header, 0, sizeof(header));
+        std::memcpy(header + kNameOffset, kLongLinkName, sizeof(kLongLinkName) - 1);
+        writeNumber(header + kModeOffset, 8, 0644);
+        writeNumber(header + kUidOffset, 8, 0);
+        writeNumber(header + kGidOffset, 8, 0);
+        writeNumber(header + kSizeOffset, 12, name.size() + 1);
+        writeNumber(header + kMtimeOffset, 12, 0);
+        header[kTypeOffset] = 'L';
+        std::memcpy(header + kMagicOffset, kGnuMagic, sizeof(kGnuMagic));
+        std::memset(header + kChecksumOffset, ' ', 8);
+        unsigned int sum = 0;
+        for (unsigned char c : header) {
+            sum += c;
+        }
+        writeNumber(header + kChecksumOffset, 7, sum);
+        header[kChecksumOffset + 7] = ' ';
+
+        if (!m_sink(header, sizeof(header)) || !m_sink(name.c_str(), name.size() + 1) ||
+            !writePadding(name.size() + 1)) {
+            return false;
+        }
+    }
+
+    std::memset(header, 0, sizeof(header));
+    std::memcpy(header + kNameOffset, name.data(), std::min(name.size(), kNameLength));
+    writeNumber(header + kModeOffset, 8, mode & 07777);
+    writeNumber(header + kUidOffset, 8, 0);
+    writeNumber(header + kGidOffset, 8, 0);
+    writeNumber(header + kSizeOffset, 12, size);
+    writeNumber(header + kMtimeOffset, 12, mtime > 0 ? static_cast<uint64_t>(mtime) : 0);
+    header[kTypeOffset] = type;
+    std::memcpy(header + kMagicOffset, kGnuMagic, sizeof(kGnuMagic));
+
+    // チェックサムはフィールドを空白とみなして計算する
+    std::memset(header + kChecksumOffset, ' ', 8);
+    unsigned int sum = 0;
+    for (unsigned char c : header) {
+        sum += c;
+    }
+    writeNumber(header + kChecksumOffset, 7, sum);
+    header[kChecksumOffset + 7] = ' ';
+
+    return m_sink(header, sizeof(header));
+}
+
+bool TarWriter::writePadding(uint64_t size) {
+    static const char zeros[kBlockSize] = {};
+    uint64_t padding = paddingFor(size);
+    return padding == 0 || m_sink(zeros, static_cast<size_t>(padding));
+}
+
+bool TarWriter::addDirectory(const std::string& name, uint32_t mode, int64_t mtime) {
+    std::string dirName = name;
+    if (dirName.empty() || dirName.back() != '/') {
+        dirName += '/';
+    }
+    return writeHeader(dirName, '5', 0, mode, mtime);
+}
+
+bool TarWriter::addFile(const std::string& name, const std::string& localPath, uint64_t size,
+                        uint32_t mode, int64_t mtime, const ProgressCallback& onBytes) {
+    std::ifstream file(localPath, std::ios::binary);
+    if (!file.is_open()) {
+        // 読めないファイルは飛ばして残りを続ける
+        m_lastError = "ファイルを開けないためスキップしました: " + localPath;
+        std::cerr << m_lastError << std::endl;
+        return true;
+    }
+
+    if (!writeHeader(name, '0', size, mode, mtime)) {
+        return false;
+    }
+
+    std::vector<char> buffer(kReadChunk);
+    uint64_t remaining = size;
+    while (remaining > 0) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+        file.read(buffer.data(), static_cast<std::streamsize>(want));
+        size_t got = static_cast<size_t>(file.gcount());
+        if (got == 0) {
+            // 読み取り中に短くなった場合は宣言したサイズまで0で埋める（アーカイブを壊さない）
+            m_lastError = "読み取り中にファイルが変更されました: " + localPath;
+            std::cerr << m_lastError << std::endl;
+            std::fill(buffer.begin(), buffer.end(), 0);
+            got = want;
+        }
+        if (!m_sink(buffer.data(), got)) {
+            return false;
+        }
+        remaining -= got;
+        if (onBytes && !onBytes(got)) {
+            return false;
+        }
+    }
+
+    return writePadding(size);
+}
+
+bool TarWriter::finish() {
+    static const char zeros[kBlockSize * 2] = {};
+    return m_sink(zeros, sizeof(zeros));
+}
+
+// ============================================================================
+// TarReader
+// ============================================================================
+
+TarReader::TarReader(const std::string& destination)
+    : m_destination(destination)
+{
+}
+
+TarReader::~TarReader() {
+    if (m_file.is_open()) {
+        m_file.close();
+    }
+}
+
+bool TarReader::feed(const char* data, size_t len) {
+    while (len > 0) {
+        switch (m_phase) {
+            case Phase::Header: {
+                size_t n = std::min(len, kBlockSize - m_headerFill);
+                std::memcpy(m_header + m_headerFill, data, n);
+                m_headerFill += n;
+                data += n;
+                len -= n;
+                if (m_headerFill == kBlockSize) {
+                    m_headerFill = 0;
+                    if (!processHeader()) {
+                        return false;
+                    }
+                }
+                break;
+            }
+
+            case Phase::FileData:
+            case Phase::SkipData:
+            case Phase::LongName:
+            case Phase::PaxHeader: {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(len, m_remaining));
+                if (m_phase == Phase::FileData) {
+                    m_file.write(data, static_cast<std::streamsize>(n));
+                    if (!m_file) {
+                        m_lastError = "ファイル書き込みエラー: " + m_filePath;
+                        return false;
+                    }
+                    if (m_onBytes && !m_onBytes(n)) {
+                        m_lastError = "転送が中断されました";
+                        return false;
+                    }
+                } else if (m_phase != Phase::SkipData) {
+                    m_extended.append(data, n);
+                }
+                m_remaining -= n;
+                data += n;
+                len -= n;
+
+                if (m_remaining == 0) {
+                    if (m_phase == Phase::FileData && !finishFile()) {
+                        return false;
+                    }
+                    if (m_phase == Phase::LongName) {
+                        m_nextName = m_extended.c_str();
+                    } else if (m_phase == Phase::PaxHeader) {
+                        applyPaxRecords(m_extended);
+                    }
+                    m_phase = m_padding > 0 ? Phase::Padding : Phase::Header;
+                }
+                break;
+            }
+
+            case Phase::Padding: {
+                size_t n = static_cast<size_t>(std::min<uint64_t>(len, m_padding));
+                m_padding -= n;
+                data += n;
+                len -= n;
+                if (m_padding == 0) {
+                    m_phase = Phase::Header;
+                }
+                break;
+            }
+
+            case Phase::End:
+                // 終端ブロック以降（レコード境界までの0埋め）は読み捨てる
+                return true;
+        }
+    }
+    return true;
+}
+
+bool TarReader::finish() {
+    if (m_phase == Phase::End || (m_phase == Phase::Header && m_headerFill == 0)) {
+        return true;
+    }
+    if (m_lastError.empty()) {
+        m_lastError = "アーカイブが途中で終わっています";
+    }
+    return false;
+}
+
+bool TarReader::processHeader() {
+    bool allZero = std::all_of(m_header, m_header + kBlockSize, [](char c) { return c == '\0'; });
+    if (allZero) {
+        // 0埋めのブロックが2つ続いたら終端
+        if (++m_zeroBlocks >= 2) {
+            m_phase = Phase::End;
+        }
+        return true;
+    }
+    m_zeroBlocks = 0;
+
+    // チェックサム確認（古い実装の符号付き合計も受け付ける）
+    uint64_t expected = parseNumber(m_header + kChecksumOffset, 8);
+    unsigned int unsignedSum = 0;
+    int signedSum = 0;
+    for (size_t i = 0; i < kBlockSize; ++i) {
+        bool inChecksum = i >= kChecksumOffset && i < kChecksumOffset + 8;
+        unsigned char c = inChecksum ? ' ' : static_cast<unsigned char>(m_header[i]);
+        unsignedSum += c;
+        signedSum += inChecksum ? ' ' : static_cast<signed char>(m_header[i]);
+    }
+    if (expected != unsignedSum && static_cast<int64_t>(expected) != signedSum) {
+        m_lastError = "tarヘッダが壊れています";
+        return false;
+    }
+
+    std::string name = fieldString(m_header + kNameOffset, kNameLength);
+    // POSIX ustarでは名前の前半がprefixに入る（GNU形式ではこの位置は別用途）
+    if (std::memcmp(m_header + kMagicOffset, "ustar\0", 6) == 0) {
+        std::string prefix = fieldString(m_header + kPrefixOffset, kPrefixLength);
+        if (!prefix.empty()) {
+            name = prefix + "/" + name;
+        }
+    }
+
+    char type = m_header[kTypeOffset];
+    uint64_t size = parseNumber(m_header + kSizeOffset, 12);
+    uint32_t mode = static_cast<uint32_t>(parseNumber(m_header + kModeOffset, 8));
+    int64_t mtime = static_cast<int64_t>(parseNumber(m_header + kMtimeOffset, 12));
+
+    if (type == 'L' || type == 'x' || type == 'g') {
+        m_extended.clear();
+        m_remaining = size;
+        m_padding = paddingFor(size);
+        // グローバルなpaxヘッダ（g）の内容は使わない
+        m_phase = (type == 'L') ? Phase::LongName : (type == 'x' ? Phase::PaxHeader : Phase::SkipData);
+        if (size == 0) {
+            m_phase = Phase::Header;
+        }
+        return true;
+    }
+
+    if (!m_nextName.empty()) {
+        name = m_nextName;
+        m_nextName.clear();
+    }
+    if (m_hasNextSize) {
+        size = m_nextSize;
+        m_hasNextSize = false;
+    }
+    return beginEntry(name, type, size, mode, mtime);
+}
+
+void TarReader::applyPaxRecords(const std::string& records) {
+    // "長さ キー=値\n" の並び
+    size_t pos = 0;
+    while (pos < records.size()) {
+        size_t space = records.find(' ', pos);
+        if (space == std::string::npos) {
+            break;
+        }
+        size_t length = std::strtoul(records.c_str() + pos, nullptr, 10);
+        if (length == 0 || pos + length > records.size()) {
+            break;
+        }
+        std::string record = records.substr(space + 1, pos + length - space - 1);
+        if (!record.empty() && record.back() == '\n') {
+            record.pop_back();
+        }
+        size_t eq = record.find('=');
+        if (eq != std::string::npos) {
+            std::string key = record.substr(0, eq);
+            std::string value = record.substr(eq + 1);
+            if (key == "path") {
+                m_nextName = value;
+            } else if (key == "size") {
+                m_nextSize = std::strtoull(value.c_str(), nullptr, 10);
+                m_hasNextSize = true;
+            }
+        }
+        pos += length;
+    }
+}
+
+bool TarReader::beginEntry(const std::string& name, char type, uint64_t size, uint32_t mode, int64_t mtime) {
+    namespace fs = std::filesystem;
+
+    m_remaining = size;
+    m_padding = paddingFor(size);
+
+    bool isFile = (type == '0' || type == '\0' || type == '7');
+    bool isDir = (type == '5');
+    std::string path = resolvePath(name);
+
+    if ((!isFile && !isDir) || path.empty()) {
+        // シンボリックリンク・デバイス等と不正なパスは展開しない（"./"自体は展開先なので何もしない）
+        if (!(isDir && path.empty())) {
+            std::cerr << "tarエントリをスキップ: " << name << std::endl;
+        }
+        m_phase = Phase::SkipData;
+        if (size == 0) {
+            m_phase = Phase::Header;
+        }
+        return true;
+    }
+
+    std::error_code ec;
+    if (isDir) {
+        fs::create_directories(path, ec);
+        if (ec) {
+            m_lastError = "ローカルディレクトリ作成失敗: " + path;
+            return false;
+        }
+        m_phase = (size == 0) ? Phase::Header : Phase::SkipData;
+        return true;
+    }
+
+    fs::create_directories(fs::path(path).parent_path(), ec);
+    // 読み取り専用の既存ファイルも置き換えられるよう先に削除する
+    if (fs::is_regular_file(path, ec)) {
+        fs::remove(path, ec);
+    }
+
+    m_file.open(path, std::ios::binary | std::ios::trunc);
+    if (!m_file.is_open()) {
+        m_lastError = "ローカルファイルを作成できません: " + path;
+        return false;
+    }
+    m_filePath = path;
+    m_fileMode = mode;
+    m_fileMtime = mtime;
+
+    if (size == 0) {
+        if (!finishFile()) {
+            return false;
+        }
+        m_phase = Phase::Header;
+        return true;
+    }
+    m_phase = Phase::FileData;
+    return true;
+}
+
+bool TarReader::finishFile() {
+    m_file.close();
+    if (!m_file) {
+        m_lastError = "ファイル書き込みエラー: " + m_filePath;
+        return false;
+    }
+
+    ::chmod(m_filePath.c_str(), static_cast<mode_t>(m_fileMode & 0777));
+    struct timeval times[2];
+    times[0].tv_sec = static_cast<time_t>(m_fileMtime);
+    times[0].tv_usec = 0;
+    times[1] = times[0];
+    ::utimes(m_filePath.c_str(), times);
+
+    m_fileCount++;
+    return true;
+}
+
+std::string TarReader::resolvePath(const std::string& name) const {
+    if (name.empty() || name[0] == '/') {
+        return "";
+    }
+
+    std::string relative;
+    size_t pos = 0;
+    while (pos <= name.size()) {
+        size_t slash = name.find('/', pos);
+        if (slash == std::string::npos) {
+            slash = name.size();
+        }
+        std::string part = name.substr(pos, slash - pos);
+        if (part == "..") {
+            return "";
+        }
+        if (!part.empty() && part != ".") {
+            if (!relative.empty()) {
+                relative += '/';
+            }
+            relative += part;
+        }
+        pos = slash + 1;
+    }
+
+    if (relative.empty()) {
+        return "";
+    }
+    return m_destination + "/" + relative;
+}
+
+} // namespace pbterm
@@ -0,0 +1,475 @@
+#include "TarTransport.h"
+#include "TarStream.h"
+#include "SshConnection.h"
+#include "SftpTransfer.h"
+#include "RateLimiter.h"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <sys/stat.h>
+#ifdef PBTERM_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace pbterm {
+
+namespace {
+
+// 送信側でまとめてキューに積むサイズと、スレッド間で保持するチャンク数の上限
+constexpr size_t kChunkSize = 256 * 1024;
+constexpr size_t kQueueDepth = 32;
+
+// tarのexecの無通信タイムアウト
+constexpr int kTarIdleTimeoutMs = 60000;
+
+std::string shellQuote(const std::string& s) {
+    std::string out = "'";
+    for (char c : s) {
+        if (c == '\'') {
+            out += "'\\''";
+        } else {
+            out += c;
+        }
+    }
+    out += "'";
+    return out;
+}
+
+std::string firstLine(const std::string& text) {
+    size_t end = text.find('\n');
+    return text.substr(0, end);
+}
+
+// アーカイブ作成/展開スレッドとexecループの間のチャンクの受け渡し（上限付き）
+class ChunkQueue {
+public:
+    explicit ChunkQueue(size_t capacity) : m_capacity(capacity) {}
+
+    // 空きができるまで待って積む（中断・終了後はfalse）
+    bool push(std::string chunk) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_aborted || m_closed || m_chunks.size() < m_capacity; });
+        if (m_aborted || m_closed) {
+            return false;
+        }
+        m_chunks.push_back(std::move(chunk));
+        m_cv.notify_all();
+        return true;
+    }
+
+    // 取り出せるまで待つ（終了後に空になった場合・中断時はfalse）
+    bool pop(std::string& chunk) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_aborted || m_closed || !m_chunks.empty(); });
+        if (m_aborted || m_chunks.empty()) {
+            return false;
+        }
+        chunk = std::move(m_chunks.front());
+        m_chunks.pop_front();
+        m_cv.notify_all();
+        return true;
+    }
+
+    // これ以上積まない（残りは取り出せる）
+    void close() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_cv.notify_all();
+    }
+
+    // 両側の待ちを解除して以降の受け渡しをやめる
+    void abort() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_aborted = true;
+        m_cv.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<std::string> m_chunks;
+    size_t m_capacity;
+    bool m_closed = false;
+    bool m_aborted = false;
+};
+
+#ifdef PBTERM_HAVE_ZLIB
+// gzip形式の圧縮（リモートのtar -zと互換）
+class GzipDeflater {
+public:
+    GzipDeflater() {
+        std::memset(&m_stream, 0, sizeof(m_stream));
+        // 回線より先に圧縮が詰まらないよう最速のレベルを使う
+        m_ok = deflateInit2(&m_stream, 1, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    }
+    ~GzipDeflater() {
+        if (m_ok) deflateEnd(&m_stream);
+    }
+
+    bool compress(const char* data, size_t len, bool finish, std::string& out) {
+        if (!m_ok) return false;
+        char buffer[64 * 1024];
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        m_stream.avail_in = static_cast<uInt>(len);
+        do {
+            m_stream.next_out = reinterpret_cast<Bytef*>(buffer);
+            m_stream.avail_out = sizeof(buffer);
+            if (deflate(&m_stream, finish ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR) {
+                return false;
+            }
+            out.append(buffer, sizeof(buffer) - m_stream.avail_out);
+        } while (m_stream.avail_out == 0);
+        return true;
+    }
+
+private:
+    z_stream m_stream;
+    bool m_ok = false;
+};
+
+class GzipInflater {
+public:
+    GzipInflater() {
+        std::memset(&m_stream, 0, sizeof(m_stream));
+        m_ok = inflateInit2(&m_stream, 15 + 16) == Z_OK;
+    }
+    ~GzipInflater() {
+        if (m_ok) inflateEnd(&m_stream);
+    }
+
+    bool decompress(const char* data, size_t len, std::string& out) {
+        if (!m_ok) return false;
+        if (m_done) return true;
+        char buffer[64 * 1024];
+        m_stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+        m_stream.avail_in = static_cast<uInt>(len);
+        do {
+            m_stream.next_out = reinterpret_cast<Bytef*>(buffer);
+            m_stream.avail_out = sizeof(buffer);
+            int rc = inflate(&m_stream, Z_NO_FLUSH);
+            if (rc == Z_NEED_DICT || rc == Z_DATA_ERROR || rc == Z_MEM_ERROR || rc == Z_STREAM_ERROR) {
+                return false;
+            }
+            out.append(buffer, sizeof(buffer) - m_stream.avail_out);
+            if (rc == Z_STREAM_END) {
+                m_done = true;
+                break;
+            }
+        } while (m_stream.avail_out == 0 || m_stream.avail_in > 0);
+        return true;
+    }
+
+private:
+    z_stream m_stream;
+    bool m_ok = false;
+    bool m_done = false;
+};
+#endif
+
+} // namespace
+
+TarTransport::TarTransport(SshConnection* connection)
+    : m_connection(connection)
+{
+}
+
+bool TarTransport::remoteHasTar() {
+    if (!m_connection || !m_connection->isConnected()) {
+        return false;
+    }
+    std::string output = m_connection->exec("command -v tar >/dev/null 2>&1 && echo ok", 5000);
+    return output.find("ok") != std::string::npos;
+}
+
+bool TarTransport::compressionSupported() {
+#ifdef PBTERM_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool TarTransport::remoteTreeSize(const std::string& remoteDir, int& fileCount, uint64_t& totalBytes) {
+    fileCount = 0;
+    totalBytes = 0;
+
+    // GNU findで正確に数え、使えない場合はduの使用量で概算する
+    std::string cmd = "cd " + shellQuote(remoteDir) + " || exit 1; "
+                      "r=$(find -L . -type f -printf '%s\\n' 2>/dev/null | "
+                      "awk '{n++; s+=$1} END {printf \"%d %.0f\", n, s}'); "
+                      "if [ \"$r\" = \"0 0\" ]; then echo \"0 $(( $(du -skL . 2>/dev/null | cut -f1) * 1024 ))\"; "
+                      "else echo \"$r\"; fi";
+    std::istringstream output(m_connection->exec(cmd, 30000));
+    return static_cast<bool>(output >> fileCount >> totalBytes);
+}
+
+bool TarTransport::upload(const std::string& localDir, const std::string& remoteDir, bool compress,
+                          const TransferHooks& hooks, std::string& error) {
+    namespace fs = std::filesystem;
+
+    compress = compress && compressionSupported();
+    // -oでアーカイブ内の所有者を使わない（rootで展開してもuid 0のファイルにしない）
+    std::string cmd = "mkdir -p " + shellQuote(remoteDir) + " && cd " + shellQuote(remoteDir) +
+                      " && tar -x -o" + (compress ? " -z" : "") + " -f -";
+
+    ChunkQueue queue(kQueueDepth);
+    std::atomic<bool> cancelled{false};
+    std::string packError;
+    uint64_t transferred = 0;
+    int fileCount = 0;
+
+    // アーカイブ作成スレッド: ローカルツリーを順にtarにしてキューへ積む
+    std::thread packer([&]() {
+        std::string pending;
+#ifdef PBTERM_HAVE_ZLIB
+        GzipDeflater deflater;
+#endif
+        auto flush = [&](bool force) {
+            if (pending.size() >= kChunkSize || (force && !pending.empty())) {
+                if (!queue.push(std::move(pending))) {
+                    return false;
+                }
+                pending.clear();
+            }
+            return true;
+        };
+        TarWriter writer([&](const char* data, size_t len) {
+#ifdef PBTERM_HAVE_ZLIB
+            if (compress) {
+                return deflater.compress(data, len, false, pending) && flush(false);
+            }
+#endif
+            pending.append(data, len);
+            return flush(false);
+        });
+        auto onBytes = [&](uint64_t bytes) {
+            transferred += bytes;
+            if (hooks.onProgress) {
+                hooks.onProgress(transferred);
+            }
+            if (hooks.checkpoint && !hooks.checkpoint()) {
+                cancelled = true;
+                return false;
+            }
+            // 速度制限はアーカイブの元データの量で数える（作成側が待てば送信も止まる）
+            if (hooks.rateLimiter && !hooks.rateLimiter->acquire(static_cast<size_t>(bytes), hooks.checkpoint)) {
+                cancelled = true;
+                return false;
+            }
+            return true;
+        };
+
+        bool ok = true;
+        fs::path root(localDir);
+        std::error_code ec;
+        fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec);
+        fs::recursive_directory_iterator end;
+        for (; ok && !ec && it != end; it.increment(ec)) {
+            struct stat st;
+            if (::stat(it->path().c_str(), &st) != 0) {
+                continue;
+            }
+            std::string rel = it->path().lexically_relative(root).generic_string();
+            if (S_ISDIR(st.st_mode)) {
+                ok = writer.addDirectory(rel, st.st_mode, st.st_mtime);
+            } else if (S_ISREG(st.st_mode)) {
+                ok = writer.addFile(rel, it->path().string(), static_cast<uint64_t>(st.st_size),
+                                    st.st_mode, st.st_mtime, onBytes);
+                fileCount++;
+            }
+        }
+        if (ok && ec) {
+            packError = "ローカルディレクトリ走査エラー: " + localDir;
+            ok = false;
+        }
+        if (ok) {
+            ok = writer.finish();
+        }
+#ifdef PBTERM_HAVE_ZLIB
+        if (ok && compress) {
+            ok = deflater.compress(nullptr, 0, true, pending);
+        }
+#endif
+        if (ok) {
+            ok = flush(true);
+        }
+        // 読めずに飛ばしたファイルがあれば失敗として報告する（アーカイブ自体は最後まで送る）
+        if (packError.empty() && !writer.lastError().empty()) {
+            packError = writer.lastError();
+        }
+
+        if (ok) {
+            queue.close();
+        } else {
+            // 途中で切れたアーカイブはリモートのtarがエラーにする
+            queue.abort();
+        }
+    });
+
+    std::string current;
+    size_t currentOffset = 0;
+    std::string remoteError;
+    ExecCallbacks callbacks;
+    callbacks.onStdin = [&](char* buffer, size_t capacity) -> size_t {
+        if (currentOffset == current.size()) {
+            if (!queue.pop(current)) {
+                return 0;
+            }
+            currentOffset = 0;
+        }
+        size_t n = std::min(capacity, current.size() - currentOffset);
+        std::memcpy(buffer, current.data() + currentOffset, n);
+        currentOffset += n;
+        return n;
+    };
+    callbacks.onStderr = [&remoteError](const char* data, size_t len) {
+        if (remoteError.size() < 4096) {
+            remoteError.append(data, len);
+        }
+        return true;
+    };
+
+    int status = m_connection->execStream(cmd, callbacks, kTarIdleTimeoutMs);
+    // リモートが先に終了した場合に作成スレッドの待ちを解除する
+    queue.abort();
+    packer.join();
+
+    if (cancelled) {
+        error = "転送が中断されました";
+        return false;
+    }
+    if (status != 0) {
+        error = "tarでの展開に失敗しました";
+        if (!remoteError.empty()) {
+            error += ": " + firstLine(remoteError);
+        }
+        return false;
+    }
+    if (!packError.empty()) {
+        error = packError;
+        return false;
+    }
+
+    std::cout << "tar転送完了: " << localDir << " -> " << remoteDir << "（" << fileCount << " ファイル）" << std::endl;
+    return true;
+}
+
+bool TarTransport::download(const std::string& remoteDir, const std::string& localDir, bool compress,
+                            const TransferHooks& hooks, std::string& error) {
+    namespace fs = std::filesystem;
+
+    std::error_code ec;
+    fs::create_directories(localDir, ec);
+    if (ec) {
+        error = "ローカルディレクトリ作成失敗: " + localDir;
+        return false;
+    }
+
+    compress = compress && compressionSupported();
+    // -hでシンボリックリンクは辿って中身を送る（SFTPでの転送と同じ結果にする）
+    std::string cmd = "cd " + shellQuote(remoteDir) + " && tar -c -h" + (compress ? " -z" : "") + " -f - .";
+
+    ChunkQueue queue(kQueueDepth);
+    std::atomic<bool> cancelled{false};
+    std::string unpackError;
+    uint64_t transferred = 0;
+
+    TarReader reader(localDir);
+    reader.setProgressCallback([&](uint64_t bytes) {
+        transferred += bytes;
+        if (hooks.onProgress) {
+            hooks.onProgress(transferred);
+        }
+        // 展開側が待てばキューが埋まり、受信も止まる
+        if (hooks.rateLimiter && !hooks.rateLimiter->acquire(static_cast<size_t>(bytes), hooks.checkpoint)) {
+            cancelled = true;
+            return false;
+        }
+        return true;
+    });
+
+    // 展開スレッド: 受信したチャンクを順に展開する
+    std::thread unpacker([&]() {
+#ifdef PBTERM_HAVE_ZLIB
+        GzipInflater inflater;
+        std::string plain;
+#endif
+        std::string chunk;
+        while (queue.pop(chunk)) {
+            if (hooks.checkpoint && !hooks.checkpoint()) {
+                cancelled = true;
+                break;
+            }
+            bool ok;
+#ifdef PBTERM_HAVE_ZLIB
+            if (compress) {
+                plain.clear();
+                if (!inflater.decompress(chunk.data(), chunk.size(), plain)) {
+                    unpackError = "受信データの伸長に失敗しました";
+                    break;
+                }
+                ok = reader.feed(plain.data(), plain.size());
+            } else
+#endif
+            {
+                ok = reader.feed(chunk.data(), chunk.size());
+            }
+            if (!ok) {
+                unpackError = reader.lastError();
+                break;
+            }
+        }
+        if (cancelled || !unpackError.empty()) {
+            // 受信側（execループ）を止める
+            queue.abort();
+        }
+    });
+
+    std::string remoteError;
+    ExecCallbacks callbacks;
+    callbacks.onStdout = [&queue](const char* data, size_t len) {
+        return queue.push(std::string(data, len));
+    };
+    callbacks.onStderr = [&remoteError](const char* data, size_t len) {
+        if (remoteError.size() < 4096) {
+            remoteError.append(data, len);
+        }
+        return true;
+    };
+
+    int status = m_connection->execStream(cmd, callbacks, kTarIdleTimeoutMs);
+    queue.close();
+    unpacker.join();
+
+    if (cancelled) {
+        error = "転送が中断されました";
+        return false;
+    }
+    if (!unpackError.empty()) {
+        error = unpackError;
+        return false;
+    }
+    if (status != 0) {
+        error = "tarでのアーカイブ作成に失敗しました";
+        if (!remoteError.empty()) {
+            error += ": " + firstLine(remoteError);
+        }
+        return false;
+    }
+    if (!reader.finish()) {
+        error = reader.lastError();
+        return false;
+    }
+
+    std::cout << "tar転送完了: " << remoteDir << " -> " << localDir << "（" << reader.fileCount() << " ファイル）" << std::endl;
+    return true;
+}
+
+} // namespace pbterm
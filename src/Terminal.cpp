@@ -1,6 +1,9 @@
 #include "Terminal.h"
 #include "SshConnection.h"
 #include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
 
@@ -195,10 +198,85 @@ static bool isWideChar(uint32_t codepoint) {
     return false;
 }
 
+// OSCの長さの上限（これより長いものは捨てる）とOSC 8のリンクの数の上限
+static constexpr size_t kMaxOscLength = 8192;
+static constexpr size_t kMaxLinks = 1024;
+
+// OSC 7のパスの %XX を戻す
+static std::string percentDecode(const std::string& s) {
+    std::string result;
+    result.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '%' && i + 2 < s.size() &&
+            std::isxdigit(static_cast<unsigned char>(s[i + 1])) &&
+            std::isxdigit(static_cast<unsigned char>(s[i + 2]))) {
+            result += static_cast<char>(std::stoi(s.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            result += s[i];
+        }
+    }
+    return result;
+}
+
+// コードポイントをUTF-8で足す
+static void appendUtf8(std::string& out, uint32_t c) {
+    if (c < 0x80) {
+        out += static_cast<char>(c);
+    } else if (c < 0x800) {
+        out += static_cast<char>(0xC0 | (c >> 6));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        out += static_cast<char>(0xE0 | (c >> 12));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    } else {
+        out += static_cast<char>(0xF0 | (c >> 18));
+        out += static_cast<char>(0x80 | ((c >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((c >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (c & 0x3F));
+    }
+}
+
+// moverectで動いたセルの値を動かす（重なるので一度写してから書く）
+template <typename T>
+static void moveRectCells(std::vector<std::vector<T>>& grid, VTermRect dest, VTermRect src) {
+    int rows = src.end_row - src.start_row;
+    int cols = src.end_col - src.start_col;
+    std::vector<T> moved(static_cast<size_t>(std::max(rows * cols, 0)), 0);
+    int gridRows = static_cast<int>(grid.size());
+    for (int r = 0; r < rows; ++r) {
+        int row = src.start_row + r;
+        if (row < 0 || row >= gridRows) {
+            continue;
+        }
+        const auto& cells = grid[row];
+        for (int c = 0; c < cols; ++c) {
+            int col = src.start_col + c;
+            if (col >= 0 && col < static_cast<int>(cells.size())) {
+                moved[r * cols + c] = cells[col];
+            }
+        }
+    }
+    for (int r = 0; r < rows; ++r) {
+        int row = dest.start_row + r;
+        if (row < 0 || row >= gridRows) {
+            continue;
+        }
+        auto& cells = grid[row];
+        for (int c = 0; c < cols; ++c) {
+            int col = dest.start_col + c;
+            if (col >= 0 && col < static_cast<int>(cells.size())) {
+                cells[col] = moved[r * cols + c];
+            }
+        }
+    }
+}
+
 // libvtermコールバック構造体
 static VTermScreenCallbacks screenCallbacks = {
     Terminal::onDamage,
-    nullptr, // moverect
+    Terminal::onMoveRect,
     Terminal::onMoveCursor,
     Terminal::onSetTermProp,
     Terminal::onBell,
@@ -210,7 +288,7 @@ static VTermScreenCallbacks screenCallbacks = {
 // vterm出力コールバック
 static void vtermOutputCallback(const char* s, size_t len, void* user) {
     Terminal* term = static_cast<Terminal*>(user);
-    term->sendToConnection(s, len);
+    term->sendReply(s, len);
 }
 
 Terminal::Terminal(int cols, int rows)
@@ -231,17 +309,27 @@ Terminal::Terminal(int cols, int rows)
     vterm_screen_set_callbacks(m_screen, &screenCallbacks, this);
     vterm_screen_reset(m_screen, 1);
 
-    // OSCコールバック設定（スレッドセーフティの問題があるため一時的に無効化）
-    // VTermState* state = vterm_obtain_state(m_vterm);
-    // VTermStateFallbacks fallbacks = {};
-    // fallbacks.osc = Terminal::onOsc;
-    // vterm_state_set_unrecognised_fallbacks(state, &fallbacks, this);
+    // libvtermが扱わないOSC（7・8）を受け取る（タイトルはonSetTermPropで届く）
+    // 読み取りスレッドで呼ばれるので、UIスレッドへはm_eventsで渡す
+    static const VTermStateFallbacks fallbacks = {
+        nullptr,            // control
+        nullptr,            // csi
+        Terminal::onOsc,
+        nullptr,            // dcs
+        nullptr,            // apc
+        nullptr,            // pm
+        nullptr,            // sos
+    };
+    vterm_state_set_unrecognised_fallbacks(vterm_obtain_state(m_vterm), &fallbacks, this);
 
     // セル配列初期化
     m_cells.resize(m_rows);
     for (auto& row : m_cells) {
         row.resize(m_cols);
     }
+    m_cellLinks.assign(m_rows, std::vector<uint16_t>(m_cols, 0));
+    m_cellTriggers.assign(m_rows, std::vector<uint8_t>(m_cols, 0));
+    m_rowDirty.assign(m_rows, 1);
 }
 
 Terminal::~Terminal() {
@@ -250,10 +338,10 @@ Terminal::~Terminal() {
     }
 }
 
-void Terminal::setChannel(std::shared_ptr<SshChannel> channel) {
+void Terminal::setChannel(std::shared_ptr<SshChannel> channel, bool bindOutput) {
     m_channel = channel;
 
-    if (m_channel) {
+    if (m_channel && bindOutput) {
         m_channel->setDataCallback([this](const char* data, size_t len) {
             onData(data, len);
         });
@@ -272,7 +360,9 @@ void Terminal::setConnection(SshConnection* connection) {
 
 void Terminal::sendToConnection(const char* data, size_t len) {
     if (len > 0) {
-        if (m_channel) {
+        if (m_inputHandler) {
+            m_inputHandler(data, len);
+        } else if (m_channel) {
             m_channel->write(data, len);
         } else if (m_connection) {
             m_connection->write(data, len);
@@ -282,14 +372,22 @@ void Terminal::sendToConnection(const char* data, size_t len) {
     }
 }
 
+void Terminal::sendReply(const char* data, size_t len) {
+    if (m_inputHandler) {
+        return;
+    }
+    sendToConnection(data, len);
+}
+
 void Terminal::onData(const char* data, size_t len) {
     std::lock_guard<std::mutex> lock(m_mutex);
     vterm_input_write(m_vterm, data, len);
+    scanDirtyRows(true);
     updateScreen();
 }
 
 void Terminal::onKeyInput(ImGuiKey key, bool ctrl, bool shift, bool alt) {
-    if (!m_channel && !m_connection) return;
+    if (!m_channel && !m_connection && !m_inputHandler) return;
 
     // 直接エスケープシーケンスを送信
     const char* seq = nullptr;
@@ -398,7 +496,7 @@ void Terminal::onKeyInput(ImGuiKey key, bool ctrl, bool shift, bool alt) {
 }
 
 void Terminal::onCharInput(unsigned int c) {
-    if (!m_channel && !m_connection) return;
+    if (!m_channel && !m_connection && !m_inputHandler) return;
 
     // Ctrl+キー処理
     ImGuiIO& io = ImGui::GetIO();
@@ -448,6 +546,10 @@ void Terminal::resize(int cols, int rows) {
 
     // スクロールバックをクリア（リサイズ時の表示崩れを防ぐ）
     m_scrollback.clear();
+    ++m_scrollbackEpoch;
+    // 行がなくなるのでOSC 133の索引も捨てる
+    m_marks.clear();
+    m_notifiedRules.clear();
 
     m_cols = cols;
     m_rows = rows;
@@ -460,6 +562,9 @@ void Terminal::resize(int cols, int rows) {
         row.clear();
         row.resize(m_cols);
     }
+    m_cellLinks.assign(m_rows, std::vector<uint16_t>(m_cols, 0));
+    m_cellTriggers.assign(m_rows, std::vector<uint8_t>(m_cols, 0));
+    m_rowDirty.assign(m_rows, 1);
 
     if (m_channel) {
         m_channel->resize(cols, rows);
@@ -474,6 +579,85 @@ void Terminal::resize(int cols, int rows) {
     m_lastResizeTime = std::chrono::steady_clock::now();
 
     updateScreen();
+    // 書き直された画面に当て直す（前から出ていたものなので知らせない）
+    scanDirtyRows(false);
+}
+
+bool Terminal::prependScrollback(const std::string& captured, unsigned epoch) {
+    int cols = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (epoch != m_scrollbackEpoch || m_scrollback.size() >= MAX_SCROLLBACK) {
+            return false;
+        }
+        cols = m_cols;
+    }
+
+    std::vector<std::string> lines;
+    size_t start = 0;
+    while (start <= captured.size()) {
+        size_t end = captured.find('\n', start);
+        if (end == std::string::npos) {
+            end = captured.size();
+        }
+        lines.push_back(captured.substr(start, end - start));
+        start = end + 1;
+    }
+    if (lines.empty()) {
+        return true;
+    }
+
+    // 出力の処理を止めないよう、別のlibvtermで読んでからまとめて足す
+    // （-e の属性は行をまたいで引き継がれるので、1行ずつではなく続けて流す。幅を超えた分は折り返さない）
+    int rows = static_cast<int>(lines.size());
+    VTerm* vterm = vterm_new(rows, cols);
+    vterm_set_utf8(vterm, 1);
+    VTermScreen* screen = vterm_obtain_screen(vterm);
+    vterm_screen_reset(screen, 1);
+    std::string text = "\x1b[?7l";
+    for (int i = 0; i < rows; ++i) {
+        if (i > 0) {
+            text += "\r\n";
+        }
+        text += lines[i];
+    }
+    vterm_input_write(vterm, text.data(), text.size());
+
+    std::vector<std::vector<VTermScreenCell>> cells(rows, std::vector<VTermScreenCell>(cols));
+    for (int row = 0; row < rows; ++row) {
+        for (int col = 0; col < cols; ++col) {
+            VTermPos pos = {row, col};
+            vterm_screen_get_cell(screen, pos, &cells[row][col]);
+        }
+    }
+    vterm_free(vterm);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (epoch != m_scrollbackEpoch || cols != m_cols) {
+        return false;
+    }
+    // いっぱいになる分は新しい側から入れる
+    int room = MAX_SCROLLBACK - static_cast<int>(m_scrollback.size());
+    int first = std::max(0, rows - room);
+    for (int row = rows - 1; row >= first; --row) {
+        m_scrollback.push_front(scrollbackRow(cols, cells[row].data()));
+        if (m_triggers) {
+            std::vector<TerminalCell>& added = m_scrollback.front();
+            cellsRowText(added, m_triggerText, m_triggerCols);
+            std::vector<uint8_t> triggers(added.size(), 0);
+            matchTriggers(m_triggerText, m_triggerCols, triggers.data(), static_cast<int>(triggers.size()));
+            for (size_t col = 0; col < added.size(); ++col) {
+                added[col].trigger = triggers[col];
+            }
+        }
+    }
+    m_prependedRows += rows - first;
+    return first == 0 && static_cast<int>(m_scrollback.size()) < MAX_SCROLLBACK;
+}
+
+unsigned Terminal::scrollbackEpoch() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_scrollbackEpoch;
 }
 
 void Terminal::clearScreen() {
@@ -481,6 +665,8 @@ void Terminal::clearScreen() {
 
     // スクロールバックをクリア
     m_scrollback.clear();
+    ++m_scrollbackEpoch;
+    m_marks.clear();
 
     // セルを空に
     for (auto& row : m_cells) {
@@ -490,10 +676,13 @@ void Terminal::clearScreen() {
         }
     }
 
-    // vterm側もリセット
+    // vterm側もリセット（書きかけのリンクも終わらせる）
+    m_activeLink = 0;
     if (m_screen) {
         vterm_screen_reset(m_screen, 1);
     }
+    m_notifiedRules.clear();
+    scanDirtyRows(false);
 
     m_autoScroll = true;
 }
@@ -531,8 +720,25 @@ void Terminal::render(ImFont* font) {
         outRow = std::max(-scrollbackRows, std::min(outRow, m_rows - 1));
     };
 
+    // OSC 8とトリガー（URL・ファイル名:行）のリンク: ホバーで出し、Ctrl+クリックでコピーする（そのクリックでは選択を始めない）
+    bool linkClicked = false;
+    if (isHovered && mousePos.x >= pos.x && mousePos.x < pos.x + charSize.x * m_cols) {
+        int linkCol = 0;
+        int linkRow = 0;
+        screenToCell(mousePos, linkCol, linkRow);
+        const std::string* oscLink = linkAt(linkRow, linkCol);
+        std::string link = oscLink ? *oscLink : triggerLinkAt(linkRow, linkCol);
+        if (!link.empty()) {
+            ImGui::SetTooltip("%s", link.c_str());
+            if (ImGui::GetIO().KeyCtrl && ImGui::IsMouseClicked(0)) {
+                ImGui::SetClipboardText(link.c_str());
+                linkClicked = true;
+            }
+        }
+    }
+
     // 左クリックで選択開始
-    if (isHovered && ImGui::IsMouseClicked(0)) {
+    if (isHovered && ImGui::IsMouseClicked(0) && !linkClicked) {
         screenToCell(mousePos, m_selStartCol, m_selStartRow);
         m_selEndCol = m_selStartCol;
         m_selEndRow = m_selStartRow;
@@ -586,11 +792,137 @@ void Terminal::render(ImFont* font) {
 
             ImVec2 cellPos(pos.x + col * charSize.x, pos.y + row * charSize.y);
             ImU32 fgColor = cell.reverse ? cell.bg.toImU32() : cell.fg.toImU32();
+            bool underline = false;
+            applyTriggerStyle(cell.trigger, fgColor, underline);
             drawList->AddText(cellPos, fgColor, cell.text.c_str());
+            if (underline) {
+                float cellWidth = charSize.x * std::max(cell.width, 1);
+                drawList->AddLine(
+                    ImVec2(cellPos.x, cellPos.y + charSize.y - 1),
+                    ImVec2(cellPos.x + cellWidth, cellPos.y + charSize.y - 1),
+                    fgColor
+                );
+            }
         }
     }
 
     // 現在の画面のセル描画
+    drawScreenCells(drawList, ImVec2(pos.x, pos.y + yOffset), charSize);
+
+    // ウィンドウがフォーカスされているか判定
+    bool windowFocused = ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows);
+
+    // 選択範囲のハイライト描画
+    if (m_hasSelection) {
+        // 選択範囲を正規化（開始が終了より前になるように）
+        int startRow = m_selStartRow, startCol = m_selStartCol;
+        int endRow = m_selEndRow, endCol = m_selEndCol;
+        if (startRow > endRow || (startRow == endRow && startCol > endCol)) {
+            std::swap(startRow, endRow);
+            std::swap(startCol, endCol);
+        }
+
+        // テーマの選択色を使用
+        ImU32 selColor = m_colorTheme.selection.toImU32();
+
+        for (int row = startRow; row <= endRow; ++row) {
+            int colStart = (row == startRow) ? startCol : 0;
+            int colEnd = (row == endRow) ? endCol : m_cols - 1;
+
+            float drawY = pos.y + (row + scrollbackRows) * charSize.y;
+            ImVec2 selStart(pos.x + colStart * charSize.x, drawY);
+            ImVec2 selEnd(pos.x + (colEnd + 1) * charSize.x, drawY + charSize.y);
+            drawList->AddRectFilled(selStart, selEnd, selColor);
+        }
+    }
+
+    drawCursor(drawList, ImVec2(pos.x, pos.y + yOffset), charSize, windowFocused);
+
+    // スクロール可能な領域のサイズを設定
+    ImGui::Dummy(ImVec2(charSize.x * m_cols, totalHeight));
+
+    // 先頭へ足した分だけ送り、見ている行を動かさない
+    if (m_prependedRows > 0) {
+        ImGui::SetScrollY(ImGui::GetScrollY() + m_prependedRows * charSize.y);
+        m_prependedRows = 0;
+    }
+
+    // 新しい出力時は自動スクロール
+    if (m_autoScroll) {
+        ImGui::SetScrollHereY(1.0f);
+        m_autoScroll = false;
+    }
+
+    // 前の描画で頼まれたプロンプトへの移動（OSC 133の索引から探す）
+    if (m_pendingJump != 0 || m_pendingJumpLine >= 0) {
+        int64_t firstLine = m_linesPushed - scrollbackRows;
+        int64_t target = m_pendingJumpLine;
+        if (m_pendingJump != 0) {
+            int64_t topLine = firstLine + static_cast<int64_t>(ImGui::GetScrollY() / charSize.y);
+            target = -1;
+            if (m_pendingJump < 0) {
+                for (auto it = m_marks.rbegin(); it != m_marks.rend(); ++it) {
+                    if (it->promptLine < topLine) {
+                        target = it->promptLine;
+                        break;
+                    }
+                }
+            } else {
+                for (const auto& mark : m_marks) {
+                    if (mark.promptLine > topLine) {
+                        target = mark.promptLine;
+                        break;
+                    }
+                }
+            }
+        }
+        if (target >= firstLine) {
+            ImGui::SetScrollY(static_cast<float>(target - firstLine) * charSize.y);
+        }
+        m_pendingJump = 0;
+        m_pendingJumpLine = -1;
+    }
+
+    // キー入力処理（ウィンドウフォーカス時）
+    if (windowFocused) {
+        handleKeyboard(ImVec2(pos.x, pos.y + yOffset), charSize);
+    }
+
+    // フォルダツリーからのドラッグ＆ドロップ
+    if (ImGui::BeginDragDropTarget()) {
+        if (const ImGuiPayload* payload = ImGui::AcceptDragDropPayload("PBTERM_PATH")) {
+            if (payload->Data && payload->DataSize > 0) {
+                const char* path = static_cast<const char*>(payload->Data);
+                sendToConnection(path, std::strlen(path));
+            }
+        }
+        ImGui::EndDragDropTarget();
+    }
+
+    ImGui::EndChild();
+    ImGui::PopFont();
+}
+
+void Terminal::renderPane(ImDrawList* drawList, const ImVec2& pos, ImFont* font, bool focused) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!font || !drawList) return;
+
+    ImGui::PushFont(font);
+    ImVec2 charSize = ImGui::CalcTextSize("A");
+
+    drawList->AddRectFilled(pos, ImVec2(pos.x + charSize.x * m_cols, pos.y + charSize.y * m_rows),
+                            m_colorTheme.background.toImU32());
+    drawScreenCells(drawList, pos, charSize);
+    drawCursor(drawList, pos, charSize, focused);
+    if (focused) {
+        handleKeyboard(pos, charSize);
+    }
+
+    ImGui::PopFont();
+}
+
+void Terminal::drawScreenCells(ImDrawList* drawList, const ImVec2& origin, const ImVec2& charSize) {
     for (int row = 0; row < m_rows; ++row) {
         int skipNext = 0;
         for (int col = 0; col < m_cols; ++col) {
@@ -610,7 +942,7 @@ void Terminal::render(ImFont* font) {
             int actualWidth = cell.width;
             if (actualWidth <= 0) actualWidth = 1;
 
-            ImVec2 cellPos(pos.x + col * charSize.x, pos.y + yOffset + row * charSize.y);
+            ImVec2 cellPos(origin.x + col * charSize.x, origin.y + row * charSize.y);
             float cellWidth = charSize.x * actualWidth;
 
             // 全角文字なら次のセルをスキップ
@@ -631,56 +963,36 @@ void Terminal::render(ImFont* font) {
                 );
             }
 
-            // 文字
-            drawList->AddText(cellPos, fgColor.toImU32(), cell.text.c_str());
+            // 文字（トリガーが一致していれば色を変える）
+            ImU32 textColor = fgColor.toImU32();
+            bool underline = cell.underline || linkAt(row, col);
+            if (row < static_cast<int>(m_cellTriggers.size()) && col < static_cast<int>(m_cellTriggers[row].size())) {
+                applyTriggerStyle(m_cellTriggers[row][col], textColor, underline);
+            }
+            drawList->AddText(cellPos, textColor, cell.text.c_str());
 
-            // 下線
-            if (cell.underline) {
+            // 下線（OSC 8とトリガーのリンクも）
+            if (underline) {
                 drawList->AddLine(
                     ImVec2(cellPos.x, cellPos.y + charSize.y - 1),
                     ImVec2(cellPos.x + cellWidth, cellPos.y + charSize.y - 1),
-                    fgColor.toImU32()
+                    textColor
                 );
             }
         }
     }
+}
 
-    // ウィンドウがフォーカスされているか判定
-    bool windowFocused = ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows);
-
-    // 選択範囲のハイライト描画
-    if (m_hasSelection) {
-        // 選択範囲を正規化（開始が終了より前になるように）
-        int startRow = m_selStartRow, startCol = m_selStartCol;
-        int endRow = m_selEndRow, endCol = m_selEndCol;
-        if (startRow > endRow || (startRow == endRow && startCol > endCol)) {
-            std::swap(startRow, endRow);
-            std::swap(startCol, endCol);
-        }
-
-        // テーマの選択色を使用
-        ImU32 selColor = m_colorTheme.selection.toImU32();
-
-        for (int row = startRow; row <= endRow; ++row) {
-            int colStart = (row == startRow) ? startCol : 0;
-            int colEnd = (row == endRow) ? endCol : m_cols - 1;
-
-            float drawY = pos.y + (row + scrollbackRows) * charSize.y;
-            ImVec2 selStart(pos.x + colStart * charSize.x, drawY);
-            ImVec2 selEnd(pos.x + (colEnd + 1) * charSize.x, drawY + charSize.y);
-            drawList->AddRectFilled(selStart, selEnd, selColor);
-        }
-    }
-
+void Terminal::drawCursor(ImDrawList* drawList, const ImVec2& origin, const ImVec2& charSize, bool focused) {
     // カーソル（アプリがカーソルを可視に設定している場合のみ表示）
     // Claude Codeなどのリッチアプリはカーソルを非表示にして独自UIを描画する
     if (m_cursorVisible &&
         m_cursorRow >= 0 && m_cursorRow < m_rows &&
         m_cursorCol >= 0 && m_cursorCol < m_cols) {
-        ImVec2 cursorPos(pos.x + m_cursorCol * charSize.x, pos.y + yOffset + m_cursorRow * charSize.y);
+        ImVec2 cursorPos(origin.x + m_cursorCol * charSize.x, origin.y + m_cursorRow * charSize.y);
 
         bool showCursor = true;
-        if (windowFocused) {
+        if (focused) {
             // フォーカス時は点滅
             float time = static_cast<float>(ImGui::GetTime());
             showCursor = fmod(time, 1.0f) < 0.5f;
@@ -688,7 +1000,7 @@ void Terminal::render(ImFont* font) {
 
         if (showCursor) {
             // フォーカス時は塗りつぶし、非フォーカス時は枠線 - テーマのカーソル色を使用
-            if (windowFocused) {
+            if (focused) {
                 drawList->AddRectFilled(
                     cursorPos,
                     ImVec2(cursorPos.x + charSize.x, cursorPos.y + charSize.y),
@@ -704,80 +1016,61 @@ void Terminal::render(ImFont* font) {
             }
         }
     }
+}
 
-    // スクロール可能な領域のサイズを設定
-    ImGui::Dummy(ImVec2(charSize.x * m_cols, totalHeight));
+void Terminal::handleKeyboard(const ImVec2& origin, const ImVec2& charSize) {
+    ImGuiIO& io = ImGui::GetIO();
 
-    // 新しい出力時は自動スクロール
-    if (m_autoScroll) {
-        ImGui::SetScrollHereY(1.0f);
-        m_autoScroll = false;
+    // IME入力位置をカーソル位置に設定
+    if (m_cursorRow >= 0 && m_cursorRow < m_rows &&
+        m_cursorCol >= 0 && m_cursorCol < m_cols) {
+        ImGuiPlatformIO& platform_io = ImGui::GetPlatformIO();
+        if (platform_io.Platform_SetImeDataFn) {
+            ImGuiPlatformImeData ime_data;
+            ime_data.WantVisible = true;
+            ime_data.InputPos = ImVec2(origin.x + m_cursorCol * charSize.x,
+                                       origin.y + m_cursorRow * charSize.y + charSize.y);
+            ime_data.InputLineHeight = charSize.y;
+            platform_io.Platform_SetImeDataFn(ImGui::GetCurrentContext(),
+                                               ImGui::GetMainViewport(), &ime_data);
+        }
     }
 
-    // キー入力処理（ウィンドウフォーカス時）
-    if (windowFocused) {
-        ImGuiIO& io = ImGui::GetIO();
-
-        // IME入力位置をカーソル位置に設定
-        if (m_cursorRow >= 0 && m_cursorRow < m_rows &&
-            m_cursorCol >= 0 && m_cursorCol < m_cols) {
-            ImGuiPlatformIO& platform_io = ImGui::GetPlatformIO();
-            if (platform_io.Platform_SetImeDataFn) {
-                ImGuiPlatformImeData ime_data;
-                ime_data.WantVisible = true;
-                ime_data.InputPos = ImVec2(pos.x + m_cursorCol * charSize.x,
-                                           pos.y + yOffset + m_cursorRow * charSize.y + charSize.y);
-                ime_data.InputLineHeight = charSize.y;
-                platform_io.Platform_SetImeDataFn(ImGui::GetCurrentContext(),
-                                                   ImGui::GetMainViewport(), &ime_data);
-            }
+    // 文字入力（日本語を含むすべてのUnicode文字）
+    // IME確定時の文字を先に処理
+    bool hasImeInput = (io.InputQueueCharacters.Size > 0);
+    for (int i = 0; i < io.InputQueueCharacters.Size; ++i) {
+        unsigned int c = io.InputQueueCharacters[i];
+        if (c > 0) {
+            onCharInput(c);
         }
+    }
 
-        // 文字入力（日本語を含むすべてのUnicode文字）
-        // IME確定時の文字を先に処理
-        bool hasImeInput = (io.InputQueueCharacters.Size > 0);
-        for (int i = 0; i < io.InputQueueCharacters.Size; ++i) {
-            unsigned int c = io.InputQueueCharacters[i];
-            if (c > 0) {
-                onCharInput(c);
-            }
-        }
+    // 特殊キー
+    static const ImGuiKey specialKeys[] = {
+        ImGuiKey_Enter, ImGuiKey_Tab, ImGuiKey_Backspace, ImGuiKey_Escape,
+        ImGuiKey_UpArrow, ImGuiKey_DownArrow, ImGuiKey_LeftArrow, ImGuiKey_RightArrow,
+        ImGuiKey_Insert, ImGuiKey_Delete, ImGuiKey_Home, ImGuiKey_End,
+        ImGuiKey_PageUp, ImGuiKey_PageDown,
+        ImGuiKey_F1, ImGuiKey_F2, ImGuiKey_F3, ImGuiKey_F4,
+        ImGuiKey_F5, ImGuiKey_F6, ImGuiKey_F7, ImGuiKey_F8,
+        ImGuiKey_F9, ImGuiKey_F10, ImGuiKey_F11, ImGuiKey_F12,
+    };
 
-        // 特殊キー
-        static const ImGuiKey specialKeys[] = {
-            ImGuiKey_Enter, ImGuiKey_Tab, ImGuiKey_Backspace, ImGuiKey_Escape,
-            ImGuiKey_UpArrow, ImGuiKey_DownArrow, ImGuiKey_LeftArrow, ImGuiKey_RightArrow,
-            ImGuiKey_Insert, ImGuiKey_Delete, ImGuiKey_Home, ImGuiKey_End,
-            ImGuiKey_PageUp, ImGuiKey_PageDown,
-            ImGuiKey_F1, ImGuiKey_F2, ImGuiKey_F3, ImGuiKey_F4,
-            ImGuiKey_F5, ImGuiKey_F6, ImGuiKey_F7, ImGuiKey_F8,
-            ImGuiKey_F9, ImGuiKey_F10, ImGuiKey_F11, ImGuiKey_F12,
-        };
-
-        for (ImGuiKey key : specialKeys) {
-            if (ImGui::IsKeyPressed(key)) {
-                // IME確定時のEnterキーは無視（文字入力として処理済み）
-                if (key == ImGuiKey_Enter && hasImeInput) {
-                    continue;
-                }
-                onKeyInput(key, io.KeyCtrl, io.KeyShift, io.KeyAlt);
+    for (ImGuiKey key : specialKeys) {
+        if (ImGui::IsKeyPressed(key)) {
+            // IME確定時のEnterキーは無視（文字入力として処理済み）
+            if (key == ImGuiKey_Enter && hasImeInput) {
+                continue;
             }
-        }
-    }
-
-    // フォルダツリーからのドラッグ＆ドロップ
-    if (ImGui::BeginDragDropTarget()) {
-        if (const ImGuiPayload* payload = ImGui::AcceptDragDropPayload("PBTERM_PATH")) {
-            if (payload->Data && payload->DataSize > 0) {
-                const char* path = static_cast<const char*>(payload->Data);
-                sendToConnection(path, std::strlen(path));
+            // Ctrl+Shift+↑↓は前後のプロンプトへの移動（シェルへは送らない）
+            if ((key == ImGuiKey_UpArrow || key == ImGuiKey_DownArrow) && io.KeyCtrl && io.KeyShift) {
+                jumpToPrompt(key == ImGuiKey_UpArrow ? -1 : 1);
+                continue;
             }
+            onKeyInput(key, io.KeyCtrl, io.KeyShift, io.KeyAlt);
         }
-        ImGui::EndDragDropTarget();
     }
-
-    ImGui::EndChild();
-    ImGui::PopFont();
 }
 
 void Terminal::updateScreen() {
@@ -884,11 +1177,59 @@ void Terminal::setColorTheme(const std::string& themeId) {
 
 // libvtermコールバック実装
 int Terminal::onDamage(VTermRect rect, void* user) {
-    (void)rect;
-    (void)user;
+    Terminal* term = static_cast<Terminal*>(user);
+
+    // 書かれたセルに今のOSC 8のリンクを付ける（リンクの外で書き換わったセルからは外す）
+    // リサイズ中は画面全体が書き直されるので付けない
+    uint16_t link = term->m_resizing ? 0 : term->m_activeLink;
+    int endRow = std::min(rect.end_row, static_cast<int>(term->m_cellLinks.size()));
+    for (int row = std::max(rect.start_row, 0); row < endRow; ++row) {
+        // トリガーはonDataの最後にこの行だけ当て直す
+        if (row < static_cast<int>(term->m_rowDirty.size())) {
+            term->m_rowDirty[row] = 1;
+        }
+        auto& links = term->m_cellLinks[row];
+        int endCol = std::min(rect.end_col, static_cast<int>(links.size()));
+        for (int col = std::max(rect.start_col, 0); col < endCol; ++col) {
+            links[col] = link;
+        }
+    }
     return 0;
 }
 
+int Terminal::onMoveRect(VTermRect dest, VTermRect src, void* user) {
+    Terminal* term = static_cast<Terminal*>(user);
+
+    // スクロールで動いたセルのリンクとトリガーも動かす
+    // 画面はupdateScreenで毎回読み直すので、libvtermにdamageを出させなくてよい（1を返す）
+    moveRectCells(term->m_cellLinks, dest, src);
+    moveRectCells(term->m_cellTriggers, dest, src);
+
+    // 行ごと動いたなら当て直すかどうかも一緒に動かし、行の一部が動いたなら当て直す
+    int rows = src.end_row - src.start_row;
+    int dirtyRows = static_cast<int>(term->m_rowDirty.size());
+    if (src.start_col == 0 && src.end_col >= term->m_cols) {
+        std::vector<uint8_t> moved(static_cast<size_t>(std::max(rows, 0)), 1);
+        for (int r = 0; r < rows; ++r) {
+            int row = src.start_row + r;
+            if (row >= 0 && row < dirtyRows) {
+                moved[r] = term->m_rowDirty[row];
+            }
+        }
+        for (int r = 0; r < rows; ++r) {
+            int row = dest.start_row + r;
+            if (row >= 0 && row < dirtyRows) {
+                term->m_rowDirty[row] = moved[r];
+            }
+        }
+    } else {
+        for (int row = std::max(dest.start_row, 0); row < std::min(dest.end_row, dirtyRows); ++row) {
+            term->m_rowDirty[row] = 1;
+        }
+    }
+    return 1;
+}
+
 int Terminal::onMoveCursor(VTermPos pos, VTermPos oldpos, int visible, void* user) {
     (void)oldpos;
     (void)visible;  // カーソル可視状態はonSetTermPropで管理
@@ -906,6 +1247,18 @@ int Terminal::onSetTermProp(VTermProp prop, VTermValue* val, void* user) {
             // カーソルの表示/非表示（DECTCEM: ?25h / ?25l）
             term->m_cursorVisible = val->boolean;
             break;
+        case VTERM_PROP_TITLE:
+            // OSC 0 / 2（断片に分かれて届くので、最後の断片でUIスレッドへ渡す）
+            if (val->string.initial) {
+                term->m_titleBuffer.clear();
+            }
+            if (val->string.str && term->m_titleBuffer.size() + val->string.len <= kMaxOscLength) {
+                term->m_titleBuffer.append(val->string.str, val->string.len);
+            }
+            if (val->string.final) {
+                term->m_events.push(TerminalEvent{TerminalEvent::Type::Title, term->m_titleBuffer});
+            }
+            break;
         default:
             break;
     }
@@ -939,7 +1292,23 @@ int Terminal::onSbPushline(int cols, const VTermScreenCell* cells, void* user) {
         return 1;
     }
 
-    // スクロールバック行を保存
+    // スクロールバック行を保存（押し出す行は画面で当て直していないことがあるので、ここで当てる）
+    term->m_scrollback.push_back(term->scrollbackRow(cols, cells));
+    term->triggerPushedRow(term->m_scrollback.back());
+
+    ++term->m_linesPushed;
+
+    // 最大行数を超えたら古い行を削除
+    if (term->m_scrollback.size() > MAX_SCROLLBACK) {
+        term->m_scrollback.erase(term->m_scrollback.begin());
+        term->trimCommandMarks();
+    }
+
+    term->m_autoScroll = true;
+    return 0;
+}
+
+std::vector<TerminalCell> Terminal::scrollbackRow(int cols, const VTermScreenCell* cells) {
     std::vector<TerminalCell> row;
     row.resize(cols);
 
@@ -1011,22 +1380,15 @@ int Terminal::onSbPushline(int cols, const VTermScreenCell* cells, void* user) {
         }
 
         // 属性
-        tcell.fg = term->vtermColorToTerminalColor(cell.fg);
-        tcell.bg = term->vtermColorToTerminalColor(cell.bg);
+        tcell.fg = vtermColorToTerminalColor(cell.fg);
+        tcell.bg = vtermColorToTerminalColor(cell.bg);
         tcell.bold = (cell.attrs.bold != 0);
         tcell.underline = (cell.attrs.underline != 0);
         tcell.reverse = (cell.attrs.reverse != 0);
     }
 
-    term->m_scrollback.push_back(std::move(row));
 
-    // 最大行数を超えたら古い行を削除
-    if (term->m_scrollback.size() > MAX_SCROLLBACK) {
-        term->m_scrollback.erase(term->m_scrollback.begin());
-    }
-
-    term->m_autoScroll = true;
-    return 0;
+    return row;
 }
 
 int Terminal::onSbPopline(int cols, VTermScreenCell* cells, void* user) {
@@ -1038,21 +1400,469 @@ int Terminal::onSbPopline(int cols, VTermScreenCell* cells, void* user) {
 
 int Terminal::onOsc(int command, VTermStringFragment frag, void* user) {
     Terminal* term = static_cast<Terminal*>(user);
+    if (command != 7 && command != 8 && command != 133) {
+        return 0;
+    }
+
+    // 読み取りの区切りで断片に分かれて届くので、最後の断片まで貯める（長すぎるものは捨てる）
+    if (frag.initial) {
+        term->m_oscBuffer.clear();
+    }
+    if (frag.str && term->m_oscBuffer.size() <= kMaxOscLength) {
+        term->m_oscBuffer.append(frag.str, frag.len);
+    }
+    if (!frag.final) {
+        return 1;
+    }
+    if (term->m_oscBuffer.size() > kMaxOscLength) {
+        term->m_oscBuffer.clear();
+        return 1;
+    }
 
-    // OSC 7: カレントディレクトリ通知
-    if (command == 7 && frag.str && frag.len > 0) {
-        std::string path(frag.str, frag.len);
-        // file://hostname/path 形式からパスを抽出
-        size_t pos = path.find("//");
+    if (command == 7) {
+        // OSC 7: カレントディレクトリ通知（file://hostname/path 形式からパスを抽出）
+        const std::string& uri = term->m_oscBuffer;
+        size_t pos = uri.find("//");
         if (pos != std::string::npos) {
-            pos = path.find('/', pos + 2);
+            pos = uri.find('/', pos + 2);
             if (pos != std::string::npos) {
-                term->m_currentDirectory = path.substr(pos);
+                // 溢れたら捨てる（UIスレッドが毎フレーム取り出すので、普通は溢れない）
+                term->m_events.push(TerminalEvent{TerminalEvent::Type::Directory, percentDecode(uri.substr(pos))});
             }
         }
+    } else if (command == 8) {
+        // OSC 8: ハイパーリンク
+        term->setHyperlink(term->m_oscBuffer);
+    } else {
+        // OSC 133: シェル統合のマーク
+        term->onShellMark(term->m_oscBuffer);
     }
+    return 1;
+}
 
-    return 0;
+void Terminal::setHyperlink(const std::string& payload) {
+    size_t semi = payload.find(';');
+    std::string uri = (semi == std::string::npos) ? std::string() : payload.substr(semi + 1);
+    if (uri.empty()) {
+        m_activeLink = 0;
+        return;
+    }
+
+    for (size_t i = 0; i < m_links.size(); ++i) {
+        if (m_links[i] == uri) {
+            m_activeLink = static_cast<uint16_t>(i + 1);
+            return;
+        }
+    }
+
+    if (m_links.size() >= kMaxLinks) {
+        // 画面に残っているリンクだけに詰め直す
+        std::vector<uint16_t> remap(m_links.size() + 1, 0);
+        std::vector<std::string> kept;
+        for (auto& row : m_cellLinks) {
+            for (auto& link : row) {
+                if (link != 0 && remap[link] == 0) {
+                    kept.push_back(std::move(m_links[link - 1]));
+                    remap[link] = static_cast<uint16_t>(kept.size());
+                }
+                link = remap[link];
+            }
+        }
+        m_links = std::move(kept);
+        if (m_links.size() >= kMaxLinks) {
+            m_activeLink = 0;
+            return;
+        }
+    }
+    m_links.push_back(uri);
+    m_activeLink = static_cast<uint16_t>(m_links.size());
+}
+
+const std::string* Terminal::linkAt(int row, int col) const {
+    if (row < 0 || row >= static_cast<int>(m_cellLinks.size()) ||
+        col < 0 || col >= static_cast<int>(m_cellLinks[row].size())) {
+        return nullptr;
+    }
+    uint16_t link = m_cellLinks[row][col];
+    if (link == 0 || link > m_links.size()) {
+        return nullptr;
+    }
+    return &m_links[link - 1];
+}
+
+void Terminal::setTriggers(std::shared_ptr<const TriggerEngine> triggers) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_triggers = std::move(triggers);
+
+    // 規則が変わったので、スクロールバックも画面も当て直す（前から出ていたものなので知らせない）
+    std::vector<uint8_t> rowTriggers;
+    for (auto& row : m_scrollback) {
+        rowTriggers.assign(row.size(), 0);
+        if (m_triggers) {
+            cellsRowText(row, m_triggerText, m_triggerCols);
+            matchTriggers(m_triggerText, m_triggerCols, rowTriggers.data(), static_cast<int>(rowTriggers.size()));
+        }
+        for (size_t col = 0; col < row.size(); ++col) {
+            row[col].trigger = rowTriggers[col];
+        }
+    }
+    std::fill(m_rowDirty.begin(), m_rowDirty.end(), 1);
+    scanDirtyRows(false);
+}
+
+void Terminal::screenRowText(int row, std::string& text, std::vector<int>& cols) const {
+    text.clear();
+    cols.clear();
+    for (int col = 0; col < m_cols; ++col) {
+        VTermPos pos = {row, col};
+        VTermScreenCell cell;
+        vterm_screen_get_cell(m_screen, pos, &cell);
+        if (cell.chars[0] == static_cast<uint32_t>(-1)) {
+            continue;  // 全角文字の継続セル
+        }
+        if (cell.chars[0] == 0) {
+            text += ' ';
+        } else {
+            for (int i = 0; i < VTERM_MAX_CHARS_PER_CELL && cell.chars[i] != 0; ++i) {
+                appendUtf8(text, cell.chars[i]);
+            }
+        }
+        cols.resize(text.size(), col);
+    }
+}
+
+void Terminal::cellsRowText(const std::vector<TerminalCell>& cells, std::string& text, std::vector<int>& cols) {
+    text.clear();
+    cols.clear();
+    for (int col = 0; col < static_cast<int>(cells.size()); ++col) {
+        if (cells[col].width == 0) {
+            continue;
+        }
+        if (cells[col].text.empty()) {
+            text += ' ';
+        } else {
+            text += cells[col].text;
+        }
+        cols.resize(text.size(), col);
+    }
+}
+
+uint64_t Terminal::matchTriggers(const std::string& text, const std::vector<int>& cols, uint8_t* triggers, int count) {
+    std::fill(triggers, triggers + count, 0);
+    uint64_t notify = 0;
+    if (!m_triggers) {
+        return notify;
+    }
+    m_triggers->scan(text, m_triggerMatches);
+    for (const auto& match : m_triggerMatches) {
+        for (size_t i = match.start; i < match.end && i < cols.size(); ++i) {
+            if (cols[i] < count) {
+                triggers[cols[i]] = static_cast<uint8_t>(match.rule + 1);
+            }
+        }
+        if (m_triggers->rule(match.rule).action == TriggerAction::Notify) {
+            notify |= uint64_t(1) << match.rule;
+        }
+    }
+    return notify;
+}
+
+void Terminal::triggerPushedRow(std::vector<TerminalCell>& row) {
+    if (!m_triggers) {
+        return;
+    }
+    std::vector<uint8_t> triggers(row.size(), 0);
+    cellsRowText(row, m_triggerText, m_triggerCols);
+    uint64_t notify = matchTriggers(m_triggerText, m_triggerCols, triggers.data(), static_cast<int>(triggers.size()));
+    for (size_t col = 0; col < row.size(); ++col) {
+        row[col].trigger = triggers[col];
+    }
+
+    // 押し出す行は画面の先頭の行なので、通し番号は押し出す前の m_linesPushed
+    if (notify != 0) {
+        notifyTriggers(m_linesPushed, notify, m_triggerText);
+    }
+    m_notifiedRules.erase(m_notifiedRules.begin(), m_notifiedRules.upper_bound(m_linesPushed));
+}
+
+void Terminal::scanDirtyRows(bool notify) {
+    std::vector<uint8_t> triggers;
+    int rows = std::min(static_cast<int>(m_rowDirty.size()), static_cast<int>(m_cellTriggers.size()));
+    for (int row = 0; row < rows; ++row) {
+        if (!m_rowDirty[row]) {
+            continue;
+        }
+        m_rowDirty[row] = 0;
+        auto& cellTriggers = m_cellTriggers[row];
+        if (!m_triggers) {
+            std::fill(cellTriggers.begin(), cellTriggers.end(), 0);
+            continue;
+        }
+        screenRowText(row, m_triggerText, m_triggerCols);
+        uint64_t rules = matchTriggers(m_triggerText, m_triggerCols, cellTriggers.data(),
+                                       static_cast<int>(cellTriggers.size()));
+
+        // 行から消えた規則は、また出たときに知らせ直す
+        int64_t line = m_linesPushed + row;
+        if (notify) {
+            notifyTriggers(line, rules, m_triggerText);
+        }
+        if (rules == 0) {
+            m_notifiedRules.erase(line);
+        } else {
+            m_notifiedRules[line] = rules;
+        }
+    }
+}
+
+void Terminal::notifyTriggers(int64_t line, uint64_t rules, const std::string& text) {
+    auto it = m_notifiedRules.find(line);
+    uint64_t fresh = rules & ~(it != m_notifiedRules.end() ? it->second : 0);
+    if (fresh == 0 || !m_triggers) {
+        return;
+    }
+    size_t end = text.find_last_not_of(' ');
+    std::string trimmed = text.substr(0, end == std::string::npos ? 0 : end + 1);
+    for (size_t i = 0; i < m_triggers->ruleCount(); ++i) {
+        if (fresh & (uint64_t(1) << i)) {
+            // 溢れたら捨てる（UIスレッドが毎フレーム取り出すので、普通は溢れない）
+            m_events.push(TerminalEvent{TerminalEvent::Type::Trigger, m_triggers->rule(i).name + ": " + trimmed});
+            break;
+        }
+    }
+    m_notifiedRules[line] = rules | (it != m_notifiedRules.end() ? it->second : 0);
+}
+
+void Terminal::applyTriggerStyle(uint8_t trigger, ImU32& color, bool& underline) const {
+    if (trigger == 0 || !m_triggers || trigger > m_triggers->ruleCount()) {
+        return;
+    }
+    const TriggerRule& rule = m_triggers->rule(trigger - 1);
+    if (rule.action == TriggerAction::Link) {
+        underline = true;
+        return;
+    }
+    color = IM_COL32((rule.color >> 16) & 0xFF, (rule.color >> 8) & 0xFF, rule.color & 0xFF, 255);
+}
+
+std::string Terminal::triggerLinkAt(int row, int col) const {
+    if (!m_triggers) {
+        return std::string();
+    }
+
+    // スクロールバックの行はセルに、画面の行はm_cellTriggersに規則番号がある
+    int scrollbackRows = static_cast<int>(m_scrollback.size());
+    const std::vector<TerminalCell>* cells = nullptr;
+    std::vector<uint8_t> sbTriggers;
+    const std::vector<uint8_t>* triggers = nullptr;
+    if (row < 0) {
+        if (row + scrollbackRows < 0) {
+            return std::string();
+        }
+        cells = &m_scrollback[row + scrollbackRows];
+        sbTriggers.reserve(cells->size());
+        for (const auto& cell : *cells) {
+            sbTriggers.push_back(cell.trigger);
+        }
+        triggers = &sbTriggers;
+    } else if (row < m_rows && row < static_cast<int>(m_cellTriggers.size()) && row < static_cast<int>(m_cells.size())) {
+        cells = &m_cells[row];
+        triggers = &m_cellTriggers[row];
+    } else {
+        return std::string();
+    }
+
+    int count = static_cast<int>(std::min(cells->size(), triggers->size()));
+    if (col < 0 || col >= count) {
+        return std::string();
+    }
+    // 全角文字の継続セルなら前のセルの規則を見る
+    while (col > 0 && (*cells)[col].width == 0) {
+        --col;
+    }
+    uint8_t trigger = (*triggers)[col];
+    if (trigger == 0 || trigger > m_triggers->ruleCount() ||
+        m_triggers->rule(trigger - 1).action != TriggerAction::Link) {
+        return std::string();
+    }
+
+    int start = col;
+    while (start > 0 && ((*triggers)[start - 1] == trigger || (*cells)[start - 1].width == 0)) {
+        --start;
+    }
+    std::string text;
+    for (int c = start; c < count && ((*triggers)[c] == trigger || (*cells)[c].width == 0); ++c) {
+        if ((*cells)[c].width > 0) {
+            text += (*cells)[c].text;
+        }
+    }
+    return text;
+}
+
+void Terminal::onShellMark(const std::string& payload) {
+    if (payload.empty()) {
+        return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    int64_t line = m_linesPushed + m_cursorRow;
+
+    if (payload[0] == 'A') {
+        // プロンプトの始まり
+        CommandMark mark;
+        mark.promptLine = line;
+        m_marks.push_back(std::move(mark));
+        // 行の上限は索引の上限にもなる（同じ行にプロンプトを出し続けられても増えすぎない）
+        if (m_marks.size() > static_cast<size_t>(MAX_SCROLLBACK)) {
+            m_marks.pop_front();
+        }
+        return;
+    }
+    if (m_marks.empty()) {
+        return;
+    }
+    CommandMark& mark = m_marks.back();
+
+    if (payload[0] == 'B') {
+        // コマンド入力の始まり（ここからCまでが入力したコマンド）
+        mark.commandLine = line;
+        mark.commandCol = m_cursorCol;
+    } else if (payload[0] == 'C' && mark.outputLine < 0) {
+        // 出力の始まり（入力したコマンドは画面に残っているうちに取り出す）
+        mark.outputLine = line;
+        mark.start = now;
+        int64_t from = mark.commandLine >= 0 ? mark.commandLine : mark.promptLine;
+        int64_t to = std::max(from, line - 1);
+        std::string text;
+        for (int64_t l = from; l <= to; ++l) {
+            if (l > from) {
+                text += '\n';
+            }
+            text += lineText(l, (l == from && mark.commandLine >= 0) ? mark.commandCol : 0);
+        }
+        size_t begin = text.find_first_not_of(" \n");
+        size_t end = text.find_last_not_of(" \n");
+        mark.command = (begin == std::string::npos) ? std::string() : text.substr(begin, end - begin + 1);
+    } else if (payload[0] == 'D' && mark.outputLine >= 0 && mark.endLine < 0) {
+        // コマンドの終わり（"D;終了コード"、出力が改行で終わっていなければカーソルの行まで含める）
+        mark.endLine = std::max(line + (m_cursorCol > 0 ? 1 : 0), mark.outputLine);
+        mark.end = now;
+        if (payload.size() > 2 && payload[1] == ';') {
+            mark.exitCode = std::atoi(payload.c_str() + 2);
+        }
+    }
+}
+
+std::string Terminal::lineText(int64_t line, int startCol) const {
+    std::string text;
+    int64_t first = m_linesPushed - static_cast<int64_t>(m_scrollback.size());
+    if (line >= m_linesPushed) {
+        // 画面の行（m_cellsは書き込みの途中では古いので、libvtermから読む）
+        int row = static_cast<int>(line - m_linesPushed);
+        if (row >= m_rows) {
+            return text;
+        }
+        for (int col = std::max(startCol, 0); col < m_cols; ++col) {
+            VTermPos pos = {row, col};
+            VTermScreenCell cell;
+            vterm_screen_get_cell(m_screen, pos, &cell);
+            if (cell.chars[0] == 0) {
+                text += ' ';
+                continue;
+            }
+            if (cell.chars[0] == static_cast<uint32_t>(-1)) {
+                continue;  // 全角文字の継続セル
+            }
+            for (int i = 0; i < VTERM_MAX_CHARS_PER_CELL && cell.chars[i] != 0; ++i) {
+                appendUtf8(text, cell.chars[i]);
+            }
+        }
+    } else if (line >= first) {
+        const auto& row = m_scrollback[static_cast<size_t>(line - first)];
+        for (int col = std::max(startCol, 0); col < static_cast<int>(row.size()); ++col) {
+            if (row[col].width == 0) {
+                continue;
+            }
+            text += row[col].text.empty() ? std::string(" ") : row[col].text;
+        }
+    }
+
+    size_t end = text.find_last_not_of(' ');
+    text.erase(end == std::string::npos ? 0 : end + 1);
+    return text;
+}
+
+void Terminal::trimCommandMarks() {
+    int64_t first = m_linesPushed - static_cast<int64_t>(m_scrollback.size());
+    while (!m_marks.empty()) {
+        // コマンドの最後の行（終わっていなければ次のプロンプトの手前まで）
+        const CommandMark& mark = m_marks.front();
+        int64_t last = mark.promptLine;
+        if (mark.endLine >= 0) {
+            last = std::max(last, mark.endLine - 1);
+        } else if (m_marks.size() > 1) {
+            last = std::max(last, m_marks[1].promptLine - 1);
+        } else if (mark.outputLine >= 0) {
+            break;  // 実行中
+        }
+        if (last >= first) {
+            break;
+        }
+        m_marks.pop_front();
+    }
+}
+
+std::vector<TerminalCommand> Terminal::commandHistory() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<TerminalCommand> history;
+    history.reserve(m_marks.size());
+    for (const auto& mark : m_marks) {
+        // プロンプトだけで実行しなかったもの（Ctrl+Cなど）は並べない
+        if (mark.outputLine < 0) {
+            continue;
+        }
+        TerminalCommand command;
+        command.command = mark.command;
+        command.exitCode = mark.exitCode;
+        command.running = (mark.endLine < 0);
+        command.durationMs = std::chrono::duration<double, std::milli>(
+            (command.running ? now : mark.end) - mark.start).count();
+        command.promptLine = mark.promptLine;
+        history.push_back(std::move(command));
+    }
+    return history;
+}
+
+std::string Terminal::lastCommandOutput() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto it = m_marks.rbegin(); it != m_marks.rend(); ++it) {
+        if (it->outputLine < 0 || it->endLine < 0) {
+            continue;
+        }
+        std::string output;
+        for (int64_t line = it->outputLine; line < it->endLine; ++line) {
+            if (line > it->outputLine) {
+                output += '\n';
+            }
+            output += lineText(line, 0);
+        }
+        size_t end = output.find_last_not_of('\n');
+        output.erase(end == std::string::npos ? 0 : end + 1);
+        return output;
+    }
+    return std::string();
+}
+
+void Terminal::jumpToPrompt(int direction) {
+    m_pendingJump = direction;
+    m_pendingJumpLine = -1;
+}
+
+void Terminal::jumpToLine(int64_t line) {
+    m_pendingJump = 0;
+    m_pendingJumpLine = line;
 }
 
 std::string Terminal::getSelectedText() const {
@@ -2,17 +2,47 @@
 #include "Terminal.h"
 #include "SshConnection.h"
 #include "TmuxController.h"
+#include "TmuxPaneTerminals.h"
+#include "PollScheduler.h"
+#include "ConnectionPipeline.h"
 #include "SettingsDialog.h"
 #include <algorithm>
 #include <iostream>
-#include <thread>
-#include <chrono>
 
 namespace pbterm {
 
+namespace {
+// 通知で届かないウィンドウ一覧を取り直す間隔の範囲（RTTに合わせてこの間で決まる）
+constexpr int kWindowPollMinMs = 250;
+constexpr int kWindowPollMaxMs = 5000;
+// OSC 0/2の題名をタブに出すときの最大文字数
+constexpr size_t kMaxTitleChars = 32;
+
+// タブに出す名前（題名があれば優先し、長ければUTF-8の文字単位で切り詰める）
+std::string tabLabel(const TerminalTabInfo& tab) {
+    if (tab.title.empty()) {
+        return tab.name;
+    }
+    size_t chars = 0;
+    for (size_t i = 0; i < tab.title.size(); ++i) {
+        if ((static_cast<unsigned char>(tab.title[i]) & 0xC0) == 0x80) {
+            continue;
+        }
+        if (++chars > kMaxTitleChars) {
+            return tab.title.substr(0, i) + "\xE2\x80\xA6";
+        }
+    }
+    return tab.title;
+}
+} // namespace
+
 TerminalDock::TerminalDock() = default;
 
-TerminalDock::~TerminalDock() = default;
+TerminalDock::~TerminalDock() {
+    if (m_tmuxController) {
+        m_tmuxController->setOnPaneOutput(nullptr);
+    }
+}
 
 void TerminalDock::setConnection(SshConnection* connection) {
     m_connection = connection;
@@ -20,9 +50,26 @@ void TerminalDock::setConnection(SshConnection* connection) {
 
 void TerminalDock::setTmuxController(TmuxController* tmux) {
     m_tmuxController = tmux;
+    m_paneTerminals = std::make_unique<TmuxPaneTerminals>(tmux);
+
+    // ペインの出力は読み取りスレッドからそのペインのターミナルへ流す
+    TmuxPaneTerminals* panes = m_paneTerminals.get();
+    m_tmuxController->setOnPaneOutput([panes](const std::string& paneId, const std::string& data) {
+        panes->onOutput(paneId, data);
+    });
+}
+
+void TerminalDock::setPollScheduler(PollScheduler* scheduler) {
+    // 購読のない古いtmuxとexecのときだけ積む（コントロールモードでは応答を待たない、execでは1往復待つ）
+    // コントロールモードで全タブのパスがOSC 7で届いていれば、パスのために取り直す必要もない
+    scheduler->add("windows", kWindowPollMinMs, kWindowPollMaxMs, [this](std::vector<TmuxController::Command>& batch) {
+        if (!m_tmuxController->isPushBased() && !pathsFromOsc()) {
+            m_tmuxController->appendWindowListQuery(batch);
+        }
+    });
 }
 
-void TerminalDock::onConnected() {
+void TerminalDock::onConnected(ConnectedShell& shell) {
     m_connected = true;
     m_tabs.clear();
     m_activeTab = -1;
@@ -32,58 +79,67 @@ void TerminalDock::onConnected() {
         m_channel.reset();
     }
     m_terminal.reset();
-
-    // tmuxが利用可能かチェック
-    bool tmuxAvailable = (m_tmuxController && m_tmuxController->isAttached());
-
-    if (tmuxAvailable) {
-        // tmuxセッションに接続
-        if (!openTmuxSession()) {
-            std::cerr << "TerminalDock: tmuxセッションへの接続失敗、通常モードで起動" << std::endl;
-            tmuxAvailable = false;
-        }
+    if (m_paneTerminals) {
+        m_paneTerminals->clear();
     }
 
-    if (tmuxAvailable) {
+    // ターミナルとチャンネルは接続処理（ConnectionPipeline）で開いたものを引き継ぐ
+    // コントロールモードではどちらもなく、ペインごとのターミナルを表示するときに作る
+    m_terminal = std::move(shell.terminal);
+    m_channel = std::move(shell.channel);
+    m_controlMode = shell.controlMode;
+    m_clientCols = 0;
+    m_clientRows = 0;
+    m_wantedCols = 0;
+    m_wantedRows = 0;
+
+    if (shell.tmuxAttached) {
         // 既存ウィンドウのタブを作成
-        auto windows = m_tmuxController->listWindows();
-        std::cout << "TerminalDock: tmuxウィンドウを復元中（" << windows.size() << "個）" << std::endl;
+        std::cout << "TerminalDock: tmuxウィンドウを復元中（" << shell.windows.size() << "個）" << std::endl;
 
-        for (const auto& win : windows) {
-            std::cout << "TerminalDock: タブ作成中: index=" << win.index << " name=" << win.name << std::endl;
+        for (const auto& win : shell.windows) {
             TerminalTabInfo tab;
             tab.id = m_nextTabId++;
             tab.tmuxWindowIndex = win.index;
             tab.name = win.name.empty() ? ("Window " + std::to_string(win.index)) : win.name;
             tab.currentPath = win.currentPath;
+            tab.paneId = win.paneId;
+            tab.panes = TmuxController::parseLayout(win.layout);
             m_tabs.push_back(tab);
 
             if (win.active) {
                 m_activeTab = static_cast<int>(m_tabs.size()) - 1;
             }
         }
-        std::cout << "TerminalDock: 全タブ作成完了 (" << m_tabs.size() << "個)" << std::endl;
 
         // タブがない場合は最初のタブを追加
         if (m_tabs.empty()) {
             addTab();
         }
-
-        // アクティブなウィンドウを選択
-        std::cout << "TerminalDock: アクティブタブ選択中: " << m_activeTab << std::endl;
-        if (m_activeTab >= 0 && m_activeTab < static_cast<int>(m_tabs.size())) {
-            selectTmuxWindow(m_tabs[m_activeTab].tmuxWindowIndex);
+        // コントロールモードでは全タブの画面を取り込んでおく
+        if (m_controlMode) {
+            std::vector<std::string> paneIds;
+            for (const auto& tab : m_tabs) {
+                preparePaneTerminals(tab, paneIds);
+            }
         }
-        std::cout << "TerminalDock: onConnected完了" << std::endl;
+        // アクティブなウィンドウはアタッチした時点で表示されるため、選択し直さない
+        std::cout << "TerminalDock: onConnected完了 (" << m_tabs.size() << "タブ)" << std::endl;
     } else {
         // tmuxなしモード：単純なSSHシェル
         std::cout << "TerminalDock: tmuxなしモードで起動" << std::endl;
-        openDirectShell();
+        TerminalTabInfo tab;
+        tab.id = m_nextTabId++;
+        tab.tmuxWindowIndex = -1;
+        tab.name = "Shell";
+        m_tabs.push_back(tab);
+        m_activeTab = 0;
     }
 }
 
 void TerminalDock::onDisconnected() {
     m_connected = false;
+    m_controlMode = false;
     m_tabs.clear();
     m_activeTab = -1;
 
@@ -92,75 +148,29 @@ void TerminalDock::onDisconnected() {
         m_channel.reset();
     }
     m_terminal.reset();
-}
-
-bool TerminalDock::openTmuxSession() {
-    if (!m_connection || !m_connection->isConnected() || !m_tmuxController) {
-        return false;
-    }
-
-    // ターミナル作成
-    m_terminal = std::make_unique<Terminal>(80, 24);
-
-    // SSHチャンネル作成
-    m_channel = m_connection->createChannel(80, 24);
-    if (!m_channel) {
-        std::cerr << "TerminalDock: チャンネル作成失敗" << std::endl;
-        return false;
+    if (m_paneTerminals) {
+        m_paneTerminals->clear();
     }
-
-    // ターミナルにチャンネルを設定
-    m_terminal->setChannel(m_channel);
-
-    // tmuxセッションにアタッチ（Homebrewのパスを含む）
-    std::string sessionName = m_tmuxController->sessionName();
-    std::string attachCmd = "export PATH=/opt/homebrew/bin:/usr/local/bin:$PATH; tmux attach-session -t " + sessionName + " || tmux new-session -s " + sessionName + "\n";
-
-    // 少し待ってからコマンドを送信（シェルの起動を待つ）
-    std::this_thread::sleep_for(std::chrono::milliseconds(200));
-    m_channel->write(attachCmd.c_str(), attachCmd.size());
-
-    std::cout << "TerminalDock: tmuxセッション '" << sessionName << "' に接続" << std::endl;
-    return true;
 }
 
-bool TerminalDock::openDirectShell() {
-    if (!m_connection || !m_connection->isConnected()) {
-        return false;
-    }
-
-    // ターミナル作成
-    m_terminal = std::make_unique<Terminal>(80, 24);
-
-    // SSHチャンネル作成
-    m_channel = m_connection->createChannel(80, 24);
-    if (!m_channel) {
-        std::cerr << "TerminalDock: チャンネル作成失敗" << std::endl;
-        return false;
+void TerminalDock::selectTmuxWindow(int windowIndex) {
+    if (m_controlMode) {
+        // 画面は手元のターミナルにあるので、tmux側のアクティブなウィンドウを合わせるだけ（再描画は要らない）
+        if (m_tmuxController && windowIndex >= 0) {
+            m_tmuxController->selectWindow(windowIndex);
+        }
+        return;
     }
 
-    // ターミナルにチャンネルを設定
-    m_terminal->setChannel(m_channel);
-
-    // 単純なタブを追加
-    TerminalTabInfo tab;
-    tab.id = m_nextTabId++;
-    tab.tmuxWindowIndex = -1;
-    tab.name = "Shell";
-    m_tabs.push_back(tab);
-    m_activeTab = 0;
-
-    std::cout << "TerminalDock: 直接シェル接続" << std::endl;
-    return true;
-}
-
-void TerminalDock::selectTmuxWindow(int windowIndex) {
     if (!m_channel || windowIndex < 0) {
         return;
     }
 
     if (m_tmuxController) {
         m_tmuxController->selectWindow(windowIndex);
+        // フレームの最後を待たずに送る（execのスレッドで実行されるのでCtrl-Lと前後することがあるが、
+        // ウィンドウが切り替わればtmuxが描き直す）
+        m_tmuxController->flushCommands();
 
         // 画面をリフレッシュするためにCtrl-L（画面再描画）を送信
         // tmuxセッション内で画面を強制的に更新
@@ -183,16 +193,15 @@ void TerminalDock::render(ImFont* font) {
         return;
     }
 
-    // tmuxの現在パスを定期的に更新
+    // tmuxのウィンドウ一覧と現在パスを反映
+    // コントロールモードでは通知で届く（購読のない古いtmuxとexecのときはPollSchedulerで取り直したものが届く）
     if (m_tmuxController && m_tmuxController->isAttached()) {
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastWindowPoll).count();
-        if (elapsed > 1000) {
-            auto windows = m_tmuxController->listWindows();
+        std::vector<TmuxWindow> windows;
+        if (m_tmuxController->takeWindowUpdate(windows)) {
             onTmuxWindowListChanged(windows);
-            m_lastWindowPoll = now;
         }
     }
+    pumpTerminalEvents();
 
     // タブバーとターミナル
     renderTabs(font);
@@ -200,6 +209,91 @@ void TerminalDock::render(ImFont* font) {
     if (m_activeTab >= 0 && m_activeTab < static_cast<int>(m_tabs.size())) {
         renderTerminal(font);
     }
+
+    // このフレームで積んだtmuxのコマンドと大きさの変更をまとめて送る
+    if (m_tmuxController) {
+        m_tmuxController->flushCommands();
+    }
+    flushClientSize();
+}
+
+void TerminalDock::pumpTerminalEvents() {
+    if (m_controlMode) {
+        if (!m_paneTerminals) {
+            return;
+        }
+        for (auto& tab : m_tabs) {
+            // 分割したウィンドウはアクティブなペインのパスと題名だけを使う（トリガーの通知はどのペインのものも使う）
+            for (const auto& pane : tab.panes) {
+                if (pane.paneId != tab.paneId) {
+                    applyTerminalEvents(&tab, m_paneTerminals->find(pane.paneId), false);
+                }
+            }
+            applyTerminalEvents(&tab, m_paneTerminals->find(tab.paneId));
+        }
+        return;
+    }
+
+    // シェルからアタッチしたtmuxはOSC 7を外へ流さず、題名もセッションのものなので、tmuxなしのシェルだけで使う
+    TerminalTabInfo* tab = nullptr;
+    if (m_activeTab >= 0 && m_activeTab < static_cast<int>(m_tabs.size()) &&
+        m_tabs[m_activeTab].tmuxWindowIndex < 0) {
+        tab = &m_tabs[m_activeTab];
+    }
+    applyTerminalEvents(tab, m_terminal.get());
+}
+
+void TerminalDock::applyTerminalEvents(TerminalTabInfo* tab, Terminal* terminal, bool activePane) {
+    if (!terminal) {
+        return;
+    }
+    bool isActiveTab = tab && m_activeTab >= 0 && m_activeTab < static_cast<int>(m_tabs.size()) &&
+                       tab == &m_tabs[m_activeTab];
+    TerminalEvent event;
+    while (terminal->takeEvent(event)) {
+        if (!tab) {
+            continue;
+        }
+        switch (event.type) {
+            case TerminalEvent::Type::Directory:
+                if (activePane) {
+                    tab->currentPath = event.text;
+                    tab->pathFromOsc = true;
+                }
+                break;
+            case TerminalEvent::Type::Title:
+                if (activePane) {
+                    tab->title = event.text;
+                }
+                break;
+            case TerminalEvent::Type::Trigger:
+                // 見えているタブでは知らせなくてよい
+                if (!isActiveTab) {
+                    tab->notice = event.text;
+                }
+                break;
+        }
+    }
+}
+
+bool TerminalDock::pathsFromOsc() const {
+    if (!m_controlMode || m_tabs.empty()) {
+        return false;
+    }
+    return std::all_of(m_tabs.begin(), m_tabs.end(), [](const TerminalTabInfo& tab) { return tab.pathFromOsc; });
+}
+
+void TerminalDock::flushClientSize() {
+    // 全ウィンドウ共通の大きさなので、ドックの大きさが変わったときだけ送る（ペインの配置はtmuxが割り振り直す）
+    if (!m_controlMode || !m_tmuxController || m_wantedCols <= 0 || m_wantedRows <= 0) {
+        return;
+    }
+    if (m_wantedCols == m_clientCols && m_wantedRows == m_clientRows) {
+        return;
+    }
+    m_tmuxController->setClientSize(m_wantedCols, m_wantedRows);
+    m_clientCols = m_wantedCols;
+    m_clientRows = m_wantedRows;
 }
 
 void TerminalDock::renderTabs(ImFont* font) {
@@ -229,7 +323,8 @@ void TerminalDock::renderTabs(ImFont* font) {
         TerminalTabInfo& tab = m_tabs[i];
 
         // タブの幅を計算
-        ImVec2 textSize = ImGui::CalcTextSize(tab.name.c_str());
+        std::string label = tabLabel(tab);
+        ImVec2 textSize = ImGui::CalcTextSize(label.c_str());
         float tabWidth = textSize.x + m_closeButtonSize + style.FramePadding.x * 4;
 
         // タブ背景
@@ -250,6 +345,16 @@ void TerminalDock::renderTabs(ImFont* font) {
 
         drawList->AddRectFilled(tabPos, tabEnd, tabColor);
 
+        // 裏で通知のトリガーが一致したタブには印を付ける（ホバーで一致した行を出す）
+        if (isActive) {
+            tab.notice.clear();
+        } else if (!tab.notice.empty()) {
+            drawList->AddCircleFilled(ImVec2(tabPos.x + 4.0f, tabPos.y + 5.0f), 3.0f, IM_COL32(255, 150, 50, 255));
+            if (isHovered) {
+                ImGui::SetTooltip("%s", tab.notice.c_str());
+            }
+        }
+
         // タブの境界線
         if (isActive) {
             drawList->AddLine(
@@ -262,7 +367,7 @@ void TerminalDock::renderTabs(ImFont* font) {
 
         // タブ名
         ImVec2 textPos(tabPos.x + style.FramePadding.x, tabPos.y + (m_tabHeight - textSize.y) * 0.5f);
-        drawList->AddText(textPos, IM_COL32(220, 220, 220, 255), tab.name.c_str());
+        drawList->AddText(textPos, IM_COL32(220, 220, 220, 255), label.c_str());
 
         // クローズボタン
         float closeBtnX = tabEnd.x - m_closeButtonSize - style.FramePadding.x;
@@ -333,6 +438,30 @@ void TerminalDock::renderTabs(ImFont* font) {
         addTab();
     }
 
+    // コマンド履歴ボタン（タブバーの右端、≡マーク）
+    float historyBtnX = tabBarPos.x + tabBarWidth - m_addButtonSize - 4.0f;
+    ImVec2 historyPos(historyBtnX, addBtnY);
+    ImVec2 historyEnd(historyBtnX + m_addButtonSize, addBtnY + m_addButtonSize);
+    bool historyHovered = historyBtnX > addEnd.x && ImGui::IsMouseHoveringRect(historyPos, historyEnd);
+    if (historyBtnX > addEnd.x) {
+        if (historyHovered) {
+            drawList->AddRectFilled(historyPos, historyEnd, IM_COL32(255, 255, 255, 30), 2.0f);
+            const Localization& loc = getLocalization(m_language);
+            ImGui::SetTooltip("%s", loc.termHistory);
+        }
+        ImU32 historyColor = historyHovered ? IM_COL32(255, 255, 255, 255) : IM_COL32(150, 150, 150, 255);
+        float hx = historyBtnX + m_addButtonSize * 0.5f;
+        float hy = addBtnY + m_addButtonSize * 0.5f;
+        float hr = m_addButtonSize * 0.3f;
+        for (int line = -1; line <= 1; ++line) {
+            float y = hy + hr * 0.7f * static_cast<float>(line);
+            drawList->AddLine(ImVec2(hx - hr, y), ImVec2(hx + hr, y), historyColor, 1.5f);
+        }
+    }
+    if (historyHovered && ImGui::IsMouseClicked(0)) {
+        ImGui::OpenPopup("##commandHistory");
+    }
+
     ImGui::EndGroup();
 
     // タブバー分の高さを進める
@@ -342,13 +471,110 @@ void TerminalDock::renderTabs(ImFont* font) {
     if (tabToClose >= 0) {
         closeTab(tabToClose);
     }
+
+    renderCommandHistory();
 }
 
-void TerminalDock::renderTerminal(ImFont* font) {
-    if (!m_terminal) {
+void TerminalDock::renderCommandHistory() {
+    if (!ImGui::BeginPopup("##commandHistory")) {
+        return;
+    }
+    const Localization& loc = getLocalization(m_language);
+    Terminal* terminal = activeTerminal();
+    std::vector<TerminalCommand> history;
+    if (terminal) {
+        history = terminal->commandHistory();
+    }
+
+    ImGui::TextUnformatted(loc.termHistory);
+    ImGui::Separator();
+    if (history.empty()) {
+        ImGui::TextDisabled("%s", loc.termHistoryEmpty);
+        ImGui::EndPopup();
         return;
     }
 
+    if (ImGui::Button(loc.termCopyLastOutput)) {
+        ImGui::SetClipboardText(terminal->lastCommandOutput().c_str());
+        ImGui::CloseCurrentPopup();
+    }
+
+    // 新しいものを上に並べ、選ぶとそのプロンプトへスクロールする
+    ImGuiTableFlags flags = ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY | ImGuiTableFlags_SizingFixedFit;
+    float height = std::min(ImGui::GetTextLineHeightWithSpacing() * static_cast<float>(history.size() + 1),
+                            ImGui::GetTextLineHeightWithSpacing() * 16.0f);
+    if (ImGui::BeginTable("##commands", 3, flags, ImVec2(ImGui::GetFontSize() * 32.0f, height))) {
+        ImGui::TableSetupScrollFreeze(0, 1);
+        ImGui::TableSetupColumn(loc.termHistoryExit);
+        ImGui::TableSetupColumn(loc.termHistoryTime);
+        ImGui::TableSetupColumn(loc.termHistoryCommand, ImGuiTableColumnFlags_WidthStretch);
+        ImGui::TableHeadersRow();
+        for (int i = static_cast<int>(history.size()) - 1; i >= 0; --i) {
+            const TerminalCommand& command = history[i];
+            ImGui::PushID(i);
+            ImGui::TableNextRow();
+
+            ImGui::TableNextColumn();
+            if (command.running) {
+                ImGui::TextDisabled("%s", loc.termHistoryRunning);
+            } else if (command.exitCode > 0) {
+                ImGui::TextColored(ImVec4(0.9f, 0.4f, 0.4f, 1.0f), "%d", command.exitCode);
+            } else if (command.exitCode == 0) {
+                ImGui::TextUnformatted("0");
+            } else {
+                ImGui::TextDisabled("-");
+            }
+
+            ImGui::TableNextColumn();
+            if (command.durationMs < 1000.0) {
+                ImGui::Text("%.0f ms", command.durationMs);
+            } else if (command.durationMs < 60000.0) {
+                ImGui::Text("%.1f s", command.durationMs / 1000.0);
+            } else {
+                int seconds = static_cast<int>(command.durationMs / 1000.0);
+                ImGui::Text("%d:%02d", seconds / 60, seconds % 60);
+            }
+
+            // 複数行のコマンドは1行目だけ出す
+            ImGui::TableNextColumn();
+            std::string firstLine = command.command.substr(0, command.command.find('\n'));
+            if (ImGui::Selectable(firstLine.c_str(), false, ImGuiSelectableFlags_SpanAllColumns)) {
+                terminal->jumpToLine(command.promptLine);
+            }
+            ImGui::PopID();
+        }
+        ImGui::EndTable();
+    }
+    ImGui::EndPopup();
+}
+
+Terminal* TerminalDock::terminalForTab(const TerminalTabInfo& tab) {
+    if (m_controlMode && m_paneTerminals) {
+        int cols = m_clientCols > 0 ? m_clientCols : 80;
+        int rows = m_clientRows > 0 ? m_clientRows : 24;
+        return m_paneTerminals->terminal(tab.paneId, cols, rows);
+    }
+    return m_terminal.get();
+}
+
+void TerminalDock::preparePaneTerminals(const TerminalTabInfo& tab, std::vector<std::string>& paneIds) {
+    if (!m_controlMode || !m_paneTerminals) {
+        return;
+    }
+    if (tab.panes.size() > 1) {
+        for (const auto& pane : tab.panes) {
+            m_paneTerminals->terminal(pane.paneId, pane.cols, pane.rows);
+            paneIds.push_back(pane.paneId);
+        }
+        return;
+    }
+    terminalForTab(tab);
+    paneIds.push_back(tab.paneId);
+}
+
+void TerminalDock::renderTerminal(ImFont* font) {
+    TerminalTabInfo& tab = m_tabs[m_activeTab];
+
     // ターミナルサイズ調整
     ImVec2 contentRegion = ImGui::GetContentRegionAvail();
     ImVec2 charSize = font ? ImGui::CalcTextSize("A") : ImVec2(8, 16);
@@ -356,13 +582,78 @@ void TerminalDock::renderTerminal(ImFont* font) {
     int newCols = static_cast<int>(contentRegion.x / charSize.x);
     int newRows = static_cast<int>(contentRegion.y / charSize.y);
 
+    // コントロールモードではウィンドウの大きさをtmuxへ知らせる（送るのはフレームの最後に1回）
+    if (m_controlMode && newCols > 0 && newRows > 0) {
+        m_wantedCols = newCols;
+        m_wantedRows = newRows;
+    }
+
+    if (m_controlMode && tab.panes.size() > 1) {
+        renderSplitPanes(tab, font);
+        return;
+    }
+
+    Terminal* terminal = terminalForTab(tab);
+    if (!terminal) {
+        return;
+    }
+
     if (newCols > 0 && newRows > 0) {
-        if (newCols != m_terminal->cols() || newRows != m_terminal->rows()) {
-            m_terminal->resize(newCols, newRows);
+        if (newCols != terminal->cols() || newRows != terminal->rows()) {
+            terminal->resize(newCols, newRows);
+        }
+    }
+
+    terminal->render(font);
+}
+
+void TerminalDock::renderSplitPanes(TerminalTabInfo& tab, ImFont* font) {
+    if (!font || !m_paneTerminals) {
+        return;
+    }
+
+    ImGui::PushFont(font);
+    ImVec2 charSize = ImGui::CalcTextSize("A");
+    ImGui::PopFont();
+
+    // ペインは同じフォント（グリフのアトラス）を使い、ドックの描画リストへまとめて描く
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImVec2 region = ImGui::GetContentRegionAvail();
+
+    // ペインの間（tmuxの境界線の1セル）は区切りの色で塗る
+    drawList->AddRectFilled(origin, ImVec2(origin.x + region.x, origin.y + region.y),
+                            ImGui::GetColorU32(ImGuiCol_Separator));
+
+    bool windowFocused = ImGui::IsWindowFocused(ImGuiFocusedFlags_RootAndChildWindows);
+    bool clicked = ImGui::IsWindowHovered() && ImGui::IsMouseClicked(0);
+    ImVec2 mouse = ImGui::GetMousePos();
+
+    for (const auto& pane : tab.panes) {
+        Terminal* terminal = m_paneTerminals->terminal(pane.paneId, pane.cols, pane.rows);
+        if (!terminal) {
+            continue;
+        }
+        // 大きさはtmuxが決めたレイアウトに合わせる（手元で縮めるだけで、tmuxへは送らない）
+        if (pane.cols > 0 && pane.rows > 0 &&
+            (pane.cols != terminal->cols() || pane.rows != terminal->rows())) {
+            terminal->resize(pane.cols, pane.rows);
+        }
+
+        ImVec2 pos(origin.x + pane.x * charSize.x, origin.y + pane.y * charSize.y);
+        ImVec2 end(pos.x + pane.cols * charSize.x, pos.y + pane.rows * charSize.y);
+
+        // クリックしたペインをアクティブにする（先に手元で切り替え、tmuxには後から知らせる）
+        if (clicked && pane.paneId != tab.paneId &&
+            mouse.x >= pos.x && mouse.x < end.x && mouse.y >= pos.y && mouse.y < end.y) {
+            tab.paneId = pane.paneId;
+            m_tmuxController->sendCommand("select-pane -t " + pane.paneId);
         }
+
+        terminal->renderPane(drawList, pos, font, windowFocused && pane.paneId == tab.paneId);
     }
 
-    m_terminal->render(font);
+    ImGui::Dummy(region);
 }
 
 int TerminalDock::addTab(const std::string& name) {
@@ -380,37 +671,20 @@ int TerminalDock::addTab(const std::string& name) {
             return -1;
         }
 
-        // 新しいウィンドウ一覧を取得して、作成されたウィンドウを探す
-        auto windows = m_tmuxController->listWindows();
-        const TmuxWindow* newWindow = nullptr;
-        for (const auto& win : windows) {
-            if (win.index == newWindowIndex) {
-                newWindow = &win;
+        // 作成は応答を待たず、コントローラが先に反映した一覧からタブを作る
+        // （名前・パス・ペインは作成後に届く一覧で埋まる）
+        onTmuxWindowListChanged(m_tmuxController->windows());
+        for (int i = 0; i < static_cast<int>(m_tabs.size()); ++i) {
+            if (m_tabs[i].tmuxWindowIndex == newWindowIndex) {
+                m_activeTab = i;
                 break;
             }
         }
 
-        if (!newWindow) {
-            std::cerr << "タブ追加失敗: 作成されたウィンドウが見つかりません (index=" << newWindowIndex << ")" << std::endl;
-            return -1;
-        }
-
-        // タブ情報を追加
-        TerminalTabInfo tab;
-        tab.id = m_nextTabId++;
-        tab.tmuxWindowIndex = newWindow->index;
-        tab.name = newWindow->name.empty() ? ("Window " + std::to_string(newWindow->index)) : newWindow->name;
-        tab.currentPath = newWindow->currentPath;
-        m_tabs.push_back(tab);
-
-        // 新しいタブをアクティブに
-        m_activeTab = static_cast<int>(m_tabs.size()) - 1;
-
         // tmuxウィンドウを選択
-        selectTmuxWindow(newWindow->index);
+        selectTmuxWindow(newWindowIndex);
 
-        std::cout << "タブ追加成功: " << tab.name << " (tmux window " << newWindow->index << ")" << std::endl;
-        std::cout << "m_terminal=" << (m_terminal ? "OK" : "NULL") << " m_channel=" << (m_channel ? "OK" : "NULL") << std::endl;
+        std::cout << "タブ追加: tmux window " << newWindowIndex << std::endl;
         return m_activeTab;
     }
 
@@ -465,7 +739,10 @@ void TerminalDock::setActiveTab(int index) {
 }
 
 Terminal* TerminalDock::activeTerminal() {
-    return m_terminal.get();
+    if (m_activeTab < 0 || m_activeTab >= static_cast<int>(m_tabs.size())) {
+        return m_terminal.get();
+    }
+    return terminalForTab(m_tabs[m_activeTab]);
 }
 
 std::string TerminalDock::activePath() const {
@@ -476,7 +753,17 @@ std::string TerminalDock::activePath() const {
 }
 
 void TerminalDock::sendText(const std::string& text) {
-    if (!m_connected || !m_channel || text.empty()) {
+    if (!m_connected || text.empty()) {
+        return;
+    }
+
+    if (m_controlMode) {
+        if (m_activeTab >= 0 && m_activeTab < static_cast<int>(m_tabs.size())) {
+            m_tmuxController->sendKeys(m_tabs[m_activeTab].paneId, text.c_str(), text.length());
+        }
+        return;
+    }
+    if (!m_channel) {
         return;
     }
 
@@ -515,9 +802,17 @@ void TerminalDock::onTmuxWindowListChanged(const std::vector<TmuxWindow>& window
         bool found = false;
         for (auto& tab : m_tabs) {
             if (tab.tmuxWindowIndex == win.index) {
-                // 名前更新
+                // 名前更新（アクティブなペインが変わったら、前のペインのOSCの題名とパスは使わない）
                 tab.name = win.name.empty() ? ("Window " + std::to_string(win.index)) : win.name;
-                tab.currentPath = win.currentPath;
+                if (tab.paneId != win.paneId) {
+                    tab.title.clear();
+                    tab.pathFromOsc = false;
+                }
+                if (!tab.pathFromOsc) {
+                    tab.currentPath = win.currentPath;
+                }
+                tab.paneId = win.paneId;
+                tab.panes = TmuxController::parseLayout(win.layout);
                 found = true;
                 break;
             }
@@ -528,10 +823,22 @@ void TerminalDock::onTmuxWindowListChanged(const std::vector<TmuxWindow>& window
             tab.tmuxWindowIndex = win.index;
             tab.name = win.name.empty() ? ("Window " + std::to_string(win.index)) : win.name;
             tab.currentPath = win.currentPath;
+            tab.paneId = win.paneId;
+            tab.panes = TmuxController::parseLayout(win.layout);
             m_tabs.push_back(tab);
         }
     }
 
+    // 裏のタブも先に作って出力を受けておき（切り替えたときに画面がそろっている）、
+    // 閉じたウィンドウ・切り替わる前のペインのターミナルは捨てる
+    if (m_controlMode && m_paneTerminals) {
+        std::vector<std::string> paneIds;
+        for (const auto& tab : m_tabs) {
+            preparePaneTerminals(tab, paneIds);
+        }
+        m_paneTerminals->retain(paneIds);
+    }
+
     // アクティブタブの調整
     if (m_tabs.empty()) {
         m_activeTab = -1;
@@ -540,6 +847,27 @@ void TerminalDock::onTmuxWindowListChanged(const std::vector<TmuxWindow>& window
     }
 }
 
+void TerminalDock::showTmuxSession(const std::string& session, const std::vector<TmuxWindow>& windows,
+                                   int windowIndex) {
+    if (!m_connected || !m_controlMode || !m_tmuxController) {
+        return;
+    }
+    if (!m_tmuxController->switchSession(session, windows)) {
+        return;
+    }
+    onTmuxWindowListChanged(m_tmuxController->windows());
+
+    if (windowIndex < 0) {
+        windowIndex = m_tmuxController->currentWindowIndex();
+    }
+    for (int i = 0; i < static_cast<int>(m_tabs.size()); ++i) {
+        if (m_tabs[i].tmuxWindowIndex == windowIndex) {
+            setActiveTab(i);
+            break;
+        }
+    }
+}
+
 std::string TerminalDock::generateTabName() {
     return "Terminal " + std::to_string(m_nextTabId);
 }
@@ -548,6 +876,18 @@ void TerminalDock::setColorTheme(const std::string& themeId) {
     if (m_terminal) {
         m_terminal->setColorTheme(themeId);
     }
+    if (m_paneTerminals) {
+        m_paneTerminals->setColorTheme(themeId);
+    }
+}
+
+void TerminalDock::setTriggers(const std::shared_ptr<const TriggerEngine>& triggers) {
+    if (m_terminal) {
+        m_terminal->setTriggers(triggers);
+    }
+    if (m_paneTerminals) {
+        m_paneTerminals->setTriggers(triggers);
+    }
 }
 
 } // namespace pbterm
@@ -0,0 +1,408 @@
+#include "TmuxControlClient.h"
+#include "SshConnection.h"
+#include <iostream>
+#include <chrono>
+#include <vector>
+
+namespace pbterm {
+
+namespace {
+
+// アタッチ完了・終了を待つ単位
+constexpr int kStartSliceMs = 50;
+
+std::string shellQuote(const std::string& s) {
+    std::string out = "'";
+    for (char c : s) {
+        if (c == '\'') {
+            out += "'\\''";
+        } else {
+            out += c;
+        }
+    }
+    out += "'";
+    return out;
+}
+
+bool startsWith(const std::string& s, const char* prefix) {
+    return s.compare(0, std::char_traits<char>::length(prefix), prefix) == 0;
+}
+
+// 空白区切りのフィールドをmaxFields個まで取り出す（最後のフィールドは行の残り全体）
+std::vector<std::string> splitFields(const std::string& line, size_t maxFields) {
+    std::vector<std::string> fields;
+    size_t pos = 0;
+    while (pos <= line.size() && fields.size() + 1 < maxFields) {
+        size_t space = line.find(' ', pos);
+        if (space == std::string::npos) {
+            break;
+        }
+        fields.push_back(line.substr(pos, space - pos));
+        pos = space + 1;
+    }
+    fields.push_back(pos <= line.size() ? line.substr(pos) : std::string());
+    return fields;
+}
+
+// "... : value" の値の部分（なければ空）
+std::string valueAfterColon(const std::string& line) {
+    size_t sep = line.find(" : ");
+    return sep == std::string::npos ? std::string() : line.substr(sep + 3);
+}
+
+} // namespace
+
+TmuxControlClient::TmuxControlClient() = default;
+
+TmuxControlClient::~TmuxControlClient() {
+    stop();
+}
+
+bool TmuxControlClient::start(SshConnection& connection, const std::string& tmuxPath,
+                              const std::string& sessionName, NotifyCallback onNotify, int timeoutMs) {
+    stop();
+
+    m_onNotify = std::move(onNotify);
+    m_lineBuffer.clear();
+    m_inBlock = false;
+    m_blockIsReply = false;
+    m_blockOutput.clear();
+    m_exited = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sessionAttached = false;
+    }
+
+    // -A: セッションがあればアタッチ、なければ作成（キャッシュで接続したときはここで作られる）
+    std::string cmd = shellQuote(tmuxPath) + " -C new-session -A -s " + shellQuote(sessionName);
+    auto channel = connection.createCommandChannel(cmd, [this](const char* data, size_t len) {
+        onData(data, len);
+    });
+    if (!channel) {
+        std::cerr << "TmuxControlClient: チャンネル作成失敗" << std::endl;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        m_channel = channel;
+    }
+
+    // アタッチできれば最初に %session-changed が届く（作成できなければtmuxはすぐ終了する）
+    bool attached = false;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (int waitedMs = 0; waitedMs < timeoutMs; waitedMs += kStartSliceMs) {
+            if (m_cv.wait_for(lock, std::chrono::milliseconds(kStartSliceMs), [this]() {
+                    return m_sessionAttached || m_exited;
+                })) {
+                break;
+            }
+            if (!channel->isOpen()) {
+                break;
+            }
+        }
+        attached = m_sessionAttached && !m_exited;
+    }
+
+    if (!attached) {
+        std::cerr << "TmuxControlClient: セッション '" << sessionName << "' にアタッチできません" << std::endl;
+        stop();
+        return false;
+    }
+    std::cout << "TmuxControlClient: コントロールモードでアタッチしました" << std::endl;
+    return true;
+}
+
+void TmuxControlClient::stop() {
+    std::shared_ptr<SshChannel> channel;
+    {
+        std::lock_guard<std::mutex> lock(m_sendMutex);
+        channel = std::move(m_channel);
+        m_channel.reset();
+    }
+    if (channel) {
+        // 標準入力を閉じるとtmuxのクライアントはデタッチして終了する（セッションは残る）
+        channel->close();
+    }
+    failPending();
+}
+
+bool TmuxControlClient::isRunning() const {
+    return m_channel && m_channel->isOpen() && !m_exited;
+}
+
+bool TmuxControlClient::send(const std::string& command, ReplyCallback onReply) {
+    std::vector<Command> commands;
+    commands.push_back(Command{command, std::move(onReply)});
+    return sendBatch(std::move(commands));
+}
+
+bool TmuxControlClient::sendBatch(std::vector<Command> commands) {
+    if (commands.empty()) {
+        return true;
+    }
+
+    // 1行が1回の送信なので、改行を含むコマンドは送らない
+    std::string line;
+    for (const auto& command : commands) {
+        if (command.text.find('\n') != std::string::npos) {
+            return false;
+        }
+        if (!line.empty()) {
+            line += " ; ";
+        }
+        line += command.text;
+    }
+    line += "\n";
+
+    std::lock_guard<std::mutex> sendLock(m_sendMutex);
+    if (!m_channel || !m_channel->isOpen() || m_exited) {
+        return false;
+    }
+    {
+        // 応答は送った順に返るので、書く前に列へ積む（書いた直後に応答が届いてもよいように）
+        std::lock_guard<std::mutex> lock(m_mutex);
+        unsigned long long lineNumber = ++m_nextLine;
+        for (auto& command : commands) {
+            PendingReply pending;
+            pending.onReply = std::move(command.onReply);
+            pending.line = lineNumber;
+            m_pending.push_back(std::move(pending));
+        }
+    }
+    m_channel->write(line.c_str(), line.size());
+    return true;
+}
+
+bool TmuxControlClient::run(const std::string& command, std::string& output, int timeoutMs) {
+    struct Reply {
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool done = false;
+        bool ok = false;
+        std::string output;
+    };
+    // 待ちがタイムアウトした後に応答が届いても壊れないよう、共有して持つ
+    auto reply = std::make_shared<Reply>();
+    bool sent = send(command, [reply](bool ok, const std::string& out) {
+        std::lock_guard<std::mutex> lock(reply->mutex);
+        reply->done = true;
+        reply->ok = ok;
+        reply->output = out;
+        reply->cv.notify_all();
+    });
+    if (!sent) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(reply->mutex);
+    if (!reply->cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&reply]() { return reply->done; })) {
+        std::cerr << "TmuxControlClient: 応答がありません: " << command << std::endl;
+        return false;
+    }
+    output = reply->output;
+    return reply->ok;
+}
+
+std::string TmuxControlClient::unescapeOutput(const std::string& data) {
+    std::string out;
+    out.reserve(data.size());
+    for (size_t i = 0; i < data.size(); ++i) {
+        if (data[i] == '\\' && i + 3 < data.size() &&
+            data[i + 1] >= '0' && data[i + 1] <= '7' &&
+            data[i + 2] >= '0' && data[i + 2] <= '7' &&
+            data[i + 3] >= '0' && data[i + 3] <= '7') {
+            out += static_cast<char>(((data[i + 1] - '0') << 6) | ((data[i + 2] - '0') << 3) | (data[i + 3] - '0'));
+            i += 3;
+        } else {
+            out += data[i];
+        }
+    }
+    return out;
+}
+
+void TmuxControlClient::onData(const char* data, size_t len) {
+    m_lineBuffer.append(data, len);
+
+    size_t start = 0;
+    size_t end;
+    while ((end = m_lineBuffer.find('\n', start)) != std::string::npos) {
+        std::string line = m_lineBuffer.substr(start, end - start);
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        handleLine(line);
+        start = end + 1;
+    }
+    m_lineBuffer.erase(0, start);
+}
+
+void TmuxControlClient::handleLine(const std::string& line) {
+    if (m_inBlock) {
+        // 応答の中身は%で始まっていてもそのまま（終端は %begin と同じ時刻・番号の %end / %error だけ）
+        bool ok = startsWith(line, "%end ");
+        if (ok || startsWith(line, "%error ")) {
+            auto fields = splitFields(line, 4);
+            if (fields.size() < 3 || fields[1] + " " + fields[2] != m_blockGuard) {
+                m_blockOutput += line;
+                m_blockOutput += '\n';
+                return;
+            }
+            m_inBlock = false;
+            if (m_blockIsReply) {
+                finishReply(ok);
+            }
+            return;
+        }
+        m_blockOutput += line;
+        m_blockOutput += '\n';
+        return;
+    }
+
+    if (startsWith(line, "%begin ")) {
+        // %begin time number flags: flagsの1ビット目はこのクライアントが送ったコマンド
+        // （アタッチ自体の応答など、送っていないものは列から取り出さない）
+        auto fields = splitFields(line, 4);
+        int flags = 1;
+        if (fields.size() >= 4) {
+            try {
+                flags = std::stoi(fields[3]);
+            } catch (...) {
+                flags = 1;
+            }
+        }
+        m_inBlock = true;
+        m_blockGuard = fields.size() >= 3 ? fields[1] + " " + fields[2] : std::string();
+        m_blockIsReply = (flags & 1) != 0;
+        m_blockOutput.clear();
+        return;
+    }
+
+    if (!line.empty() && line[0] == '%') {
+        handleNotification(line);
+    }
+}
+
+void TmuxControlClient::handleNotification(const std::string& line) {
+    TmuxNotification n;
+
+    if (startsWith(line, "%output ")) {
+        auto fields = splitFields(line, 3);
+        n.type = TmuxNotification::Type::Output;
+        n.paneId = fields.size() > 1 ? fields[1] : "";
+        n.value = unescapeOutput(fields.size() > 2 ? fields[2] : "");
+    } else if (startsWith(line, "%extended-output ")) {
+        auto fields = splitFields(line, 3);
+        n.type = TmuxNotification::Type::Output;
+        n.paneId = fields.size() > 1 ? fields[1] : "";
+        n.value = unescapeOutput(valueAfterColon(line));
+    } else if (startsWith(line, "%window-add ")) {
+        n.type = TmuxNotification::Type::WindowAdd;
+        n.windowId = splitFields(line, 2)[1];
+    } else if (startsWith(line, "%window-close ") || startsWith(line, "%unlinked-window-close ")) {
+        n.type = TmuxNotification::Type::WindowClose;
+        n.windowId = splitFields(line, 2)[1];
+    } else if (startsWith(line, "%window-renamed ") || startsWith(line, "%unlinked-window-renamed ")) {
+        auto fields = splitFields(line, 3);
+        n.type = TmuxNotification::Type::WindowRenamed;
+        n.windowId = fields[1];
+        n.value = fields.size() > 2 ? fields[2] : "";
+    } else if (startsWith(line, "%layout-change ")) {
+        // %layout-change @window layout visible-layout flags（ズーム中は表示中のレイアウトが1ペインになる）
+        auto fields = splitFields(line, 5);
+        n.type = TmuxNotification::Type::LayoutChange;
+        n.windowId = fields[1];
+        n.value = fields.size() > 3 ? fields[3] : (fields.size() > 2 ? fields[2] : "");
+    } else if (startsWith(line, "%session-window-changed ")) {
+        auto fields = splitFields(line, 3);
+        n.type = TmuxNotification::Type::SessionWindowChanged;
+        n.windowId = fields.size() > 2 ? fields[2] : "";
+    } else if (startsWith(line, "%window-pane-changed ")) {
+        auto fields = splitFields(line, 3);
+        n.type = TmuxNotification::Type::WindowPaneChanged;
+        n.windowId = fields[1];
+        n.paneId = fields.size() > 2 ? fields[2] : "";
+    } else if (startsWith(line, "%subscription-changed ")) {
+        // %subscription-changed name $session @window index %pane : value（対象でない項目は "-"）
+        auto fields = splitFields(line, 7);
+        n.type = TmuxNotification::Type::SubscriptionChanged;
+        n.name = fields[1];
+        if (fields.size() > 3 && fields[3] != "-") {
+            n.windowId = fields[3];
+        }
+        if (fields.size() > 5 && fields[5] != "-") {
+            n.paneId = fields[5];
+        }
+        n.value = valueAfterColon(line);
+    } else if (startsWith(line, "%session-changed ")) {
+        auto fields = splitFields(line, 3);
+        n.type = TmuxNotification::Type::SessionChanged;
+        n.name = fields.size() > 2 ? fields[2] : "";
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_sessionAttached = true;
+        m_cv.notify_all();
+    } else if (line == "%exit" || startsWith(line, "%exit ")) {
+        n.type = TmuxNotification::Type::Exit;
+        m_exited = true;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_cv.notify_all();
+        }
+        failPending();
+    } else {
+        n.type = TmuxNotification::Type::Other;
+        n.value = line;
+    }
+
+    if (m_onNotify) {
+        m_onNotify(n);
+    }
+}
+
+void TmuxControlClient::finishReply(bool ok) {
+    ReplyCallback callback;
+    std::vector<ReplyCallback> skipped;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending.empty()) {
+            return;
+        }
+        unsigned long long line = m_pending.front().line;
+        callback = std::move(m_pending.front().onReply);
+        m_pending.pop_front();
+        // 失敗したコマンドより後ろは同じ行でも実行されず、応答も返らない
+        while (!ok && !m_pending.empty() && m_pending.front().line == line) {
+            skipped.push_back(std::move(m_pending.front().onReply));
+            m_pending.pop_front();
+        }
+    }
+
+    std::string output = m_blockOutput;
+    if (!output.empty() && output.back() == '\n') {
+        output.pop_back();
+    }
+    m_blockOutput.clear();
+    if (callback) {
+        callback(ok, output);
+    }
+    for (auto& next : skipped) {
+        if (next) {
+            next(false, std::string());
+        }
+    }
+}
+
+void TmuxControlClient::failPending() {
+    std::deque<PendingReply> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        pending.swap(m_pending);
+    }
+    for (auto& entry : pending) {
+        if (entry.onReply) {
+            entry.onReply(false, std::string());
+        }
+    }
+}
+
+} // namespace pbterm
@@ -1,14 +1,140 @@
 #include "TmuxController.h"
 #include "SshConnection.h"
+#include "RemoteBootstrap.h"
+#include "TmuxControlClient.h"
+#include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <cstdlib>
 #include <chrono>
 #include <thread>
 #include <random>
 
 namespace pbterm {
 
-TmuxController::TmuxController() = default;
+namespace {
+
+// パスの購読名
+constexpr const char* kPathSubscription = "pbterm-paths";
+
+// コントロールモードのlist-windowsの形式（タブ区切り、名前は最後なので ':' を含んでもよい）
+// window_id, window_index, window_active, window_visible_layout, pane_id, pane_current_path, window_name
+constexpr const char* kControlWindowFormat =
+    "#{window_id}\t#{window_index}\t#{window_active}\t#{window_visible_layout}\t#{pane_id}\t#{pane_current_path}\t#{window_name}";
+
+// execのlist-windowsの形式
+constexpr const char* kExecWindowFormat = "#{window_index}:#{window_name}:#{window_active}:#{pane_current_path}";
+
+// execでまとめて実行したコマンドの出力を分ける目印（コマンドごとにdisplay-message -pで出す）
+constexpr const char* kQueryMarker = "pbterm-query-end";
+
+// send-keysの1コマンドに載せるバイト数（貼り付けなど長い入力は分けて送る）
+constexpr size_t kSendKeysChunk = 256;
+
+// tmuxの引数を単一引用符で囲む（中の ' は '\'' にする）
+// tmuxのコマンド解析とシェル（execでtmuxを起動する場合）のどちらでも同じ文字列として通る
+std::string tmuxQuote(const std::string& s) {
+    std::string result = "'";
+    for (char c : s) {
+        if (c == '\'') {
+            result += "'\\''";
+        } else {
+            result += c;
+        }
+    }
+    result += "'";
+    return result;
+}
+
+// セッション（windowIndexが0以上ならそのウィンドウ）を指す -t の値
+// 先頭の = で前方一致ではなく名前の完全一致にする（"dev" が "devel" に当たらないように）
+std::string tmuxTarget(const std::string& session, int windowIndex = -1) {
+    std::string target = "=" + session;
+    if (windowIndex >= 0) {
+        target += ":" + std::to_string(windowIndex);
+    }
+    return tmuxQuote(target);
+}
+
+// tmux -V の出力がmajor.minor以上か（"tmux 3.3a" / "tmux next-3.4" / "tmux master"）
+bool versionAtLeast(const std::string& version, int wantMajor, int wantMinor) {
+    size_t pos = version.find_first_of("0123456789");
+    if (pos == std::string::npos) {
+        return version.find("master") != std::string::npos;
+    }
+    int major = 0;
+    int minor = 0;
+    try {
+        size_t used = 0;
+        major = std::stoi(version.substr(pos), &used);
+        size_t dot = pos + used;
+        if (dot < version.size() && version[dot] == '.') {
+            minor = std::stoi(version.substr(dot + 1));
+        }
+    } catch (...) {
+        return false;
+    }
+    return major > wantMajor || (major == wantMajor && minor >= wantMinor);
+}
+
+bool parseLayoutNumber(const std::string& s, size_t& pos, int& value) {
+    size_t start = pos;
+    value = 0;
+    while (pos < s.size() && s[pos] >= '0' && s[pos] <= '9') {
+        value = value * 10 + (s[pos] - '0');
+        ++pos;
+    }
+    return pos > start;
+}
+
+// "WxH,X,Y" に続けて ",ID"（ペイン）か "{...}"（左右分割）・"[...]"（上下分割）
+bool parseLayoutCell(const std::string& s, size_t& pos, std::vector<TmuxPaneRect>& panes) {
+    TmuxPaneRect rect;
+    if (!parseLayoutNumber(s, pos, rect.cols) || pos >= s.size() || s[pos++] != 'x' ||
+        !parseLayoutNumber(s, pos, rect.rows) || pos >= s.size() || s[pos++] != ',' ||
+        !parseLayoutNumber(s, pos, rect.x) || pos >= s.size() || s[pos++] != ',' ||
+        !parseLayoutNumber(s, pos, rect.y)) {
+        return false;
+    }
+
+    if (pos < s.size() && s[pos] == ',') {
+        ++pos;
+        int id = 0;
+        if (!parseLayoutNumber(s, pos, id)) {
+            return false;
+        }
+        rect.paneId = "%" + std::to_string(id);
+        panes.push_back(rect);
+        return true;
+    }
+
+    if (pos >= s.size() || (s[pos] != '{' && s[pos] != '[')) {
+        return false;
+    }
+    char close = (s[pos] == '{') ? '}' : ']';
+    ++pos;
+    while (true) {
+        if (!parseLayoutCell(s, pos, panes)) {
+            return false;
+        }
+        if (pos < s.size() && s[pos] == ',') {
+            ++pos;
+            continue;
+        }
+        if (pos < s.size() && s[pos] == close) {
+            ++pos;
+            return true;
+        }
+        return false;
+    }
+}
+
+} // namespace
+
+TmuxController::TmuxController()
+    : m_control(std::make_unique<TmuxControlClient>())
+{
+}
 
 TmuxController::~TmuxController() {
     closeControlChannel();
@@ -18,6 +144,16 @@ void TmuxController::setConnection(SshConnection* connection) {
     m_connection = connection;
 }
 
+void TmuxController::setSessionName(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_sessionMutex);
+    m_sessionName = name;
+}
+
+std::string TmuxController::sessionName() const {
+    std::lock_guard<std::mutex> lock(m_sessionMutex);
+    return m_sessionName;
+}
+
 bool TmuxController::openControlChannel() {
     if (!m_connection || !m_connection->isConnected()) {
         std::cerr << "TmuxController: SSH未接続" << std::endl;
@@ -32,16 +168,20 @@ bool TmuxController::openControlChannel() {
 }
 
 void TmuxController::closeControlChannel() {
-    m_controlRunning = false;
-
-    if (m_controlThread.joinable()) {
-        m_controlThread.join();
-    }
-
-    if (m_controlChannel) {
-        m_controlChannel->close();
-        m_controlChannel.reset();
+    // 読み取りスレッドとexec用のスレッドを止めてから一覧を片付ける
+    m_control->stop();
+    stopExecThread();
+    {
+        std::lock_guard<std::mutex> lock(m_pushMutex);
+        m_controlWindows.clear();
+        m_pushedWindows.clear();
+        m_hasPushedWindows = false;
     }
+    m_listPending = false;
+    m_listAgain = false;
+    m_pushPaths = false;
+    m_commandQueue.clear();
+    m_queueChangesWindows = false;
 
     m_controlChannelOpen = false;
     m_attached = false;
@@ -57,57 +197,61 @@ std::string TmuxController::executeCommand(const std::string& cmd, int timeoutMs
     return m_connection->exec(cmd, timeoutMs);
 }
 
-bool TmuxController::startOrAttachSession() {
-    if (!m_controlChannelOpen) {
-        if (!openControlChannel()) {
-            return false;
+std::string TmuxController::runTmux(const std::string& args, int timeoutMs) {
+    if (isControlMode()) {
+        std::string output;
+        if (!m_control->run(args, output, timeoutMs)) {
+            std::cerr << "TmuxController: コマンド失敗: " << args << " (" << output << ")" << std::endl;
+            return "";
         }
+        return output;
     }
+    return executeCommand(m_tmuxPath + " " + args, timeoutMs);
+}
 
-    // tmuxのパスを検出（よくあるパスを試す）
-    std::vector<std::string> tmuxPaths = {
-        "/opt/homebrew/bin/tmux",  // macOS ARM Homebrew
-        "/usr/local/bin/tmux",      // macOS Intel Homebrew / Linux
-        "/usr/bin/tmux",            // Linux system
-        "tmux"                      // PATH内
-    };
+bool TmuxController::startOrAttachSession() {
+    if (!m_connection) {
+        return false;
+    }
+    RemoteFacts facts;
+    std::string error;
+    if (!runRemoteBootstrap(*m_connection, m_sessionName, facts, error)) {
+        std::cerr << "TmuxController: " << error << std::endl;
+    }
+    return adoptBootstrap(facts);
+}
 
-    m_tmuxPath.clear();
-    for (const auto& path : tmuxPaths) {
-        std::string testCmd = "test -x " + path + " && echo 'OK'";
-        std::string result = executeCommand(testCmd);
-        if (result.find("OK") != std::string::npos) {
-            m_tmuxPath = path;
-            break;
+bool TmuxController::adoptBootstrap(const RemoteFacts& facts) {
+    if (!m_controlChannelOpen) {
+        if (!openControlChannel()) {
+            return false;
         }
     }
 
+    m_tmuxPath = facts.tmuxPath;
+    m_tmuxVersion = facts.tmuxVersion;
     if (m_tmuxPath.empty()) {
         std::cerr << "TmuxController: tmuxが見つかりません" << std::endl;
         m_attached = false;
         return false;
     }
-    std::cout << "TmuxController: tmuxパス: " << m_tmuxPath << std::endl;
-
-    // 既存セッションを確認
-    std::string checkCmd = m_tmuxPath + " has-session -t " + m_sessionName + " 2>/dev/null && echo 'EXISTS' || echo 'NOT_EXISTS'";
-    std::string result = executeCommand(checkCmd);
+    std::cout << "TmuxController: tmuxパス: " << m_tmuxPath << " (" << m_tmuxVersion << ")" << std::endl;
 
-    bool sessionExists = (result.find("EXISTS") != std::string::npos);
-
-    if (sessionExists) {
+    if (!facts.sessionReady) {
+        std::cerr << "TmuxController: セッション '" << m_sessionName << "' を作成できませんでした" << std::endl;
+        m_attached = false;
+        return false;
+    }
+    if (facts.sessionExisted) {
         std::cout << "TmuxController: 既存セッション '" << m_sessionName << "' にアタッチします" << std::endl;
     } else {
-        std::cout << "TmuxController: 新規セッション '" << m_sessionName << "' を作成します" << std::endl;
-        // 新規セッション作成（デタッチ状態で）
-        std::string createCmd = m_tmuxPath + " new-session -d -s " + m_sessionName;
-        executeCommand(createCmd);
+        std::cout << "TmuxController: 新規セッション '" << m_sessionName << "' を作成しました" << std::endl;
     }
 
     m_attached = true;
 
-    // ウィンドウ一覧を取得
-    m_windows = listWindows();
+    // ウィンドウ一覧はブートストラップの出力に含まれている
+    setWindows(parseWindowList(facts.windowListing));
 
     if (m_onAttached) {
         m_onAttached();
@@ -118,46 +262,455 @@ bool TmuxController::startOrAttachSession() {
 }
 
 void TmuxController::detach() {
+    m_control->stop();
     m_attached = false;
     m_windows.clear();
 }
 
-int TmuxController::createWindow(const std::string& name) {
+bool TmuxController::startControlMode() {
+    if (!m_attached || !m_connection || m_tmuxPath.empty()) {
+        return false;
+    }
+    // キー入力のsend-keys -Hは3.0から（それより古いtmuxはシェルからアタッチして表示する）
+    if (!versionAtLeast(m_tmuxVersion, 3, 0)) {
+        std::cerr << "TmuxController: tmuxが古いためコントロールモードを使いません (" << m_tmuxVersion << ")" << std::endl;
+        return false;
+    }
+
+    auto onNotify = [this](const TmuxNotification& notification) {
+        onControlNotification(notification);
+    };
+    if (!m_control->start(*m_connection, m_tmuxPath, m_sessionName, onNotify)) {
+        std::cerr << "TmuxController: コントロールモードを開けません" << std::endl;
+        return false;
+    }
+
+    m_pushPaths = versionAtLeast(m_tmuxVersion, 3, 2);
+    if (m_pushPaths) {
+        // アクティブなペインのパスが変わるとtmuxが %subscription-changed を送ってくる（最短1秒間隔）
+        m_control->send(std::string("refresh-client -B '") + kPathSubscription + ":@*:#{pane_current_path}'");
+    }
+    requestWindowList();
+
+    std::cout << "TmuxController: コントロールモードを開始しました（パスの購読: "
+              << (m_pushPaths ? "あり" : "なし") << "）" << std::endl;
+    return true;
+}
+
+bool TmuxController::isControlMode() const {
+    return m_control->isRunning();
+}
+
+bool TmuxController::isPushBased() const {
+    return m_pushPaths && isControlMode();
+}
+
+void TmuxController::setOnPaneOutput(PaneOutputCallback callback) {
+    std::lock_guard<std::mutex> lock(m_outputMutex);
+    m_onPaneOutput = std::move(callback);
+}
+
+bool TmuxController::sendCommand(const std::string& args, ReplyCallback onReply) {
+    if (!isControlMode()) {
+        return false;
+    }
+    return m_control->send(args, std::move(onReply));
+}
+
+bool TmuxController::sendCommands(std::vector<Command> commands) {
+    if (!isControlMode()) {
+        return false;
+    }
+    std::vector<TmuxControlClient::Command> batch;
+    batch.reserve(commands.size());
+    for (auto& command : commands) {
+        batch.push_back(TmuxControlClient::Command{command.args, std::move(command.onReply)});
+    }
+    return m_control->sendBatch(std::move(batch));
+}
+
+bool TmuxController::sendQueries(std::vector<Command> commands) {
+    if (commands.empty()) {
+        return true;
+    }
+    if (isControlMode()) {
+        std::vector<ReplyCallback> replies;
+        replies.reserve(commands.size());
+        for (const auto& command : commands) {
+            replies.push_back(command.onReply);
+        }
+        if (sendCommands(std::move(commands))) {
+            return true;
+        }
+        for (auto& reply : replies) {
+            if (reply) {
+                reply(false, "");
+            }
+        }
+        return false;
+    }
     if (!m_attached || !m_controlChannelOpen) {
-        return -1;
+        for (auto& command : commands) {
+            if (command.onReply) {
+                command.onReply(false, "");
+            }
+        }
+        return false;
+    }
+
+    // execでもUIスレッドは待たない（応答はexec用のスレッドから届く）
+    ExecBatch batch;
+    batch.commands = std::move(commands);
+    batch.tmuxPath = m_tmuxPath;
+    batch.sessionName = sessionName();
+    postExec(std::move(batch));
+    return true;
+}
+
+void TmuxController::postExec(ExecBatch batch) {
+    {
+        std::lock_guard<std::mutex> lock(m_execMutex);
+        if (!m_execStopping) {
+            m_execQueue.push_back(std::move(batch));
+            if (!m_execThread.joinable()) {
+                m_execThread = std::thread(&TmuxController::execThread, this);
+            }
+            m_execCv.notify_all();
+            return;
+        }
+    }
+    // 止めている最中（切断中）なので送らない
+    for (auto& command : batch.commands) {
+        if (command.onReply) {
+            command.onReply(false, "");
+        }
     }
+}
 
-    // -P オプションで作成されたウィンドウの情報を取得
+void TmuxController::stopExecThread() {
+    std::deque<ExecBatch> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_execMutex);
+        m_execStopping = true;
+        dropped.swap(m_execQueue);
+    }
+    m_execCv.notify_all();
+    // 実行中のexecはタイムアウトまでに終わる
+    if (m_execThread.joinable()) {
+        m_execThread.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_execMutex);
+        m_execStopping = false;
+    }
+
+    for (auto& batch : dropped) {
+        for (auto& command : batch.commands) {
+            if (command.onReply) {
+                command.onReply(false, "");
+            }
+        }
+    }
+}
+
+void TmuxController::execThread() {
+    while (true) {
+        ExecBatch batch;
+        {
+            std::unique_lock<std::mutex> lock(m_execMutex);
+            m_execCv.wait(lock, [this]() { return m_execStopping || !m_execQueue.empty(); });
+            if (m_execStopping) {
+                return;
+            }
+            batch = std::move(m_execQueue.front());
+            m_execQueue.pop_front();
+        }
+        runExecBatch(batch);
+    }
+}
+
+void TmuxController::runExecBatch(ExecBatch& batch) {
     std::string cmd;
-    if (name.empty()) {
-        cmd = m_tmuxPath + " new-window -P -t " + m_sessionName + " -F '#{window_index}'";
-    } else {
-        cmd = m_tmuxPath + " new-window -P -t " + m_sessionName + " -n '" + name + "' -F '#{window_index}'";
+    for (const auto& command : batch.commands) {
+        if (!cmd.empty()) {
+            cmd += " \\; ";
+        }
+        cmd += command.args + " \\; display-message -p '" + kQueryMarker + "'";
+    }
+    std::string output;
+    std::string error;
+    int status = execTmux(batch.tmuxPath, cmd, output, error);
+    if (status != 0) {
+        std::cerr << "TmuxController: コマンド失敗 (" << status << "): " << error << std::endl;
     }
 
-    std::string result = executeCommand(cmd);
+    // 途中で失敗するとtmuxは残りを実行しないので、目印の出なかったコマンドは失敗にする
+    // （最初に失敗したコマンドにはtmuxのエラーメッセージを渡す）
+    std::istringstream iss(output);
+    std::string line;
+    bool failed = false;
+    for (auto& command : batch.commands) {
+        std::string reply;
+        bool ok = false;
+        while (!failed && std::getline(iss, line)) {
+            if (line == kQueryMarker) {
+                ok = true;
+                break;
+            }
+            if (!reply.empty()) {
+                reply += '\n';
+            }
+            reply += line;
+        }
+        if (!ok && !failed) {
+            failed = true;
+            reply = error;
+        } else if (!ok) {
+            reply.clear();
+        }
+        if (command.onReply) {
+            command.onReply(ok, reply);
+        }
+    }
 
-    // 結果から新しいウィンドウのインデックスを取得
-    int newWindowIndex = -1;
-    try {
-        // 改行や空白を除去
-        result.erase(result.find_last_not_of(" \n\r\t") + 1);
-        if (!result.empty()) {
-            newWindowIndex = std::stoi(result);
+    // 手元で先に反映した一覧を、実行後の一覧で確かめ直す（その後にまた手元で変えていれば次の実行に任せる）
+    if (batch.relist) {
+        std::string listing;
+        std::string cmd = "list-windows -t " + tmuxTarget(batch.sessionName) + " -F '" + kExecWindowFormat + "'";
+        if (execTmux(batch.tmuxPath, cmd, listing, error) == 0 && batch.generation == m_localGeneration) {
+            std::vector<TmuxWindow> windows = parseWindowList(listing);
+            std::lock_guard<std::mutex> lock(m_pushMutex);
+            m_pushedWindows = std::move(windows);
+            m_hasPushedWindows = true;
         }
-    } catch (...) {
-        std::cerr << "TmuxController: ウィンドウインデックスの解析失敗: [" << result << "]" << std::endl;
-        newWindowIndex = -1;
+    }
+}
+
+int TmuxController::execTmux(const std::string& tmuxPath, const std::string& args, std::string& output,
+                             std::string& error, int timeoutMs) {
+    output.clear();
+    error.clear();
+    if (!m_connection || !m_controlChannelOpen) {
+        error = "制御チャンネルが開いていません";
+        return -1;
+    }
+
+    ExecCallbacks callbacks;
+    callbacks.onStdout = [&output](const char* data, size_t len) {
+        output.append(data, len);
+        return true;
+    };
+    callbacks.onStderr = [&error](const char* data, size_t len) {
+        error.append(data, len);
+        return true;
+    };
+    return m_connection->execStream(tmuxPath + " " + args, callbacks, timeoutMs);
+}
+
+void TmuxController::sendKeys(const std::string& paneId, const char* data, size_t len) {
+    if (paneId.empty() || !isControlMode()) {
+        return;
+    }
+
+    // バイト列をそのまま16進で渡す（制御文字・改行・引用符もエスケープ不要）
+    static const char* hex = "0123456789abcdef";
+    for (size_t offset = 0; offset < len; offset += kSendKeysChunk) {
+        size_t count = std::min(kSendKeysChunk, len - offset);
+        std::string cmd = "send-keys -t " + paneId + " -H";
+        cmd.reserve(cmd.size() + count * 3);
+        for (size_t i = 0; i < count; ++i) {
+            unsigned char c = static_cast<unsigned char>(data[offset + i]);
+            cmd += ' ';
+            cmd += hex[c >> 4];
+            cmd += hex[c & 0x0f];
+        }
+        m_control->send(cmd);
+    }
+}
+
+void TmuxController::setClientSize(int cols, int rows) {
+    if (cols <= 0 || rows <= 0 || !isControlMode()) {
+        return;
+    }
+    // コントロールモードのクライアントには大きさがないので、表示する大きさを知らせる（3.1から "WxH"）
+    std::string size = versionAtLeast(m_tmuxVersion, 3, 1)
+        ? std::to_string(cols) + "x" + std::to_string(rows)
+        : std::to_string(cols) + "," + std::to_string(rows);
+    m_control->send("refresh-client -C " + size);
+}
+
+bool TmuxController::takeWindowUpdate(std::vector<TmuxWindow>& windows) {
+    {
+        std::lock_guard<std::mutex> lock(m_pushMutex);
+        if (!m_hasPushedWindows) {
+            return false;
+        }
+        windows = m_pushedWindows;
+        m_hasPushedWindows = false;
     }
 
-    // ウィンドウ一覧を更新
-    m_windows = listWindows();
+    setWindows(windows);
+    return true;
+}
 
-    if (m_onWindowListChanged) {
-        m_onWindowListChanged(m_windows);
+void TmuxController::setWindows(const std::vector<TmuxWindow>& windows) {
+    m_windows = windows;
+    for (const auto& win : m_windows) {
+        if (win.active) {
+            m_currentWindowIndex = win.index;
+        }
     }
+}
+
+void TmuxController::onControlNotification(const TmuxNotification& notification) {
+    switch (notification.type) {
+        case TmuxNotification::Type::WindowAdd:
+        case TmuxNotification::Type::WindowClose:
+        case TmuxNotification::Type::SessionWindowChanged:
+            // インデックスとアクティブ状態が変わるので一覧ごと取り直す
+            requestWindowList();
+            break;
+        case TmuxNotification::Type::WindowRenamed:
+        case TmuxNotification::Type::LayoutChange:
+        case TmuxNotification::Type::SubscriptionChanged: {
+            if (notification.type == TmuxNotification::Type::SubscriptionChanged &&
+                notification.name != kPathSubscription) {
+                break;
+            }
+            std::lock_guard<std::mutex> lock(m_pushMutex);
+            for (auto& win : m_controlWindows) {
+                if (win.id != notification.windowId) {
+                    continue;
+                }
+                std::string& field =
+                    notification.type == TmuxNotification::Type::WindowRenamed ? win.name :
+                    notification.type == TmuxNotification::Type::LayoutChange ? win.layout : win.currentPath;
+                if (field != notification.value) {
+                    field = notification.value;
+                    publishWindowsLocked();
+                }
+                break;
+            }
+            break;
+        }
+        case TmuxNotification::Type::WindowPaneChanged: {
+            std::lock_guard<std::mutex> lock(m_pushMutex);
+            for (auto& win : m_controlWindows) {
+                if (win.id == notification.windowId && win.paneId != notification.paneId) {
+                    win.paneId = notification.paneId;
+                    publishWindowsLocked();
+                    break;
+                }
+            }
+            break;
+        }
+        case TmuxNotification::Type::Output: {
+            std::lock_guard<std::mutex> lock(m_outputMutex);
+            if (m_onPaneOutput) {
+                m_onPaneOutput(notification.paneId, notification.value);
+            }
+            break;
+        }
+        case TmuxNotification::Type::Exit:
+            // 以後のコマンドはexecで動く（isControlMode()がfalseになる）
+            std::cerr << "TmuxController: コントロールモードが終了しました" << std::endl;
+            break;
+        default:
+            break;
+    }
+}
+
+void TmuxController::requestWindowList() {
+    if (m_listPending.exchange(true)) {
+        m_listAgain = true;
+        return;
+    }
+
+    Command command = windowListCommand();
+    if (!m_control->send(command.args, std::move(command.onReply))) {
+        m_listPending = false;
+    }
+}
+
+TmuxController::Command TmuxController::windowListCommand() {
+    std::string cmd = "list-windows -t " + tmuxTarget(sessionName()) + " -F '" + kControlWindowFormat + "'";
+    unsigned long long generation = m_localGeneration;
+    return Command{cmd, [this, generation](bool ok, const std::string& output) {
+        if (generation != m_localGeneration) {
+            // 送った後に手元で先に反映した操作がある（その操作の後でもう一度取る）
+            m_listAgain = true;
+        } else if (ok) {
+            std::vector<TmuxWindow> windows = parseControlWindowList(output);
+            std::lock_guard<std::mutex> lock(m_pushMutex);
+            m_controlWindows = std::move(windows);
+            publishWindowsLocked();
+        }
+        m_listPending = false;
+        if (m_listAgain.exchange(false)) {
+            requestWindowList();
+        }
+    }};
+}
+
+void TmuxController::publishWindowsLocked() {
+    m_pushedWindows = m_controlWindows;
+    m_hasPushedWindows = true;
+}
+
+int TmuxController::createWindow(const std::string& name) {
+    if (!m_attached || !m_controlChannelOpen) {
+        return -1;
+    }
+
+    // 空いている番号を指定して作る（応答を待たずにタブを出せる、番号が埋まっていれば失敗して一覧で戻る）
+    // tmuxは指定がなければbase-index以上の空き番号を使うので、今ある最小の番号から探す
+    int newWindowIndex = 0;
+    if (!m_windows.empty()) {
+        newWindowIndex = m_windows.front().index;
+        for (const auto& win : m_windows) {
+            newWindowIndex = std::min(newWindowIndex, win.index);
+        }
+        bool used = true;
+        while (used) {
+            used = false;
+            for (const auto& win : m_windows) {
+                if (win.index == newWindowIndex) {
+                    used = true;
+                    ++newWindowIndex;
+                    break;
+                }
+            }
+        }
+    }
+
+    std::string cmd = "new-window -t " + tmuxTarget(m_sessionName, newWindowIndex);
+    if (!name.empty()) {
+        cmd += " -n " + tmuxQuote(name);
+    }
+    queueCommand(cmd, [newWindowIndex](bool ok, const std::string& output) {
+        if (!ok) {
+            std::cerr << "TmuxController: ウィンドウを作成できませんでした (index=" << newWindowIndex << "): " << output << std::endl;
+        }
+    });
+
+    // 新しいウィンドウはアクティブになる（名前・パス・ペインは一覧が届いたときに埋まる）
+    TmuxWindow win;
+    win.index = newWindowIndex;
+    win.name = name;
+    win.active = true;
+    applyLocalChange([win](std::vector<TmuxWindow>& windows) {
+        auto pos = windows.begin();
+        for (auto& existing : windows) {
+            existing.active = false;
+        }
+        while (pos != windows.end() && pos->index < win.index) {
+            ++pos;
+        }
+        windows.insert(pos, win);
+    });
+    m_currentWindowIndex = newWindowIndex;
 
-    std::cout << "TmuxController: 新しいウィンドウを作成しました (index=" << newWindowIndex << ")" << std::endl;
+    std::cout << "TmuxController: 新しいウィンドウを作成します (index=" << newWindowIndex << ")" << std::endl;
     return newWindowIndex;
 }
 
@@ -166,8 +719,12 @@ bool TmuxController::selectWindow(int index) {
         return false;
     }
 
-    std::string cmd = m_tmuxPath + " select-window -t " + m_sessionName + ":" + std::to_string(index);
-    executeCommand(cmd);
+    queueCommand("select-window -t " + tmuxTarget(m_sessionName, index));
+    applyLocalChange([index](std::vector<TmuxWindow>& windows) {
+        for (auto& win : windows) {
+            win.active = (win.index == index);
+        }
+    });
 
     m_currentWindowIndex = index;
     return true;
@@ -178,15 +735,12 @@ bool TmuxController::closeWindow(int index) {
         return false;
     }
 
-    std::string cmd = m_tmuxPath + " kill-window -t " + m_sessionName + ":" + std::to_string(index);
-    executeCommand(cmd);
-
-    // ウィンドウ一覧を更新
-    m_windows = listWindows();
-
-    if (m_onWindowListChanged) {
-        m_onWindowListChanged(m_windows);
-    }
+    queueCommand("kill-window -t " + tmuxTarget(m_sessionName, index));
+    applyLocalChange([index](std::vector<TmuxWindow>& windows) {
+        windows.erase(std::remove_if(windows.begin(), windows.end(),
+                                     [index](const TmuxWindow& win) { return win.index == index; }),
+                      windows.end());
+    });
 
     return true;
 }
@@ -196,31 +750,97 @@ bool TmuxController::renameWindow(int index, const std::string& name) {
         return false;
     }
 
-    std::string cmd = m_tmuxPath + " rename-window -t " + m_sessionName + ":" + std::to_string(index) + " '" + name + "'";
-    executeCommand(cmd);
-
-    // ウィンドウ一覧を更新
-    m_windows = listWindows();
+    queueCommand("rename-window -t " + tmuxTarget(m_sessionName, index) + " " + tmuxQuote(name));
+    applyLocalChange([index, name](std::vector<TmuxWindow>& windows) {
+        for (auto& win : windows) {
+            if (win.index == index) {
+                win.name = name;
+            }
+        }
+    });
 
     return true;
 }
 
+void TmuxController::queueCommand(const std::string& args, ReplyCallback onReply) {
+    Command command;
+    command.args = args;
+    command.onReply = std::move(onReply);
+    m_commandQueue.push_back(std::move(command));
+}
+
+void TmuxController::applyLocalChange(const std::function<void(std::vector<TmuxWindow>&)>& change) {
+    m_queueChangesWindows = true;
+    // これより前に送ったlist-windowsの応答は変更前の一覧なので捨てる
+    ++m_localGeneration;
+
+    change(m_windows);
+    std::lock_guard<std::mutex> lock(m_pushMutex);
+    change(m_controlWindows);
+    if (m_hasPushedWindows) {
+        change(m_pushedWindows);
+    }
+}
+
+void TmuxController::flushCommands() {
+    if (m_commandQueue.empty()) {
+        return;
+    }
+    std::vector<Command> queue;
+    queue.swap(m_commandQueue);
+    bool changesWindows = m_queueChangesWindows;
+    m_queueChangesWindows = false;
+
+    if (isControlMode()) {
+        if (!sendCommands(std::move(queue))) {
+            std::cerr << "TmuxController: コマンドを送れませんでした" << std::endl;
+            return;
+        }
+        if (changesWindows) {
+            // 列に積んだ後・送る前に出たlist-windowsも古い
+            ++m_localGeneration;
+            // 失敗したコマンドは通知が来ないので、送った後の一覧で確かめ直す
+            requestWindowList();
+        }
+        return;
+    }
+
+    // execではexec用のスレッドで1回のtmux起動にまとめて実行する（UIスレッドは待たない）
+    // 失敗したコマンドの分は手元で先に反映した一覧と食い違うので、実行後の一覧で確かめ直す
+    ExecBatch batch;
+    batch.commands = std::move(queue);
+    batch.tmuxPath = m_tmuxPath;
+    batch.sessionName = sessionName();
+    batch.relist = changesWindows;
+    batch.generation = m_localGeneration;
+    postExec(std::move(batch));
+}
+
 std::vector<TmuxWindow> TmuxController::listWindows() {
     if (!m_controlChannelOpen) {
         return {};
     }
 
+    if (isControlMode()) {
+        std::string cmd = "list-windows -t " + tmuxTarget(m_sessionName) + " -F '" + kControlWindowFormat + "'";
+        std::vector<TmuxWindow> windows = parseControlWindowList(runTmux(cmd));
+        setWindows(windows);
+        return windows;
+    }
+
     // tmux list-windows でウィンドウ一覧を取得
     // フォーマット: index:name:active:pane_current_path
-    std::string cmd = m_tmuxPath + " list-windows -t " + m_sessionName + " -F '#{window_index}:#{window_name}:#{window_active}:#{pane_current_path}'";
+    std::string cmd = m_tmuxPath + " list-windows -t " + tmuxTarget(m_sessionName) + " -F '" + kExecWindowFormat + "'";
     std::string result = executeCommand(cmd);
 
     std::cout << "TmuxController::listWindows 結果: [" << result << "]" << std::endl;
 
-    return parseWindowList(result);
+    std::vector<TmuxWindow> windows = parseWindowList(result);
+    setWindows(windows);
+    return windows;
 }
 
-std::vector<TmuxWindow> TmuxController::parseWindowList(const std::string& output) {
+std::vector<TmuxWindow> TmuxController::parseWindowList(const std::string& output) const {
     std::vector<TmuxWindow> windows;
 
     std::istringstream iss(output);
@@ -252,29 +872,164 @@ std::vector<TmuxWindow> TmuxController::parseWindowList(const std::string& outpu
                 win.currentPath = parts[3];
             }
             windows.push_back(win);
+        }
+    }
+
+    return windows;
+}
+
+std::vector<TmuxWindow> TmuxController::parseControlWindowList(const std::string& output) const {
+    std::vector<TmuxWindow> windows;
+
+    std::istringstream iss(output);
+    std::string line;
+
+    while (std::getline(iss, line)) {
+        if (line.empty() || line[0] == '\r') continue;
 
-            if (win.active) {
-                m_currentWindowIndex = win.index;
+        // フォーマット: id\tindex\tactive\tlayout\tpane\tpath\tname（名前はタブを含んでも最後まで）
+        std::vector<std::string> parts;
+        size_t start = 0;
+        while (parts.size() < 6) {
+            size_t tab = line.find('\t', start);
+            if (tab == std::string::npos) {
+                break;
             }
+            parts.push_back(line.substr(start, tab - start));
+            start = tab + 1;
         }
+        if (parts.size() < 6) continue;
+        parts.push_back(line.substr(start));
+
+        TmuxWindow win;
+        try {
+            win.index = std::stoi(parts[1]);
+        } catch (...) {
+            continue;
+        }
+        win.id = parts[0];
+        win.active = (parts[2] == "1");
+        win.layout = parts[3];
+        win.paneId = parts[4];
+        win.currentPath = parts[5];
+        win.name = parts[6];
+        windows.push_back(win);
     }
 
-    m_windows = windows;
     return windows;
 }
 
+std::vector<TmuxPaneRect> TmuxController::parseLayout(const std::string& layout) {
+    std::vector<TmuxPaneRect> panes;
+
+    // 先頭はチェックサム
+    size_t comma = layout.find(',');
+    if (comma == std::string::npos) {
+        return panes;
+    }
+    size_t pos = comma + 1;
+    if (!parseLayoutCell(layout, pos, panes) || pos != layout.size()) {
+        panes.clear();
+    }
+    return panes;
+}
+
 std::vector<TmuxSession> TmuxController::listSessions() {
     if (!m_controlChannelOpen) {
         return {};
     }
 
     // tmux list-sessions でセッション一覧を取得
-    std::string cmd = m_tmuxPath + " list-sessions -F '#{session_name}:#{session_windows}:#{session_attached}'";
-    std::string result = executeCommand(cmd);
+    std::string cmd = "list-sessions -F '#{session_name}:#{session_windows}:#{session_attached}'";
+    std::string result = runTmux(cmd);
 
     return parseSessionList(result);
 }
 
+TmuxController::Command TmuxController::sessionListQuery(SessionListCallback onList) {
+    // session_name, session_attached, window_activity に続けてコントロールモードの一覧と同じ項目
+    std::string cmd = std::string("list-windows -a -F '#{session_name}\t#{session_attached}\t#{window_activity}\t") +
+                      kControlWindowFormat + "'";
+    return Command{cmd, [this, onList](bool ok, const std::string& output) {
+        std::vector<TmuxSession> sessions;
+        if (ok) {
+            std::istringstream iss(output);
+            std::string line;
+            while (std::getline(iss, line)) {
+                size_t tab1 = line.find('\t');
+                size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+                size_t tab3 = tab2 == std::string::npos ? tab2 : line.find('\t', tab2 + 1);
+                if (tab3 == std::string::npos) {
+                    continue;
+                }
+                std::vector<TmuxWindow> parsed = parseControlWindowList(line.substr(tab3 + 1));
+                if (parsed.empty()) {
+                    continue;
+                }
+                TmuxWindow win = parsed.front();
+                win.activity = std::atoll(line.substr(tab2 + 1, tab3 - tab2 - 1).c_str());
+
+                // list-windows -a はセッションごとにまとまって並ぶ
+                std::string name = line.substr(0, tab1);
+                if (sessions.empty() || sessions.back().name != name) {
+                    TmuxSession session;
+                    session.name = name;
+                    session.windowCount = 0;
+                    session.attached = (line.substr(tab1 + 1, tab2 - tab1 - 1) != "0");
+                    sessions.push_back(session);
+                }
+                sessions.back().windows.push_back(win);
+                sessions.back().windowCount++;
+            }
+        }
+        if (onList) {
+            onList(sessions);
+        }
+    }};
+}
+
+bool TmuxController::switchSession(const std::string& name, const std::vector<TmuxWindow>& windows) {
+    if (!m_attached || !isControlMode() || name.empty()) {
+        return false;
+    }
+    if (name == sessionName()) {
+        return true;
+    }
+
+    // 列に積んだ前のセッション向けのコマンドを先に送ってから切り替える
+    flushCommands();
+    // 応答より先に名前を変えておく（失敗の応答で戻す）
+    std::string previous = sessionName();
+    setSessionName(name);
+    bool sent = m_control->send("switch-client -t " + tmuxTarget(name), [this, name, previous](bool ok, const std::string& output) {
+        if (!ok) {
+            // 元のセッションのまま（先に反映した一覧も取り直して戻す）
+            std::cerr << "TmuxController: セッションを切り替えられませんでした: " << name << " (" << output << ")" << std::endl;
+            setSessionName(previous);
+            requestWindowList();
+        }
+    });
+    if (!sent) {
+        setSessionName(previous);
+        return false;
+    }
+
+    std::vector<TmuxWindow> known = windows;
+    applyLocalChange([known](std::vector<TmuxWindow>& list) {
+        list = known;
+    });
+    for (const auto& win : m_windows) {
+        if (win.active) {
+            m_currentWindowIndex = win.index;
+        }
+    }
+    // 確かめ直し（失敗していれば元のセッションの一覧に戻る）
+    requestWindowList();
+
+    std::cout << "TmuxController: セッション '" << name << "' へ切り替えます" << std::endl;
+    return true;
+}
+
 std::vector<TmuxSession> TmuxController::parseSessionList(const std::string& output) {
     std::vector<TmuxSession> sessions;
 
@@ -304,32 +1059,33 @@ std::vector<TmuxSession> TmuxController::parseSessionList(const std::string& out
     return sessions;
 }
 
-void TmuxController::pollWindowList() {
+void TmuxController::appendWindowListQuery(std::vector<Command>& batch) {
     if (!m_attached || !m_controlChannelOpen) {
         return;
     }
 
-    // 現在のウィンドウ一覧を取得
-    auto newWindows = listWindows();
-
-    // 変更があればコールバックを呼ぶ
-    bool changed = (newWindows.size() != m_windows.size());
-    if (!changed) {
-        for (size_t i = 0; i < newWindows.size(); ++i) {
-            if (newWindows[i].index != m_windows[i].index ||
-                newWindows[i].name != m_windows[i].name ||
-                newWindows[i].active != m_windows[i].active) {
-                changed = true;
-                break;
-            }
+    if (isControlMode()) {
+        // 購読のないtmuxではパスの変化だけ通知が来ないので、同じストリームで取り直す
+        // 通知で取り直している最中なら、その応答で足りる
+        if (!m_pushPaths && !m_listPending.exchange(true)) {
+            batch.push_back(windowListCommand());
         }
+        return;
     }
 
-    if (changed && m_onWindowListChanged) {
-        m_onWindowListChanged(newWindows);
-    }
-
-    m_windows = newWindows;
+    // execでは応答がexec用のスレッドから呼ばれる
+    // 積んだ後に手元で先に反映した操作があれば古い一覧なので使わない（その操作の実行後に取り直される）
+    std::string cmd = "list-windows -t " + tmuxTarget(m_sessionName) + " -F '" + kExecWindowFormat + "'";
+    unsigned long long generation = m_localGeneration;
+    batch.push_back(Command{cmd, [this, generation](bool ok, const std::string& output) {
+        if (!ok || generation != m_localGeneration) {
+            return;
+        }
+        std::vector<TmuxWindow> windows = parseWindowList(output);
+        std::lock_guard<std::mutex> lock(m_pushMutex);
+        m_pushedWindows = std::move(windows);
+        m_hasPushedWindows = true;
+    }});
 }
 
 } // namespace pbterm
@@ -0,0 +1,378 @@
+#include "TmuxPaneTerminals.h"
+#include "Terminal.h"
+#include "TmuxController.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+
+namespace pbterm {
+
+struct TmuxPaneTerminals::Pane {
+    enum class State {
+        Capturing,  // capture-paneの応答待ち（届いた出力は取り込む画面に含まれるので捨てる）
+        Captured,   // カーソル位置の応答待ち（届いた出力はheldへためる）
+        Live        // 出力をそのまま流す
+    };
+
+    std::unique_ptr<Terminal> terminal;
+    std::mutex mutex;
+    State state = State::Capturing;
+    std::string screen;     // capture-pane -e の出力
+    std::string held;       // Captured中に届いた出力
+
+    // 履歴の取り込み
+    int seedHistorySize = -1;   // 画面を取り込んだときのhistory_size（これより古い行が手元にない）
+    unsigned seedEpoch = 0;     // そのときのスクロールバックのepoch
+    bool importing = false;
+    bool importStarted = false;
+    unsigned importEpoch = 0;   // 取り込みを始めたときのスクロールバックのepoch
+};
+
+// 取り込み中の位置（行番号は最古の履歴を0とする）
+struct TmuxPaneTerminals::HistoryImport {
+    std::string paneId;
+    unsigned epoch = 0;
+    int end = -1;           // [.., end) がまだ手元にない（-1なら最初の応答のhistory_sizeにする）
+    int historySize = 0;    // 直近のhistory_size（相対の行番号に直すのに使う）
+    int misses = 0;         // 出力が流れて欲しい範囲を取り損ねた回数
+};
+
+namespace {
+
+// 1回に取る履歴の行数と、範囲を取り損ねたときに取り直す上限
+constexpr int kHistoryChunk = 200;
+constexpr int kHistoryMaxMisses = 3;
+
+// 改行で区切ったfirst行目からcount行を返す（空の行も1行と数える）
+std::string sliceLines(const std::string& text, int first, int count) {
+    std::string out;
+    size_t start = 0;
+    for (int i = 0; i < first + count; ++i) {
+        size_t end = text.find('\n', start);
+        if (i >= first) {
+            if (i > first) {
+                out += '\n';
+            }
+            out += text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+        }
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+    return out;
+}
+
+// capture-paneの行を画面へ描き直すシーケンスにする（最後にカーソルを戻す）
+std::string seedSequence(const std::string& screen, int cursorX, int cursorY) {
+    std::string out = "\x1b[H\x1b[2J";
+    std::istringstream iss(screen);
+    std::string line;
+    bool first = true;
+    while (std::getline(iss, line)) {
+        if (!first) {
+            out += "\r\n";
+        }
+        first = false;
+        out += line;
+        out += "\x1b[0m";
+    }
+    out += "\x1b[" + std::to_string(cursorY + 1) + ";" + std::to_string(cursorX + 1) + "H";
+    return out;
+}
+
+} // namespace
+
+TmuxPaneTerminals::TmuxPaneTerminals(TmuxController* tmux)
+    : m_tmux(tmux)
+{
+}
+
+TmuxPaneTerminals::~TmuxPaneTerminals() {
+    clear();
+}
+
+Terminal* TmuxPaneTerminals::terminal(const std::string& paneId, int cols, int rows) {
+    if (paneId.empty()) {
+        return nullptr;
+    }
+
+    std::shared_ptr<Pane> pane;
+    bool created = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_panes.find(paneId);
+        if (it != m_panes.end()) {
+            pane = it->second;
+        } else {
+            pane = std::make_shared<Pane>();
+            pane->terminal = std::make_unique<Terminal>(cols, rows);
+            if (!m_themeId.empty()) {
+                pane->terminal->setColorTheme(m_themeId);
+            }
+            if (m_triggers) {
+                pane->terminal->setTriggers(m_triggers);
+            }
+            TmuxController* tmux = m_tmux;
+            pane->terminal->setInputHandler([tmux, paneId](const char* data, size_t len) {
+                tmux->sendKeys(paneId, data, len);
+            });
+            m_panes[paneId] = pane;
+            created = true;
+        }
+    }
+
+    if (created) {
+        startCapture(paneId, pane);
+    } else {
+        startHistoryImport(m_tmux, paneId, pane);
+    }
+    return pane->terminal.get();
+}
+
+Terminal* TmuxPaneTerminals::find(const std::string& paneId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_panes.find(paneId);
+    return it != m_panes.end() ? it->second->terminal.get() : nullptr;
+}
+
+void TmuxPaneTerminals::startCapture(const std::string& paneId, const std::shared_ptr<Pane>& pane) {
+    std::weak_ptr<Pane> weak = pane;
+    TmuxController* tmux = m_tmux;
+
+    // 1行で送るので、画面とカーソル位置・履歴の行数の間に出力が挟まらない
+    std::vector<TmuxController::Command> commands;
+    commands.push_back(TmuxController::Command{"capture-pane -p -e -t " + paneId, [weak](bool ok, const std::string& output) {
+        auto pane = weak.lock();
+        if (!pane) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(pane->mutex);
+        if (ok) {
+            pane->screen = output;
+        }
+        pane->state = Pane::State::Captured;
+    }});
+    commands.push_back(TmuxController::Command{
+        "display-message -p -t " + paneId + " '#{pane_width} #{pane_height} #{cursor_x} #{cursor_y} #{history_size}'",
+        [weak, tmux, paneId](bool ok, const std::string& output) {
+            auto pane = weak.lock();
+            if (!pane) {
+                return;
+            }
+            {
+                std::lock_guard<std::mutex> lock(pane->mutex);
+                int width = 0;
+                int height = 0;
+                int cursorX = 0;
+                int cursorY = 0;
+                int historySize = -1;
+                if (ok) {
+                    std::istringstream iss(output);
+                    iss >> width >> height >> cursorX >> cursorY >> historySize;
+                }
+                // 取り込む画面はペインの大きさのもの（ドックの大きさには次のフレームで合わせ直す）
+                if (width > 0 && height > 0) {
+                    pane->terminal->resize(width, height);
+                }
+                std::string seed = seedSequence(pane->screen, cursorX, cursorY);
+                pane->terminal->onData(seed.data(), seed.size());
+                if (!pane->held.empty()) {
+                    pane->terminal->onData(pane->held.data(), pane->held.size());
+                }
+                pane->screen.clear();
+                pane->held.clear();
+                pane->seedHistorySize = historySize;
+                pane->seedEpoch = pane->terminal->scrollbackEpoch();
+                pane->state = Pane::State::Live;
+            }
+            startHistoryImport(tmux, paneId, pane);
+        }});
+
+    if (!m_tmux->sendCommands(std::move(commands))) {
+        // コントロールモードでなくなっていた（取り込まずに出力だけ流す）
+        std::lock_guard<std::mutex> lock(pane->mutex);
+        pane->state = Pane::State::Live;
+    }
+}
+
+void TmuxPaneTerminals::startHistoryImport(TmuxController* tmux, const std::string& paneId,
+                                           const std::shared_ptr<Pane>& pane) {
+    unsigned epoch = pane->terminal->scrollbackEpoch();
+    auto import = std::make_shared<HistoryImport>();
+    {
+        std::lock_guard<std::mutex> lock(pane->mutex);
+        if (pane->state != Pane::State::Live || pane->importing ||
+            (pane->importStarted && pane->importEpoch == epoch)) {
+            return;
+        }
+        pane->importing = true;
+        pane->importStarted = true;
+        pane->importEpoch = epoch;
+
+        import->paneId = paneId;
+        import->epoch = epoch;
+        // 画面を取り込んだ後にスクロールバックを捨てていなければ、その時点より古い行を取る
+        // （捨てていれば、取り込みを始めた時点の履歴をすべて取る）
+        if (pane->seedHistorySize >= 0 && pane->seedEpoch == epoch) {
+            import->end = pane->seedHistorySize;
+            import->historySize = pane->seedHistorySize;
+        }
+    }
+    requestHistory(tmux, pane, import);
+}
+
+void TmuxPaneTerminals::requestHistory(TmuxController* tmux, const std::weak_ptr<Pane>& weak,
+                                       const std::shared_ptr<HistoryImport>& import) {
+    // capture-paneの行番号は表示中の先頭が0、履歴は負（-1が最も新しい）
+    int start = -kHistoryChunk;
+    int last = -1;
+    if (import->end >= 0) {
+        if (import->end == 0) {
+            finishHistoryImport(weak);
+            return;
+        }
+        int first = std::max(0, import->end - kHistoryChunk);
+        start = first - import->historySize;
+        last = import->end - 1 - import->historySize;
+        if (last >= 0) {
+            finishHistoryImport(weak);
+            return;
+        }
+    }
+
+    // 同じ行で今のhistory_sizeも取り、取れた範囲を確かめる（間に出力が流れると行番号がずれる）
+    auto historySize = std::make_shared<int>(-1);
+    std::vector<TmuxController::Command> commands;
+    commands.push_back(TmuxController::Command{
+        "display-message -p -t " + import->paneId + " '#{history_size}'",
+        [historySize](bool ok, const std::string& output) {
+            if (ok) {
+                *historySize = std::atoi(output.c_str());
+            }
+        }});
+    commands.push_back(TmuxController::Command{
+        "capture-pane -p -e -t " + import->paneId + " -S " + std::to_string(start) + " -E " + std::to_string(last),
+        [tmux, weak, import, start, last, historySize](bool ok, const std::string& output) {
+            onHistoryChunk(tmux, weak, import, start, last, *historySize, ok, output);
+        }});
+    if (!tmux->sendCommands(std::move(commands))) {
+        finishHistoryImport(weak);
+    }
+}
+
+void TmuxPaneTerminals::onHistoryChunk(TmuxController* tmux, const std::weak_ptr<Pane>& weak,
+                                       const std::shared_ptr<HistoryImport>& import,
+                                       int start, int last, int historySize, bool ok, const std::string& output) {
+    auto pane = weak.lock();
+    if (!pane) {
+        return;
+    }
+    if (!ok || historySize < 0) {
+        finishHistoryImport(weak);
+        return;
+    }
+    if (import->end < 0) {
+        import->end = historySize;
+    }
+    import->historySize = historySize;
+
+    // 実際に取れた範囲（履歴より古い位置を指定すると最古の行からになる）
+    int gotFirst = std::max(0, start + historySize);
+    int gotLast = last + historySize;
+    int first = std::max(0, import->end - kHistoryChunk);
+    if (gotLast < import->end - 1) {
+        // 履歴が消された（clear-historyなど）
+        finishHistoryImport(weak);
+        return;
+    }
+    int from = std::max(first, gotFirst);
+    if (from > import->end - 1) {
+        // 出力が多く流れて範囲を外した（今の行数で取り直す）
+        if (++import->misses > kHistoryMaxMisses) {
+            finishHistoryImport(weak);
+        } else {
+            requestHistory(tmux, weak, import);
+        }
+        return;
+    }
+    import->misses = 0;
+
+    std::string lines = sliceLines(output, from - gotFirst, import->end - from);
+    bool more = pane->terminal->prependScrollback(lines, import->epoch);
+    import->end = from;
+    if (!more || import->end == 0) {
+        finishHistoryImport(weak);
+        return;
+    }
+    requestHistory(tmux, weak, import);
+}
+
+void TmuxPaneTerminals::finishHistoryImport(const std::weak_ptr<Pane>& weak) {
+    auto pane = weak.lock();
+    if (!pane) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(pane->mutex);
+    pane->importing = false;
+}
+
+void TmuxPaneTerminals::retain(const std::vector<std::string>& paneIds) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto it = m_panes.begin(); it != m_panes.end();) {
+        if (std::find(paneIds.begin(), paneIds.end(), it->first) == paneIds.end()) {
+            it = m_panes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void TmuxPaneTerminals::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_panes.clear();
+}
+
+void TmuxPaneTerminals::setColorTheme(const std::string& themeId) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_themeId = themeId;
+    for (auto& entry : m_panes) {
+        entry.second->terminal->setColorTheme(themeId);
+    }
+}
+
+void TmuxPaneTerminals::setTriggers(const std::shared_ptr<const TriggerEngine>& triggers) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_triggers = triggers;
+    for (auto& entry : m_panes) {
+        entry.second->terminal->setTriggers(triggers);
+    }
+}
+
+void TmuxPaneTerminals::onOutput(const std::string& paneId, const std::string& data) {
+    std::shared_ptr<Pane> pane;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_panes.find(paneId);
+        if (it == m_panes.end()) {
+            // まだ表示していないペイン（作るときにcapture-paneで今の画面を取り込む）
+            return;
+        }
+        pane = it->second;
+    }
+
+    std::lock_guard<std::mutex> lock(pane->mutex);
+    switch (pane->state) {
+        case Pane::State::Capturing:
+            break;
+        case Pane::State::Captured:
+            pane->held += data;
+            break;
+        case Pane::State::Live:
+            pane->terminal->onData(data.data(), data.size());
+            break;
+    }
+}
+
+} // namespace pbterm
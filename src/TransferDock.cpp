@@ -0,0 +1,270 @@
+#include "TransferDock.h"
+#include "TransferManager.h"
+#include "TarTransport.h"
+#include "SettingsDialog.h"
+#include "imgui.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace pbterm {
+
+namespace {
+constexpr const char* kIconUpload = u8"\ue2c6";    // file_upload
+constexpr const char* kIconDownload = u8"\ue2c4";  // file_download
+
+std::string formatBytes(double bytes) {
+    const char* units[] = {"B", "KB", "MB", "GB", "TB"};
+    int unit = 0;
+    while (bytes >= 1024.0 && unit < 4) {
+        bytes /= 1024.0;
+        unit++;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), unit == 0 ? "%.0f %s" : "%.1f %s", bytes, units[unit]);
+    return buf;
+}
+
+std::string formatDuration(double seconds) {
+    long total = static_cast<long>(seconds + 0.5);
+    char buf[32];
+    if (total >= 3600) {
+        snprintf(buf, sizeof(buf), "%ld:%02ld:%02ld", total / 3600, (total / 60) % 60, total % 60);
+    } else {
+        snprintf(buf, sizeof(buf), "%ld:%02ld", total / 60, total % 60);
+    }
+    return buf;
+}
+
+const char* stateLabel(const Localization& loc, TransferState state) {
+    switch (state) {
+        case TransferState::Queued: return loc.transferQueued;
+        case TransferState::Scanning: return loc.transferScanning;
+        case TransferState::Running: return loc.transferRunning;
+        case TransferState::Verifying: return loc.transferVerifying;
+        case TransferState::Paused: return loc.transferPaused;
+        case TransferState::Completed: return loc.transferCompleted;
+        case TransferState::Failed: return loc.transferFailed;
+        case TransferState::Cancelled: return loc.transferCancelled;
+    }
+    return "";
+}
+} // namespace
+
+void TransferDock::render() {
+    const Localization& loc = getLocalization(m_language);
+
+    if (!m_manager) {
+        return;
+    }
+
+    std::vector<TransferItemStatus> items = m_manager->snapshot();
+
+    if (ImGui::Button(loc.transferClearFinished)) {
+        m_manager->clearFinished();
+    }
+    renderSyncOptions();
+    renderArchiveOptions();
+    renderVerifyOptions();
+    renderRateLimitOptions();
+    ImGui::Separator();
+
+    renderReportPopup();
+
+    if (items.empty()) {
+        ImGui::TextDisabled("%s", loc.transferEmpty);
+        return;
+    }
+
+    ImGui::BeginChild("##transferList", ImVec2(0, 0), ImGuiChildFlags_None);
+
+    for (const auto& item : items) {
+        ImGui::PushID(item.id);
+
+        ImGui::TextUnformatted(item.direction == TransferDirection::Upload ? kIconUpload : kIconDownload);
+        ImGui::SameLine();
+        ImGui::TextUnformatted(item.name.c_str());
+        ImGui::SameLine();
+        if (item.dryRun) {
+            ImGui::TextDisabled("[%s: %s]", loc.transferDryRun, stateLabel(loc, item.state));
+        } else {
+            ImGui::TextDisabled("[%s]", stateLabel(loc, item.state));
+        }
+        if (ImGui::IsItemHovered()) {
+            ImGui::SetTooltip("%s\n-> %s", item.sourcePath.c_str(), item.destinationPath.c_str());
+        }
+
+        // バイト単位の進捗
+        float fraction = 0.0f;
+        if (item.totalBytes > 0) {
+            fraction = static_cast<float>(static_cast<double>(item.transferredBytes) / static_cast<double>(item.totalBytes));
+        } else if (item.state == TransferState::Completed) {
+            fraction = 1.0f;
+        }
+        std::string overlay = formatBytes(static_cast<double>(item.transferredBytes)) + " / " +
+                              formatBytes(static_cast<double>(item.totalBytes));
+        ImGui::ProgressBar(fraction, ImVec2(-1, 0), overlay.c_str());
+
+        // ファイル数・速度・残り時間
+        std::string detail;
+        if (item.totalFiles > 1) {
+            char buf[64];
+            snprintf(buf, sizeof(buf), "%d/%d %s", item.completedFiles, item.totalFiles, loc.transferFiles);
+            detail = buf;
+        }
+        if (item.state == TransferState::Running && item.bytesPerSecond > 0.0) {
+            if (!detail.empty()) detail += "  ";
+            detail += formatBytes(item.bytesPerSecond) + "/s";
+            if (item.etaSeconds >= 0.0) {
+                detail += "  " + formatDuration(item.etaSeconds);
+            }
+        }
+        ImGui::TextUnformatted(detail.c_str());
+
+        // 操作ボタン
+        if (!item.isFinished()) {
+            ImGui::SameLine();
+            if (item.state == TransferState::Paused) {
+                if (ImGui::SmallButton(loc.transferResume)) {
+                    m_manager->resume(item.id);
+                }
+            } else if (ImGui::SmallButton(loc.transferPause)) {
+                m_manager->pause(item.id);
+            }
+            ImGui::SameLine();
+            if (ImGui::SmallButton(loc.transferCancel)) {
+                m_manager->cancel(item.id);
+            }
+
+            // 優先度（高い項目のファイルから転送し、セッションも優先して使う）
+            const char* priorities[] = {loc.transferPriorityHigh, loc.transferPriorityNormal, loc.transferPriorityLow};
+            int priority = static_cast<int>(item.priority);
+            ImGui::SameLine();
+            ImGui::SetNextItemWidth(80);
+            if (ImGui::Combo("##priority", &priority, priorities, 3)) {
+                m_manager->setPriority(item.id, static_cast<TransferPriority>(priority));
+            }
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("%s", loc.transferPriority);
+            }
+        } else if (item.state != TransferState::Completed) {
+            ImGui::SameLine();
+            if (ImGui::SmallButton(loc.transferRetry)) {
+                m_manager->retry(item.id);
+            }
+        }
+        if (!item.report.empty()) {
+            ImGui::SameLine();
+            if (ImGui::SmallButton(loc.transferReport)) {
+                m_reportText = item.report;
+                m_showReport = true;
+            }
+        }
+
+        if (item.state == TransferState::Failed && !item.error.empty()) {
+            ImGui::TextColored(ImVec4(0.9f, 0.35f, 0.35f, 1.0f), "%s", item.error.c_str());
+        }
+
+        ImGui::Separator();
+        ImGui::PopID();
+    }
+
+    ImGui::EndChild();
+}
+
+void TransferDock::renderSyncOptions() {
+    const Localization& loc = getLocalization(m_language);
+
+    bool changed = false;
+    ImGui::SameLine();
+    if (ImGui::Checkbox(loc.transferSyncMode, &m_syncEnabled)) {
+        changed = true;
+    }
+    if (m_syncEnabled) {
+        ImGui::SameLine();
+        if (ImGui::Checkbox(loc.transferSyncHashes, &m_syncHashes)) {
+            changed = true;
+        }
+        ImGui::SameLine();
+        if (ImGui::Checkbox(loc.transferDryRun, &m_syncDryRun)) {
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        SyncOptions options;
+        options.compareHashes = m_syncHashes;
+        m_manager->setSyncMode(m_syncEnabled, options, m_syncDryRun);
+    }
+}
+
+void TransferDock::renderArchiveOptions() {
+    const Localization& loc = getLocalization(m_language);
+
+    bool changed = false;
+    if (ImGui::Checkbox(loc.transferArchiveMode, &m_archiveEnabled)) {
+        changed = true;
+    }
+    if (m_archiveEnabled && TarTransport::compressionSupported()) {
+        ImGui::SameLine();
+        if (ImGui::Checkbox(loc.transferCompress, &m_archiveCompress)) {
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        m_manager->setArchiveMode(m_archiveEnabled, m_archiveCompress);
+    }
+}
+
+void TransferDock::renderVerifyOptions() {
+    const Localization& loc = getLocalization(m_language);
+
+    ImGui::SameLine();
+    if (ImGui::Checkbox(loc.transferVerify, &m_verifyEnabled)) {
+        m_manager->setVerifyMode(m_verifyEnabled);
+    }
+}
+
+void TransferDock::renderRateLimitOptions() {
+    const Localization& loc = getLocalization(m_language);
+
+    bool changed = false;
+    ImGui::SameLine();
+    if (ImGui::Checkbox(loc.transferRateLimit, &m_rateLimitEnabled)) {
+        changed = true;
+    }
+    if (m_rateLimitEnabled) {
+        ImGui::SameLine();
+        ImGui::SetNextItemWidth(120);
+        if (ImGui::DragInt("##rateLimit", &m_rateLimitMBps, 0.5f, 1, 10000, "%d MB/s")) {
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        uint64_t rate = m_rateLimitEnabled ? static_cast<uint64_t>(m_rateLimitMBps) * 1024 * 1024 : 0;
+        m_manager->setRateLimit(rate);
+    }
+}
+
+void TransferDock::renderReportPopup() {
+    if (!m_showReport) return;
+
+    const Localization& loc = getLocalization(m_language);
+    ImGui::OpenPopup(loc.transferReportTitle);
+
+    if (ImGui::BeginPopupModal(loc.transferReportTitle, nullptr, ImGuiWindowFlags_AlwaysAutoResize)) {
+        ImGui::InputTextMultiline("##syncReport", m_reportText.data(), m_reportText.size() + 1,
+                                  ImVec2(560, 320), ImGuiInputTextFlags_ReadOnly);
+
+        if (ImGui::Button(loc.transferClose, ImVec2(100, 0))) {
+            m_showReport = false;
+            ImGui::CloseCurrentPopup();
+        }
+
+        ImGui::EndPopup();
+    }
+}
+
+} // namespace pbterm
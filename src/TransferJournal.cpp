@@ -0,0 +1,207 @@
+#include "TransferJournal.h"
+#include "SettingsDialog.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+namespace pbterm {
+
+namespace {
+
+// 変更から書き出しまでの待ち（この間の変更は1回の書き出しにまとめる）
+constexpr auto kWriteDelay = std::chrono::milliseconds(500);
+
+// 同じ転送（接続先・方向・転送元・転送先が同じ）を見分けるキー
+std::string transferKey(const TransferJournalEntry& entry) {
+    std::string key = entry.endpoint;
+    key += entry.upload ? "\nup\n" : "\ndown\n";
+    key += entry.source;
+    key += '\n';
+    key += entry.destination;
+    return key;
+}
+
+} // namespace
+
+TransferJournal::TransferJournal() = default;
+
+TransferJournal::~TransferJournal() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_cv.notify_all();
+    if (m_writer.joinable()) {
+        m_writer.join();
+    }
+}
+
+void TransferJournal::add(const TransferJournalEntry& entry) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_index.emplace(transferKey(entry), m_nextSequence).second) {
+        return;
+    }
+    m_entries.emplace(m_nextSequence++, entry);
+    markDirtyLocked();
+}
+
+void TransferJournal::remove(const TransferJournalEntry& entry) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_index.find(transferKey(entry));
+    if (it == m_index.end()) {
+        return;
+    }
+    m_entries.erase(it->second);
+    m_index.erase(it);
+    markDirtyLocked();
+}
+
+void TransferJournal::markDirtyLocked() {
+    m_dirty = true;
+    if (!m_writer.joinable()) {
+        m_writer = std::thread(&TransferJournal::writerThread, this);
+    }
+    m_cv.notify_all();
+}
+
+void TransferJournal::writerThread() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [this]() { return m_dirty || m_stopping; });
+        if (!m_dirty) {
+            return;
+        }
+        // 続けて来る変更を待ってからまとめて書く（終了時は待たない）
+        m_cv.wait_for(lock, kWriteDelay, [this]() { return m_stopping; });
+
+        std::vector<TransferJournalEntry> entries;
+        entries.reserve(m_entries.size());
+        for (const auto& e : m_entries) {
+            entries.push_back(e.second);
+        }
+        m_dirty = false;
+        lock.unlock();
+        write(entries);
+        lock.lock();
+    }
+}
+
+std::vector<TransferJournalEntry> TransferJournal::entriesFor(const std::string& endpoint) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<TransferJournalEntry> result;
+    for (const auto& e : m_entries) {
+        if (e.second.endpoint == endpoint) {
+            result.push_back(e.second);
+        }
+    }
+    return result;
+}
+
+void TransferJournal::write(const std::vector<TransferJournalEntry>& entries) {
+    // 書きかけで終了しても前の内容が残るよう、一時ファイルに書いてから置き換える
+    std::string path = configPath();
+    std::string tempPath = path + ".tmp";
+    std::ofstream file(tempPath);
+
+    if (!file.is_open()) {
+        std::cerr << "転送ジャーナルを開けません: " << tempPath << std::endl;
+        return;
+    }
+
+    // シンプルなテキスト形式で保存
+    for (const auto& e : entries) {
+        file << "[transfer]\n";
+        file << "endpoint=" << e.endpoint << "\n";
+        file << "direction=" << (e.upload ? "upload" : "download") << "\n";
+        file << "source=" << e.source << "\n";
+        file << "destination=" << e.destination << "\n";
+        file << "is_dir=" << (e.isDir ? "1" : "0") << "\n";
+        file << "sync=" << (e.sync ? "1" : "0") << "\n";
+        file << "sync_hashes=" << (e.syncHashes ? "1" : "0") << "\n";
+    }
+    file.close();
+    if (file.fail() || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "転送ジャーナルを保存できません: " << path << std::endl;
+        std::remove(tempPath.c_str());
+    }
+}
+
+void TransferJournal::load() {
+    std::string path = configPath();
+    std::ifstream file(path);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_index.clear();
+    if (!file.is_open()) {
+        return;
+    }
+
+    std::string line;
+    TransferJournalEntry current;
+    bool inEntry = false;
+
+    auto getValue = [](const std::string& line, const std::string& key) -> std::string {
+        if (line.find(key + "=") == 0) {
+            return line.substr(key.length() + 1);
+        }
+        return "";
+    };
+
+    auto flush = [&]() {
+        if (inEntry && !current.source.empty() && !current.destination.empty() &&
+            m_index.emplace(transferKey(current), m_nextSequence).second) {
+            m_entries.emplace(m_nextSequence++, current);
+        }
+    };
+
+    while (std::getline(file, line)) {
+        // 改行を削除
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+            line.pop_back();
+        }
+
+        if (line == "[transfer]") {
+            flush();
+            current = TransferJournalEntry();
+            inEntry = true;
+            continue;
+        }
+        if (!inEntry) continue;
+
+        std::string val;
+
+        val = getValue(line, "endpoint");
+        if (!val.empty()) { current.endpoint = val; continue; }
+
+        val = getValue(line, "direction");
+        if (!val.empty()) { current.upload = (val == "upload"); continue; }
+
+        val = getValue(line, "source");
+        if (!val.empty()) { current.source = val; continue; }
+
+        val = getValue(line, "destination");
+        if (!val.empty()) { current.destination = val; continue; }
+
+        val = getValue(line, "is_dir");
+        if (!val.empty()) { current.isDir = (val == "1"); continue; }
+
+        val = getValue(line, "sync");
+        if (!val.empty()) { current.sync = (val == "1"); continue; }
+
+        val = getValue(line, "sync_hashes");
+        if (!val.empty()) { current.syncHashes = (val == "1"); continue; }
+    }
+    flush();
+
+    if (!m_entries.empty()) {
+        std::cout << "転送ジャーナル読み込み: " << m_entries.size() << " 件の未完了転送" << std::endl;
+    }
+}
+
+std::string TransferJournal::configPath() const {
+    return AppSettings::configDir() + "/transfers.journal";
+}
+
+} // namespace pbterm
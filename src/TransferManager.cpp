@@ -0,0 +1,905 @@
+#include "TransferManager.h"
+#include "SshConnection.h"
+#include "SftpTransfer.h"
+#include "TarTransport.h"
+#include <algorithm>
+#include <filesystem>
+#include <deque>
+#include <iostream>
+
+namespace pbterm {
+
+namespace {
+
+// 速度の計測間隔
+constexpr double kRateSampleMs = 500.0;
+
+// このファイル数以上のディレクトリはtarストリームで転送する
+// （少数の大きなファイルは並列のSFTPの方が速い）
+constexpr int kArchiveMinFiles = 32;
+
+// 回線断で失敗した項目を再接続時に自動でやり直す回数の上限
+constexpr int kMaxAutoRetries = 3;
+
+std::string baseName(const std::string& path) {
+    std::string trimmed = path;
+    while (trimmed.size() > 1 && (trimmed.back() == '/' || trimmed.back() == '\\')) {
+        trimmed.pop_back();
+    }
+    size_t pos = trimmed.find_last_of("/\\");
+    return (pos != std::string::npos) ? trimmed.substr(pos + 1) : trimmed;
+}
+
+} // namespace
+
+TransferManager::TransferManager(SshConnection* connection, int workerCount)
+    : m_connection(connection)
+{
+    m_journal.load();
+    m_verifier = std::make_unique<TransferVerifier>(connection,
+        [this](const TransferVerifier::Request& request, VerifyResult result, const std::string& error) {
+            onVerified(request, result, error);
+        });
+
+    int count = std::max(1, workerCount);
+    for (int i = 0; i < count; ++i) {
+        m_workers.emplace_back(&TransferManager::workerLoop, this);
+    }
+}
+
+TransferManager::~TransferManager() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        for (auto& item : m_items) {
+            item->cancelRequested = true;
+        }
+    }
+    m_cv.notify_all();
+
+    for (auto& worker : m_workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    // 検証スレッドは結果の反映で項目に触れるので先に止める
+    m_verifier.reset();
+}
+
+int TransferManager::enqueueUpload(const std::string& localPath, const std::string& remotePath) {
+    std::error_code ec;
+    bool isDir = std::filesystem::is_directory(localPath, ec);
+    return enqueue(TransferDirection::Upload, localPath, remotePath, isDir);
+}
+
+int TransferManager::enqueueDownload(const std::string& remotePath, const std::string& localPath, bool isDir) {
+    return enqueue(TransferDirection::Download, remotePath, localPath, isDir);
+}
+
+void TransferManager::setSyncMode(bool enabled, const SyncOptions& options, bool dryRun) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_syncEnabled = enabled;
+    m_syncOptions = options;
+    m_syncDryRun = dryRun;
+}
+
+void TransferManager::setArchiveMode(bool enabled, bool compress) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_archiveEnabled = enabled;
+    m_archiveCompress = compress;
+}
+
+void TransferManager::setVerifyMode(bool enabled) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_verifyEnabled = enabled;
+}
+
+void TransferManager::setRateLimit(uint64_t bytesPerSecond) {
+    m_rateLimiter.setRate(bytesPerSecond);
+}
+
+void TransferManager::setPriority(int id, TransferPriority priority) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Item* item = findItemLocked(id);
+        if (!item) return;
+        item->priority = priority;
+    }
+    m_cv.notify_all();
+}
+
+int TransferManager::enqueue(TransferDirection direction, const std::string& source,
+                             const std::string& destination, bool isDir) {
+    auto item = std::make_unique<Item>();
+    item->direction = direction;
+    item->name = baseName(source);
+    item->source = source;
+    item->destination = destination;
+    item->isDir = isDir;
+    if (m_connection) {
+        item->endpoint = m_connection->endpoint();
+    }
+
+    int id;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        id = m_nextId++;
+        item->id = id;
+        item->verify = m_verifyEnabled;
+        if (m_syncEnabled && direction == TransferDirection::Upload && isDir) {
+            item->sync = true;
+            item->dryRun = m_syncDryRun;
+            item->syncOptions = m_syncOptions;
+        } else if (m_archiveEnabled && isDir) {
+            item->archive = true;
+            item->compress = m_archiveCompress;
+        }
+        // ドライランは何も書き込まないので再開の対象にしない
+        if (!item->dryRun) {
+            m_journal.add(journalEntry(*item));
+        }
+        m_items.push_back(std::move(item));
+    }
+    m_cv.notify_all();
+    return id;
+}
+
+void TransferManager::pause(int id) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Item* item = findItemLocked(id);
+    if (!item || makeStatusLocked(*item).isFinished()) return;
+    item->pauseRequested = true;
+    updateItemStateLocked(*item);
+}
+
+void TransferManager::resume(int id) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Item* item = findItemLocked(id);
+        if (!item) return;
+        item->pauseRequested = false;
+        updateItemStateLocked(*item);
+    }
+    m_cv.notify_all();
+}
+
+void TransferManager::cancel(int id) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Item* item = findItemLocked(id);
+        if (!item || makeStatusLocked(*item).isFinished()) return;
+        item->cancelRequested = true;
+        item->interrupted = false;
+        m_journal.remove(journalEntry(*item));
+        updateItemStateLocked(*item);
+    }
+    // 中断で空いたワーカーに次の項目を拾わせる
+    m_cv.notify_all();
+}
+
+void TransferManager::retry(int id) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Item* item = findItemLocked(id);
+        if (!item) return;
+        if (item->state != TransferState::Failed && item->state != TransferState::Cancelled) return;
+        resetForRetryLocked(*item);
+        item->autoRetries = 0;
+        m_journal.add(journalEntry(*item));
+    }
+    m_cv.notify_all();
+}
+
+void TransferManager::resetForRetryLocked(Item& item) {
+    item.cancelRequested = false;
+    item.pauseRequested = false;
+    item.interrupted = false;
+    item.finishedReported = false;
+    item.error.clear();
+    item.failedFiles = 0;
+    item.nextFile = 0;
+    for (auto& job : item.files) {
+        if (job.state == FileJob::State::Failed) {
+            job.state = FileJob::State::Pending;
+        }
+    }
+    item.sampleTime = std::chrono::steady_clock::time_point();
+    item.bytesPerSecond = 0.0;
+    updateItemStateLocked(item);
+}
+
+void TransferManager::clearFinished() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto removed = std::stable_partition(m_items.begin(), m_items.end(), [](const std::unique_ptr<Item>& item) {
+        bool finished = item->state == TransferState::Completed || item->state == TransferState::Failed ||
+                        item->state == TransferState::Cancelled;
+        // 残す項目を前に集める
+        return !(finished && item->running == 0 && item->verifying == 0 && !item->scanning);
+    });
+    for (auto it = removed; it != m_items.end(); ++it) {
+        m_journal.remove(journalEntry(**it));
+    }
+    m_items.erase(removed, m_items.end());
+}
+
+void TransferManager::cancelAll() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& item : m_items) {
+        if (!makeStatusLocked(*item).isFinished()) {
+            item->cancelRequested = true;
+            item->interrupted = true;
+            updateItemStateLocked(*item);
+        }
+    }
+    m_cv.notify_all();
+}
+
+void TransferManager::waitIdle() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cv.wait(lock, [this]() { return m_busyWorkers == 0; });
+    }
+
+    // 検証待ちのファイルは未実行に戻る（再開時に転送済みの部分を照合して続きから送る）
+    m_verifier->cancelAll();
+}
+
+void TransferManager::resumeInterrupted() {
+    if (!m_connection) return;
+    std::string endpoint = m_connection->endpoint();
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // 切断で中断した項目と、回線断で失敗した項目をやり直す
+        // （権限・容量不足などの失敗は何度やっても同じなので手動の再試行に任せる）
+        for (auto& item : m_items) {
+            if (item->endpoint != endpoint || !item->interrupted) continue;
+            if (item->state == TransferState::Failed) {
+                if (item->autoRetries >= kMaxAutoRetries) {
+                    item->interrupted = false;
+                    m_journal.remove(journalEntry(*item));
+                    std::cerr << "自動再開の上限に達しました: " << item->source << std::endl;
+                    continue;
+                }
+                item->autoRetries++;
+                resetForRetryLocked(*item);
+            } else if (item->state == TransferState::Cancelled) {
+                resetForRetryLocked(*item);
+            }
+        }
+
+        // 前回の起動で終わらなかった転送を一覧に戻す
+        for (const auto& entry : m_journal.entriesFor(endpoint)) {
+            bool listed = std::any_of(m_items.begin(), m_items.end(), [&](const std::unique_ptr<Item>& item) {
+                return item->endpoint == entry.endpoint &&
+                       (item->direction == TransferDirection::Upload) == entry.upload &&
+                       item->source == entry.source && item->destination == entry.destination;
+            });
+            if (listed) continue;
+
+            auto item = std::make_unique<Item>();
+            item->id = m_nextId++;
+            item->direction = entry.upload ? TransferDirection::Upload : TransferDirection::Download;
+            item->name = baseName(entry.source);
+            item->source = entry.source;
+            item->destination = entry.destination;
+            item->isDir = entry.isDir;
+            item->endpoint = entry.endpoint;
+            item->sync = entry.sync;
+            item->syncOptions.compareHashes = entry.syncHashes;
+            item->archive = m_archiveEnabled && entry.isDir && !entry.sync;
+            item->compress = m_archiveCompress;
+            item->verify = m_verifyEnabled;
+            item->restored = true;
+            std::cout << "未完了の転送を再開します: " << entry.source << " -> " << entry.destination << std::endl;
+            m_items.push_back(std::move(item));
+        }
+    }
+    m_cv.notify_all();
+}
+
+std::vector<TransferItemStatus> TransferManager::snapshot() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto now = std::chrono::steady_clock::now();
+
+    std::vector<TransferItemStatus> result;
+    result.reserve(m_items.size());
+    for (auto& item : m_items) {
+        uint64_t bytes = item->transferred.load();
+        if (item->state == TransferState::Running) {
+            if (item->sampleTime == std::chrono::steady_clock::time_point()) {
+                item->sampleTime = now;
+                item->sampleBytes = bytes;
+            } else {
+                double elapsedMs = std::chrono::duration<double, std::milli>(now - item->sampleTime).count();
+                if (elapsedMs >= kRateSampleMs) {
+                    // 再試行で巻き戻った場合は0とみなす
+                    int64_t delta = static_cast<int64_t>(bytes - item->sampleBytes);
+                    double bps = delta > 0 ? static_cast<double>(delta) * 1000.0 / elapsedMs : 0.0;
+                    item->bytesPerSecond = (item->bytesPerSecond <= 0.0) ? bps : (item->bytesPerSecond * 0.6 + bps * 0.4);
+                    item->sampleTime = now;
+                    item->sampleBytes = bytes;
+                }
+            }
+        } else {
+            item->sampleTime = std::chrono::steady_clock::time_point();
+            item->bytesPerSecond = 0.0;
+        }
+        result.push_back(makeStatusLocked(*item));
+    }
+    return result;
+}
+
+std::vector<TransferItemStatus> TransferManager::takeFinished() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::vector<TransferItemStatus> result;
+    for (auto& item : m_items) {
+        TransferItemStatus status = makeStatusLocked(*item);
+        if (status.isFinished() && !item->finishedReported) {
+            item->finishedReported = true;
+            result.push_back(std::move(status));
+        }
+    }
+    return result;
+}
+
+bool TransferManager::hasActive() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& item : m_items) {
+        if (!makeStatusLocked(*item).isFinished()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TransferManager::workerLoop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true) {
+        Item* item = nullptr;
+        size_t fileIndex = 0;
+        bool needScan = false;
+
+        m_cv.wait(lock, [&]() {
+            return m_stopping || pickWorkLocked(item, fileIndex, needScan);
+        });
+        if (m_stopping) {
+            return;
+        }
+
+        m_busyWorkers++;
+
+        if (needScan) {
+            item->scanning = true;
+            updateItemStateLocked(*item);
+            lock.unlock();
+
+            std::vector<FileJob> files;
+            std::string error;
+            bool ok = scanItem(*item, files, error);
+
+            lock.lock();
+            item->scanning = false;
+            if (ok) {
+                item->totalBytes = 0;
+                for (const auto& job : files) {
+                    item->totalBytes += job.size;
+                }
+                // 前回の起動で終わらなかった項目は途中ファイルの続きから送る（同期は計画どおり送り直す）
+                if (item->restored && !item->sync) {
+                    for (auto& job : files) {
+                        job.resume = !job.archive;
+                    }
+                }
+                item->files = std::move(files);
+                item->nextFile = 0;
+                item->expanded = true;
+            } else if (!item->cancelRequested) {
+                item->error = error;
+                item->interrupted = !m_connection->isConnected();
+                std::cerr << "転送準備失敗: " << item->source << " - " << error << std::endl;
+            }
+        } else {
+            FileJob& job = item->files[fileIndex];
+            job.state = FileJob::State::Running;
+            job.reported = 0;
+            item->running++;
+            updateItemStateLocked(*item);
+            lock.unlock();
+
+            std::string error;
+            bool ok = runFileJob(*item, job, error);
+
+            lock.lock();
+            item->running--;
+            if (ok) {
+                // 走査時からサイズが変わっていた場合は合計を補正
+                item->totalBytes = item->totalBytes - job.size + job.reported;
+                job.size = job.reported;
+                if (shouldVerify(*item, job)) {
+                    // 検証は専用スレッドに任せ、このワーカーは次のファイルへ進む
+                    job.state = FileJob::State::Verifying;
+                    item->verifying++;
+
+                    TransferVerifier::Request request;
+                    request.itemId = item->id;
+                    request.fileIndex = fileIndex;
+                    request.upload = (item->direction == TransferDirection::Upload);
+                    request.localPath = request.upload ? job.source : job.destination;
+                    request.remotePath = request.upload ? job.destination : job.source;
+                    request.local = std::move(job.digest);
+                    m_verifier->submit(std::move(request));
+                } else {
+                    job.state = FileJob::State::Done;
+                    item->completedFiles++;
+                }
+            } else {
+                job.digest.reset();
+                item->transferred -= job.reported;
+                job.reported = 0;
+                if (item->cancelRequested || item->pauseRequested || m_stopping) {
+                    // 再開・再試行で続きから送れるよう未実行に戻す
+                    job.state = FileJob::State::Pending;
+                    job.resume = !job.archive && !job.delta;
+                    item->nextFile = std::min(item->nextFile, fileIndex);
+                } else {
+                    job.state = FileJob::State::Failed;
+                    item->failedFiles++;
+                    item->error = error;
+                    // 接続が切れていたなら再接続時に自動でやり直す
+                    item->interrupted = item->interrupted || !m_connection->isConnected();
+                    if (item->interrupted) {
+                        job.resume = !job.archive && !job.delta;
+                    }
+                    std::cerr << "転送失敗: " << job.source << " - " << error << std::endl;
+                }
+            }
+        }
+
+        updateItemStateLocked(*item);
+        m_busyWorkers--;
+        m_cv.notify_all();
+    }
+}
+
+bool TransferManager::pickWorkLocked(Item*& item, size_t& fileIndex, bool& needScan) {
+    // 優先度の高い項目から、同じ優先度の中では登録順に処理し、先頭の項目のファイルを複数ワーカーで並列に転送する
+    for (TransferPriority level : {TransferPriority::High, TransferPriority::Normal, TransferPriority::Low}) {
+        if (pickWorkLocked(level, item, fileIndex, needScan)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TransferManager::pickWorkLocked(TransferPriority level, Item*& item, size_t& fileIndex, bool& needScan) {
+    for (auto& candidate : m_items) {
+        if (candidate->priority != level) continue;
+        if (candidate->cancelRequested || candidate->pauseRequested) continue;
+        if (!candidate->error.empty() && !candidate->expanded) continue;  // 走査失敗
+
+        if (!candidate->expanded) {
+            if (!candidate->scanning) {
+                item = candidate.get();
+                needScan = true;
+                return true;
+            }
+            continue;
+        }
+
+        auto& files = candidate->files;
+        for (size_t i = candidate->nextFile; i < files.size(); ++i) {
+            if (files[i].state == FileJob::State::Pending) {
+                candidate->nextFile = i + 1;
+                item = candidate.get();
+                fileIndex = i;
+                needScan = false;
+                return true;
+            }
+        }
+        candidate->nextFile = files.size();
+    }
+    return false;
+}
+
+bool TransferManager::scanItem(Item& item, std::vector<FileJob>& files, std::string& error) {
+    if (!m_connection || !m_connection->isConnected()) {
+        error = "未接続";
+        return false;
+    }
+    if (item.direction == TransferDirection::Upload) {
+        return scanLocalTree(item, files, error);
+    }
+    return scanRemoteTree(item, files, error);
+}
+
+bool TransferManager::scanLocalTree(Item& item, std::vector<FileJob>& files, std::string& error) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+
+    if (item.sync && item.isDir) {
+        return scanSyncTree(item, files, error);
+    }
+    if (item.archive && item.isDir && planArchiveJob(item, files)) {
+        return true;
+    }
+
+    if (!item.isDir) {
+        FileJob job;
+        job.source = item.source;
+        job.destination = item.destination;
+        job.size = fs::file_size(item.source, ec);
+        if (ec) {
+            error = "ローカルファイルを開けません: " + item.source;
+            return false;
+        }
+        files.push_back(std::move(job));
+        return true;
+    }
+
+    // ディレクトリは親から順に並ぶ（作成順序をそのまま使える）
+    std::vector<std::string> directories;
+    directories.push_back(item.destination);
+
+    fs::path root(item.source);
+    fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec);
+    fs::recursive_directory_iterator end;
+    for (; !ec && it != end; it.increment(ec)) {
+        if (item.cancelRequested) {
+            error = "転送が中断されました";
+            return false;
+        }
+
+        std::string rel = it->path().lexically_relative(root).generic_string();
+        std::string remotePath = DirectorySync::joinRemote(item.destination, rel);
+
+        std::error_code typeEc;
+        if (it->is_directory(typeEc)) {
+            directories.push_back(remotePath);
+        } else if (it->is_regular_file(typeEc)) {
+            FileJob job;
+            job.source = it->path().string();
+            job.destination = remotePath;
+            job.size = it->file_size(typeEc);
+            files.push_back(std::move(job));
+        }
+    }
+    if (ec) {
+        error = "ローカルディレクトリ走査エラー: " + item.source;
+        return false;
+    }
+
+    return m_connection->makeRemoteDirectories(directories, error);
+}
+
+bool TransferManager::scanSyncTree(Item& item, std::vector<FileJob>& files, std::string& error) {
+    DirectorySync sync(m_connection);
+    SyncPlan plan;
+    if (!sync.plan(item.source, item.destination, item.syncOptions, plan, error,
+                   [&item]() { return !item.cancelRequested; })) {
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        item.report = plan.report();
+    }
+    if (item.dryRun) {
+        return true;
+    }
+
+    for (const auto& entry : plan.files) {
+        if (entry.action == SyncAction::Skip) continue;
+        FileJob job;
+        job.source = entry.localPath;
+        job.destination = entry.remotePath;
+        job.size = entry.size;
+        job.delta = (entry.action == SyncAction::Delta);
+        job.resume = false;
+        job.mtime = entry.mtime;
+        files.push_back(std::move(job));
+    }
+
+    return m_connection->makeRemoteDirectories(plan.directories, error);
+}
+
+bool TransferManager::planArchiveJob(Item& item, std::vector<FileJob>& files) {
+    TarTransport tar(m_connection);
+    int fileCount = 0;
+    uint64_t totalBytes = 0;
+
+    if (item.direction == TransferDirection::Upload) {
+        namespace fs = std::filesystem;
+        std::error_code ec;
+        fs::recursive_directory_iterator it(item.source, fs::directory_options::skip_permission_denied, ec);
+        fs::recursive_directory_iterator end;
+        for (; !ec && it != end; it.increment(ec)) {
+            std::error_code typeEc;
+            if (it->is_regular_file(typeEc)) {
+                fileCount++;
+                totalBytes += it->file_size(typeEc);
+            }
+        }
+        if (ec || fileCount < kArchiveMinFiles || !tar.remoteHasTar()) {
+            return false;
+        }
+    } else {
+        if (!tar.remoteHasTar()) {
+            std::cout << "リモートにtarが無いためSFTPで転送します: " << item.source << std::endl;
+            return false;
+        }
+        // ファイル数が取得できない場合（0）はtarを使う
+        tar.remoteTreeSize(item.source, fileCount, totalBytes);
+        if (fileCount > 0 && fileCount < kArchiveMinFiles) {
+            return false;
+        }
+    }
+
+    FileJob job;
+    job.source = item.source;
+    job.destination = item.destination;
+    job.size = totalBytes;
+    job.archive = true;
+    job.resume = false;
+    files.push_back(std::move(job));
+    return true;
+}
+
+bool TransferManager::scanRemoteTree(Item& item, std::vector<FileJob>& files, std::string& error) {
+    namespace fs = std::filesystem;
+
+    if (!item.isDir) {
+        FileJob job;
+        job.source = item.source;
+        job.destination = item.destination;
+        RemoteEntry entry;
+        if (m_connection->statRemote(item.source, entry)) {
+            job.size = entry.size;
+        }
+        files.push_back(std::move(job));
+        return true;
+    }
+
+    if (item.archive && planArchiveJob(item, files)) {
+        return true;
+    }
+
+    // 幅優先でリモートツリーを一覧し、ローカルのディレクトリを先に作る
+    std::deque<std::pair<std::string, fs::path>> pending;
+    pending.emplace_back(item.source, fs::path(item.destination));
+
+    while (!pending.empty()) {
+        if (item.cancelRequested) {
+            error = "転送が中断されました";
+            return false;
+        }
+
+        auto [remoteDir, localDir] = pending.front();
+        pending.pop_front();
+
+        std::error_code ec;
+        fs::create_directories(localDir, ec);
+        if (ec) {
+            error = "ローカルディレクトリ作成失敗: " + localDir.string();
+            return false;
+        }
+
+        std::vector<RemoteEntry> entries;
+        if (!m_connection->listDirectory(remoteDir, entries)) {
+            error = m_connection->lastError();
+            return false;
+        }
+
+        for (const auto& entry : entries) {
+            std::string remotePath = DirectorySync::joinRemote(remoteDir, entry.name);
+            fs::path localPath = localDir / entry.name;
+            if (entry.isDir) {
+                pending.emplace_back(remotePath, localPath);
+            } else {
+                FileJob job;
+                job.source = remotePath;
+                job.destination = localPath.string();
+                job.size = entry.size;
+                files.push_back(std::move(job));
+            }
+        }
+    }
+
+    return true;
+}
+
+bool TransferManager::runFileJob(Item& item, FileJob& job, std::string& error) {
+    // このワーカーがセッションロックを待つときの優先度（転送中の変更はcheckpointで反映）
+    SessionLock::PriorityScope priority(sessionPriority(item.priority));
+
+    TransferHooks hooks;
+    // 前回の途中ファイルがあれば照合して続きから転送する
+    hooks.resume = job.resume;
+    hooks.rateLimiter = &m_rateLimiter;
+    hooks.onProgress = [&item, &job](uint64_t bytes) {
+        // セッション再作成で0から数え直すこともあるので差分で加算（減算は符号なしの巻き戻しで表現）
+        item.transferred += bytes - job.reported;
+        job.reported = bytes;
+    };
+    // 一時停止もここで打ち切る（待つとセッションとワーカーを握ったままになり、後ろの転送が進まない）
+    // 打ち切ったファイルは未実行に戻り、再開時に転送済みの部分を照合して続きから送る
+    hooks.checkpoint = [this, &item]() {
+        SessionLock::setThreadPriority(sessionPriority(item.priority));
+        return !item.cancelRequested && !item.pauseRequested && !m_stopping;
+    };
+
+    if (job.archive) {
+        TarTransport tar(m_connection);
+        if (item.direction == TransferDirection::Upload) {
+            return tar.upload(job.source, job.destination, item.compress, hooks, error);
+        }
+        return tar.download(job.source, job.destination, item.compress, hooks, error);
+    }
+
+    if (item.direction == TransferDirection::Download) {
+        return m_connection->downloadFile(job.source, job.destination, hooks, error);
+    }
+
+    // ローカルのハッシュは送信と並行して計算しておく
+    if (shouldVerify(item, job)) {
+        job.digest = m_verifier->hashLocal(job.source);
+    }
+
+    bool ok;
+    if (job.delta) {
+        DirectorySync sync(m_connection);
+        ok = sync.deltaUpload(job.source, job.destination, hooks, error);
+    } else {
+        ok = m_connection->uploadFile(job.source, job.destination, hooks, error);
+    }
+    // 次回の同期で変更なしと判定できるよう更新時刻を合わせる
+    if (ok && job.mtime != 0) {
+        m_connection->setRemoteMtime(job.destination, job.mtime);
+    }
+    return ok;
+}
+
+SessionPriority TransferManager::sessionPriority(TransferPriority priority) {
+    switch (priority) {
+        case TransferPriority::High: return SessionPriority::BulkHigh;
+        case TransferPriority::Normal: return SessionPriority::BulkNormal;
+        case TransferPriority::Low: return SessionPriority::BulkLow;
+    }
+    return SessionPriority::BulkNormal;
+}
+
+bool TransferManager::shouldVerify(const Item& item, const FileJob& job) {
+    return item.verify && !job.archive && !job.delta;
+}
+
+void TransferManager::onVerified(const TransferVerifier::Request& request, VerifyResult result,
+                                 const std::string& error) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Item* item = findItemLocked(request.itemId);
+        if (!item || request.fileIndex >= item->files.size()) return;
+        FileJob& job = item->files[request.fileIndex];
+        if (job.state != FileJob::State::Verifying) return;
+        item->verifying--;
+
+        switch (result) {
+            case VerifyResult::Verified:
+            case VerifyResult::Repaired:
+            case VerifyResult::Unavailable:
+                job.state = FileJob::State::Done;
+                item->completedFiles++;
+                break;
+            case VerifyResult::Failed:
+                // 再試行では末尾の照合で続きからにせず、最初から送り直す
+                item->transferred -= job.reported;
+                job.reported = 0;
+                job.resume = false;
+                job.state = FileJob::State::Failed;
+                item->failedFiles++;
+                item->error = error;
+                break;
+            case VerifyResult::Cancelled:
+                item->transferred -= job.reported;
+                job.reported = 0;
+                job.state = FileJob::State::Pending;
+                item->nextFile = std::min(item->nextFile, request.fileIndex);
+                break;
+        }
+        updateItemStateLocked(*item);
+    }
+    m_cv.notify_all();
+}
+
+void TransferManager::updateItemStateLocked(Item& item) {
+    TransferState previous = item.state;
+
+    if (item.scanning) {
+        item.state = TransferState::Scanning;
+    } else if (item.running > 0) {
+        item.state = item.pauseRequested ? TransferState::Paused : TransferState::Running;
+    } else if (item.cancelRequested) {
+        item.state = TransferState::Cancelled;
+    } else if (!item.expanded) {
+        if (!item.error.empty()) {
+            item.state = TransferState::Failed;
+        } else {
+            item.state = item.pauseRequested ? TransferState::Paused : TransferState::Queued;
+        }
+    } else {
+        bool hasPending = std::any_of(item.files.begin(), item.files.end(), [](const FileJob& job) {
+            return job.state == FileJob::State::Pending;
+        });
+        if (hasPending) {
+            item.state = item.pauseRequested ? TransferState::Paused : TransferState::Running;
+        } else if (item.verifying > 0) {
+            item.state = TransferState::Verifying;
+        } else {
+            item.state = item.failedFiles > 0 ? TransferState::Failed : TransferState::Completed;
+        }
+    }
+
+    if (item.state != previous && item.state == TransferState::Completed) {
+        m_journal.remove(journalEntry(item));
+        std::cout << "転送完了: " << item.name << "（" << item.completedFiles << " ファイル）" << std::endl;
+    }
+    // 回線断以外の失敗は次回の起動でも再開しない（手動の再試行でジャーナルに戻る）
+    if (item.state != previous && item.state == TransferState::Failed && !item.interrupted) {
+        m_journal.remove(journalEntry(item));
+    }
+}
+
+TransferJournalEntry TransferManager::journalEntry(const Item& item) const {
+    TransferJournalEntry entry;
+    entry.endpoint = item.endpoint;
+    entry.upload = (item.direction == TransferDirection::Upload);
+    entry.source = item.source;
+    entry.destination = item.destination;
+    entry.isDir = item.isDir;
+    entry.sync = item.sync;
+    entry.syncHashes = item.syncOptions.compareHashes;
+    return entry;
+}
+
+TransferManager::Item* TransferManager::findItemLocked(int id) {
+    for (auto& item : m_items) {
+        if (item->id == id) {
+            return item.get();
+        }
+    }
+    return nullptr;
+}
+
+TransferItemStatus TransferManager::makeStatusLocked(const Item& item) const {
+    TransferItemStatus status;
+    status.id = item.id;
+    status.direction = item.direction;
+    status.state = item.state;
+    status.name = item.name;
+    status.sourcePath = item.source;
+    status.destinationPath = item.destination;
+    status.isDir = item.isDir;
+    status.sync = item.sync;
+    status.dryRun = item.dryRun;
+    status.verify = item.verify;
+    status.priority = item.priority;
+    status.report = item.report;
+    status.totalBytes = item.totalBytes;
+    status.transferredBytes = item.transferred.load();
+    status.totalFiles = static_cast<int>(item.files.size());
+    status.completedFiles = item.completedFiles;
+    status.failedFiles = item.failedFiles;
+    status.verifyingFiles = item.verifying;
+    status.bytesPerSecond = item.bytesPerSecond;
+    status.error = item.error;
+
+    if (status.bytesPerSecond > 0.0 && status.totalBytes > status.transferredBytes) {
+        status.etaSeconds = static_cast<double>(status.totalBytes - status.transferredBytes) / status.bytesPerSecond;
+    } else if (status.state == TransferState::Running && status.totalBytes <= status.transferredBytes) {
+        status.etaSeconds = 0.0;
+    }
+    return status;
+}
+
+} // namespace pbterm
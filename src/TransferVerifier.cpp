@@ -0,0 +1,576 @@
+#include "TransferVerifier.h"
+#include "SshConnection.h"
+#include "SftpTransfer.h"
+#include "Sha256.h"
+#include "Xxh64.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace pbterm {
+
+// ローカルファイルのチャンクごとのハッシュ（ハッシュ用スレッドが埋めていく）
+struct LocalDigest {
+    VerifyAlgorithm algorithm = VerifyAlgorithm::None;
+    uint64_t size = 0;
+    uint64_t chunkSize = 0;
+    std::vector<std::string> chunks;
+    int remaining = 0;
+    bool failed = false;
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+namespace {
+
+// チャンクサイズ（1ファイルを最大kMaxChunks個に分割、不一致時はこの単位で再転送する）
+constexpr uint64_t kMinChunkSize = 4 * 1024 * 1024;
+constexpr uint64_t kMaxChunkSize = 64 * 1024 * 1024;
+constexpr uint64_t kMaxChunks = 1024;
+
+// 不一致のチャンクを再転送して比較し直す回数
+constexpr int kMaxRepairRounds = 2;
+
+// ローカルのハッシュを待つ間に中断・終了を確かめる間隔（ハッシュの完了以外は通知されない）
+constexpr auto kCancelCheckInterval = std::chrono::milliseconds(100);
+
+// ローカルのハッシュ計算スレッド数の上限
+constexpr unsigned kMaxHashThreads = 8;
+constexpr size_t kHashReadSize = 1024 * 1024;
+
+// 1回のexecに渡すコマンドラインの上限（ARG_MAXより十分小さく）
+constexpr size_t kMaxCommandLength = 64 * 1024;
+
+constexpr int kDetectTimeoutMs = 10000;
+constexpr int kHashTimeoutMs = 120000;
+
+// xxhsumがあればXXH64、無ければSHA-256（macOSはshasum）
+const char* kDetectCommand =
+    "if command -v xxh64sum >/dev/null 2>&1 || command -v xxhsum >/dev/null 2>&1; then echo xxh64; "
+    "elif command -v sha256sum >/dev/null 2>&1 || command -v shasum >/dev/null 2>&1; then echo sha256; "
+    "else echo none; fi";
+const char* kXxh64Setup =
+    "if command -v xxh64sum >/dev/null 2>&1; then H=xxh64sum; else H='xxhsum -H1'; fi; ";
+const char* kSha256Setup =
+    "if command -v sha256sum >/dev/null 2>&1; then H=sha256sum; else H='shasum -a 256'; fi; ";
+
+// v 番号 ファイル名 チャンクサイズ 先頭 終端: サイズとチャンクごとのハッシュを出力する
+const char* kChunkFunction =
+    "v() { echo \"$1 s $(wc -c < \"$2\")\"; i=$4; while [ $i -lt $5 ]; do "
+    "echo \"$1 $i $(dd if=\"$2\" bs=$3 skip=$i count=1 2>/dev/null | $H | cut -d' ' -f1)\"; "
+    "i=$((i+1)); done; }; ";
+
+std::string shellQuote(const std::string& s) {
+    std::string out = "'";
+    for (char c : s) {
+        if (c == '\'') {
+            out += "'\\''";
+        } else {
+            out += c;
+        }
+    }
+    out += "'";
+    return out;
+}
+
+std::string toLower(std::string s) {
+    for (char& c : s) {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    return s;
+}
+
+uint64_t chooseChunkSize(uint64_t size) {
+    uint64_t chunk = (size + kMaxChunks - 1) / kMaxChunks;
+    chunk = (chunk + kMinChunkSize - 1) / kMinChunkSize * kMinChunkSize;
+    return std::clamp(chunk, kMinChunkSize, kMaxChunkSize);
+}
+
+// リモートパスを親ディレクトリと名前に分ける
+void splitRemote(const std::string& path, std::string& dir, std::string& name) {
+    size_t pos = path.find_last_of("/\\");
+    if (pos == std::string::npos) {
+        dir = ".";
+        name = path;
+    } else {
+        dir = (pos == 0) ? path.substr(0, 1) : path.substr(0, pos);
+        name = path.substr(pos + 1);
+    }
+}
+
+// ローカルファイルの範囲のハッシュ（読み取り失敗時は空文字列）
+std::string hashRange(const std::string& path, uint64_t offset, uint64_t length, VerifyAlgorithm algorithm) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return "";
+    }
+
+    Xxh64 xxh;
+    Sha256 sha;
+    std::vector<char> buffer(static_cast<size_t>(std::min<uint64_t>(length, kHashReadSize)));
+    uint64_t done = 0;
+    bool ok = true;
+    while (done < length) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(buffer.size(), length - done));
+        ssize_t n = pread(fd, buffer.data(), want, static_cast<off_t>(offset + done));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            ok = false;
+            break;
+        }
+        if (algorithm == VerifyAlgorithm::Xxh64) {
+            xxh.update(buffer.data(), static_cast<size_t>(n));
+        } else {
+            sha.update(buffer.data(), static_cast<size_t>(n));
+        }
+        done += static_cast<uint64_t>(n);
+    }
+    ::close(fd);
+
+    if (!ok) {
+        return "";
+    }
+    return algorithm == VerifyAlgorithm::Xxh64 ? xxh.hexDigest() : sha.hexDigest();
+}
+
+uint64_t chunkLength(const LocalDigest& digest, size_t chunk) {
+    uint64_t offset = chunk * digest.chunkSize;
+    return std::min(digest.chunkSize, digest.size - offset);
+}
+
+} // namespace
+
+TransferVerifier::TransferVerifier(SshConnection* connection, ResultCallback onResult)
+    : m_connection(connection), m_onResult(std::move(onResult))
+{
+    unsigned count = std::clamp(std::thread::hardware_concurrency(), 2u, kMaxHashThreads);
+    for (unsigned i = 0; i < count; ++i) {
+        m_hashThreads.emplace_back(&TransferVerifier::hashThread, this);
+    }
+    m_verifyThread = std::thread(&TransferVerifier::verifyThread, this);
+}
+
+TransferVerifier::~TransferVerifier() {
+    m_stopping = true;
+    {
+        std::lock_guard<std::mutex> lock(m_hashMutex);
+    }
+    m_hashCv.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_cv.notify_all();
+
+    // ハッシュ用スレッドは残りのタスクを失敗扱いにしてから終わる（検証スレッドの待ちが解ける）
+    for (auto& thread : m_hashThreads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    if (m_verifyThread.joinable()) {
+        m_verifyThread.join();
+    }
+}
+
+VerifyAlgorithm TransferVerifier::algorithm() {
+    std::lock_guard<std::mutex> lock(m_algorithmMutex);
+    std::string endpoint = m_connection ? m_connection->endpoint() : std::string();
+    if (!m_algorithmEndpoint.empty() && endpoint == m_algorithmEndpoint) {
+        return m_algorithm;
+    }
+    if (!m_connection || !m_connection->isConnected()) {
+        return VerifyAlgorithm::None;
+    }
+
+    std::string out = m_connection->exec(kDetectCommand, kDetectTimeoutMs);
+    if (out.find("xxh64") != std::string::npos) {
+        m_algorithm = VerifyAlgorithm::Xxh64;
+    } else if (out.find("sha256") != std::string::npos) {
+        m_algorithm = VerifyAlgorithm::Sha256;
+    } else if (out.find("none") != std::string::npos) {
+        m_algorithm = VerifyAlgorithm::None;
+        std::cout << "リモートにハッシュコマンドが無いため転送の検証を行いません" << std::endl;
+    } else {
+        // 調べられなかった場合は次回もう一度試す
+        return VerifyAlgorithm::None;
+    }
+    m_algorithmEndpoint = endpoint;
+    return m_algorithm;
+}
+
+std::shared_ptr<LocalDigest> TransferVerifier::hashLocal(const std::string& path) {
+    auto digest = std::make_shared<LocalDigest>();
+    digest->algorithm = algorithm();
+
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        digest->failed = true;
+        return digest;
+    }
+    digest->size = static_cast<uint64_t>(st.st_size);
+    digest->chunkSize = chooseChunkSize(digest->size);
+    if (digest->algorithm == VerifyAlgorithm::None) {
+        return digest;
+    }
+
+    size_t count = static_cast<size_t>((digest->size + digest->chunkSize - 1) / digest->chunkSize);
+    digest->chunks.resize(count);
+    digest->remaining = static_cast<int>(count);
+    if (count == 0) {
+        return digest;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_hashMutex);
+        // 終了処理に入った後はハッシュ用スレッドが拾わないので積まない（待つ側がremainingを待ち続けないように）
+        if (m_stopping) {
+            digest->failed = true;
+            digest->remaining = 0;
+            return digest;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            m_hashQueue.push_back({digest, path, i});
+        }
+    }
+    m_hashCv.notify_all();
+    return digest;
+}
+
+void TransferVerifier::hashThread() {
+    std::unique_lock<std::mutex> lock(m_hashMutex);
+    while (true) {
+        m_hashCv.wait(lock, [this]() { return m_stopping || !m_hashQueue.empty(); });
+        if (m_hashQueue.empty()) {
+            return;
+        }
+        HashTask task = std::move(m_hashQueue.front());
+        m_hashQueue.pop_front();
+        lock.unlock();
+
+        LocalDigest& digest = *task.digest;
+        std::string hash;
+        if (!m_stopping) {
+            hash = hashRange(task.path, task.chunk * digest.chunkSize, chunkLength(digest, task.chunk),
+                             digest.algorithm);
+        }
+        {
+            std::lock_guard<std::mutex> digestLock(digest.mutex);
+            digest.chunks[task.chunk] = hash;
+            if (hash.empty()) {
+                digest.failed = true;
+            }
+            digest.remaining--;
+        }
+        digest.cv.notify_all();
+
+        lock.lock();
+    }
+}
+
+void TransferVerifier::submit(Request request) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.push_back(std::move(request));
+    }
+    m_cv.notify_all();
+}
+
+void TransferVerifier::cancelAll() {
+    std::vector<Request> dropped;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_generation++;
+        dropped.swap(m_pending);
+        m_cv.wait(lock, [this]() { return !m_busy || m_stopping; });
+    }
+    for (const auto& request : dropped) {
+        m_onResult(request, VerifyResult::Cancelled, "");
+    }
+}
+
+bool TransferVerifier::cancelled(uint64_t generation) const {
+    return m_stopping || m_generation != generation;
+}
+
+void TransferVerifier::verifyThread() {
+    // リモートのハッシュ計算と修復の転送は、通常の転送と同じ優先度でセッションを使う
+    SessionLock::PriorityScope priority(SessionPriority::BulkNormal);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_cv.wait(lock, [this]() { return m_stopping || !m_pending.empty(); });
+        if (m_stopping) {
+            // 検証待ちのまま残さない（転送側は未実行に戻し、次回の再開で照合して続きから送る）
+            std::vector<Request> dropped;
+            dropped.swap(m_pending);
+            lock.unlock();
+            for (const auto& request : dropped) {
+                m_onResult(request, VerifyResult::Cancelled, "");
+            }
+            return;
+        }
+
+        // 前回の検証中に転送が終わったファイルをまとめて検証する
+        std::vector<Request> batch;
+        batch.swap(m_pending);
+        uint64_t generation = m_generation;
+        m_busy = true;
+        lock.unlock();
+
+        verifyBatch(batch, generation);
+
+        lock.lock();
+        m_busy = false;
+        m_cv.notify_all();
+    }
+}
+
+void TransferVerifier::verifyBatch(std::vector<Request>& batch, uint64_t generation) {
+    VerifyAlgorithm algo = algorithm();
+    if (algo == VerifyAlgorithm::None) {
+        for (const auto& request : batch) {
+            m_onResult(request, VerifyResult::Unavailable, "");
+        }
+        return;
+    }
+
+    // ダウンロードしたファイルのハッシュはここで計算し始め、リモートの計算と並行させる
+    for (auto& request : batch) {
+        if (!request.local || request.local->algorithm != algo) {
+            request.local = hashLocal(request.localPath);
+        }
+    }
+
+    std::map<std::string, std::vector<size_t>> groups;
+    std::vector<std::string> names(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        std::string dir;
+        splitRemote(batch[i].remotePath, dir, names[i]);
+        groups[dir].push_back(i);
+    }
+
+    std::vector<bool> reported(batch.size(), false);
+    auto report = [&](size_t index, VerifyResult result, const std::string& error) {
+        reported[index] = true;
+        if (result == VerifyResult::Failed) {
+            std::cerr << "検証失敗: " << batch[index].remotePath << " - " << error << std::endl;
+        }
+        m_onResult(batch[index], result, error);
+    };
+
+    TransferHooks hooks;
+    hooks.checkpoint = [this, generation]() { return !cancelled(generation); };
+
+    for (auto& [dir, indices] : groups) {
+        if (cancelled(generation)) break;
+
+        // 1. ディレクトリ内のファイルの全チャンクをリモートでまとめて計算
+        std::vector<Request*> files;
+        std::vector<std::vector<size_t>> chunks;
+        for (size_t index : indices) {
+            files.push_back(&batch[index]);
+            std::vector<size_t> all(batch[index].local->chunks.size());
+            for (size_t c = 0; c < all.size(); ++c) all[c] = c;
+            chunks.push_back(std::move(all));
+        }
+        std::vector<RemoteChunks> remote;
+        if (!remoteChunkHashes(dir, files, chunks, remote, generation)) {
+            if (cancelled(generation)) break;
+            for (size_t index : indices) {
+                report(index, VerifyResult::Failed, "リモートのハッシュを取得できません");
+            }
+            continue;
+        }
+
+        // 2. ローカルのハッシュの完了を待って比較
+        std::vector<std::vector<size_t>> mismatched(indices.size());
+        std::vector<bool> done(indices.size(), false);
+        for (size_t k = 0; k < indices.size(); ++k) {
+            LocalDigest& digest = *files[k]->local;
+            {
+                std::unique_lock<std::mutex> lock(digest.mutex);
+                while (digest.remaining > 0 && !cancelled(generation)) {
+                    digest.cv.wait_for(lock, kCancelCheckInterval);
+                }
+            }
+            if (cancelled(generation)) break;
+
+            if (digest.failed) {
+                report(indices[k], VerifyResult::Failed, "ローカルファイルのハッシュを計算できません");
+                done[k] = true;
+            } else if (!remote[k].sizeKnown || remote[k].size != digest.size) {
+                report(indices[k], VerifyResult::Failed, "サイズが一致しません");
+                done[k] = true;
+            } else {
+                for (size_t c = 0; c < digest.chunks.size(); ++c) {
+                    if (remote[k].chunks[c] != digest.chunks[c]) {
+                        mismatched[k].push_back(c);
+                    }
+                }
+            }
+        }
+
+        // 3. 一致しなかったチャンクだけを再転送して比較し直す
+        std::vector<bool> repaired(indices.size(), false);
+        for (int round = 0; round < kMaxRepairRounds && !cancelled(generation); ++round) {
+            std::vector<Request*> retryFiles;
+            std::vector<std::vector<size_t>> retryChunks;
+            std::vector<size_t> retryIndex;
+            for (size_t k = 0; k < indices.size(); ++k) {
+                if (done[k] || mismatched[k].empty()) continue;
+
+                Request& request = *files[k];
+                LocalDigest& digest = *request.local;
+                std::cout << "チャンク不一致のため再転送します: " << request.remotePath << "（"
+                          << mismatched[k].size() << " / " << digest.chunks.size() << "）" << std::endl;
+
+                std::string error;
+                bool sent = true;
+                for (size_t c : mismatched[k]) {
+                    uint64_t offset = c * digest.chunkSize;
+                    if (!m_connection->transferRange(request.upload, request.localPath, request.remotePath,
+                                                     offset, chunkLength(digest, c), hooks, error)) {
+                        sent = false;
+                        break;
+                    }
+                    // ダウンロードはローカル側が書き換わったので計算し直す
+                    if (!request.upload) {
+                        digest.chunks[c] = hashRange(request.localPath, offset, chunkLength(digest, c), algo);
+                    }
+                }
+                if (!sent) {
+                    if (cancelled(generation)) break;
+                    report(indices[k], VerifyResult::Failed, error);
+                    done[k] = true;
+                    continue;
+                }
+                repaired[k] = true;
+                retryFiles.push_back(files[k]);
+                retryChunks.push_back(mismatched[k]);
+                retryIndex.push_back(k);
+            }
+            if (retryFiles.empty() || cancelled(generation)) break;
+
+            std::vector<RemoteChunks> recheck;
+            if (!remoteChunkHashes(dir, retryFiles, retryChunks, recheck, generation)) {
+                break;
+            }
+            for (size_t r = 0; r < retryFiles.size(); ++r) {
+                size_t k = retryIndex[r];
+                const LocalDigest& digest = *files[k]->local;
+                std::vector<size_t> still;
+                for (size_t c : mismatched[k]) {
+                    if (recheck[r].chunks[c] != digest.chunks[c]) {
+                        still.push_back(c);
+                    }
+                }
+                mismatched[k] = std::move(still);
+            }
+        }
+
+        if (cancelled(generation)) break;
+
+        for (size_t k = 0; k < indices.size(); ++k) {
+            if (done[k]) continue;
+            if (!mismatched[k].empty()) {
+                report(indices[k], VerifyResult::Failed,
+                       "内容が一致しません（" + std::to_string(mismatched[k].size()) + " チャンク）");
+            } else {
+                report(indices[k], repaired[k] ? VerifyResult::Repaired : VerifyResult::Verified, "");
+            }
+        }
+    }
+
+    // 中断した場合は残りを通知する
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (!reported[i]) {
+            m_onResult(batch[i], VerifyResult::Cancelled, "");
+        }
+    }
+}
+
+bool TransferVerifier::remoteChunkHashes(const std::string& remoteDir, const std::vector<Request*>& files,
+                                         const std::vector<std::vector<size_t>>& chunks,
+                                         std::vector<RemoteChunks>& results, uint64_t generation) {
+    results.assign(files.size(), RemoteChunks());
+
+    // ファイルごとの呼び出し（連続したチャンクは1回の呼び出しにまとめる）
+    std::vector<std::string> calls;
+    for (size_t k = 0; k < files.size(); ++k) {
+        const LocalDigest& digest = *files[k]->local;
+        results[k].chunks.resize(digest.chunks.size());
+
+        std::string dir, name;
+        splitRemote(files[k]->remotePath, dir, name);
+        std::string prefix = "v " + std::to_string(k) + " " + shellQuote(name) + " " +
+                             std::to_string(digest.chunkSize) + " ";
+        const std::vector<size_t>& list = chunks[k];
+        if (list.empty()) {
+            calls.push_back(prefix + "0 0; ");
+            continue;
+        }
+        size_t start = 0;
+        for (size_t i = 1; i <= list.size(); ++i) {
+            if (i == list.size() || list[i] != list[i - 1] + 1) {
+                calls.push_back(prefix + std::to_string(list[start]) + " " + std::to_string(list[i - 1] + 1) + "; ");
+                start = i;
+            }
+        }
+    }
+
+    std::string setup = (files.front()->local->algorithm == VerifyAlgorithm::Xxh64) ? kXxh64Setup : kSha256Setup;
+    std::string prefix = setup + "cd " + shellQuote(remoteDir) + " || exit 1; " + kChunkFunction;
+
+    std::string pending;
+    ExecCallbacks callbacks;
+    callbacks.onStdout = [&](const char* data, size_t len) {
+        pending.append(data, len);
+        size_t start = 0;
+        size_t pos;
+        while ((pos = pending.find('\n', start)) != std::string::npos) {
+            std::istringstream line(pending.substr(start, pos - start));
+            size_t k = 0;
+            std::string field;
+            std::string value;
+            if (line >> k >> field && k < results.size()) {
+                if (field == "s") {
+                    if (line >> value) {
+                        results[k].size = std::strtoull(value.c_str(), nullptr, 10);
+                        results[k].sizeKnown = true;
+                    }
+                } else {
+                    size_t c = std::strtoull(field.c_str(), nullptr, 10);
+                    if (c < results[k].chunks.size() && line >> value) {
+                        results[k].chunks[c] = toLower(value);
+                    }
+                }
+            }
+            start = pos + 1;
+        }
+        pending.erase(0, start);
+        return !cancelled(generation);
+    };
+
+    // 通常はディレクトリごとに1回、ファイルが非常に多い場合はコマンドライン長の上限で分ける
+    size_t index = 0;
+    while (index < calls.size()) {
+        std::string cmd = prefix;
+        while (index < calls.size() &&
+               (cmd.size() == prefix.size() || cmd.size() + calls[index].size() < kMaxCommandLength)) {
+            cmd += calls[index];
+            ++index;
+        }
+        pending.clear();
+        if (m_connection->execStream(cmd, callbacks, kHashTimeoutMs) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace pbterm
@@ -0,0 +1,399 @@
+#include "TriggerEngine.h"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <queue>
+
+namespace pbterm {
+
+namespace {
+
+unsigned char foldCase(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<unsigned char>(c - 'A' + 'a') : c;
+}
+
+// 直前の文字を0回でもよい・繰り返すものにする量指定子
+bool isOptionalQuantifier(char c) {
+    return c == '*' || c == '?' || c == '{';
+}
+
+// 引数を取るエスケープ（\xHH, \uHHHH, \cX, \k<name>, 2桁以上の後方参照）の最後の位置
+// posはエスケープの文字の位置。引数の文字を後ろの文字列として拾わないよう読み飛ばすのに使う
+size_t escapeOperandEnd(const std::string& pattern, size_t pos) {
+    char escaped = pattern[pos];
+    size_t end = pos;
+    auto skipWhile = [&](size_t count, const std::string& accept) {
+        while (count > 0 && end + 1 < pattern.size() && accept.find(pattern[end + 1]) != std::string::npos) {
+            ++end;
+            --count;
+        }
+    };
+    const std::string digits = "0123456789";
+    const std::string hexDigits = digits + "abcdefABCDEF";
+    if (escaped == 'x') {
+        skipWhile(2, hexDigits);
+    } else if (escaped == 'u') {
+        skipWhile(4, hexDigits);
+    } else if (escaped == 'c') {
+        skipWhile(1, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ");
+    } else if (escaped == 'k' && end + 1 < pattern.size() && pattern[end + 1] == '<') {
+        size_t close = pattern.find('>', end);
+        end = (close == std::string::npos) ? pattern.size() - 1 : close;
+    } else if (escaped >= '1' && escaped <= '9') {
+        skipWhile(std::string::npos, digits);
+    }
+    return end;
+}
+
+TriggerAction parseAction(const std::string& value) {
+    if (value == "link") {
+        return TriggerAction::Link;
+    }
+    if (value == "notify") {
+        return TriggerAction::Notify;
+    }
+    return TriggerAction::Highlight;
+}
+
+} // namespace
+
+TriggerEngine::TriggerEngine(const std::vector<TriggerRule>& rules) {
+    m_next.emplace_back();
+    m_next.back().fill(-1);
+    m_output.push_back(0);
+
+    for (const auto& rule : rules) {
+        if (m_rules.size() >= kMaxRules) {
+            std::cerr << "トリガーが多すぎるので残りは使いません: " << rule.name << std::endl;
+            break;
+        }
+        auto flags = std::regex::ECMAScript | std::regex::optimize;
+        if (rule.ignoreCase) {
+            flags |= std::regex::icase;
+        }
+        CompiledRule compiled;
+        try {
+            compiled.regex = std::regex(rule.pattern, flags);
+        } catch (...) {
+            std::cerr << "トリガーの正規表現が不正です: " << rule.name << " (" << rule.pattern << ")" << std::endl;
+            continue;
+        }
+        compiled.rule = rule;
+        size_t index = m_rules.size();
+        m_rules.push_back(std::move(compiled));
+
+        std::vector<std::string> literals;
+        if (!rule.literal.empty()) {
+            size_t start = 0;
+            while (start <= rule.literal.size()) {
+                size_t end = rule.literal.find('|', start);
+                if (end == std::string::npos) {
+                    end = rule.literal.size();
+                }
+                literals.push_back(rule.literal.substr(start, end - start));
+                start = end + 1;
+            }
+        } else {
+            literals = requiredLiterals(rule.pattern);
+        }
+        bool filtered = !literals.empty() &&
+                        std::none_of(literals.begin(), literals.end(),
+                                     [](const std::string& literal) { return literal.empty(); });
+        if (!filtered) {
+            m_unfiltered |= uint64_t(1) << index;
+            continue;
+        }
+        for (const auto& literal : literals) {
+            addLiteral(literal, index);
+        }
+    }
+    buildAutomaton();
+}
+
+std::vector<std::string> TriggerEngine::requiredLiterals(const std::string& pattern) {
+    std::vector<std::string> literals;
+    std::string best;
+    std::string run;
+    int depth = 0;
+
+    auto endRun = [&]() {
+        if (run.size() > best.size()) {
+            best = run;
+        }
+        run.clear();
+    };
+
+    for (size_t i = 0; i < pattern.size(); ++i) {
+        char c = pattern[i];
+        if (c == '\\' && i + 1 < pattern.size()) {
+            char escaped = pattern[++i];
+            i = escapeOperandEnd(pattern, i);
+            if (depth > 0) {
+                continue;
+            }
+            if (escaped == 'b' || escaped == 'B') {
+                continue;  // 幅のない境界は文字列を切らない
+            }
+            if (std::string("dDwWsSnrtfv0123456789cxuk").find(escaped) != std::string::npos) {
+                endRun();
+                continue;
+            }
+            run += escaped;
+            continue;
+        }
+        if (c == '[') {
+            // 文字クラスは読み飛ばす（先頭の"]"と"\\]"は閉じではない）
+            endRun();
+            size_t j = i + 1;
+            if (j < pattern.size() && pattern[j] == '^') {
+                ++j;
+            }
+            if (j < pattern.size() && pattern[j] == ']') {
+                ++j;
+            }
+            while (j < pattern.size() && pattern[j] != ']') {
+                j += (pattern[j] == '\\') ? 2 : 1;
+            }
+            i = j;
+            continue;
+        }
+        if (c == '(') {
+            ++depth;
+            endRun();
+            continue;
+        }
+        if (c == ')') {
+            depth = std::max(depth - 1, 0);
+            continue;
+        }
+        if (depth > 0) {
+            continue;
+        }
+        if (c == '|') {
+            endRun();
+            literals.push_back(best);
+            best.clear();
+            continue;
+        }
+        if (isOptionalQuantifier(c)) {
+            // 直前の1文字は必須ではない
+            if (!run.empty()) {
+                run.pop_back();
+            }
+            endRun();
+            if (c == '{') {
+                i = std::min(pattern.find('}', i), pattern.size());
+            }
+            continue;
+        }
+        if (c == '+') {
+            // 直前の1文字は必ず現れるが、その後ろとは続かないことがある
+            if (!run.empty()) {
+                char last = run.back();
+                endRun();
+                run = last;
+            }
+            continue;
+        }
+        if (c == '^' || c == '$') {
+            continue;
+        }
+        if (c == '.') {
+            endRun();
+            continue;
+        }
+        run += c;
+    }
+    endRun();
+    literals.push_back(best);
+    return literals;
+}
+
+void TriggerEngine::addLiteral(const std::string& literal, size_t rule) {
+    int32_t state = 0;
+    for (char ch : literal) {
+        unsigned char c = foldCase(static_cast<unsigned char>(ch));
+        if (m_next[state][c] < 0) {
+            m_next[state][c] = static_cast<int32_t>(m_next.size());
+            m_next.emplace_back();
+            m_next.back().fill(-1);
+            m_output.push_back(0);
+        }
+        state = m_next[state][c];
+    }
+    m_output[state] |= uint64_t(1) << rule;
+}
+
+void TriggerEngine::buildAutomaton() {
+    // 幅優先で失敗遷移を求め、足りない遷移は失敗先のものを写して1表引きで進めるようにする
+    std::vector<int32_t> fail(m_next.size(), 0);
+    std::queue<int32_t> queue;
+    for (int c = 0; c < 256; ++c) {
+        int32_t next = m_next[0][c];
+        if (next < 0) {
+            m_next[0][c] = 0;
+        } else {
+            fail[next] = 0;
+            queue.push(next);
+        }
+    }
+    while (!queue.empty()) {
+        int32_t state = queue.front();
+        queue.pop();
+        m_output[state] |= m_output[fail[state]];
+        for (int c = 0; c < 256; ++c) {
+            int32_t next = m_next[state][c];
+            if (next < 0) {
+                m_next[state][c] = m_next[fail[state]][c];
+            } else {
+                fail[next] = m_next[fail[state]][c];
+                queue.push(next);
+            }
+        }
+    }
+}
+
+void TriggerEngine::scan(const std::string& line, std::vector<TriggerMatch>& matches) const {
+    matches.clear();
+    if (m_rules.empty() || line.empty()) {
+        return;
+    }
+
+    uint64_t candidates = m_unfiltered;
+    int32_t state = 0;
+    for (char ch : line) {
+        state = m_next[state][foldCase(static_cast<unsigned char>(ch))];
+        candidates |= m_output[state];
+    }
+    if (candidates == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < m_rules.size(); ++i) {
+        if ((candidates & (uint64_t(1) << i)) == 0) {
+            continue;
+        }
+        auto end = std::sregex_iterator();
+        for (auto it = std::sregex_iterator(line.begin(), line.end(), m_rules[i].regex); it != end; ++it) {
+            if (it->length() == 0) {
+                continue;
+            }
+            TriggerMatch match;
+            match.rule = i;
+            match.start = static_cast<size_t>(it->position());
+            match.end = match.start + static_cast<size_t>(it->length());
+            matches.push_back(match);
+        }
+    }
+
+    // 重なったものを除く
+    std::sort(matches.begin(), matches.end(), [](const TriggerMatch& a, const TriggerMatch& b) {
+        return a.start != b.start ? a.start < b.start : a.rule < b.rule;
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < matches.size(); ++i) {
+        if (kept > 0 && matches[i].start < matches[kept - 1].end) {
+            continue;
+        }
+        matches[kept++] = matches[i];
+    }
+    matches.resize(kept);
+}
+
+std::vector<TriggerRule> TriggerEngine::defaultRules() {
+    std::vector<TriggerRule> rules;
+
+    TriggerRule error;
+    error.name = "error";
+    error.pattern = "\\berror\\b|\\bfatal\\b|\\bfailed\\b";
+    error.action = TriggerAction::Notify;
+    error.color = 0xFF5050;
+    error.ignoreCase = true;
+    rules.push_back(error);
+
+    TriggerRule warning;
+    warning.name = "warning";
+    warning.pattern = "\\bwarning\\b";
+    warning.action = TriggerAction::Highlight;
+    warning.color = 0xE0C040;
+    warning.ignoreCase = true;
+    rules.push_back(warning);
+
+    TriggerRule url;
+    url.name = "url";
+    url.pattern = "https?://[^\\s\"'<>]+";
+    url.action = TriggerAction::Link;
+    rules.push_back(url);
+
+    // ファイル名:行（:桁）（コンパイラやgrep -nの出力）
+    TriggerRule fileLine;
+    fileLine.name = "file:line";
+    fileLine.pattern = "[\\w./-]*\\w\\.[A-Za-z]\\w*:\\d+(:\\d+)?";
+    fileLine.literal = ":";
+    fileLine.action = TriggerAction::Link;
+    rules.push_back(fileLine);
+
+    return rules;
+}
+
+std::vector<TriggerRule> TriggerEngine::loadRules(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cout << "トリガー設定ファイルなし（既定の規則を使用）: " << path << std::endl;
+        return defaultRules();
+    }
+
+    std::vector<TriggerRule> rules;
+    TriggerRule current;
+    bool inTrigger = false;
+
+    auto finish = [&]() {
+        if (inTrigger && !current.pattern.empty()) {
+            rules.push_back(current);
+        }
+        current = TriggerRule();
+    };
+
+    std::string line;
+    while (std::getline(file, line)) {
+        // 改行を削除
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        if (line == "[trigger]") {
+            finish();
+            inTrigger = true;
+            continue;
+        }
+        size_t pos = line.find('=');
+        if (!inTrigger || pos == std::string::npos) {
+            continue;
+        }
+
+        std::string key = line.substr(0, pos);
+        std::string value = line.substr(pos + 1);
+        if (key == "name") {
+            current.name = value;
+        } else if (key == "pattern") {
+            current.pattern = value;
+        } else if (key == "literal") {
+            current.literal = value;
+        } else if (key == "action") {
+            current.action = parseAction(value);
+        } else if (key == "color") {
+            current.color = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 16)) & 0xFFFFFF;
+        } else if (key == "ignore_case") {
+            current.ignoreCase = (value == "1");
+        }
+    }
+    finish();
+
+    std::cout << "トリガー読み込み: " << rules.size() << "個" << std::endl;
+    return rules;
+}
+
+} // namespace pbterm
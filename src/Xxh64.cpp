@@ -0,0 +1,137 @@
+#include "Xxh64.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace pbterm {
+
+namespace {
+
+constexpr uint64_t kPrime1 = 0x9E3779B185EBCA87ULL;
+constexpr uint64_t kPrime2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t kPrime3 = 0x165667B19E3779F9ULL;
+constexpr uint64_t kPrime4 = 0x85EBCA77C2B2AE63ULL;
+constexpr uint64_t kPrime5 = 0x27D4EB2F165667C5ULL;
+
+inline uint64_t rotl(uint64_t x, int n) {
+    return (x << n) | (x >> (64 - n));
+}
+
+// 入力はリトルエンディアンとして読む
+inline uint64_t read64(const uint8_t* p) {
+    return static_cast<uint64_t>(p[0]) | (static_cast<uint64_t>(p[1]) << 8) |
+           (static_cast<uint64_t>(p[2]) << 16) | (static_cast<uint64_t>(p[3]) << 24) |
+           (static_cast<uint64_t>(p[4]) << 32) | (static_cast<uint64_t>(p[5]) << 40) |
+           (static_cast<uint64_t>(p[6]) << 48) | (static_cast<uint64_t>(p[7]) << 56);
+}
+
+inline uint32_t read32(const uint8_t* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+inline uint64_t round(uint64_t acc, uint64_t input) {
+    acc += input * kPrime2;
+    acc = rotl(acc, 31);
+    return acc * kPrime1;
+}
+
+inline uint64_t mergeRound(uint64_t acc, uint64_t value) {
+    acc ^= round(0, value);
+    return acc * kPrime1 + kPrime4;
+}
+
+} // namespace
+
+Xxh64::Xxh64(uint64_t seed)
+    : m_seed(seed)
+{
+    m_acc[0] = seed + kPrime1 + kPrime2;
+    m_acc[1] = seed + kPrime2;
+    m_acc[2] = seed;
+    m_acc[3] = seed - kPrime1;
+}
+
+void Xxh64::update(const void* data, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    m_totalLen += len;
+
+    // 前回の端数と合わせて32バイトになれば処理する
+    if (m_bufferLen > 0) {
+        size_t take = std::min(len, sizeof(m_buffer) - m_bufferLen);
+        std::memcpy(m_buffer + m_bufferLen, p, take);
+        m_bufferLen += take;
+        p += take;
+        len -= take;
+        if (m_bufferLen < sizeof(m_buffer)) {
+            return;
+        }
+        for (int i = 0; i < 4; ++i) {
+            m_acc[i] = round(m_acc[i], read64(m_buffer + i * 8));
+        }
+        m_bufferLen = 0;
+    }
+
+    while (len >= 32) {
+        m_acc[0] = round(m_acc[0], read64(p));
+        m_acc[1] = round(m_acc[1], read64(p + 8));
+        m_acc[2] = round(m_acc[2], read64(p + 16));
+        m_acc[3] = round(m_acc[3], read64(p + 24));
+        p += 32;
+        len -= 32;
+    }
+
+    if (len > 0) {
+        std::memcpy(m_buffer, p, len);
+        m_bufferLen = len;
+    }
+}
+
+uint64_t Xxh64::digest() const {
+    uint64_t h;
+    if (m_totalLen >= 32) {
+        h = rotl(m_acc[0], 1) + rotl(m_acc[1], 7) + rotl(m_acc[2], 12) + rotl(m_acc[3], 18);
+        for (int i = 0; i < 4; ++i) {
+            h = mergeRound(h, m_acc[i]);
+        }
+    } else {
+        h = m_seed + kPrime5;
+    }
+    h += m_totalLen;
+
+    const uint8_t* p = m_buffer;
+    size_t len = m_bufferLen;
+    while (len >= 8) {
+        h ^= round(0, read64(p));
+        h = rotl(h, 27) * kPrime1 + kPrime4;
+        p += 8;
+        len -= 8;
+    }
+    if (len >= 4) {
+        h ^= static_cast<uint64_t>(read32(p)) * kPrime1;
+        h = rotl(h, 23) * kPrime2 + kPrime3;
+        p += 4;
+        len -= 4;
+    }
+    while (len > 0) {
+        h ^= static_cast<uint64_t>(*p) * kPrime5;
+        h = rotl(h, 11) * kPrime1;
+        ++p;
+        --len;
+    }
+
+    h ^= h >> 33;
+    h *= kPrime2;
+    h ^= h >> 29;
+    h *= kPrime3;
+    h ^= h >> 32;
+    return h;
+}
+
+std::string Xxh64::hexDigest() const {
+    char buf[17];
+    snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(digest()));
+    return buf;
+}
+
+} // namespace pbterm